@@ -36,7 +36,9 @@
 #include "playback.h"
 #endif
 #include "buffering.h"
+#include "metadata_cache.h"
 #include "linked_list.h"
+#include "trace.h"
 
 /* Define LOGF_ENABLE to enable logf output in this file */
 /* #define LOGF_ENABLE */
@@ -652,8 +654,12 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
     trigger_cpu_boost();
 
     if (h->type == TYPE_ID3) {
-        get_metadata_ex(ringbuf_ptr(h->data),
-                        h->fd, h->path, METADATA_CLOSE_FD_ON_EXIT);
+        /* parse the file even if the UI has it cached: the codecs need the
+           private data some parsers leave in the mp3entry */
+        struct mp3entry *id3 = ringbuf_ptr(h->data);
+        off_t size = filesize(h->fd);
+        if (get_metadata_ex(id3, h->fd, h->path, METADATA_CLOSE_FD_ON_EXIT))
+            metadata_cache_add(id3, h->path, size);
         h->fd = -1; /* with above, behavior same as close_fd */
         h->widx = ringbuf_add(h->data, h->filesize);
         h->end  = h->filesize;
@@ -689,7 +695,9 @@ static bool buffer_handle(int handle_id, size_t to_buffer)
             return false; /* no space for read */
 
         /* rc is the actual amount read */
+        TRACE_BEGIN(BUFFER_READ, handle_id);
         ssize_t rc = read(h->fd, ringbuf_ptr(widx), copy_n);
+        TRACE_END(BUFFER_READ, rc);
 
         if (rc <= 0) {
             /* Some kind of filesystem error, maybe recoverable if not codec */
@@ -848,7 +856,6 @@ static int load_image(int fd, const char *path,
                       struct bufopen_bitmap_data *data,
                       size_t bufidx, size_t max_size)
 {
-    (void)path;
     int rc;
     struct bitmap *bmp = ringbuf_ptr(bufidx);
     struct dim *dim = data->dim;
@@ -864,6 +871,14 @@ static int load_image(int fd, const char *path,
 #endif
     const int format = FORMAT_NATIVE | FORMAT_DITHER |
                        FORMAT_RESIZE | FORMAT_KEEP_ASPECT;
+
+    /* A previously scaled copy skips both the decoding and the scaling */
+    struct albumart_cache_key key;
+    rc = albumart_cache_load(fd, path, aa, dim, bmp,
+                             (int)(max_size - sizeof(struct bitmap)), &key);
+    if (rc > 0)
+        return rc + sizeof(struct bitmap);
+
 #ifdef HAVE_JPEG
     if (aa != NULL) {
         lseek(fd, aa->pos, SEEK_SET);
@@ -875,6 +890,9 @@ static int load_image(int fd, const char *path,
 #endif
         rc = read_bmp_fd(fd, bmp, (int)max_size, format, NULL);
 
+    if (rc > 0)
+        albumart_cache_store(&key, dim, bmp, rc);
+
     return rc + (rc > 0 ? sizeof(struct bitmap) : 0);
 }
 #endif /* HAVE_ALBUMART */
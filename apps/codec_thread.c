@@ -37,6 +37,7 @@
 /* Define LOGF_ENABLE to enable logf output in this file */
 /*#define LOGF_ENABLE*/
 #include "logf.h"
+#include "trace.h"
 
 /* macros to enable logf for queues
    logging on SYS_TIMEOUT can be disabled */
@@ -532,7 +533,9 @@ static void run_codec(void)
         buf_pin_handle(ci.audio_hid, true);
     }
 
+    TRACE_BEGIN(CODEC_RUN, codec_type);
     status = codec_run_proc();
+    TRACE_END(CODEC_RUN, status);
 
     if (!encoder)
     {
@@ -0,0 +1,352 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/*
+ * Key layout
+ *
+ * Characters are stored as they are compared: case folded unless
+ * COLLATE_CASE is given, and with COLLATE_NATURAL a '.' becomes 1 so that
+ * "Song.mp3" sorts before "Song (Live).mp3", as in strnatcmp.c.
+ *
+ * strnatcmp() compares two runs of digits that start at the same place
+ * digit by digit if either of them starts with '0', and otherwise the longer
+ * run wins and runs of the same length compare digit by digit. A run that
+ * starts with '0' is therefore stored as KEY_ZERO_RUN, its digits and
+ * KEY_RUN_END, which is lower than any digit, and any other run as
+ * KEY_NUMBER, its length and its digits. Both markers are digits themselves,
+ * so runs still sort like a digit against anything else.
+ *
+ * Every string ends in 0, which is lower than any character, so that the
+ * next part of the key only decides between equal strings. Reversed parts
+ * have all their bytes inverted, which makes the terminator higher than any
+ * character instead.
+ */
+
+#include <ctype.h>
+#include <string.h>
+#include "config.h"
+#include "system.h"
+#include "core_alloc.h"
+#include "collation.h"
+
+/*#define LOGF_ENABLE*/
+#include "logf.h"
+
+#define KEY_RUN_END     0x01
+#define KEY_ZERO_RUN    '0'
+#define KEY_NUMBER      '1'
+
+/* Kept from startup, so sorting by keys still works while the audio buffer
+   has taken all the other memory. Larger sorts need free memory. */
+#if MEMORYSIZE <= 8
+#define COLLATION_RESERVE   (16 << 10)
+#elif MEMORYSIZE <= 32
+#define COLLATION_RESERVE   (64 << 10)
+#else
+#define COLLATION_RESERVE   (256 << 10)
+#endif
+
+static int reserve_handle;
+static bool reserve_busy;
+
+struct collation_item
+{
+    uint32_t prefix;            /* first bytes of the key, big endian */
+    uint32_t offset;            /* of the key in keys */
+    uint16_t length;            /* of the key */
+    int index;                  /* of the element */
+};
+
+/* Encode str into p, or only measure it if p is NULL. Returns the size. */
+static size_t encode_string(unsigned char *p, const char *str,
+                            unsigned int flags)
+{
+    const unsigned char *s = (const unsigned char *)str;
+    unsigned char inv = (flags & COLLATE_REVERSE) ? 0xff : 0;
+    size_t size = 0;
+
+#define PUT(c) do { unsigned char _c = (c); if (p) *p++ = _c ^ inv; size++; } while (0)
+
+    while (*s)
+    {
+        int c = *s;
+
+        if ((flags & COLLATE_NATURAL) && isdigit(c))
+        {
+            const unsigned char *run = s;
+            while (isdigit(*s))
+                s++;
+
+            if (*run == '0')
+            {
+                PUT(KEY_ZERO_RUN);
+                while (run < s)
+                    PUT(*run++);
+                PUT(KEY_RUN_END);
+            }
+            else
+            {
+                PUT(KEY_NUMBER);
+                PUT(MIN(s - run, 255));
+                while (run < s)
+                    PUT(*run++);
+            }
+            continue;
+        }
+
+        if ((flags & COLLATE_NATURAL) && c == '.')
+            c = 1;
+        else if (!(flags & COLLATE_CASE))
+            c = tolower(c);
+
+        PUT(c);
+        s++;
+    }
+
+    PUT(0);
+#undef PUT
+
+    return size;
+}
+
+size_t collation_string_size(const char *str, unsigned int flags)
+{
+    return encode_string(NULL, str, flags);
+}
+
+void collation_init_reserve(void)
+{
+    /* never moved, so a sort doesn't have to pin it */
+    reserve_handle = core_alloc_ex(COLLATION_RESERVE, &buflib_ops_locked);
+    if (reserve_handle <= 0)
+    {
+        logf("%s: no memory", __func__);
+        reserve_handle = 0;
+    }
+}
+
+bool collation_init(struct collation *co, int count, size_t key_size,
+                    size_t elem_size)
+{
+    size_t items = ALIGN_UP(count * sizeof(struct collation_item),
+                            sizeof(long));
+    elem_size = ALIGN_UP(elem_size, sizeof(long));
+
+    /* items, a second set of items for merging, an element and the keys */
+    size_t size = 2 * items + elem_size + key_size;
+
+    /* Use the reserve or memory that is free. Making others shrink for
+       this, like the audio buffer during playback, costs more than the sort
+       saves. */
+    co->handle = 0;
+    co->reserved = false;
+    if (reserve_handle > 0 && !reserve_busy && size <= COLLATION_RESERVE)
+    {
+        co->handle = reserve_handle;
+        co->reserved = true;
+        reserve_busy = true;
+    }
+    else if (size <= core_allocatable())
+        co->handle = core_alloc_ex(size, &buflib_ops_locked);
+    if (co->handle <= 0)
+    {
+        logf("%s: no memory for %d keys", __func__, count);
+        co->handle = 0;
+        return false;
+    }
+
+    char *buf = core_get_data(co->handle);
+    co->items = (struct collation_item *)buf;
+    co->temp = buf + 2 * items;
+    co->keys = (unsigned char *)co->temp + elem_size;
+    co->count = 0;
+    co->max = count;
+    co->key_start = co->key_used = 0;
+    co->key_size = key_size;
+    return true;
+}
+
+void collation_add_string(struct collation *co, const char *str,
+                          unsigned int flags)
+{
+    if (!co->handle)
+        return;
+
+    if (co->key_used + collation_string_size(str, flags) > co->key_size)
+    {
+        co->key_used = co->key_size + 1; /* fail collation_sort() */
+        return;
+    }
+
+    co->key_used += encode_string(co->keys + co->key_used, str, flags);
+}
+
+void collation_add_number(struct collation *co, uint32_t value,
+                          unsigned int flags)
+{
+    if (!co->handle)
+        return;
+
+    if (co->key_used + COLLATION_NUMBER_SIZE > co->key_size)
+    {
+        co->key_used = co->key_size + 1;
+        return;
+    }
+
+    if (flags & COLLATE_REVERSE)
+        value = ~value;
+
+    unsigned char *p = co->keys + co->key_used;
+    p[0] = value >> 24;
+    p[1] = value >> 16;
+    p[2] = value >> 8;
+    p[3] = value;
+    co->key_used += COLLATION_NUMBER_SIZE;
+}
+
+void collation_next(struct collation *co)
+{
+    if (!co->handle || co->count >= co->max || co->key_used > co->key_size)
+        return;
+
+    struct collation_item *item = &co->items[co->count];
+    size_t length = co->key_used - co->key_start;
+    const unsigned char *key = co->keys + co->key_start;
+
+    if (length > UINT16_MAX)
+    {
+        co->key_used = co->key_size + 1;
+        return;
+    }
+
+    item->prefix = 0;
+    for (size_t i = 0; i < 4; i++)
+        item->prefix = (item->prefix << 8) | (i < length ? key[i] : 0);
+    item->offset = co->key_start;
+    item->length = length;
+    item->index = co->count++;
+
+    co->key_start = co->key_used;
+}
+
+static inline int compare_items(const unsigned char *keys,
+                                const struct collation_item *a,
+                                const struct collation_item *b)
+{
+    if (a->prefix != b->prefix)
+        return a->prefix < b->prefix ? -1 : 1;
+
+    int cmp = memcmp(keys + a->offset, keys + b->offset,
+                     MIN(a->length, b->length));
+    return cmp ? cmp : a->length - b->length;
+}
+
+/* Bottom-up merge sort, leaves the result in items or aux and returns it */
+static struct collation_item *merge_sort(const unsigned char *keys,
+                                         struct collation_item *items,
+                                         struct collation_item *aux,
+                                         int count)
+{
+    struct collation_item *from = items, *to = aux, *tmp;
+
+    for (int width = 1; width < count; width *= 2)
+    {
+        for (int lo = 0; lo < count; lo += 2 * width)
+        {
+            int mid = MIN(lo + width, count);
+            int hi = MIN(lo + 2 * width, count);
+            int i = lo, j = mid, k = lo;
+
+            /* already in order, which is common for directory listings */
+            if (mid == hi || compare_items(keys, &from[mid - 1], &from[mid]) <= 0)
+            {
+                memcpy(&to[lo], &from[lo], (hi - lo) * sizeof(*to));
+                continue;
+            }
+
+            while (i < mid && j < hi)
+            {
+                if (compare_items(keys, &from[j], &from[i]) < 0)
+                    to[k++] = from[j++];
+                else
+                    to[k++] = from[i++];
+            }
+            while (i < mid)
+                to[k++] = from[i++];
+            while (j < hi)
+                to[k++] = from[j++];
+        }
+
+        tmp = from;
+        from = to;
+        to = tmp;
+    }
+
+    return from;
+}
+
+bool collation_sort(struct collation *co, void *base, size_t elem_size)
+{
+    bool ok = false;
+
+    if (!co->handle)
+        return false;
+
+    if (co->key_used > co->key_size || co->count != co->max)
+        goto out;
+
+    struct collation_item *sorted =
+        merge_sort(co->keys, co->items,
+                   (struct collation_item *)((char *)co->items +
+                       ALIGN_UP(co->max * sizeof(struct collation_item),
+                                sizeof(long))),
+                   co->count);
+
+    /* move each element to its place, following the cycles of the
+       permutation and marking the places that are done */
+    char *elems = base;
+    for (int i = 0; i < co->count; i++)
+    {
+        if (sorted[i].index == i)
+            continue;
+
+        int j = i;
+        memcpy(co->temp, elems + i * elem_size, elem_size);
+        while (1)
+        {
+            int k = sorted[j].index;
+            sorted[j].index = j;
+            if (k == i)
+                break;
+            memcpy(elems + j * elem_size, elems + k * elem_size, elem_size);
+            j = k;
+        }
+        memcpy(elems + j * elem_size, co->temp, elem_size);
+    }
+    ok = true;
+
+out:
+    if (co->reserved)
+        reserve_busy = false;
+    else
+        core_free(co->handle);
+    co->handle = 0;
+    co->reserved = false;
+    return ok;
+}
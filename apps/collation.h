@@ -0,0 +1,80 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef _COLLATION_H_
+#define _COLLATION_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* Sorting by precomputed collation keys.
+ *
+ * Each item gets a binary key, built once from one or more strings and
+ * numbers, such that comparing two keys with memcmp() gives the same result
+ * as the comparison functions that would otherwise be called for every pair:
+ * strnatcmp() and strnatcasecmp() with COLLATE_NATURAL, strcmp() and
+ * strcasecmp() without. The items are then sorted by their keys.
+ *
+ * Usage: sum up collation_string_size() and COLLATION_NUMBER_SIZE for all
+ * the parts of all keys, call collation_init(), then for each item in order
+ * add its parts and call collation_next(), and finally collation_sort().
+ */
+
+#define COLLATE_NATURAL  0x1    /* compare runs of digits as numbers */
+#define COLLATE_CASE     0x2    /* case sensitive */
+#define COLLATE_REVERSE  0x4    /* this part sorts the other way round */
+
+#define COLLATION_NUMBER_SIZE 4
+
+struct collation_item;
+
+struct collation
+{
+    int handle;
+    bool reserved;              /* handle is the reserve from startup */
+    struct collation_item *items;
+    unsigned char *keys;
+    void *temp;                 /* room for one element of the sorted array */
+    int count;                  /* items that were added */
+    int max;                    /* items there is room for */
+    size_t key_start;           /* start of the key being built */
+    size_t key_used;
+    size_t key_size;
+};
+
+/* Keep some memory for sorting from startup */
+void collation_init_reserve(void);
+
+size_t collation_string_size(const char *str, unsigned int flags);
+
+/* Allocate room for count items with keys of key_size bytes altogether,
+   that sort an array of elements of elem_size bytes */
+bool collation_init(struct collation *co, int count, size_t key_size,
+                    size_t elem_size);
+void collation_add_string(struct collation *co, const char *str,
+                          unsigned int flags);
+void collation_add_number(struct collation *co, uint32_t value,
+                          unsigned int flags);
+void collation_next(struct collation *co);
+
+/* Put the elements of base in the order of their keys and free the keys.
+   Returns false, leaving base alone, if the keys didn't fit. */
+bool collation_sort(struct collation *co, void *base, size_t elem_size);
+
+#endif /* _COLLATION_H_ */
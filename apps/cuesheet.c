@@ -39,9 +39,214 @@
 #include "playback.h"
 #include "cuesheet.h"
 #include "gui/wps.h"
+#include "core_alloc.h"
+#include "crc32.h"
+#include "events.h"
 
 #define CUE_DIR ROCKBOX_DIR "/cue"
 
+/* Parsed cuesheets are kept in RAM so that loading the same track again, or
+ * another track of the same image, doesn't read and parse the file again.
+ * The cache works like the metadata cache: records are appended to one of two
+ * generations, and when it is full the other one is emptied and filled next.
+ * A record holds the track offsets and the strings packed back to back, a
+ * few kilobytes instead of the ~70k of a struct cuesheet. Records are found
+ * by the path, the position of an embedded cuesheet and the size of the file
+ * it is in. The cache is allocated at startup, like the metadata cache. */
+#if MEMORYSIZE <= 8
+#define CUE_CACHE_SIZE  (8 << 10)
+#else
+#define CUE_CACHE_SIZE  (32 << 10)
+#endif
+#define CUE_CACHE_GEN   (CUE_CACHE_SIZE / 2)
+
+/* strings of a cuesheet and of each track, in the order they are stored */
+#define CUE_STRINGS     5   /* path, file, title, performer, songwriter */
+#define TRACK_STRINGS   3   /* title, performer, songwriter */
+
+struct cue_record
+{
+    uint32_t key;               /* crc32 of the path, 0 if dropped */
+    uint32_t filesize;
+    uint32_t pos;               /* of an embedded cuesheet, 0 for a file */
+    uint16_t size;              /* of the whole record */
+    uint16_t track_count;
+    uint32_t offsets[];         /* of the tracks, followed by the strings */
+};
+
+static struct
+{
+    int handle;
+    size_t used[2];             /* bytes used in each generation */
+    int cur;                    /* generation being filled */
+    struct mutex mutex;
+} cue_cache;
+
+static void cue_strings(struct cuesheet *cue, int i, char **s, size_t *size)
+{
+    if (i < CUE_STRINGS)
+    {
+        char *strs[CUE_STRINGS] =
+            { cue->path, cue->file, cue->title, cue->performer, cue->songwriter };
+        *s = strs[i];
+        *size = i < 2 ? MAX_PATH : MAX_NAME*3 + 1;
+    }
+    else
+    {
+        struct cue_track_info *track =
+            &cue->tracks[(i - CUE_STRINGS) / TRACK_STRINGS];
+        char *strs[TRACK_STRINGS] =
+            { track->title, track->performer, track->songwriter };
+        *s = strs[(i - CUE_STRINGS) % TRACK_STRINGS];
+        *size = MAX_NAME*3 + 1;
+    }
+}
+
+static struct cue_record *cue_cache_find(uint32_t key, const char *path,
+                                         uint32_t pos)
+{
+    /* newest generation first */
+    for (int i = 0; i < 2; i++)
+    {
+        int gen = cue_cache.cur ^ i;
+        unsigned char *p = (unsigned char *)core_get_data(cue_cache.handle) +
+                           gen * CUE_CACHE_GEN;
+        unsigned char *end = p + cue_cache.used[gen];
+        while (p < end)
+        {
+            struct cue_record *r = (struct cue_record *)p;
+            if (r->key == key && r->pos == pos &&
+                !strcmp((char *)&r->offsets[r->track_count], path))
+                return r;
+            p += r->size;
+        }
+    }
+    return NULL;
+}
+
+static bool cue_cache_get(struct cuesheet *cue, const char *path,
+                          uint32_t pos, off_t filesize)
+{
+    bool found = false;
+
+    if (cue_cache.handle <= 0)
+        return false;
+
+    mutex_lock(&cue_cache.mutex);
+
+    struct cue_record *r =
+        cue_cache_find(crc_32(path, strlen(path), 0xffffffff) | 1, path, pos);
+    if (r && r->filesize == (uint32_t)filesize)
+    {
+        memset(cue, 0, sizeof(struct cuesheet));
+        cue->track_count = r->track_count;
+        cue->curr_track = cue->tracks;
+
+        const char *src = (const char *)&r->offsets[r->track_count];
+        for (int i = 0; i < CUE_STRINGS + TRACK_STRINGS * r->track_count; i++)
+        {
+            char *dst;
+            size_t size;
+            cue_strings(cue, i, &dst, &size);
+            src += strlcpy(dst, src, size) + 1;
+        }
+        for (int i = 0; i < r->track_count; i++)
+            cue->tracks[i].offset = r->offsets[i];
+        found = true;
+    }
+
+    mutex_unlock(&cue_cache.mutex);
+    return found;
+}
+
+static void cue_cache_add(struct cuesheet *cue, uint32_t pos, off_t filesize)
+{
+    int count = CUE_STRINGS + TRACK_STRINGS * cue->track_count;
+    size_t size = sizeof(struct cue_record) +
+                  cue->track_count * sizeof(uint32_t);
+
+    for (int i = 0; i < count; i++)
+    {
+        char *s;
+        size_t max;
+        cue_strings(cue, i, &s, &max);
+        size += strlen(s) + 1;
+    }
+    size = ALIGN_UP(size, sizeof(uint32_t));
+    if (size > CUE_CACHE_GEN || filesize < 0)
+        return;
+
+    if (cue_cache.handle <= 0)
+        return;
+
+    mutex_lock(&cue_cache.mutex);
+
+    uint32_t key = crc_32(cue->path, strlen(cue->path), 0xffffffff) | 1;
+    struct cue_record *r = cue_cache_find(key, cue->path, pos);
+    if (r)
+    {
+        if (r->filesize == (uint32_t)filesize)
+            goto out; /* already known */
+        r->key = 0; /* file changed, forget the old one */
+    }
+
+    if (cue_cache.used[cue_cache.cur] + size > CUE_CACHE_GEN)
+    {
+        /* current generation is full, recycle the older one */
+        cue_cache.cur ^= 1;
+        cue_cache.used[cue_cache.cur] = 0;
+    }
+
+    r = (struct cue_record *)((unsigned char *)core_get_data(cue_cache.handle) +
+                              cue_cache.cur * CUE_CACHE_GEN +
+                              cue_cache.used[cue_cache.cur]);
+    r->key = key;
+    r->filesize = filesize;
+    r->pos = pos;
+    r->size = size;
+    r->track_count = cue->track_count;
+    for (int i = 0; i < cue->track_count; i++)
+        r->offsets[i] = cue->tracks[i].offset;
+
+    char *dst = (char *)&r->offsets[r->track_count];
+    for (int i = 0; i < count; i++)
+    {
+        char *s;
+        size_t max;
+        cue_strings(cue, i, &s, &max);
+        size_t len = strlen(s) + 1;
+        memcpy(dst, s, len);
+        dst += len;
+    }
+    cue_cache.used[cue_cache.cur] += size;
+
+out:
+    mutex_unlock(&cue_cache.mutex);
+}
+
+/* anything may have changed while the host had the disk */
+static void usb_inserted_handler(unsigned short id, void *data)
+{
+    (void)id;
+    (void)data;
+    mutex_lock(&cue_cache.mutex);
+    cue_cache.used[0] = cue_cache.used[1] = 0;
+    mutex_unlock(&cue_cache.mutex);
+}
+
+void cuesheet_init(void)
+{
+    mutex_init(&cue_cache.mutex);
+    cue_cache.handle = core_alloc(CUE_CACHE_SIZE);
+    if (cue_cache.handle <= 0)
+    {
+        logf("cuesheet cache: no memory");
+        cue_cache.handle = 0;
+        return;
+    }
+    add_event(SYS_EVENT_USB_INSERTED, usb_inserted_handler);
+}
+
 static bool search_for_cuesheet(const char *path, struct cuesheet_file *cue_file)
 {
     size_t len;
@@ -214,6 +419,14 @@ bool parse_cuesheet(struct cuesheet_file *cue_file, struct cuesheet *cue)
     int fd = open(cue_file->path, O_RDONLY, 0644);
     if(fd < 0)
         return false;
+
+    off_t size = filesize(fd);
+    if (cue_cache_get(cue, cue_file->path, cue_file->pos, size))
+    {
+        close(fd);
+        return true;
+    }
+
     if (cue_file->pos > 0)
     {
         is_embedded = true;
@@ -398,6 +611,7 @@ bool parse_cuesheet(struct cuesheet_file *cue_file, struct cuesheet *cue)
             strmemccpy(cue->tracks[i].songwriter, cue->songwriter, MAX_NAME*3);
     }
 
+    cue_cache_add(cue, cue_file->pos, size);
     return true;
 }
 
@@ -421,9 +635,19 @@ static bool seek(unsigned long pos)
    and updates the information about the current track. */
 int cue_find_current_track(struct cuesheet *cue, unsigned long curpos)
 {
-    int i=0;
-    while (i < cue->track_count-1 && cue->tracks[i+1].offset < curpos)
-        i++;
+    /* the last track that starts before curpos, or the first one */
+    int i = 0, lo = 1, hi = cue->track_count - 1;
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (cue->tracks[mid].offset < curpos)
+        {
+            i = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
 
     cue->curr_track_idx = i;
     cue->curr_track = cue->tracks + i;
@@ -58,6 +58,8 @@ struct cuesheet_file {
     enum character_encoding encoding;
 };
 
+void cuesheet_init(void) INIT_ATTR;
+
 /* looks if there is a cuesheet file with a name matching path of "track_id3" */
 bool look_for_cuesheet_file(struct mp3entry *track_id3, struct cuesheet_file *cue_file);
 
@@ -82,6 +82,7 @@
 #include "peakmeter.h"
 #include "skin_engine/skin_engine.h"
 #include "logfdisp.h"
+#include "trace.h"
 #include "core_alloc.h"
 #include "pcmbuf.h"
 #include "buffering.h"
@@ -2511,6 +2512,18 @@ static bool dbg_talk(void)
     return simplelist_show_list(&list);
 }
 
+#ifdef ROCKBOX_HAS_TRACE
+static bool dbg_dump_trace(void)
+{
+    int count = trace_dump(ROCKBOX_DIR "/trace.rbt");
+    if (count < 0)
+        splash(HZ, "Could not save the trace");
+    else
+        splashf(HZ, "Saved %d events", count);
+    return false;
+}
+#endif
+
 #ifdef HAVE_USBSTACK
 #if (defined(ROCKBOX_HAS_LOGF) && defined(USB_ENABLE_SERIAL))
 static bool toggle_usb_core_driver(int driver, char *msg)
@@ -2548,6 +2561,10 @@ static int dbg_usb_audio_cb(int action, struct gui_synclist *lists)
     simplelist_addline("Samples used per Frame: %f", (double)usb_audio_get_samplesperframe()/(1<<16)); // convert from 16.16 fixed to float
     simplelist_addline("Samples received per frame: %f", (double)usb_audio_get_samples_rx_perframe()/(1<<16)); // convert from 16.16 fixed to float
     simplelist_addline("Samples diff: %f", (double)(usb_audio_get_samplesperframe()-usb_audio_get_samples_rx_perframe())/(1<<16)); // convert from 16.16 fixed to float
+    simplelist_addline("Resampling: %s", usb_audio_get_resampling()?"On":"Off");
+    simplelist_addline("Drift: %ld ppm", (long)usb_audio_get_drift_ppm());
+    simplelist_addline("Correction: %ld ppm", (long)usb_audio_get_correction_ppm());
+    simplelist_addline("Underflows: %u / Overflows: %u", usb_audio_get_underflow_count(), usb_audio_get_overflow_count());
     simplelist_addline("%s", usb_audio_get_underflow()?"UNDERFLOW!":" ");
     simplelist_addline("%s", usb_audio_get_overflow()?"OVERFLOW!":" ");
     simplelist_addline("%s", usb_audio_get_alloc_failed()?"ALLOC FAILED!":" ");
@@ -2889,6 +2906,9 @@ static const struct {
         {"Show Log File", logfdisplay },
         {"Dump Log File", logfdump },
 #endif
+#ifdef ROCKBOX_HAS_TRACE
+        {"Dump Trace", dbg_dump_trace },
+#endif
 #if defined(HAVE_USBSTACK)
 #if defined(ROCKBOX_HAS_LOGF) && defined(USB_ENABLE_SERIAL)
         {"USB Serial driver (logf)", toggle_usb_serial },
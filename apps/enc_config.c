@@ -102,6 +102,7 @@ static void mp3_enc_get_caps(const struct encoder_config *cfg,
 static void mp3_enc_default_config(struct encoder_config *cfg)
 {
     cfg->mp3_enc.bitrate = 128; /* default that works for all types */
+    cfg->mp3_enc.fast = false;
 } /* mp3_enc_default_config */
 
 static void mp3_enc_convert_config(struct encoder_config *cfg,
@@ -112,12 +113,14 @@ static void mp3_enc_convert_config(struct encoder_config *cfg,
         global_settings.mp3_enc_config.bitrate =
             round_value_to_list32(cfg->mp3_enc.bitrate, mp3_enc_bitr,
                                   MP3_ENC_NUM_BITR, false);
+        global_settings.mp3_enc_config.fast = cfg->mp3_enc.fast;
     }
     else
     {
         if ((unsigned)global_settings.mp3_enc_config.bitrate >= MP3_ENC_NUM_BITR)
             global_settings.mp3_enc_config.bitrate = MP3_ENC_BITRATE_CFG_DEFAULT;
         cfg->mp3_enc.bitrate = mp3_enc_bitr[global_settings.mp3_enc_config.bitrate];
+        cfg->mp3_enc.fast = global_settings.mp3_enc_config.fast;
     }
 } /* mp3_enc_convert_config */
 
@@ -192,13 +195,23 @@ static bool mp3_enc_bitrate(struct menucallback_data *data)
     return res;
 } /* mp3_enc_bitrate */
 
+/* mp3_enc: show the fast encoding setting */
+static bool mp3_enc_fast(struct menucallback_data *data)
+{
+    struct encoder_config *cfg = data->cfg;
+    return set_bool(str(LANG_MP3_ENC_FAST), &cfg->mp3_enc.fast);
+} /* mp3_enc_fast */
+
 /* mp3_enc configuration menu */
 MENUITEM_FUNCTION_W_PARAM(mp3_bitrate, 0, ID2P(LANG_BITRATE),
                    mp3_enc_bitrate, &menu_callback_data,
                    enc_menuitem_callback, Icon_NOICON);
+MENUITEM_FUNCTION_W_PARAM(mp3_fast, 0, ID2P(LANG_MP3_ENC_FAST),
+                   mp3_enc_fast, &menu_callback_data,
+                   enc_menuitem_callback, Icon_NOICON);
 MAKE_MENU( mp3_enc_menu, ID2P(LANG_ENCODER_SETTINGS),
            enc_menuitem_enteritem, Icon_NOICON,
-           &mp3_bitrate);
+           &mp3_bitrate, &mp3_fast);
 
 
 /** wav_enc.codec **/
@@ -44,7 +44,9 @@
 #include "filetree.h"
 #include "misc.h"
 #include "strnatcmp.h"
+#include "collation.h"
 #include "keyboard.h"
+#include "storage.h"
 
 #ifdef HAVE_MULTIVOLUME
 #include "mv.h"
@@ -60,6 +62,7 @@ static struct compare_data
     int sort_dir; /* qsort key for sorting directories */
     int sort_file; /*       ...for sorting files       */
     int(*_compar)(const char*, const char*, size_t);
+    unsigned int collate_flags; /* the same for collation keys */
 } cmp_data;
 
 /* dummmy functions to allow compatibility with strncmp & strncasecmp */
@@ -95,6 +98,7 @@ int ft_build_playlist(struct tree_context* c, int start_index)
                                         PLAYLIST_REPLACE, false, false);
     if (res >= 0)
     {
+        playlist_insert_context_reserve(&pl_context, c->filesindir);
         cpu_boost(true);
         for(i = 0;i < c->filesindir;i++)
         {
@@ -297,132 +301,313 @@ static int compare(const void* p1, const void* p2)
     return 0; /* never reached */
 }
 
-/* load and sort directory into the tree's cache. returns NULL on failure. */
-int ft_load(struct tree_context* c, const char* tempdir)
+/* Add the collation key that sorts an entry the way compare() does, or only
+   return its size if co is NULL */
+static size_t sort_key(struct collation *co, const struct entry *e)
 {
-    if (c->out_of_tree > 0) /* something else is loaded */
-        return 0;
+    int criteria = cmp_data.sort_file;
+    uint32_t group = 0, rank = 0;
+    unsigned int rank_flags = 0, name_flags = cmp_data.collate_flags;
 
-    int files_in_dir = 0;
-    int name_buffer_used = 0;
-    struct dirent *entry;
-    bool (*callback_show_item)(char *, int, struct tree_context *) = NULL;
-    DIR *dir;
+    if (cmp_data.sort_dir != SORT_AS_FILE)
+    {
+        /* directories first */
+        group = 2;
+        if (e->attr & ATTR_DIRECTORY)
+        {
+            criteria = cmp_data.sort_dir;
+            group = 1;
+#ifdef HAVE_MULTIVOLUME
+            if (e->attr & ATTR_VOLUME)
+            {
+                /* volumes before that, sorted alphabetically */
+                criteria = SORT_ALPHA;
+                group = 0;
+            }
+#endif
+        }
+    }
 
-    if (!c->is_browsing)
-        c->browse = NULL;
+    switch (criteria)
+    {
+        case SORT_TYPE:
+        case SORT_TYPE_REVERSED:
+            rank = e->attr & FILE_ATTR_MASK;
+            if (!rank) /* unknown type */
+                rank = INT_MAX;
+            if (criteria == SORT_TYPE_REVERSED)
+                rank_flags = COLLATE_REVERSE;
+            break;
 
-    if (tempdir)
-        dir = opendir(tempdir);
-    else
+        case SORT_DATE:
+        case SORT_DATE_REVERSED:
+            rank = e->time_write;
+            if (criteria == SORT_DATE_REVERSED)
+                rank_flags = COLLATE_REVERSE;
+            break;
+
+        case SORT_ALPHA_REVERSED:
+            name_flags |= COLLATE_REVERSE;
+            break;
+    }
+
+    if (co)
     {
-        dir = opendir(c->currdir);
-        callback_show_item = c->browse? c->browse->callback_show_item: NULL;
+        collation_add_number(co, group, 0);
+        collation_add_number(co, rank, rank_flags);
+        collation_add_string(co, e->name, name_flags);
+        collation_next(co);
     }
-    if(!dir)
-        return -1; /* not a directory */
 
-    c->dirsindir = 0;
-    c->dirfull = false;
+    return 2 * COLLATION_NUMBER_SIZE + collation_string_size(e->name, name_flags);
+}
 
-    tree_lock_cache(c);
-    while ((entry = readdir(dir))) {
-        int len;
-        struct dirinfo info;
-        struct entry* dptr = tree_get_entry_at(c, files_in_dir);
-        if (!dptr)
-        {
-            c->dirfull = true;
-            break;
-        }
+/* Sort the entries by their collation keys, which is a lot quicker than
+   calling compare() for every pair. Returns false if there isn't enough
+   memory for the keys. */
+static bool sort_by_keys(struct tree_context* c, int count)
+{
+    struct entry *entries = tree_get_entries(c); /* locked by the caller */
+    struct collation co;
+    size_t size = 0;
+    int i;
 
-        info = dir_get_info(dir, entry);
-        len = strlen((char *)entry->d_name);
+    for (i = 0; i < count; i++)
+        size += sort_key(NULL, &entries[i]);
 
-        /* Skip FAT volume ID */
-        if (info.attribute & ATTR_VOLUME_ID) {
-            continue;
-        }
+    if (!collation_init(&co, count, size, sizeof(struct entry)))
+        return false;
 
-        dptr->attr = info.attribute;
-        int dir_attr = (dptr->attr & ATTR_DIRECTORY);
-        /* skip directories . and .. */
-        if (dir_attr && is_dotdir_name(entry->d_name))
-            continue;
+    for (i = 0; i < count; i++)
+        sort_key(&co, &entries[i]);
 
-        /* filter out dotfiles and hidden files */
-        if (*c->dirfilter != SHOW_ALL &&
-            ((entry->d_name[0]=='.') ||
-            (info.attribute & ATTR_HIDDEN))) {
-            continue;
-        }
+    return collation_sort(&co, entries, sizeof(struct entry));
+}
 
-        if (*c->dirfilter == SHOW_PLUGINS && (dptr->attr & ATTR_DIRECTORY) &&
-            (dptr->attr &
-            (ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_VOLUME)) != 0) {
-            continue; /* skip non plugin folders */
-        }
+/* Reading a directory that takes longer than this shows what there is, the
+   rest is read in slices while the browser is idle */
+#define FT_FIRST_TICKS  (HZ/5)
+#define FT_SLICE_TICKS  (HZ/20)
+
+/* Listings of directories next to the current one are kept while browsing,
+   so that going there doesn't have to wait for the disk. Each has a slot of
+   a buffer that is set aside at startup, plus one for the prefetch, so that
+   they work during playback too. */
+#define FT_SNAPSHOTS        2
+#if MEMORYSIZE <= 8
+#define FT_SNAPSHOT_SIZE    (8 << 10)
+#else
+#define FT_SNAPSHOT_SIZE    (16 << 10)
+#endif
 
-        /* check for known file types */
-        if ( !(dir_attr) )
-            dptr->attr |= filetype_get_attr((char *)entry->d_name);
+/* the directory being read into the tree cache */
+static struct
+{
+    DIR *dir;                   /* NULL when done */
+    int name_buffer_used;
+    bool (*callback_show_item)(char *, int, struct tree_context *);
+} loading;
 
-        int file_attr = (dptr->attr & FILE_ATTR_MASK);
+/* an entry in a snapshot, followed by its name */
+struct ft_record
+{
+    int attr;
+    unsigned time_write;
+    char name[];
+};
+
+static struct ft_snapshot
+{
+    unsigned char *buf;         /* records, NULL if there is no reserve */
+    bool valid;                 /* false if the slot is free */
+    size_t size;
+    int count;
+    int dirfilter;
+    int dirlevel;
+    bool thumbnails;            /* FILE_ATTR_THUMBNAIL is up to date */
+    unsigned mtime;             /* of the directory when it was read */
+    long last_used;
+    char path[MAX_PATH];
+} snapshots[FT_SNAPSHOTS];
+
+/* the selected subdirectory being read into a snapshot */
+static struct
+{
+    DIR *dir;                   /* NULL when done */
+    unsigned char *buf;         /* swapped with the snapshot it replaces */
+    unsigned mtime;
+    size_t used;
+    int count;
+    int dirlevel;
+    char path[MAX_PATH];        /* last one that was tried */
+} prefetch;
+
+static inline size_t record_size(size_t len)
+{
+    return ALIGN_UP(sizeof(struct ft_record) + len + 1, sizeof(int));
+}
+
+/* Work out the attributes of a directory entry, and whether the browser
+   shows it */
+static bool ft_show_entry(struct tree_context *c, int dirlevel,
+                          struct dirent *entry, struct dirinfo *info, int *attr,
+                          bool (*callback_show_item)(char *, int, struct tree_context *))
+{
+    /* Skip FAT volume ID */
+    if (info->attribute & ATTR_VOLUME_ID) {
+        return false;
+    }
+
+    *attr = info->attribute;
+    int dir_attr = (*attr & ATTR_DIRECTORY);
+    /* skip directories . and .. */
+    if (dir_attr && is_dotdir_name(entry->d_name))
+        return false;
+
+    /* filter out dotfiles and hidden files */
+    if (*c->dirfilter != SHOW_ALL &&
+        ((entry->d_name[0]=='.') ||
+        (info->attribute & ATTR_HIDDEN))) {
+        return false;
+    }
+
+    if (*c->dirfilter == SHOW_PLUGINS && (*attr & ATTR_DIRECTORY) &&
+        (*attr &
+        (ATTR_HIDDEN | ATTR_SYSTEM | ATTR_VOLUME_ID | ATTR_VOLUME)) != 0) {
+        return false; /* skip non plugin folders */
+    }
+
+    /* check for known file types */
+    if ( !(dir_attr) )
+        *attr |= filetype_get_attr((char *)entry->d_name);
+
+    int file_attr = (*attr & FILE_ATTR_MASK);
 
 #define CHK_FT(show,attr) (*c->dirfilter == (show) && file_attr != (attr))
-        /* filter out non-visible files */
-        if ((!(dir_attr) && (CHK_FT(SHOW_PLAYLIST, FILE_ATTR_M3U) ||
-            (CHK_FT(SHOW_MUSIC, FILE_ATTR_AUDIO) && file_attr != FILE_ATTR_M3U) ||
-            (*c->dirfilter == SHOW_SUPPORTED && !filetype_supported(dptr->attr)))) ||
-            CHK_FT(SHOW_WPS,  FILE_ATTR_WPS)  ||
-            CHK_FT(SHOW_FONT, FILE_ATTR_FONT) ||
-            CHK_FT(SHOW_SBS,  FILE_ATTR_SBS)  ||
+    /* filter out non-visible files */
+    if ((!(dir_attr) && (CHK_FT(SHOW_PLAYLIST, FILE_ATTR_M3U) ||
+        (CHK_FT(SHOW_MUSIC, FILE_ATTR_AUDIO) && file_attr != FILE_ATTR_M3U) ||
+        (*c->dirfilter == SHOW_SUPPORTED && !filetype_supported(*attr)))) ||
+        CHK_FT(SHOW_WPS,  FILE_ATTR_WPS)  ||
+        CHK_FT(SHOW_FONT, FILE_ATTR_FONT) ||
+        CHK_FT(SHOW_SBS,  FILE_ATTR_SBS)  ||
 #if CONFIG_TUNER
-            CHK_FT(SHOW_FMS, FILE_ATTR_FMS) ||
-            CHK_FT(SHOW_FMR, FILE_ATTR_FMR) ||
+        CHK_FT(SHOW_FMS, FILE_ATTR_FMS) ||
+        CHK_FT(SHOW_FMR, FILE_ATTR_FMR) ||
 #endif
 #ifdef HAVE_REMOTE_LCD
-            CHK_FT(SHOW_RWPS, FILE_ATTR_RWPS) ||
-            CHK_FT(SHOW_RSBS, FILE_ATTR_RSBS) ||
+        CHK_FT(SHOW_RWPS, FILE_ATTR_RWPS) ||
+        CHK_FT(SHOW_RSBS, FILE_ATTR_RSBS) ||
 #if CONFIG_TUNER
-            CHK_FT(SHOW_RFMS, FILE_ATTR_RFMS) ||
+        CHK_FT(SHOW_RFMS, FILE_ATTR_RFMS) ||
 #endif
 #endif
-            CHK_FT(SHOW_M3U, FILE_ATTR_M3U) ||
-            CHK_FT(SHOW_CFG, FILE_ATTR_CFG) ||
-            CHK_FT(SHOW_LNG, FILE_ATTR_LNG) ||
-            CHK_FT(SHOW_MOD, FILE_ATTR_MOD) ||
-           /* show first level directories */
-           ((!(dir_attr) || c->dirlevel > 0)       &&
-            CHK_FT(SHOW_PLUGINS, FILE_ATTR_ROCK)   &&
-                       file_attr != FILE_ATTR_LUA  &&
-                       file_attr != FILE_ATTR_OPX) ||
-            (callback_show_item && !callback_show_item(entry->d_name, dptr->attr, c)))
+        CHK_FT(SHOW_M3U, FILE_ATTR_M3U) ||
+        CHK_FT(SHOW_CFG, FILE_ATTR_CFG) ||
+        CHK_FT(SHOW_LNG, FILE_ATTR_LNG) ||
+        CHK_FT(SHOW_MOD, FILE_ATTR_MOD) ||
+       /* show first level directories */
+       ((!(dir_attr) || dirlevel > 0)          &&
+        CHK_FT(SHOW_PLUGINS, FILE_ATTR_ROCK)   &&
+                   file_attr != FILE_ATTR_LUA  &&
+                   file_attr != FILE_ATTR_OPX) ||
+        (callback_show_item && !callback_show_item(entry->d_name, *attr, c)))
+    {
+        return false;
+    }
+#undef CHK_FT
+
+    return true;
+}
+
+static int ft_open(struct tree_context* c, const char* tempdir)
+{
+    loading.callback_show_item = NULL;
+    if (tempdir)
+        loading.dir = opendir(tempdir);
+    else
+    {
+        loading.dir = opendir(c->currdir);
+        loading.callback_show_item = c->browse? c->browse->callback_show_item: NULL;
+    }
+    if(!loading.dir)
+        return -1; /* not a directory */
+
+    c->dirsindir = 0;
+    c->dirfull = false;
+    c->filesindir = c->dirlength = 0;
+    loading.name_buffer_used = 0;
+    return 0;
+}
+
+/* Read the directory into the cache, until it is done or, if timed, until
+   the deadline has passed. Returns true if there is more to read. */
+static bool ft_read_entries(struct tree_context* c, bool timed, long deadline)
+{
+    int files_in_dir = c->filesindir;
+    struct dirent *entry;
+    bool more = true;
+
+    tree_lock_cache(c);
+    /* don't return an empty list that isn't */
+    while (!timed || files_in_dir == 0 || TIME_BEFORE(current_tick, deadline))
+    {
+        int len;
+        struct dirinfo info;
+
+        entry = readdir(loading.dir);
+        if (!entry)
         {
-            continue;
+            more = false;
+            break;
+        }
+
+        struct entry* dptr = tree_get_entry_at(c, files_in_dir);
+        if (!dptr)
+        {
+            c->dirfull = true;
+            more = false;
+            break;
         }
-#undef CHK_FT
 
-        if (len > c->cache.name_buffer_size - name_buffer_used - 1) {
+        info = dir_get_info(loading.dir, entry);
+        if (!ft_show_entry(c, c->dirlevel, entry, &info, &dptr->attr,
+                           loading.callback_show_item))
+            continue;
+
+        len = strlen((char *)entry->d_name);
+        if (len > c->cache.name_buffer_size - loading.name_buffer_used - 1) {
             /* Tell the world that we ran out of buffer space */
             c->dirfull = true;
+            more = false;
             break;
         }
 
         ++files_in_dir;
 
-        dptr->name = core_get_data(c->cache.name_buffer_handle)+name_buffer_used;
+        dptr->name = core_get_data(c->cache.name_buffer_handle)+loading.name_buffer_used;
         dptr->time_write = info.mtime;
         strcpy(dptr->name, (char *)entry->d_name);
-        name_buffer_used += len + 1;
+        loading.name_buffer_used += len + 1;
 
-        if (dir_attr) /* count the remaining dirs */
+        if (dptr->attr & ATTR_DIRECTORY) /* count the remaining dirs */
             c->dirsindir++;
     }
+    tree_unlock_cache(c);
+
     c->filesindir = files_in_dir;
     c->dirlength = files_in_dir;
-    closedir(dir);
 
+    if (!more)
+    {
+        closedir(loading.dir);
+        loading.dir = NULL;
+    }
+    return more;
+}
+
+static void ft_sort_setup(struct tree_context* c)
+{
     /* allow directories to be sorted into file list */
     cmp_data.sort_dir = (*c->dirfilter == SHOW_PLUGINS) ? SORT_AS_FILE : c->sort_dir;
 
@@ -445,16 +630,501 @@ int ft_load(struct tree_context* c, const char* tempdir)
             cmp_data._compar = strncasecmp;
     }
 
-    qsort(tree_get_entries(c), files_in_dir, sizeof(struct entry), compare);
+    cmp_data.collate_flags =
+        (global_settings.sort_case ? COLLATE_CASE : 0) |
+        (global_settings.interpret_numbers == SORT_INTERPRET_AS_NUMBER ?
+            COLLATE_NATURAL : 0);
+}
+
+static void ft_sort(struct tree_context* c)
+{
+    ft_sort_setup(c);
+
+    tree_lock_cache(c);
+    if (!sort_by_keys(c, c->filesindir))
+        qsort(tree_get_entries(c), c->filesindir, sizeof(struct entry), compare);
+    tree_unlock_cache(c);
+}
+
+/* Sort the entries read after the first 'sorted' ones, which are in order
+   already, and merge them in. Much quicker than sorting all of them again
+   for every slice of a large directory. The unused end of the entry buffer
+   holds the new entries while merging, if there is no room there all of
+   them are sorted again. compare() is used throughout, so that a listing
+   that is read in slices stays in one order. */
+static void ft_sort_new(struct tree_context* c, int sorted)
+{
+    int count = c->filesindir - sorted;
+
+    if (count <= 0)
+        return;
+
+    ft_sort_setup(c);
+
+    tree_lock_cache(c);
+    struct entry *entries = tree_get_entries(c);
+
+    if (sorted > 0 && c->filesindir + count <= c->cache.max_entries)
+    {
+        struct entry *new = &entries[c->filesindir];
+
+        qsort(&entries[sorted], count, sizeof(struct entry), compare);
+        memcpy(new, &entries[sorted], count * sizeof(struct entry));
+
+        /* merge from the end, so nothing that is still needed is
+           overwritten */
+        int i = sorted - 1, j = count - 1, k = c->filesindir - 1;
+        while (j >= 0)
+        {
+            if (i >= 0 && compare(&entries[i], &new[j]) > 0)
+                entries[k--] = entries[i--];
+            else
+                entries[k--] = new[j--];
+        }
+    }
+    else
+        qsort(entries, c->filesindir, sizeof(struct entry), compare);
+
+    tree_unlock_cache(c);
+}
+
+void ft_mem_init(void)
+{
+    /* never moved, the snapshots point into it */
+    int handle = core_alloc_ex((FT_SNAPSHOTS + 1) * FT_SNAPSHOT_SIZE,
+                               &buflib_ops_locked);
+    if (handle <= 0)
+        return;
+
+    unsigned char *buf = core_get_data(handle);
+    for (int i = 0; i < FT_SNAPSHOTS; i++)
+        snapshots[i].buf = buf + i * FT_SNAPSHOT_SIZE;
+    prefetch.buf = buf + FT_SNAPSHOTS * FT_SNAPSHOT_SIZE;
+}
+
+static void ft_forget_snapshot(struct ft_snapshot *snap)
+{
+    snap->valid = false;
+}
+
+/* The time of a directory from its entry in the parent, 0 for the root.
+   Checked before a snapshot is used, in case the directory was changed. */
+static unsigned ft_dir_mtime(const char *path)
+{
+    char parent[MAX_PATH];
+    const char *name = strrchr(path, '/');
+    unsigned mtime = 0;
+
+    if (!name || !name[1])
+        return 0;
+
+    size_t len = MAX(name - path, 1); /* keep the slash of the root */
+    if (len >= sizeof(parent))
+        return 0;
+    memcpy(parent, path, len);
+    parent[len] = '\0';
+
+    DIR *dir = opendir(parent);
+    if (!dir)
+        return 0;
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)))
+    {
+        if (!strcmp((char *)entry->d_name, name + 1))
+        {
+            mtime = dir_get_info(dir, entry).mtime;
+            break;
+        }
+    }
+
+    closedir(dir);
+    return mtime;
+}
+
+static struct ft_snapshot *ft_find_snapshot(struct tree_context* c,
+                                            const char *path, int dirlevel)
+{
+    for (int i = 0; i < FT_SNAPSHOTS; i++)
+    {
+        struct ft_snapshot *snap = &snapshots[i];
+        if (snap->valid && snap->dirfilter == *c->dirfilter &&
+            snap->dirlevel == dirlevel && !strcmp(snap->path, path))
+            return snap;
+    }
+    return NULL;
+}
+
+/* A free slot, or the one that was used least recently */
+static struct ft_snapshot *ft_new_snapshot(struct tree_context* c,
+                                           const char *path, int dirlevel)
+{
+    struct ft_snapshot *snap = ft_find_snapshot(c, path, dirlevel);
+
+    if (!snap)
+    {
+        snap = &snapshots[0];
+        for (int i = 1; i < FT_SNAPSHOTS && snap->valid; i++)
+        {
+            if (!snapshots[i].valid ||
+                TIME_BEFORE(snapshots[i].last_used, snap->last_used))
+                snap = &snapshots[i];
+        }
+    }
+
+    ft_forget_snapshot(snap);
+    return snap;
+}
+
+/* Keep the listing of the current directory, before leaving it */
+static void ft_save_snapshot(struct tree_context* c)
+{
+    struct ft_snapshot *snap;
+    struct entry *entries;
+    size_t size = 0;
+    int i;
+
+    if (loading.dir || c->dirfull || c->filesindir <= 0 ||
+        (c->browse && c->browse->callback_show_item))
+        return;
+
+    entries = tree_get_entries(c);
+    for (i = 0; i < c->filesindir; i++)
+        size += record_size(strlen(entries[i].name));
+
+    snap = ft_new_snapshot(c, c->currdir, c->dirlevel);
+    if (!snap->buf || size > FT_SNAPSHOT_SIZE)
+        return;
+
+    unsigned mtime = ft_dir_mtime(c->currdir);
+
+    /* nothing yields from here on */
+    unsigned char *p = snap->buf;
+    entries = tree_get_entries(c);
+    for (i = 0; i < c->filesindir; i++)
+    {
+        struct ft_record *r = (struct ft_record *)p;
+        size_t len = strlen(entries[i].name);
+        r->attr = entries[i].attr;
+        r->time_write = entries[i].time_write;
+        memcpy(r->name, entries[i].name, len + 1);
+        p += record_size(len);
+    }
+
+    snap->valid = true;
+    snap->size = size;
+    snap->count = c->filesindir;
+    snap->dirfilter = *c->dirfilter;
+    snap->dirlevel = c->dirlevel;
+    snap->thumbnails = global_settings.talk_file_clip;
+    snap->mtime = mtime;
+    snap->last_used = current_tick;
+    strmemccpy(snap->path, c->currdir, MAX_PATH);
+}
+
+/* Load the current directory from a snapshot. Returns false if there is
+   none. */
+static bool ft_load_snapshot(struct tree_context* c)
+{
+    struct ft_snapshot *snap;
+    int files_in_dir = 0, name_buffer_used = 0;
+
+    if (c->browse && c->browse->callback_show_item)
+        return false;
+
+    snap = ft_find_snapshot(c, c->currdir, c->dirlevel);
+    if (!snap)
+        return false;
+
+    if (ft_dir_mtime(c->currdir) != snap->mtime)
+    {
+        ft_forget_snapshot(snap);
+        return false;
+    }
+
+    c->dirsindir = 0;
+    c->dirfull = false;
+
+    /* nothing yields in here */
+    const unsigned char *p = snap->buf;
+    struct entry *entries = tree_get_entries(c);
+    char *names = core_get_data(c->cache.name_buffer_handle);
+    for (int i = 0; i < snap->count; i++)
+    {
+        const struct ft_record *r = (const struct ft_record *)p;
+        size_t len = strlen(r->name);
+
+        if (files_in_dir >= c->cache.max_entries ||
+            len > (size_t)(c->cache.name_buffer_size - name_buffer_used - 1))
+        {
+            c->dirfull = true;
+            break;
+        }
+
+        struct entry *dptr = &entries[files_in_dir++];
+        dptr->attr = r->attr;
+        dptr->time_write = r->time_write;
+        dptr->name = names + name_buffer_used;
+        memcpy(dptr->name, r->name, len + 1);
+        name_buffer_used += len + 1;
+
+        if (dptr->attr & ATTR_DIRECTORY)
+            c->dirsindir++;
+
+        p += record_size(len);
+    }
+
+    c->filesindir = c->dirlength = files_in_dir;
+    snap->last_used = current_tick;
+
+    ft_sort(c);
+    if (global_settings.talk_file_clip && !snap->thumbnails)
+        check_file_thumbnails(c); /* map .talk to ours */
+    return true;
+}
+
+static void ft_stop_prefetch(void)
+{
+    if (prefetch.dir)
+    {
+        closedir(prefetch.dir);
+        prefetch.dir = NULL;
+    }
+}
+
+/* Read some more of the selected subdirectory into a snapshot, so that it
+   is there when it is entered. Returns true if there is more to read. */
+static bool ft_prefetch_selected(struct tree_context* c, long deadline)
+{
+    char path[MAX_PATH];
+    struct dirent *entry;
+
+    struct entry *e = tree_get_entry_at(c, c->selected_item);
+    if (!e || c->selected_item >= c->filesindir ||
+        !(e->attr & ATTR_DIRECTORY) ||
+        (c->browse && c->browse->callback_show_item))
+    {
+        ft_stop_prefetch();
+        return false;
+    }
+
+    ft_assemble_path(path, sizeof(path), c->currdir, e->name);
+    if (!strcmp(path, prefetch.path))
+    {
+        if (!prefetch.dir)
+            return false; /* done with this one */
+    }
+    else
+    {
+        /* the selection moved on */
+        ft_stop_prefetch();
+        strmemccpy(prefetch.path, path, MAX_PATH);
+
+        if (ft_find_snapshot(c, path, c->dirlevel + 1))
+            return false;
+#ifdef HAVE_DISK_STORAGE
+        /* don't spin up the disk for a guess */
+        if (!storage_disk_is_active())
+            return false;
+#endif
+        if (!prefetch.buf)
+            return false;
+
+        prefetch.dir = opendir(path);
+        if (!prefetch.dir)
+        {
+            ft_stop_prefetch();
+            return false;
+        }
+        prefetch.mtime = e->time_write;
+        prefetch.used = 0;
+        prefetch.count = 0;
+        prefetch.dirlevel = c->dirlevel + 1;
+    }
+
+    while (TIME_BEFORE(current_tick, deadline))
+    {
+        struct dirinfo info;
+        int attr;
+
+        entry = readdir(prefetch.dir);
+        if (!entry)
+        {
+            struct ft_snapshot *snap =
+                ft_new_snapshot(c, prefetch.path, prefetch.dirlevel);
+
+            closedir(prefetch.dir);
+            prefetch.dir = NULL;
+
+            unsigned char *buf = snap->buf;
+            snap->buf = prefetch.buf;
+            prefetch.buf = buf;
+            snap->valid = true;
+            snap->size = prefetch.used;
+            snap->count = prefetch.count;
+            snap->dirfilter = *c->dirfilter;
+            snap->dirlevel = prefetch.dirlevel;
+            snap->thumbnails = false;
+            snap->mtime = prefetch.mtime;
+            snap->last_used = current_tick;
+            strmemccpy(snap->path, prefetch.path, MAX_PATH);
+            return false;
+        }
+
+        info = dir_get_info(prefetch.dir, entry);
+        if (!ft_show_entry(c, prefetch.dirlevel, entry, &info, &attr, NULL))
+            continue;
+
+        size_t len = strlen((char *)entry->d_name);
+        if (prefetch.used + record_size(len) > FT_SNAPSHOT_SIZE ||
+            prefetch.count >= c->cache.max_entries)
+        {
+            ft_stop_prefetch();
+            return false;
+        }
+
+        struct ft_record *r = (struct ft_record *)(prefetch.buf + prefetch.used);
+        r->attr = attr;
+        r->time_write = info.mtime;
+        memcpy(r->name, entry->d_name, len + 1);
+        prefetch.used += record_size(len);
+        prefetch.count++;
+    }
+
+    return true;
+}
+
+void ft_stop_loading(void)
+{
+    if (loading.dir)
+    {
+        /* the cache holds part of a directory */
+        closedir(loading.dir);
+        loading.dir = NULL;
+        reload_directory();
+    }
+
+    ft_stop_prefetch();
+    prefetch.path[0] = '\0';
+    for (int i = 0; i < FT_SNAPSHOTS; i++)
+        ft_forget_snapshot(&snapshots[i]);
+}
+
+/* load and sort directory into the tree's cache. returns NULL on failure. */
+int ft_load(struct tree_context* c, const char* tempdir)
+{
+    if (c->out_of_tree > 0) /* something else is loaded */
+        return 0;
+
+    if (loading.dir)
+    {
+        closedir(loading.dir);
+        loading.dir = NULL;
+        reload_directory();
+    }
+
+    if (!c->is_browsing)
+        c->browse = NULL;
+
+    if (ft_open(c, tempdir) < 0)
+        return -1;
+
+    ft_read_entries(c, false, 0);
+    ft_sort(c);
 
     /* If thumbnail talking is enabled, make an extra run to mark files with
        associated thumbnails, so we don't do unsuccessful spinups later. */
     if (global_settings.talk_file_clip)
         check_file_thumbnails(c); /* map .talk to ours */
 
-    tree_unlock_cache(c);
     return 0;
 }
+
+int ft_load_first(struct tree_context* c)
+{
+    if (c->out_of_tree > 0) /* something else is loaded */
+        return 0;
+
+    if (loading.dir)
+    {
+        closedir(loading.dir);
+        loading.dir = NULL;
+    }
+
+    if (!c->is_browsing)
+        c->browse = NULL;
+
+    if (ft_load_snapshot(c))
+        return 0;
+
+    if (ft_open(c, NULL) < 0)
+        return -1;
+
+    bool more = ft_read_entries(c, true, current_tick + FT_FIRST_TICKS);
+    if (more)
+        ft_sort_new(c, 0); /* the rest is merged in later */
+    else
+        ft_sort(c);
+
+    if (!more && global_settings.talk_file_clip)
+        check_file_thumbnails(c); /* map .talk to ours */
+
+    return 0;
+}
+
+bool ft_load_more(struct tree_context* c)
+{
+    long deadline = current_tick + FT_SLICE_TICKS;
+
+    if (loading.dir)
+    {
+        int sorted = c->filesindir;
+        bool more = ft_read_entries(c, true, deadline);
+        ft_sort_new(c, sorted);
+
+        if (!more && global_settings.talk_file_clip)
+            check_file_thumbnails(c); /* map .talk to ours */
+
+        return true; /* there may be something to prefetch */
+    }
+
+    return ft_prefetch_selected(c, deadline);
+}
+
+/* Read the rest of the current directory, keeping the selected entry
+   selected */
+void ft_finish_loading(struct tree_context* c)
+{
+    char name[MAX_PATH];
+    struct entry *e;
+
+    if (!loading.dir)
+        return;
+
+    e = tree_get_entry_at(c, c->selected_item);
+    if (e && c->selected_item < c->filesindir)
+        strmemccpy(name, e->name, MAX_PATH);
+    else
+        name[0] = '\0';
+
+    splash(0, ID2P(LANG_WAIT));
+    int sorted = c->filesindir;
+    ft_read_entries(c, false, 0);
+    ft_sort_new(c, sorted);
+    if (global_settings.talk_file_clip)
+        check_file_thumbnails(c); /* map .talk to ours */
+
+    e = tree_get_entries(c);
+    for (int i = 0; name[0] && i < c->filesindir; i++)
+    {
+        if (!strcmp(e[i].name, name))
+        {
+            c->selected_item = i;
+            break;
+        }
+    }
+}
+
 static void ft_load_font(char *file)
 {
     int current_font_id;
@@ -563,6 +1233,13 @@ int ft_enter(struct tree_context* c)
     char buf[MAX_PATH];
 
     struct entry* file = tree_get_entry_at(c, c->selected_item);
+    if (file && !(file->attr & ATTR_DIRECTORY))
+    {
+        /* playing builds the playlist from all of the directory, which
+           sorts it again */
+        ft_finish_loading(c);
+        file = tree_get_entry_at(c, c->selected_item);
+    }
     if (!file)
     {
         splashf(HZ, ID2P(LANG_READ_FAILED), str(LANG_UNKNOWN));
@@ -572,6 +1249,7 @@ int ft_enter(struct tree_context* c)
     int file_attr = file->attr;
     ft_assemble_path(buf, sizeof(buf), c->currdir, file->name);
     if (file_attr & ATTR_DIRECTORY) {
+        ft_save_snapshot(c);
         memcpy(c->currdir, buf, sizeof(c->currdir));
         if ( c->dirlevel < MAX_DIR_LEVELS )
             c->selected_item_history[c->dirlevel] = c->selected_item;
@@ -583,6 +1261,9 @@ int ft_enter(struct tree_context* c)
         bool play = false;
         int start_index=0;
 
+        /* leave the memory to whatever is started */
+        ft_stop_loading();
+
         switch ( file_attr & FILE_ATTR_MASK ) {
             case FILE_ATTR_M3U:
                 play = ft_play_playlist(buf, c->currdir, file->name);
@@ -849,6 +1530,8 @@ int ft_exit(struct tree_context* c)
         i--;
 
     if (i>1) {
+        ft_save_snapshot(c);
+
         while (c->currdir[i-1]!=PATH_SEPCH)
             i--;
         strcpy(buf,&c->currdir[i]);
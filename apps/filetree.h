@@ -22,7 +22,18 @@
 #define FILETREE_H
 #include "tree.h"
 
+/* Set aside the memory for the listings kept by ft_load_first() */
+void ft_mem_init(void);
 int ft_load(struct tree_context* c, const char* tempdir);
+/* For the browser: reads as much of the current directory as can be read
+   quickly and leaves the rest to ft_load_more(), which is called while the
+   browser is idle until it returns false and also prefetches the selected
+   subdirectory. Listings of the directories around the current one are
+   kept until ft_stop_loading(). */
+int ft_load_first(struct tree_context* c);
+bool ft_load_more(struct tree_context* c);
+void ft_finish_loading(struct tree_context* c);
+void ft_stop_loading(void);
 int ft_enter(struct tree_context* c);
 int ft_exit(struct tree_context* c);
 int ft_assemble_path(char *buf, size_t bufsz,
@@ -59,6 +59,45 @@ enum {
 /* these are static to make scrolling work */
 static struct viewport list_text[NB_SCREENS], title_text[NB_SCREENS];
 
+/* The rows of the last draw of each screen. For lists that opt in with
+ * gui_synclist_set_cache_rows(), a redraw that only follows the selection or
+ * the scroll position takes the rows it already had from here instead of
+ * asking the list again, which can be slow: tagtree formats for example. The
+ * text of the rows is copied from one half of the buffer to the other on
+ * every draw, rows that don't fit are fetched again the next time. */
+#if MEMORYSIZE <= 8
+#define ROW_CACHE_TEXT  256
+#else
+#define ROW_CACHE_TEXT  1024
+#endif
+#define ROW_CACHE_ROWS  (LCD_HEIGHT / 8 + 2)
+
+struct cached_row
+{
+    short text;                 /* offset of the name, -1 if it isn't kept */
+    short icon;
+#ifdef HAVE_LCD_COLOR
+    int color;
+#endif
+};
+
+static struct row_cache
+{
+    const struct gui_synclist *list;
+    const void *data;
+    list_get_name *get_name;
+    list_get_icon *get_icon;
+#ifdef HAVE_LCD_COLOR
+    list_get_color *get_color;
+#endif
+    int nb_items;
+    int first;                  /* item of rows[cur][0] */
+    int count;
+    int cur;
+    struct cached_row rows[2][ROW_CACHE_ROWS];
+    char text[2][ROW_CACHE_TEXT];
+} row_cache[NB_SCREENS];
+
 /* list-private helpers from the generic list.c (move to header?) */
 int gui_list_get_item_offset(struct gui_synclist * gui_list, int item_width,
                              int text_pos, struct screen * display,
@@ -193,7 +232,57 @@ static bool draw_title(struct screen *display,
     return true;
 }
 
-void list_draw(struct screen *display, struct gui_synclist *list)
+/* Get the name, icon and colour of item i, from the rows of the last draw if
+   it is one of them, and keep them as row n of this draw */
+static const char *get_row(struct row_cache *rc, struct gui_synclist *list,
+                           int i, int n, size_t *used, struct cached_row *row)
+{
+    extern char simplelist_buffer[SIMPLELIST_MAX_LINES * SIMPLELIST_MAX_LINELENGTH];
+    /*char entry_buffer[MAX_PATH]; use the buffer from gui/list.c instead */
+    const int next = rc->cur ^ 1;
+    const char *name;
+
+    if (i >= rc->first && i < rc->first + rc->count &&
+        rc->rows[rc->cur][i - rc->first].text >= 0)
+    {
+        *row = rc->rows[rc->cur][i - rc->first];
+        name = &rc->text[rc->cur][row->text];
+    }
+    else
+    {
+        unsigned const char *s =
+            list->callback_get_item_name(i, list->data, simplelist_buffer,
+                                         sizeof(simplelist_buffer));
+        if (P2ID((unsigned char *)s) > VOICEONLY_DELIMITER)
+            name = "";
+        else
+            name = P2STR(s);
+#ifdef HAVE_LCD_COLOR
+        row->color = list->callback_get_item_color ?
+                        list->callback_get_item_color(i, list->data) : -1;
+#endif
+        row->icon = list->callback_get_item_icon ?
+                        list->callback_get_item_icon(i, list->data) : Icon_NOICON;
+    }
+
+    row->text = -1;
+    if (list->cache_rows && n < ROW_CACHE_ROWS)
+    {
+        size_t len = strlen(name) + 1;
+        if (*used + len <= ROW_CACHE_TEXT)
+        {
+            memcpy(&rc->text[next][*used], name, len);
+            row->text = *used;
+            *used += len;
+        }
+        rc->rows[next][n] = *row;
+    }
+
+    return name;
+}
+
+static void draw_list(struct screen *display, struct gui_synclist *list,
+                      bool use_cache)
 {
     int start, end, item_offset, i;
     const int screen = display->screen_type;
@@ -326,24 +415,30 @@ void list_draw(struct screen *display, struct gui_synclist *list)
         .have_icons = have_icons, .linedes = &linedes, .display = display
     };
 
+    struct row_cache *rc = &row_cache[screen];
+    size_t text_used = 0;
+
+    if (!use_cache || rc->list != list || rc->data != list->data ||
+        rc->nb_items != list->nb_items ||
+        rc->get_name != list->callback_get_item_name ||
+#ifdef HAVE_LCD_COLOR
+        rc->get_color != list->callback_get_item_color ||
+#endif
+        rc->get_icon != list->callback_get_item_icon)
+    {
+        rc->count = 0;
+    }
+
     for (i=start; i<end && i<list->nb_items; i++)
     {
         /* do the text */
-        enum themable_icons icon;
-        unsigned const char *s;
-        extern char simplelist_buffer[SIMPLELIST_MAX_LINES * SIMPLELIST_MAX_LINELENGTH];
-        /*char entry_buffer[MAX_PATH]; use the buffer from gui/list.c instead */
-        unsigned char *entry_name;
+        struct cached_row row;
+        const char *entry_name;
         int line = i - start;
         int line_indent = 0;
         int style = STYLE_DEFAULT;
         bool is_selected = false;
-        s = list->callback_get_item_name(i, list->data, simplelist_buffer,
-                                         sizeof(simplelist_buffer));
-        if (P2ID((unsigned char *)s) > VOICEONLY_DELIMITER)
-            entry_name = "";
-        else
-            entry_name = P2STR(s);
+        entry_name = get_row(rc, list, i, line, &text_used, &row);
 
         while (*entry_name == '\t')
         {
@@ -419,38 +514,57 @@ void list_draw(struct screen *display, struct gui_synclist *list)
         
 #ifdef HAVE_LCD_COLOR
         /* if the list has a color callback */
-        if (list->callback_get_item_color)
-        {
-            int c = list->callback_get_item_color(i, list->data);
-            if (c >= 0)
-            {   /* if color selected */
-                linedes.text_color = c;
-                style |= STYLE_COLORED;
-            }
+        if (row.color >= 0)
+        {   /* if color selected */
+            linedes.text_color = row.color;
+            style |= STYLE_COLORED;
         }
 #endif
         linedes.style = style;
         linedes.scroll = is_selected ? true : list->scroll_all;
         linedes.line = i % list->selected_size;
-        icon = list->callback_get_item_icon ?
-                    list->callback_get_item_icon(i, list->data) : Icon_NOICON;
 
 
         list_info.y = line * linedes.height + draw_offset;
         list_info.is_selected = is_selected;
         list_info.item_indent = line_indent;
         list_info.line = i;
-        list_info.icon = icon;
+        list_info.icon = row.icon;
         list_info.dsp_text = entry_name;
         list_info.item_offset = item_offset;
 
         callback_draw_item(&list_info);
     }
+
+    rc->cur ^= 1;
+    rc->first = start;
+    rc->count = list->cache_rows ? MIN(i - start, ROW_CACHE_ROWS) : 0;
+    rc->list = list;
+    rc->data = list->data;
+    rc->nb_items = list->nb_items;
+    rc->get_name = list->callback_get_item_name;
+#ifdef HAVE_LCD_COLOR
+    rc->get_color = list->callback_get_item_color;
+#endif
+    rc->get_icon = list->callback_get_item_icon;
+
     display->set_viewport(parent);
     display->update_viewport();
     display->set_viewport(last_vp);
 }
 
+void list_draw(struct screen *display, struct gui_synclist *list)
+{
+    draw_list(display, list, false);
+}
+
+/* Redraw after only the selection or the view moved. The items must be the
+   same as at the last draw, which the callbacks aren't asked for again. */
+void list_draw_moved(struct screen *display, struct gui_synclist *list)
+{
+    draw_list(display, list, true);
+}
+
 #if defined(HAVE_TOUCHSCREEN)
 /* This needs to be fixed if we ever get more than 1 touchscreen on a target. */
 
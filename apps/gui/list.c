@@ -47,6 +47,7 @@
 #define FRAMEDROP_TRIGGER 6
 
 void list_draw(struct screen *display, struct gui_synclist *list);
+void list_draw_moved(struct screen *display, struct gui_synclist *list);
 
 static long last_dirty_tick;
 static struct viewport parent[NB_SCREENS];
@@ -158,6 +159,7 @@ void gui_synclist_init(struct gui_synclist * gui_list,
     gui_list->callback_get_item_name = callback_get_item_name;
     gui_list->callback_speak_item = NULL;
     gui_list->callback_draw_item = NULL;
+    gui_list->cache_rows = false;
     gui_list->nb_items = 0;
     gui_list->selected_item = 0;
     gui_synclist_init_display_settings(gui_list);
@@ -185,6 +187,7 @@ void gui_synclist_init(struct gui_synclist * gui_list,
     gui_list->title_icon = Icon_NOICON;
 
     gui_list->scheduled_talk_tick = gui_list->last_talked_tick = 0;
+    gui_list->voice_prefetched_item = -1;
     gui_list->dirty_tick = current_tick;
 
 #ifdef HAVE_LCD_COLOR
@@ -239,6 +242,24 @@ void gui_synclist_draw(struct gui_synclist *gui_list)
     }
 }
 
+/*
+ * Update the screen after the selection or the view moved, without asking
+ * the list again for the items that were already shown.
+ */
+static void gui_synclist_draw_moved(struct gui_synclist *gui_list)
+{
+    if (!gui_list->cache_rows || list_is_dirty(gui_list))
+    {
+        gui_synclist_draw(gui_list);
+        return;
+    }
+    FOR_NB_SCREENS(i)
+    {
+        if (!skinlist_draw(&screens[i], gui_list))
+            list_draw_moved(&screens[i], gui_list);
+    }
+}
+
 /* sets up the list so the selection is shown correctly on the screen */
 static void gui_list_put_selection_on_screen(struct gui_synclist * gui_list,
                                              enum screen_type screen)
@@ -347,6 +368,50 @@ static void _gui_synclist_speak_item(struct gui_synclist *lists)
     }
 }
 
+/* Number of items on either side of the selection whose clips are prefetched,
+   and how long after an announcement to wait so that it isn't held up by it */
+#define VOICE_PREFETCH_ITEMS 2
+#define VOICE_PREFETCH_DELAY (HZ/2)
+
+static bool voice_prefetch_pending(struct gui_synclist *lists)
+{
+    return lists->talk_menu && lists->callback_speak_item &&
+           lists->nb_items > 1 && !lists->scheduled_talk_tick &&
+           lists->voice_prefetched_item != lists->selected_item;
+}
+
+/* Load the clips of the items next to the selection while the user listens,
+   so that moving on doesn't have to wait for the voice file to be read */
+static void gui_synclist_prefetch_voice(struct gui_synclist *lists)
+{
+    list_speak_item *cb = lists->callback_speak_item;
+    int selected = lists->selected_item;
+
+    lists->voice_prefetched_item = selected;
+    if (!talk_prefetch(true))
+        return;
+
+    for (int i = 1; i <= VOICE_PREFETCH_ITEMS; i++)
+    {
+        for (int dir = 1; dir >= -1; dir -= 2)
+        {
+            int item = selected + dir * i * lists->selected_size;
+            if (item < 0 || item >= lists->nb_items)
+            {
+                if (!lists->wraparound)
+                    continue;
+                item = (item + lists->nb_items) % lists->nb_items;
+            }
+            /* stop as soon as the user does something */
+            if (button_queue_count())
+                break;
+            cb(item, lists->data);
+        }
+    }
+
+    talk_prefetch(false);
+}
+
 void gui_synclist_speak_item(struct gui_synclist *lists)
 {
     if (lists->talk_menu)
@@ -445,11 +510,17 @@ void gui_synclist_set_title(struct gui_synclist * gui_list,
 void gui_synclist_set_nb_items(struct gui_synclist * lists, int nb_items)
 {
     lists->nb_items = nb_items;
+    lists->voice_prefetched_item = -1;
     FOR_NB_SCREENS(i)
     {
         lists->offset_position[i] = 0;
     }
 }
+void gui_synclist_grow_nb_items(struct gui_synclist * lists, int nb_items)
+{
+    if (nb_items > lists->nb_items)
+        lists->nb_items = nb_items;
+}
 int gui_synclist_get_nb_items(struct gui_synclist * lists)
 {
     return lists->nb_items;
@@ -464,6 +535,11 @@ void gui_synclist_set_icon_callback(struct gui_synclist * lists,
     lists->callback_get_item_icon = icon_callback;
 }
 
+void gui_synclist_set_cache_rows(struct gui_synclist * lists, bool cache_rows)
+{
+    lists->cache_rows = cache_rows;
+}
+
 void gui_synclist_set_voice_callback(struct gui_synclist * lists,
                                      list_speak_item voice_callback)
 {
@@ -697,7 +773,7 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
 #ifndef HAVE_WHEEL_ACCELERATION
             if (button_queue_count() < FRAMEDROP_TRIGGER)
 #endif
-                gui_synclist_draw(lists);
+                gui_synclist_draw_moved(lists);
             yield();
             *actionptr = ACTION_STD_PREV;
             return true;
@@ -710,14 +786,14 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
 #ifndef HAVE_WHEEL_ACCELERATION
             if (button_queue_count() < FRAMEDROP_TRIGGER)
 #endif
-                gui_synclist_draw(lists);
+                gui_synclist_draw_moved(lists);
             yield();
             *actionptr = ACTION_STD_NEXT;
             return true;
 
         case ACTION_TREE_PGRIGHT:
             gui_synclist_scroll_right(lists);
-            gui_synclist_draw(lists);
+            gui_synclist_draw_moved(lists);
             yield();
             return true;
         case ACTION_TREE_ROOT_INIT:
@@ -743,7 +819,7 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
                 return false;
             }
             gui_synclist_scroll_left(lists);
-            gui_synclist_draw(lists);
+            gui_synclist_draw_moved(lists);
             pgleft_allow_cancel = false; /* stop ACTION_TREE_PAGE_LEFT
                                             skipping to root */
             yield();
@@ -760,7 +836,7 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
 #endif
                                           SCREEN_MAIN;
             gui_synclist_select_previous_page(lists, screen, false);
-            gui_synclist_draw(lists);
+            gui_synclist_draw_moved(lists);
             yield();
             *actionptr = ACTION_STD_NEXT;
         }
@@ -775,7 +851,7 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
 #endif
                                           SCREEN_MAIN;
             gui_synclist_select_next_page(lists, screen, false);
-            gui_synclist_draw(lists);
+            gui_synclist_draw_moved(lists);
             yield();
             *actionptr = ACTION_STD_PREV;
         }
@@ -785,6 +861,11 @@ bool gui_synclist_do_button(struct gui_synclist * lists, int *actionptr)
        && TIME_AFTER(current_tick, lists->scheduled_talk_tick))
         /* scheduled postponed item announcement is due */
         _gui_synclist_speak_item(lists);
+    else if (action == ACTION_NONE && voice_prefetch_pending(lists) &&
+             !TIME_BEFORE(current_tick,
+                          lists->last_talked_tick + VOICE_PREFETCH_DELAY))
+        /* idle after an announcement, get the neighbours ready */
+        gui_synclist_prefetch_voice(lists);
     return false;
 }
 
@@ -804,6 +885,16 @@ int list_do_action_timeout(struct gui_synclist *lists, int timeout)
         if(timeout > delay || timeout == TIMEOUT_BLOCK)
             timeout = delay;
     }
+    else if (voice_prefetch_pending(lists))
+    {
+        /* wake up once the announcement is under way to prefetch clips */
+        long delay = lists->last_talked_tick + VOICE_PREFETCH_DELAY
+                     - current_tick + 1;
+        if(delay < 0)
+            delay = 0;
+        if(timeout > delay || timeout == TIMEOUT_BLOCK)
+            timeout = delay;
+    }
     return timeout;
 }
 
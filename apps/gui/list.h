@@ -163,6 +163,8 @@ struct gui_synclist
     int line_height[NB_SCREENS];
     int offset_position[NB_SCREENS]; /* the list's screen scroll placement in pixels */
     long scheduled_talk_tick, last_talked_tick, dirty_tick;
+    /* item around which voice clips were last prefetched, -1 if none */
+    int voice_prefetched_item;
 
     list_get_icon *callback_get_item_icon;
     list_get_name *callback_get_item_name;
@@ -182,6 +184,7 @@ struct gui_synclist
     struct list_selection_color *selection_color;
 #endif
     struct viewport *parent[NB_SCREENS];
+    bool cache_rows; /* see gui_synclist_set_cache_rows() */
 
 #ifdef HAVE_TOUCHSCREEN
     int y_pos; /* absolute Y coordinate, used for smooth scrolling */
@@ -202,7 +205,13 @@ extern void gui_synclist_init(
     struct viewport parent[NB_SCREENS] /* NOTE: new screens should NOT set this to NULL */
     );
 extern void gui_synclist_set_nb_items(struct gui_synclist * lists, int nb_items);
+/* for lists that grow while they are shown, keeps the selection and scrolling */
+extern void gui_synclist_grow_nb_items(struct gui_synclist * lists, int nb_items);
 extern void gui_synclist_set_icon_callback(struct gui_synclist * lists, list_get_icon icon_callback);
+/* for lists whose items only change along with their number or when the
+   owner draws the list again, lets redraws that only move reuse the rows
+   that were shown */
+extern void gui_synclist_set_cache_rows(struct gui_synclist * lists, bool cache_rows);
 extern void gui_synclist_set_voice_callback(struct gui_synclist * lists, list_speak_item voice_callback);
 extern void gui_synclist_set_viewport_defaults(struct viewport *vp, enum screen_type screen);
 #ifdef HAVE_LCD_COLOR
@@ -26,6 +26,7 @@
 #include "lang.h"
 #include "debug.h"
 #include "string.h"
+#include "string-extra.h"
 #include "viewport.h"
 
 /* The following header is generated by the build system and only defines
@@ -46,6 +47,7 @@
 
 static unsigned char language_buffer[MAX_LANGUAGE_SIZE];
 static unsigned char lang_options = 0;
+static char core_lang_file[MAX_PATH]; /* what language_buffer holds */
 
 void lang_init(const unsigned char *builtin, unsigned char **dest, int count)
 {
@@ -128,9 +130,18 @@ int lang_load(const char *filename, const unsigned char *builtin,
 
 int lang_core_load(const char *filename)
 {
-    return lang_load(filename, core_language_builtin, language_strings,
-                     language_buffer, 0, MAX_LANGUAGE_SIZE,
-                     LANG_LAST_INDEX_IN_ARRAY);
+    int retcode = lang_load(filename, core_language_builtin, language_strings,
+                            language_buffer, 0, MAX_LANGUAGE_SIZE,
+                            LANG_LAST_INDEX_IN_ARRAY);
+
+    strmemccpy(core_lang_file, retcode ? "" : filename,
+               sizeof (core_lang_file));
+    return retcode;
+}
+
+int lang_core_is_loaded(const char *filename)
+{
+    return core_lang_file[0] && !strcmp(core_lang_file, filename);
 }
 
 int lang_english_to_id(const char *english)
@@ -27,6 +27,9 @@ void lang_init(const unsigned char *builtin, unsigned char **dest, int count);
 /* load a given language file */
 int lang_core_load(const char *filename);
 
+/* returns whether the core strings are from this language file */
+int lang_core_is_loaded(const char *filename);
+
 int lang_load(const char *filename, const unsigned char *builtin, 
               unsigned char **dest, unsigned char *buffer, 
               unsigned int user_num, int max_lang_size,
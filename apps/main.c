@@ -54,6 +54,9 @@
 #include "language.h"
 #include "wps.h"
 #include "playlist.h"
+#include "metadata_cache.h"
+#include "collation.h"
+#include "cuesheet.h"
 #include "core_alloc.h"
 #include "rolo.h"
 #include "screens.h"
@@ -76,6 +79,7 @@
 #include "skin_engine/skin_engine.h"
 #include "statusbar-skinned.h"
 #include "bootchart.h"
+#include "trace.h"
 #include "logdiskf.h"
 #include "bootdata.h"
 #if defined(HAVE_DEVICEDATA)
@@ -233,6 +237,7 @@ int main(void)
     /* no calls INIT_ATTR functions after this point anymore!
      * see definition of INIT_ATTR in config.h */
     CHART(">root_menu");
+    bootchart_save();
     root_menu();
 }
 
@@ -391,6 +396,9 @@ static void init(void)
     system_init();
     core_allocator_init();
     kernel_init();
+#ifdef ROCKBOX_HAS_TRACE
+    trace_init();
+#endif
 #ifdef APPLICATION
     paths_init();
 #endif
@@ -448,6 +456,9 @@ static void init(void)
     tree_mem_init();
     filetype_init();
     playlist_init();
+    metadata_cache_init();
+    collation_init_reserve();
+    cuesheet_init();
     shortcuts_init();
 
     audio_init();
@@ -475,6 +486,9 @@ static void init(void)
     system_init();
     core_allocator_init();
     kernel_init();
+#ifdef ROCKBOX_HAS_TRACE
+    trace_init();
+#endif
 
 #if defined(HAVE_BOOTDATA) && !defined(BOOTLOADER)
     verify_boot_data();
@@ -756,11 +770,20 @@ static void init(void)
         CHART("<eeprom_settings_store");
     }
 #endif
+    CHART(">playlist_init");
     playlist_init();
+    CHART("<playlist_init");
+    metadata_cache_init();
+    collation_init_reserve();
+    cuesheet_init();
     tree_mem_init();
+    CHART(">filetype_init");
     filetype_init();
+    CHART("<filetype_init");
 
+    CHART(">shortcuts_init");
     shortcuts_init();
+    CHART("<shortcuts_init");
 
     CHART(">audio_init");
     audio_init();
@@ -787,13 +810,13 @@ static void init(void)
     lineout_set(global_settings.lineout_active);
 #endif
 #ifdef HAVE_HOTSWAP_STORAGE_AS_MAIN
-    CHART("<check_bootfile(false)");
-    check_bootfile(false); /* remember write time and filesize */
     CHART(">check_bootfile(false)");
+    check_bootfile(false); /* remember write time and filesize */
+    CHART("<check_bootfile(false)");
 #endif
-    CHART("<settings_apply_skins");
-    settings_apply_skins();
     CHART(">settings_apply_skins");
+    settings_apply_skins();
+    CHART("<settings_apply_skins");
 }
 
 #ifdef CPU_PP
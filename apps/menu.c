@@ -326,6 +326,60 @@ static int talk_menu_item(int selected_item, void *data)
         return 0;
 }
 
+/* Number of entries of the selected submenu whose clips are prefetched */
+#define MENU_PREFETCH_ITEMS 4
+
+/* voice id talk_menu_item() would speak for an item, -1 if it has none or it
+   is spoken through a callback */
+static int menu_item_voice_id(const struct menu_item_ex *item)
+{
+    int type = item->flags&MENU_TYPE_MASK;
+    if ((type == MT_SETTING) || (type == MT_SETTING_W_TEXT))
+    {
+        const struct settings_list *setting = find_setting(item->variable);
+        return (setting && setting->lang_id) ? setting->lang_id : -1;
+    }
+    if (!(item->flags&MENU_HAS_DESC))
+        return -1;
+    return P2ID(item->callback_and_desc->desc);
+}
+
+/* Load the clips of the first entries of the selected submenu, so they can
+   be announced without delay when it is entered */
+static void talk_menu_prefetch(const struct menu_item_ex *menu,
+                               struct gui_synclist *lists)
+{
+    static const struct menu_item_ex *last_submenu = NULL;
+    static unsigned int last_generation = 0;
+    const struct menu_item_ex *submenu;
+    int i, count, id;
+
+    if ((menu->flags&MENU_TYPE_MASK) != MT_MENU ||
+        current_subitems_count == 0)
+        return;
+    submenu = menu->submenus[get_menu_selection(
+                              gui_synclist_get_sel_pos(lists), menu)];
+    if ((submenu->flags&MENU_TYPE_MASK) != MT_MENU)
+        return;
+    /* the clips are only gone again if another voice was loaded since */
+    if (submenu == last_submenu && last_generation == talk_get_generation())
+        return;
+    if (!talk_prefetch(true))
+        return;
+    last_submenu = submenu;
+    last_generation = talk_get_generation();
+
+    count = MIN(MENU_GET_COUNT(submenu->flags), MENU_PREFETCH_ITEMS);
+    for (i = 0; i < count && !button_queue_count(); i++)
+    {
+        id = menu_item_voice_id(submenu->submenus[i]);
+        if (id != -1)
+            talk_id(id, false);
+    }
+
+    talk_prefetch(false);
+}
+
 void do_setting_screen(const struct settings_list *setting, const char * title,
                         struct viewport parent[NB_SCREENS])
 {
@@ -492,6 +546,10 @@ int do_menu(const struct menu_item_ex *start_menu, int *start_selected,
         {
             redraw_lists = list_stop_handler();
         }
+        else if (action == ACTION_NONE && global_settings.talk_menu)
+        {
+            talk_menu_prefetch(menu, &lists);
+        }
         else if (action == ACTION_STD_CONTEXT)
         {
             if (menu == &root_menu_)
@@ -303,6 +303,7 @@ MAKE_MENU(filesplitoptionsmenu, ID2P(LANG_RECORD_TIMESPLIT), NULL, Icon_NOICON,
 
 
 MENUITEM_SETTING(rec_prerecord_time, &global_settings.rec_prerecord_time, NULL);
+MENUITEM_SETTING(rec_archive, &global_settings.rec_archive, NULL);
 
 static int clear_rec_directory(void)
 {
@@ -594,6 +595,7 @@ MAKE_MENU(recording_settings_menu, ID2P(LANG_RECORDING_SETTINGS),
             &recmonomode,
             &filesplitoptionsmenu,
             &rec_prerecord_time,
+            &rec_archive,
             &clear_rec_directory_item,
 #ifdef HAVE_BACKLIGHT
             &cliplight,
@@ -0,0 +1,291 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/*
+ * The cache is split into two generations which are filled one after the
+ * other. Records are appended to the current generation; when it is full the
+ * other one is emptied and becomes current. Lookups search both, so at least
+ * the most recent half of the cache is always available, and eviction never
+ * has to move or track individual records.
+ *
+ * A record is a small header, the numeric fields of the mp3entry and then the
+ * path and the tag strings packed back to back. That is usually a few hundred
+ * bytes rather than the ~3k of a full mp3entry.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include "string-extra.h"
+#include "config.h"
+#include "system.h"
+#include "kernel.h"
+#include "file.h"
+#include "core_alloc.h"
+#include "crc32.h"
+#include "events.h"
+#include "metadata_cache.h"
+
+/*#define LOGF_ENABLE*/
+#include "logf.h"
+
+#if MEMORYSIZE <= 8
+#define METADATA_CACHE_SIZE (16 << 10)
+#else
+#define METADATA_CACHE_SIZE (64 << 10)
+#endif
+
+/* the tag string pointers of struct mp3entry */
+static const unsigned short string_fields[] =
+{
+    offsetof(struct mp3entry, title),
+    offsetof(struct mp3entry, artist),
+    offsetof(struct mp3entry, album),
+    offsetof(struct mp3entry, genre_string),
+    offsetof(struct mp3entry, disc_string),
+    offsetof(struct mp3entry, track_string),
+    offsetof(struct mp3entry, year_string),
+    offsetof(struct mp3entry, composer),
+    offsetof(struct mp3entry, comment),
+    offsetof(struct mp3entry, albumartist),
+    offsetof(struct mp3entry, grouping),
+    offsetof(struct mp3entry, mb_track_id),
+};
+#define NUM_STRINGS ARRAYLEN(string_fields)
+#define STRING_FIELD(id3, i) \
+    (*(char **)((char *)(id3) + string_fields[i]))
+
+/* The numeric fields live between the strings pointers and the parser
+   buffers, and after the parser buffers until the end of the struct */
+#define HEAD_START  offsetof(struct mp3entry, discnum)
+#define HEAD_SIZE   (offsetof(struct mp3entry, id3v2buf) - HEAD_START)
+#define TAIL_START  offsetof(struct mp3entry, offset)
+#define TAIL_SIZE   (sizeof(struct mp3entry) - TAIL_START)
+/* all strings are restored into id3v2buf and id3v1buf, which are adjacent */
+#define STRINGS_MAX (ID3V2_BUF_SIZE + sizeof(((struct mp3entry *)0)->id3v1buf))
+
+struct mdc_record
+{
+    uint32_t key;                       /* crc32 of the path, 0 if dropped */
+    uint32_t filesize;                  /* size of the parsed file */
+    uint16_t size;                      /* size of the whole record */
+    uint16_t path_len;                  /* including the terminator */
+    uint16_t str_len[NUM_STRINGS];      /* including the terminator,
+                                           0 for a NULL string */
+    unsigned char head[HEAD_SIZE];
+    unsigned char tail[TAIL_SIZE];
+    char data[];                        /* path, then the strings */
+};
+
+static struct
+{
+    int handle;
+    size_t gen_size;                    /* size of one generation */
+    size_t used[2];                     /* bytes used in each generation */
+    int cur;                            /* generation being filled */
+    struct mutex mutex;
+} mdc;
+
+static inline unsigned char *gen_base(int gen)
+{
+    return (unsigned char *)core_get_data(mdc.handle) + gen * mdc.gen_size;
+}
+
+static struct mdc_record *find_record(uint32_t key, const char *path)
+{
+    /* newest generation first */
+    for (int i = 0; i < 2; i++)
+    {
+        int gen = mdc.cur ^ i;
+        unsigned char *p = gen_base(gen), *end = p + mdc.used[gen];
+        while (p < end)
+        {
+            struct mdc_record *r = (struct mdc_record *)p;
+            if (r->key == key && !strcmp(r->data, path))
+                return r;
+            p += r->size;
+        }
+    }
+    return NULL;
+}
+
+void metadata_cache_flush(void)
+{
+    mutex_lock(&mdc.mutex);
+    mdc.used[0] = mdc.used[1] = 0;
+    mutex_unlock(&mdc.mutex);
+}
+
+void metadata_cache_add(const struct mp3entry *id3, const char *path,
+                        off_t filesize)
+{
+    size_t lens[NUM_STRINGS];
+    size_t path_len, size;
+    unsigned int i;
+
+    if (mdc.handle <= 0 || filesize < 0)
+        return;
+
+    path_len = strlen(path) + 1;
+    size = sizeof(struct mdc_record) + path_len;
+    for (i = 0; i < NUM_STRINGS; i++)
+    {
+        const char *s = STRING_FIELD(id3, i);
+        lens[i] = s ? strlen(s) + 1 : 0;
+        size += lens[i];
+    }
+    if (size - sizeof(struct mdc_record) - path_len > STRINGS_MAX)
+        return; /* wouldn't fit back into an mp3entry */
+    size = ALIGN_UP(size, sizeof(uint32_t));
+    if (size > mdc.gen_size || size > UINT16_MAX)
+        return;
+
+    mutex_lock(&mdc.mutex);
+
+    uint32_t key = crc_32(path, path_len - 1, 0xffffffff) | 1;
+    struct mdc_record *r = find_record(key, path);
+    if (r)
+    {
+        if (r->filesize == (uint32_t)filesize)
+            goto out; /* already known */
+        r->key = 0; /* file changed, forget the old one */
+    }
+
+    if (mdc.used[mdc.cur] + size > mdc.gen_size)
+    {
+        /* current generation is full, recycle the older one */
+        mdc.cur ^= 1;
+        mdc.used[mdc.cur] = 0;
+    }
+
+    r = (struct mdc_record *)(gen_base(mdc.cur) + mdc.used[mdc.cur]);
+    r->key = key;
+    r->filesize = filesize;
+    r->size = size;
+    r->path_len = path_len;
+    memcpy(r->head, (const char *)id3 + HEAD_START, HEAD_SIZE);
+    memcpy(r->tail, (const char *)id3 + TAIL_START, TAIL_SIZE);
+
+    char *p = r->data;
+    memcpy(p, path, path_len);
+    p += path_len;
+    for (i = 0; i < NUM_STRINGS; i++)
+    {
+        r->str_len[i] = lens[i];
+        if (lens[i])
+        {
+            memcpy(p, STRING_FIELD(id3, i), lens[i]);
+            p += lens[i];
+        }
+    }
+    mdc.used[mdc.cur] += size;
+
+out:
+    mutex_unlock(&mdc.mutex);
+}
+
+bool metadata_cache_get(struct mp3entry *id3, const char *path,
+                        off_t filesize, int flags)
+{
+    struct mdc_record *r;
+    bool found = false;
+
+    if (mdc.handle <= 0)
+        return false;
+
+    mutex_lock(&mdc.mutex);
+
+    r = find_record(crc_32(path, strlen(path), 0xffffffff) | 1, path);
+    if (r && r->filesize == (uint32_t)filesize)
+    {
+        wipe_mp3entry(id3);
+        memcpy((char *)id3 + HEAD_START, r->head, HEAD_SIZE);
+        memcpy((char *)id3 + TAIL_START, r->tail, TAIL_SIZE);
+        id3->cuesheet = NULL;
+
+        const char *src = r->data + r->path_len;
+        char *dst = id3->id3v2buf;
+        for (unsigned int i = 0; i < NUM_STRINGS; i++)
+        {
+            STRING_FIELD(id3, i) = r->str_len[i] ? dst : NULL;
+            memcpy(dst, src, r->str_len[i]);
+            src += r->str_len[i];
+            dst += r->str_len[i];
+        }
+
+        if (!(flags & METADATA_EXCLUDE_ID3_PATH))
+            strlcpy(id3->path, path, sizeof(id3->path));
+        found = true;
+    }
+
+    mutex_unlock(&mdc.mutex);
+    return found;
+}
+
+bool get_metadata_cached(struct mp3entry *id3, int fd, const char *path,
+                         int flags)
+{
+    bool close_fd = false;
+    bool success;
+    off_t size;
+
+    if (fd < 0)
+    {
+        fd = open(path, O_RDONLY);
+        if (fd < 0)
+            return get_metadata_ex(id3, -1, path, flags); /* let it fail */
+        close_fd = true;
+    }
+    else
+        close_fd = (flags & METADATA_CLOSE_FD_ON_EXIT);
+
+    size = filesize(fd);
+    success = metadata_cache_get(id3, path, size, flags);
+    if (!success)
+    {
+        success = get_metadata_ex(id3, fd, path,
+                                  flags & ~METADATA_CLOSE_FD_ON_EXIT);
+        if (success)
+            metadata_cache_add(id3, path, size);
+    }
+
+    if (close_fd)
+        close(fd);
+    return success;
+}
+
+/* anything may have changed while the host had the disk */
+static void usb_inserted_handler(unsigned short id, void *data)
+{
+    (void)id;
+    (void)data;
+    metadata_cache_flush();
+}
+
+void metadata_cache_init(void)
+{
+    mutex_init(&mdc.mutex);
+    mdc.handle = core_alloc(METADATA_CACHE_SIZE);
+    if (mdc.handle <= 0)
+    {
+        logf("metadata cache: no memory");
+        return;
+    }
+    mdc.gen_size = ALIGN_DOWN(METADATA_CACHE_SIZE / 2, sizeof(uint32_t));
+    add_event(SYS_EVENT_USB_INSERTED, usb_inserted_handler);
+}
@@ -0,0 +1,53 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef _METADATA_CACHE_H_
+#define _METADATA_CACHE_H_
+
+#include <stdbool.h>
+#include <sys/types.h>
+#include "config.h"
+#include "metadata.h"
+
+/* RAM cache of parsed track metadata for the UI.
+ *
+ * Entries hold the tag strings and the numeric fields of an mp3entry, but
+ * not the parser's scratch buffers, which some codecs use for private setup
+ * data. Cached entries are therefore fine for displaying a track, but
+ * playback must still parse the file itself. */
+
+void metadata_cache_init(void) INIT_ATTR;
+void metadata_cache_flush(void);
+
+/* Store freshly parsed metadata for path; filesize is the size of the file
+   it was parsed from */
+void metadata_cache_add(const struct mp3entry *id3, const char *path,
+                        off_t filesize);
+
+/* Fill id3 from the cache. filesize must match the cached entry, so a file
+   replaced in place isn't answered with its old tags. flags are the
+   METADATA_* flags of get_metadata_ex(). */
+bool metadata_cache_get(struct mp3entry *id3, const char *path,
+                        off_t filesize, int flags);
+
+/* get_metadata_ex() that answers from the cache when the file is unchanged,
+   and adds what it parses */
+bool get_metadata_cached(struct mp3entry *id3, int fd, const char *path,
+                         int flags);
+
+#endif /* _METADATA_CACHE_H_ */
@@ -40,6 +40,7 @@
 #include "settings.h"
 #include "audio.h"
 #include "voice_thread.h"
+#include "trace.h"
 
 /* 2 channels * 2 bytes/sample, interleaved */
 #define PCMBUF_SAMPLE_SIZE   (2 * 2)
@@ -333,6 +334,8 @@ static void commit_chunks(size_t threshold)
     size_t index = chunk_widx;
     size_t end_index = index + pcmbuf_bytes_waiting;
 
+    TRACE_EVENT(PCMBUF_COMMIT, pcmbuf_bytes_waiting);
+
     /* Copy to the beginning of the buffer all data that must wrap */
     if (end_index > pcmbuf_size)
         memcpy(pcmbuf_buffer, pcmbuf_guardbuf, end_index - pcmbuf_size);
@@ -825,6 +828,11 @@ static void pcmbuf_pcm_callback(const void **start, size_t *size)
                                            desc->pos_key);
         }
     }
+    else if (!fade_out_complete)
+    {
+        /* ran dry, or at the end of playback */
+        TRACE_EVENT(PCMBUF_UNDERRUN, 0);
+    }
 }
 
 /* Force playback */
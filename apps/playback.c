@@ -33,6 +33,7 @@
 #include "metadata.h"
 #include "cuesheet.h"
 #include "buffering.h"
+#include "metadata_cache.h"
 #include "talk.h"
 #include "playlist.h"
 #include "abrepeat.h"
@@ -1625,6 +1626,14 @@ static bool audio_get_track_metadata(int offset, struct mp3entry *id3)
         /* Try to get it from the database */
         if (!tagcache_fill_tags(id3, path))
 #endif
+        /* or from what the UI or buffering parsed earlier, if the file
+           wasn't replaced since */
+        int fd = open(path, O_RDONLY);
+        off_t size = fd >= 0 ? filesize(fd) : -1;
+        if (fd >= 0)
+            close(fd);
+
+        if (size < 0 || !metadata_cache_get(id3, path, size, 0))
         {
             /* By now, filename is the only source of info */
             fill_metadata_from_path(id3, path);
@@ -3173,6 +3182,8 @@ static void audio_stop_playback(void)
     wipe_track_metadata(true);
 #ifdef HAVE_ALBUMART
     clear_last_folder_album_art();
+    /* files may be added or removed before playback is started again */
+    albumart_lookup_flush();
 #endif
     /* Go idle */
     filling = STATE_IDLE;
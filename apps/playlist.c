@@ -51,15 +51,28 @@
               they are not saved to disk as part of the playlist.
         c. Delete track (D:<position>)
             - Delete track from specified position in the current playlist.
-        d. Shuffle playlist (S:<seed>:<index>)
+        d. Shuffle playlist (S:<seed>:<index>[:<method>])
             - Shuffle entire playlist with specified seed.  The index
               identifies the first index in the newly shuffled playlist
-              (needed for repeat mode).
+              (needed for repeat mode).  Method 1 is the keyed permutation
+              of pl_index_shuffle(), without a method the playlist was
+              shuffled with rand() by older versions.
         e. Unshuffle playlist (U:<index>)
             - Unshuffle entire playlist.  The index identifies the first index
               in the newly unshuffled playlist.
         f. Reset last insert position (R)
             - Needed so that insertions work properly after resume
+        g. Set/clear flags (F:<flags to set>:<flags to clear>)
+            - Update the playlist flags, e.g. the modified flag.
+        h. Snapshot (B:<serial>)
+            - Only allowed before the P command.  The indices and state of
+              the playlist are loaded from the snapshot file with the same
+              serial instead of scanning the playlist file and replaying the
+              commands the control file was compacted from.  The paths of the
+              inserted tracks follow the P command on comment lines.  If the
+              snapshot is missing or doesn't match the playlist file, the
+              playlist file is scanned and those tracks are added at the end
+              instead, so the tracks survive even though their order doesn't.
 
   Resume:
       The only resume info that needs to be saved is the current index in the
@@ -68,6 +81,10 @@
       exactly the same as before shutdown.  To avoid unnecessary disk
       accesses, the shuffle mode settings are also saved in settings and only
       flushed to disk when required.
+
+      To keep resume quick, the control file is compacted at shutdown (and
+      after a slow resume) into a snapshot and a short B header, so only the
+      commands logged since then have to be replayed.
  */
 
 // #define LOGF_ENABLE
@@ -76,6 +93,7 @@
 #include <ctype.h>
 #include "string-extra.h"
 #include "playlist.h"
+#include "playlist_paths.h"
 #include "ata_idle_notify.h"
 #include "file.h"
 #include "action.h"
@@ -128,6 +146,22 @@
 /* default load buffer size (should be at least 1 KiB) */
 #define PLAYLIST_LOAD_BUFLEN    (32*1024)
 
+/* index entries reserved at boot, beyond that the index grows on demand */
+#define PLAYLIST_RESERVED_SIZE  32000
+
+/* bytes reserved at boot for the paths of the current playlist */
+#if MEMORYSIZE <= 8
+#define PLAYLIST_PATHS_RESERVED_SIZE    (32 << 10)
+#elif MEMORYSIZE <= 32
+#define PLAYLIST_PATHS_RESERVED_SIZE    (128 << 10)
+#else
+#define PLAYLIST_PATHS_RESERVED_SIZE    (512 << 10)
+#endif
+
+/* control file lines of bulk inserts are written out in pieces of this size,
+   small enough to be kept around for good */
+#define PLAYLIST_BATCH_BUFLEN   (4*1024)
+
 /*
  * Minimum supported version and current version of the control file.
  * Any versions outside of this range will be rejected by the loader.
@@ -146,6 +180,9 @@
 
 #define PLAYLIST_COMMAND_SIZE (MAX_PATH+12)
 
+/* method of the shuffles logged to the control file, see S below */
+#define PLAYLIST_SHUFFLE_METHOD 1
+
 /*
     Each playlist index has a flag associated with it which identifies what
     type of track it is.  These flags are stored in the 4 high order bits of
@@ -175,8 +212,53 @@
 #define PLAYLIST_QUEUED                 0x20000000
 #define PLAYLIST_SKIPPED                0x10000000
 
+/* the index entry of track i, an lvalue */
+#define PL_INDEX(playlist, i)   (*pl_index_get(&(playlist)->indices, (i)))
+
 static struct playlist_info current_playlist;
 static struct playlist_info on_disk_playlist;
+/* the current playlist wasn't shuffled since it was last sorted or loaded,
+   like the "sorted" state of playlist_resume() replaying its commands */
+static bool current_sorted = true;
+/* the on-disk playlist owns the current playlist's index block */
+static bool index_borrowed;
+
+/* size of the current control file after its last compaction */
+static off_t control_base_size;
+
+/* The control file lines of tracks that an insert context adds are collected
+   here and written together, instead of with two small writes per track.
+   Everything else that writes or reads the control file flushes them first. */
+static struct
+{
+    struct playlist_info *playlist; /* owner, NULL if not batching */
+    size_t used;
+    off_t base;                     /* control file offset of the buffer */
+    char buf[PLAYLIST_BATCH_BUFLEN];
+} control_batch;
+
+/* Copy of the track paths of the current playlist, so that they needn't be
+   read from disk again when there is no dircache to find them. The paths of
+   inserted tracks are kept after those of the playlist file. */
+static struct pl_paths track_paths;
+#define PATH_KEY_CONTROL    0x80000000
+
+static inline unsigned long path_key(unsigned long entry)
+{
+    unsigned long seek = entry & PLAYLIST_SEEK_MASK;
+    return (entry & PLAYLIST_INSERT_TYPE_MASK) ? seek | PATH_KEY_CONTROL : seek;
+}
+
+static bool keep_track_paths(const struct playlist_info *playlist)
+{
+    if (playlist != &current_playlist)
+        return false;
+#ifdef HAVE_DIRCACHE
+    if (global_settings.dircache)
+        return false; /* the references are cheaper */
+#endif
+    return true;
+}
 
 /* REPEAT_ONE support function from playback.c */
 extern bool audio_pending_track_skip_is_manual(void);
@@ -186,22 +268,12 @@ static inline bool is_manual_skip(void)
 }
 
 /* Directory Cache*/
-static void dc_init_filerefs(struct playlist_info *playlist,
-                             int start, int count)
+static void dc_init_filerefs(struct playlist_info *playlist)
 {
 #ifdef HAVE_DIRCACHE
-    if (!playlist->dcfrefs_handle)
-        return;
-
-    struct dircache_fileref *dcfrefs = core_get_data(playlist->dcfrefs_handle);
-    int end = start + count;
-
-    for (int i = start; i < end; i++)
-        dircache_fileref_init(&dcfrefs[i]);
+    pl_index_init_refs(&playlist->indices);
 #else
     (void)playlist;
-    (void)start;
-    (void)count;
 #endif
 }
 
@@ -303,12 +375,37 @@ static void pl_close_playlist(struct playlist_info *playlist)
     pl_close_fd(&playlist->fd);
 }
 
+/*
+ * Write out the batched control file lines of the playlist, if there are any.
+ * Not thread-safe.
+ */
+static int flush_control_batch(struct playlist_info *playlist)
+{
+    ssize_t len = control_batch.used;
+
+    if (control_batch.playlist != playlist || len == 0)
+        return 0;
+
+    control_batch.used = 0;
+    if (playlist->control_fd < 0 ||
+        lseek(playlist->control_fd, control_batch.base, SEEK_SET) !=
+            control_batch.base ||
+        write(playlist->control_fd, control_batch.buf, len) != len)
+    {
+        ERRORF("%s: lost %ld bytes", __func__, (long)len);
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * Close any open playlist control file descriptor.
  * Not thread-safe.
  */
 static void pl_close_control(struct playlist_info *playlist)
 {
+    flush_control_batch(playlist);
     pl_close_fd(&playlist->control_fd);
 }
 
@@ -370,6 +467,11 @@ static void create_control_unlocked(struct playlist_info* playlist)
                                 O_CREAT|O_RDWR|O_TRUNC, 0666);
 
     playlist->control_created = (playlist->control_fd >= 0);
+    if (playlist == &current_playlist)
+    {
+        control_base_size = 0;
+        pl_paths_truncate(&track_paths, PATH_KEY_CONTROL);
+    }
 
     if (!playlist->control_created)
     {
@@ -396,10 +498,41 @@ static int rotate_index(const struct playlist_info* playlist, int index)
 
 static void sync_control_unlocked(struct playlist_info* playlist)
 {
+    flush_control_batch(playlist);
     if (playlist->control_fd >= 0)
         fsync(playlist->control_fd);
 }
 
+/*
+ * Add an A or Q line to the control file batch, flushing it if it is full
+ */
+static int batch_control_unlocked(struct playlist_info* playlist,
+                                  enum playlist_command command, int i1, int i2,
+                                  const char* s1, int *seekpos)
+{
+    char head[32];
+    int head_len = snprintf(head, sizeof(head), "%c:%d:%d:",
+                            command == PLAYLIST_COMMAND_ADD ? 'A' : 'Q',
+                            i1, i2);
+    size_t len = head_len + strlen(s1) + 1;
+
+    if (control_batch.used + len > PLAYLIST_BATCH_BUFLEN &&
+        flush_control_batch(playlist) < 0)
+        return -1;
+
+    if (control_batch.used == 0)
+        control_batch.base = lseek(playlist->control_fd, 0, SEEK_END);
+
+    char *p = control_batch.buf + control_batch.used;
+    memcpy(p, head, head_len);
+    memcpy(p + head_len, s1, len - head_len - 1);
+    p[len - 1] = '\n';
+
+    *seekpos = control_batch.base + control_batch.used + head_len;
+    control_batch.used += len;
+    return len;
+}
+
 static int update_control_unlocked(struct playlist_info* playlist,
                                    enum playlist_command command, int i1, int i2,
                                    const char* s1, const char* s2, int *seekpos)
@@ -407,6 +540,16 @@ static int update_control_unlocked(struct playlist_info* playlist,
     int fd = playlist->control_fd;
     int result;
 
+    if (control_batch.playlist == playlist)
+    {
+        if (command == PLAYLIST_COMMAND_ADD || command == PLAYLIST_COMMAND_QUEUE)
+            return batch_control_unlocked(playlist, command, i1, i2, s1, seekpos);
+
+        /* keep the order of the lines */
+        if (flush_control_batch(playlist) < 0)
+            return -1;
+    }
+
     lseek(fd, 0, SEEK_END);
 
     switch (command)
@@ -428,7 +571,7 @@ static int update_control_unlocked(struct playlist_info* playlist,
         result = fdprintf(fd, "D:%d\n", i1);
         break;
     case PLAYLIST_COMMAND_SHUFFLE:
-        result = fdprintf(fd, "S:%d:%d\n", i1, i2);
+        result = fdprintf(fd, "S:%d:%d:%d\n", i1, i2, PLAYLIST_SHUFFLE_METHOD);
         break;
     case PLAYLIST_COMMAND_UNSHUFFLE:
         result = fdprintf(fd, "U:%d\n", i1);
@@ -482,6 +625,8 @@ static void empty_playlist_unlocked(struct playlist_info* playlist, bool resume)
     playlist->filename[0] = '\0';
 
     playlist->seed = 0;
+    if (playlist == &current_playlist)
+        current_sorted = true;
 
     playlist->utf8 = true;
     playlist->control_created = false;
@@ -491,6 +636,9 @@ static void empty_playlist_unlocked(struct playlist_info* playlist, bool resume)
     playlist->first_index = 0;
     playlist->amount = 0;
     playlist->last_insert_pos = -1;
+    pl_index_clear(&playlist->indices);
+    if (playlist == &current_playlist)
+        pl_paths_clear(&track_paths);
 
     playlist->started = false;
 
@@ -698,6 +846,21 @@ static void display_playlist_count(int count, const unsigned char *fmt,
     splashf(0, P2STR(fmt), count, str(LANG_OFF_ABORT)); /* (voiced above) */
 }
 
+/*
+ * Keep the track path of the playlist file line at seek in memory
+ */
+static void add_playlist_path(struct playlist_info* playlist,
+                              unsigned long seek, char *line, int len)
+{
+    char temp[MAX_PATH+1];
+
+    line[len] = '\0';
+    if (!playlist->utf8)
+        convert_m3u_name(line, len, MAX_PATH+1, temp);
+
+    pl_paths_add(&track_paths, path_key(seek), line);
+}
+
 /*
  * calculate track offsets within a playlist file
  */
@@ -709,6 +872,11 @@ static int add_indices_to_playlist(struct playlist_info* playlist,
     bool store_index;
     unsigned char *p;
     int result = 0;
+    /* the track path being read when keeping them, -1 if there is none */
+    bool keep_paths = keep_track_paths(playlist);
+    int line_len = -1;
+    unsigned long line_seek = 0;
+    char line[MAX_PATH+1];
     /* get emergency buffer so we don't fail horribly */
     if (!buflen)
         buffer = alloca((buflen = 64));
@@ -744,6 +912,10 @@ static int add_indices_to_playlist(struct playlist_info* playlist,
             if((*p == '\n') || (*p == '\r'))
             {
                 store_index = true;
+
+                if (line_len >= 0)
+                    add_playlist_path(playlist, line_seek, line, line_len);
+                line_len = -1;
             }
             else if(store_index)
             {
@@ -751,23 +923,41 @@ static int add_indices_to_playlist(struct playlist_info* playlist,
 
                 if(*p != '#')
                 {
-                    if ( playlist->amount >= playlist->max_playlist_size ) {
+                    /* Store a new entry */
+                    if ( playlist->amount >= playlist->max_playlist_size ||
+                         !pl_index_insert(&playlist->indices,
+                                          playlist->amount, i+count) ) {
                         notify_buffer_full();
                         result = -1;
                         goto exit;
                     }
 
-                    /* Store a new entry */
-                    playlist->indices[ playlist->amount ] = i+count;
-                    dc_init_filerefs(playlist, playlist->amount, 1);
                     playlist->amount++;
+
+                    if (keep_paths)
+                    {
+                        line_seek = i+count;
+                        line_len = 0;
+                    }
                 }
             }
+
+            if (line_len >= 0 && *p != '\n' && *p != '\r')
+            {
+                if (line_len < MAX_PATH)
+                    line[line_len++] = *p;
+                else
+                    line_len = -1; /* too long, leave it on disk */
+            }
         }
 
         i+= count;
     }
 
+    /* the last line may not end in a new line */
+    if (line_len >= 0)
+        add_playlist_path(playlist, line_seek, line, line_len);
+
 exit:
     playlist_write_unlock(playlist);
     return result;
@@ -1059,25 +1249,34 @@ static int get_track_filename(struct playlist_info* playlist, int index,
 
     playlist_write_lock(playlist);
 
-    bool control_file = playlist->indices[index] & PLAYLIST_INSERT_TYPE_MASK;
-    unsigned long seek = playlist->indices[index] & PLAYLIST_SEEK_MASK;
+    bool control_file = PL_INDEX(playlist, index) & PLAYLIST_INSERT_TYPE_MASK;
+    unsigned long seek = PL_INDEX(playlist, index) & PLAYLIST_SEEK_MASK;
 
 #ifdef HAVE_DIRCACHE
-    if (playlist->dcfrefs_handle)
+    if (playlist->indices.refs)
     {
-        struct dircache_fileref *dcfrefs = core_get_data_pinned(playlist->dcfrefs_handle);
-        max = dircache_get_fileref_path(&dcfrefs[index],
-                                        tmp_buf, sizeof(tmp_buf));
+        /* copy it, the index may move while the dircache is busy */
+        struct dircache_fileref dcfref =
+            *pl_index_ref(&playlist->indices, index);
+        max = dircache_get_fileref_path(&dcfref, tmp_buf, sizeof(tmp_buf));
 
-        NOTEF("%s [in DCache]: 0x%x %s", __func__, dcfrefs[index], tmp_buf);
-        core_put_data_pinned(dcfrefs);
+        NOTEF("%s [in DCache]: 0x%x %s", __func__, dcfref, tmp_buf);
     }
 #endif /* HAVE_DIRCACHE */
 
+    if (max < 0 && playlist == &current_playlist)
+    {
+        max = pl_paths_get(&track_paths, path_key(PL_INDEX(playlist, index)),
+                           tmp_buf, sizeof(tmp_buf));
+
+        NOTEF("%s [in RAM]: 0x%x %s", __func__, seek, max < 0 ? "" : tmp_buf);
+    }
+
     if (max < 0)
     {
         if (control_file)
         {
+            flush_control_batch(playlist);
             fd = playlist->control_fd;
             utf8 = true;
         }
@@ -1201,21 +1400,24 @@ static int remove_all_tracks_unlocked(struct playlist_info *playlist)
     sync_control_unlocked(playlist);
 
     /* Move current track down to position 0 */
-    playlist->indices[0] = playlist->indices[playlist->index];
+    unsigned long current = PL_INDEX(playlist, playlist->index);
 #ifdef HAVE_DIRCACHE
-    if (playlist->dcfrefs_handle)
-    {
-        struct dircache_fileref *dcfrefs =
-            core_get_data(playlist->dcfrefs_handle);
-        dcfrefs[0] = dcfrefs[playlist->index];
-    }
+    struct dircache_fileref dcfref;
+    if (playlist->indices.refs)
+        dcfref = *pl_index_ref(&playlist->indices, playlist->index);
+#endif
+    pl_index_clear(&playlist->indices);
+    pl_index_insert(&playlist->indices, 0, current);
+#ifdef HAVE_DIRCACHE
+    if (playlist->indices.refs)
+        *pl_index_ref(&playlist->indices, 0) = dcfref;
 #endif
 
     /* Update playlist state as if by remove_track_unlocked() */
     playlist->first_index = 0;
     playlist->index = 0;
     playlist->amount = 1;
-    playlist->indices[0] |= PLAYLIST_QUEUED;
+    PL_INDEX(playlist, 0) |= PLAYLIST_QUEUED;
     playlist->flags = 0; /* Reset dirplay and modified flags */
 
     if (playlist->last_insert_pos == 0)
@@ -1227,8 +1429,10 @@ static int remove_all_tracks_unlocked(struct playlist_info *playlist)
         return 0;
 
     /* Update seek offset so it points into the new control file. */
-    playlist->indices[0] &= ~PLAYLIST_INSERT_TYPE_MASK & ~PLAYLIST_SEEK_MASK;
-    playlist->indices[0] |= PLAYLIST_INSERT_TYPE_INSERT | seek_pos;
+    PL_INDEX(playlist, 0) &= ~PLAYLIST_INSERT_TYPE_MASK & ~PLAYLIST_SEEK_MASK;
+    PL_INDEX(playlist, 0) |= PLAYLIST_INSERT_TYPE_INSERT | seek_pos;
+    if (keep_track_paths(playlist))
+        pl_paths_add(&track_paths, path_key(PL_INDEX(playlist, 0)), filename);
 
     /* Cut connection to playlist file */
     update_playlist_filename_unlocked(playlist, "", "");
@@ -1261,7 +1465,6 @@ static int add_track_to_playlist_unlocked(struct playlist_info* playlist,
 {
     int insert_position, orig_position;
     unsigned long flags = PLAYLIST_INSERT_TYPE_INSERT;
-    int i;
 
     insert_position = orig_position = position;
 
@@ -1281,7 +1484,7 @@ static int add_track_to_playlist_unlocked(struct playlist_info* playlist,
                insertion list else add after current playing track */
             if (playlist->last_insert_pos >= 0 &&
                 playlist->last_insert_pos < playlist->amount &&
-                (playlist->indices[playlist->last_insert_pos]&
+                (PL_INDEX(playlist, playlist->last_insert_pos)&
                     PLAYLIST_INSERT_TYPE_MASK) == PLAYLIST_INSERT_TYPE_INSERT)
                 position = insert_position = playlist->last_insert_pos+1;
             else if (playlist->amount > 0)
@@ -1356,20 +1559,11 @@ static int add_track_to_playlist_unlocked(struct playlist_info* playlist,
     if (queue)
         flags |= PLAYLIST_QUEUED;
 
-#ifdef HAVE_DIRCACHE
-    struct dircache_fileref *dcfrefs = NULL;
-    if (playlist->dcfrefs_handle)
-        dcfrefs = core_get_data(playlist->dcfrefs_handle);
-#else
-    int *dcfrefs = NULL;
-#endif
-
-    /* shift indices so that track can be added */
-    for (i=playlist->amount; i>insert_position; i--)
+    /* make room for the track, its seek position is filled in below */
+    if (!pl_index_insert(&playlist->indices, insert_position, flags))
     {
-        playlist->indices[i] = playlist->indices[i-1];
-        if (dcfrefs)
-            dcfrefs[i] = dcfrefs[i-1];
+        notify_buffer_full();
+        return -1;
     }
 
     /* update stored indices if needed */
@@ -1417,11 +1611,15 @@ static int add_track_to_playlist_unlocked(struct playlist_info* playlist,
             playlist->last_insert_pos, filename, NULL, &seek_pos);
 
         if (result < 0)
+        {
+            pl_index_remove(&playlist->indices, insert_position);
             return result;
+        }
     }
 
-    playlist->indices[insert_position] = flags | seek_pos;
-    dc_init_filerefs(playlist, insert_position, 1);
+    PL_INDEX(playlist, insert_position) = flags | seek_pos;
+    if (keep_track_paths(playlist))
+        pl_paths_add(&track_paths, path_key(flags | seek_pos), filename);
 
     playlist->amount++;
 
@@ -1443,28 +1641,12 @@ static int directory_search_callback(char* filename, void* context)
 static int remove_track_unlocked(struct playlist_info* playlist,
                                  int position, bool write)
 {
-    int i;
     int result = 0;
 
     if (playlist->amount <= 0)
         return -1;
 
-#ifdef HAVE_DIRCACHE
-    struct dircache_fileref *dcfrefs = NULL;
-    if (playlist->dcfrefs_handle)
-        dcfrefs = core_get_data(playlist->dcfrefs_handle);
-#else
-    int *dcfrefs = NULL;
-#endif
-
-    /* shift indices now that track has been removed */
-    for (i=position; i<playlist->amount; i++)
-    {
-        playlist->indices[i] = playlist->indices[i+1];
-        if (dcfrefs)
-            dcfrefs[i] = dcfrefs[i+1];
-    }
-
+    pl_index_remove(&playlist->indices, position);
     playlist->amount--;
 
     /* update stored indices if needed */
@@ -1497,35 +1679,33 @@ static int remove_track_unlocked(struct playlist_info* playlist,
 static void find_and_set_playlist_index_unlocked(struct playlist_info* playlist,
                                                  unsigned long seek)
 {
-    int i;
-
     /* Set the index to the current song */
-    for (i=0; i<playlist->amount; i++)
-    {
-        if (playlist->indices[i] == seek)
-        {
-            playlist->index = playlist->first_index = i;
-
-            break;
-        }
-    }
+    int i = pl_index_find(&playlist->indices, seek);
+    if (i >= 0)
+        playlist->index = playlist->first_index = i;
 }
 
 /*
- * randomly rearrange the array of indices for the playlist.  If start_current
- * is true then update the index to the new index of the current playing track
+ * rearrange the indices the way older versions shuffled, for control files
+ * that they wrote
  */
-static int randomise_playlist_unlocked(struct playlist_info* playlist,
-                                       unsigned int seed, bool start_current,
-                                       bool write)
+static void randomise_indices_compat(struct playlist_info* playlist,
+                                     unsigned int seed)
 {
     int count;
     int candidate;
-    unsigned long current = playlist->indices[playlist->index];
+    unsigned long *indices;
+#ifdef HAVE_DIRCACHE
+    struct dircache_fileref *dcfrefs;
+#endif
 
-    /* seed 0 is used to identify sorted playlist for resume purposes */
-    if (seed == 0)
-        seed = 1;
+    if (playlist->amount <= 0)
+        return;
+
+    indices = pl_index_flatten(&playlist->indices);
+#ifdef HAVE_DIRCACHE
+    dcfrefs = pl_index_ref(&playlist->indices, 0);
+#endif
 
     /* seed with the given seed */
     srand(seed);
@@ -1537,19 +1717,41 @@ static int randomise_playlist_unlocked(struct playlist_info* playlist,
         candidate = rand() % (count + 1);
 
         /* now swap the values at the 'count' and 'candidate' positions */
-        unsigned long indextmp = playlist->indices[candidate];
-        playlist->indices[candidate] = playlist->indices[count];
-        playlist->indices[count] = indextmp;
+        unsigned long indextmp = indices[candidate];
+        indices[candidate] = indices[count];
+        indices[count] = indextmp;
 #ifdef HAVE_DIRCACHE
-        if (playlist->dcfrefs_handle)
+        if (dcfrefs)
         {
-            struct dircache_fileref *dcfrefs = core_get_data(playlist->dcfrefs_handle);
             struct dircache_fileref dcftmp = dcfrefs[candidate];
             dcfrefs[candidate] = dcfrefs[count];
             dcfrefs[count] = dcftmp;
         }
 #endif
     }
+}
+
+/*
+ * randomly rearrange the array of indices for the playlist.  If start_current
+ * is true then update the index to the new index of the current playing track
+ *
+ * The indices aren't moved until the order changes in some other way, the
+ * shuffle is only applied when they are looked up.
+ */
+static int randomise_playlist_unlocked(struct playlist_info* playlist,
+                                       unsigned int seed, bool start_current,
+                                       bool write)
+{
+    unsigned long current = 0;
+
+    if (playlist->amount > 0)
+        current = PL_INDEX(playlist, playlist->index);
+
+    /* seed 0 is used to identify sorted playlist for resume purposes */
+    if (seed == 0)
+        seed = 1;
+
+    pl_index_shuffle(&playlist->indices, seed);
 
     if (start_current)
         find_and_set_playlist_index_unlocked(playlist, current);
@@ -1558,6 +1760,8 @@ static int randomise_playlist_unlocked(struct playlist_info* playlist,
     playlist->last_insert_pos = -1;
 
     playlist->seed = seed;
+    if (playlist == &current_playlist)
+        current_sorted = false;
 
     if (write)
     {
@@ -1603,17 +1807,22 @@ static int sort_compare_fn(const void* p1, const void* p2)
 static int sort_playlist_unlocked(struct playlist_info* playlist,
                                   bool start_current, bool write)
 {
-    unsigned long current = playlist->indices[playlist->index];
+    unsigned long current = 0;
 
     if (playlist->amount > 0)
-        qsort((void*)playlist->indices, playlist->amount,
-            sizeof(playlist->indices[0]), sort_compare_fn);
+    {
+        current = PL_INDEX(playlist, playlist->index);
+        /* the result doesn't depend on the order, so skip shuffling */
+        pl_index_drop_shuffle(&playlist->indices);
+        qsort((void*)pl_index_flatten(&playlist->indices), playlist->amount,
+            sizeof(unsigned long), sort_compare_fn);
+    }
 
 #ifdef HAVE_DIRCACHE
     /** We need to re-check the song names from disk because qsort can't
      * sort two arrays at once :/
      * FIXME: Please implement a better way to do this. */
-    dc_init_filerefs(playlist, 0, playlist->max_playlist_size);
+    dc_init_filerefs(playlist);
 #endif
 
     if (start_current)
@@ -1622,6 +1831,9 @@ static int sort_playlist_unlocked(struct playlist_info* playlist,
     /* indices have been moved so last insert position is no longer valid */
     playlist->last_insert_pos = -1;
 
+    if (playlist == &current_playlist)
+        current_sorted = true;
+
     if (write && playlist->control_fd >= 0)
     {
         playlist->first_index = 0;
@@ -1662,7 +1874,7 @@ static int calculate_step_count(const struct playlist_info *playlist, int steps)
             index -= playlist->amount;
 
         /* Check if we found a bad entry. */
-        if (playlist->indices[index] & PLAYLIST_SKIPPED)
+        if (PL_INDEX(playlist, index) & PLAYLIST_SKIPPED)
         {
             steps += direction;
             /* Are all entries bad? */
@@ -1742,7 +1954,7 @@ static int get_next_index(const struct playlist_info* playlist, int steps,
                 /* second time around so skip the queued files */
                 for (i=0; i<playlist->amount; i++)
                 {
-                    if (playlist->indices[index] & PLAYLIST_QUEUED)
+                    if (PL_INDEX(playlist, index) & PLAYLIST_QUEUED)
                         index = (index+1) % playlist->amount;
                     else
                     {
@@ -1757,7 +1969,7 @@ static int get_next_index(const struct playlist_info* playlist, int steps,
 
     /* No luck if the whole playlist was bad. */
     if (next_index < 0 || next_index >= playlist->amount ||
-        playlist->indices[next_index] & PLAYLIST_SKIPPED)
+        PL_INDEX(playlist, next_index) & PLAYLIST_SKIPPED)
         return -1;
 
     return next_index;
@@ -1774,7 +1986,6 @@ static void dc_thread_playlist(void)
     static char tmp[MAX_PATH+1];
 
     struct playlist_info *playlist = &current_playlist;
-    struct dircache_fileref *dcfrefs;
     int index;
 
     /* Thread starts out stopped */
@@ -1815,7 +2026,7 @@ static void dc_thread_playlist(void)
             case SYS_TIMEOUT:
             {
                 /* Nothing to do if there are no dcfrefs or tracks */
-                if (!playlist->dcfrefs_handle || playlist->amount <= 0)
+                if (!playlist->indices.refs || playlist->amount <= 0)
                 {
                     is_dirty = false;
                     sleep_time = TIMEOUT_BLOCK;
@@ -1838,12 +2049,16 @@ static void dc_thread_playlist(void)
 #endif
 
                 trigger_cpu_boost();
-                dcfrefs = core_get_data_pinned(playlist->dcfrefs_handle);
+                /* the references must stay put while the disk is accessed */
+                core_pin(playlist->indices.handle);
 
                 for (index = 0; index < playlist->amount; index++)
                 {
+                    struct dircache_fileref *dcfref =
+                        pl_index_ref(&playlist->indices, index);
+
                     /* Process only pointers that are superficially stale. */
-                    if (dircache_search(DCS_FILEREF, &dcfrefs[index], NULL) > 0)
+                    if (dircache_search(DCS_FILEREF, dcfref, NULL) > 0)
                         continue;
 
                     /* Bail out if a command needs servicing. */
@@ -1859,7 +2074,7 @@ static void dc_thread_playlist(void)
 
                     /* Obtain the dircache file entry cookie. */
                     dircache_search(DCS_CACHED_PATH | DCS_UPDATE_FILEREF,
-                                    &dcfrefs[index], tmp);
+                                    dcfref, tmp);
 
                     /* And be on background so user doesn't notice any delays. */
                     yield();
@@ -1874,7 +2089,7 @@ static void dc_thread_playlist(void)
                     logf("%s: scan complete", __func__);
                 }
 
-                core_put_data_pinned(dcfrefs);
+                core_unpin(playlist->indices.handle);
                 cancel_cpu_boost();
 
                 logf("%s: %ld ticks", __func__, current_tick - scan_start_tick);
@@ -1914,9 +2129,11 @@ static int alloc_tempbuf(size_t* buflen)
 static int move_callback(int handle, void* current, void* new)
 {
     (void)handle;
-    struct playlist_info* playlist = &current_playlist;
-    if (current == playlist->indices)
-        playlist->indices = new;
+    /* the on-disk playlist may have borrowed the block */
+    if (current == current_playlist.indices.base)
+        current_playlist.indices.base = new;
+    if (current == on_disk_playlist.indices.base)
+        on_disk_playlist.indices.base = new;
     return BUFLIB_CB_OK;
 }
 
@@ -1926,6 +2143,371 @@ static struct buflib_callbacks ops = {
     .shrink_callback = NULL,
 };
 
+/* Give the index block that playlist_load() borrowed back to the current
+   playlist, emptied unless it is to become the current playlist's */
+static void return_borrowed_index(bool keep)
+{
+    if (!index_borrowed)
+        return;
+
+    current_playlist.indices = on_disk_playlist.indices;
+    if (!keep)
+        pl_index_clear(&current_playlist.indices);
+
+    pl_index_init_buffer(&on_disk_playlist.indices, NULL, 0, false);
+    index_borrowed = false;
+}
+
+static int pl_get_tempname(const char *filename, char *buf, size_t bufsz)
+{
+    if (strlcpy(buf, filename, bufsz) >= bufsz)
+        return -1;
+
+    if (strlcat(buf, "_temp", bufsz) >= bufsz)
+        return -1;
+
+    return 0;
+}
+
+/*
+ * Control file snapshots
+ *
+ * Replaying a long control file on resume is slow, so every now and then the
+ * state of the current playlist is written to a snapshot file and the control
+ * file is compacted to a B command naming the snapshot, the original P command
+ * and the paths of the inserted tracks on comment lines. Resume then loads
+ * the indices from the snapshot and only replays what was logged afterwards.
+ */
+#define PLAYLIST_SNAPSHOT_MAGIC     0x504c534e /* "PLSN" */
+#define PLAYLIST_SNAPSHOT_VERSION   2
+
+/* compact at shutdown once this much has been logged since the last time */
+#define PLAYLIST_COMPACT_MIN        (4 << 10)
+/* and right after resuming if that had to replay more than this */
+#define PLAYLIST_COMPACT_RESUME     (32 << 10)
+
+struct playlist_snapshot
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t serial;          /* matches the B command of the control file */
+    uint32_t base_size;       /* size of the compacted control file */
+    int32_t  amount;
+    int32_t  first_index;
+    int32_t  last_insert_pos;
+    int32_t  seed;
+    uint32_t flags;
+    int32_t  sorted;          /* not shuffled since the last sort */
+    int32_t  playlist_size;   /* size of the playlist file, -1 if none */
+    /* followed by the index entries */
+};
+
+/* entries that compact_compare_fn() sorts the positions of */
+static const unsigned long *compact_entries;
+
+static int compact_compare_fn(const void *p1, const void *p2)
+{
+    unsigned long s1 = compact_entries[*(const int *)p1] & PLAYLIST_SEEK_MASK;
+    unsigned long s2 = compact_entries[*(const int *)p2] & PLAYLIST_SEEK_MASK;
+
+    return (s1 > s2) - (s1 < s2);
+}
+
+/* size of the playlist file, -1 if there is none or < -1 on error */
+static int get_playlist_size(struct playlist_info *playlist)
+{
+    if (playlist->filename[playlist->dirlen] == '\0')
+        return -1;
+
+    int fd = pl_open_playlist(playlist);
+    return fd < 0 ? -2 : filesize(fd);
+}
+
+/* exchange the seek offsets of the entries at order[] with seeks[] */
+static void swap_seeks(unsigned long *entries, const int *order, int *seeks,
+                       int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        unsigned long entry = entries[order[i]];
+        entries[order[i]] = (entry & ~PLAYLIST_SEEK_MASK) | seeks[i];
+        seeks[i] = entry & PLAYLIST_SEEK_MASK;
+    }
+}
+
+/*
+ * Snapshot the current playlist and compact its control file. buf must hold
+ * two ints per inserted track. On failure the playlist and the control file
+ * are left as they were.
+ *
+ * Returns 0 on success, < 0 on error.
+ */
+static int compact_control_unlocked(struct playlist_info *playlist,
+                                    void *buf, size_t buflen)
+{
+    struct playlist_snapshot hdr;
+    char tmpname[MAX_PATH+1];
+    char line[MAX_PATH+1];
+    unsigned long *entries;
+    int *order = buf, *seeks;
+    int fd = -1, snap_fd = -1;
+    int count = 0, i;
+    int err = 0;
+
+    if (playlist->control_fd < 0 ||
+        pl_get_tempname(playlist->control_filename, tmpname, sizeof(tmpname)))
+        return -1;
+
+    hdr.playlist_size = get_playlist_size(playlist);
+    if (hdr.playlist_size < -1)
+        return -2;
+
+    /* the entries must stay put while the disk is accessed */
+    core_pin(playlist->indices.handle);
+    entries = pl_index_flatten(&playlist->indices);
+    if (!entries)
+    {
+        err = -3;
+        goto out;
+    }
+
+    for (i = 0; i < playlist->amount; i++)
+    {
+        if (!(entries[i] & PLAYLIST_INSERT_TYPE_MASK))
+            continue;
+
+        if ((size_t)(count + 1) * 2 * sizeof(int) > buflen)
+        {
+            err = -3;
+            goto out;
+        }
+        order[count++] = i;
+    }
+    seeks = order + count;
+
+    /* Keep the inserted tracks in the order they were logged in, since that
+       is what sorting the playlist goes by */
+    compact_entries = entries;
+    qsort(order, count, sizeof(int), compact_compare_fn);
+
+    fd = open(tmpname, O_CREAT|O_RDWR|O_TRUNC, 0666);
+    if (fd < 0)
+    {
+        err = -4;
+        goto out;
+    }
+
+    hdr.serial = current_tick;
+    if (fdprintf(fd, "B:%lu\n", (unsigned long)hdr.serial) <= 0)
+    {
+        err = -5;
+        goto out;
+    }
+
+    /* copy the P command, the first line that is neither a comment nor B */
+    lseek(playlist->control_fd, 0, SEEK_SET);
+    do
+    {
+        if (read_line(playlist->control_fd, line, sizeof(line)) <= 0)
+        {
+            err = -6;
+            goto out;
+        }
+    } while (line[0] != 'P');
+
+    if (fdprintf(fd, "%s\n", line) <= 0)
+    {
+        err = -7;
+        goto out;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        lseek(playlist->control_fd, entries[order[i]] & PLAYLIST_SEEK_MASK,
+              SEEK_SET);
+        if (read_line(playlist->control_fd, line, sizeof(line)) <= 0 ||
+            write(fd, "#", 1) != 1)
+        {
+            err = -8;
+            goto out;
+        }
+
+        seeks[i] = lseek(fd, 0, SEEK_CUR);
+        if (fdprintf(fd, "%s\n", line) <= 0)
+        {
+            err = -9;
+            goto out;
+        }
+    }
+
+    hdr.base_size = lseek(fd, 0, SEEK_CUR);
+    fsync(fd);
+
+    snap_fd = open(PLAYLIST_SNAPSHOT_FILE "_temp", O_CREAT|O_WRONLY|O_TRUNC,
+                   0666);
+    if (snap_fd < 0)
+    {
+        err = -10;
+        goto out;
+    }
+
+    hdr.magic = PLAYLIST_SNAPSHOT_MAGIC;
+    hdr.version = PLAYLIST_SNAPSHOT_VERSION;
+    hdr.amount = playlist->amount;
+    hdr.first_index = playlist->first_index;
+    hdr.last_insert_pos = playlist->last_insert_pos;
+    hdr.seed = playlist->seed;
+    hdr.flags = playlist->flags;
+    hdr.sorted = current_sorted;
+
+    /* switch the entries over to the new control file, seeks keeps the old
+       offsets in case it has to be undone */
+    swap_seeks(entries, order, seeks, count);
+
+    ssize_t size = playlist->amount * sizeof(*entries);
+    if (write(snap_fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+        write(snap_fd, entries, size) != size)
+    {
+        err = -11;
+        goto undo;
+    }
+
+    fsync(snap_fd);
+    close(snap_fd);
+    snap_fd = -1;
+    close(fd);
+    fd = -1;
+
+    /* the old snapshot is kept until the old control file is replaced,
+       which may still name it */
+    remove(PLAYLIST_SNAPSHOT_FILE "_old");
+    rename(PLAYLIST_SNAPSHOT_FILE, PLAYLIST_SNAPSHOT_FILE "_old");
+    if (rename(PLAYLIST_SNAPSHOT_FILE "_temp", PLAYLIST_SNAPSHOT_FILE) < 0)
+    {
+        rename(PLAYLIST_SNAPSHOT_FILE "_old", PLAYLIST_SNAPSHOT_FILE);
+        err = -12;
+        goto undo;
+    }
+
+    pl_close_control(playlist);
+    if (rename(tmpname, playlist->control_filename) < 0)
+    {
+        remove(PLAYLIST_SNAPSHOT_FILE);
+        rename(PLAYLIST_SNAPSHOT_FILE "_old", PLAYLIST_SNAPSHOT_FILE);
+        playlist->control_fd = open(playlist->control_filename, O_RDWR);
+        playlist->control_created = (playlist->control_fd >= 0);
+        err = -13;
+        goto undo;
+    }
+    remove(PLAYLIST_SNAPSHOT_FILE "_old");
+
+    playlist->control_fd = open(playlist->control_filename, O_RDWR);
+    playlist->control_created = (playlist->control_fd >= 0);
+    control_base_size = hdr.base_size;
+    /* the inserted tracks moved */
+    pl_paths_truncate(&track_paths, PATH_KEY_CONTROL);
+
+    logf("%s: %d tracks, %d inserted, %lu bytes", __func__,
+         playlist->amount, count, (unsigned long)hdr.base_size);
+    goto out;
+
+undo:
+    swap_seeks(entries, order, seeks, count);
+out:
+    if (snap_fd >= 0)
+        close(snap_fd);
+    if (fd >= 0)
+        close(fd);
+    if (err < 0)
+    {
+        remove(PLAYLIST_SNAPSHOT_FILE "_temp");
+        remove(tmpname);
+    }
+
+    core_unpin(playlist->indices.handle);
+    return err;
+}
+
+/* compact the control file if more than limit bytes were logged since the
+   last time */
+static void compact_control_if_needed(struct playlist_info *playlist,
+                                      void *buf, size_t buflen, off_t limit)
+{
+    if (playlist != &current_playlist || playlist->control_fd < 0 ||
+        filesize(playlist->control_fd) - control_base_size <= limit)
+        return;
+
+    int err = compact_control_unlocked(playlist, buf, buflen);
+    if (err < 0)
+        logf("%s: error %d", __func__, err);
+}
+
+/*
+ * Load the indices and state of the current playlist from the snapshot that
+ * a B command named. buf is scratch space.
+ *
+ * Returns 0 on success, < 0 if the snapshot is missing or doesn't match.
+ */
+static int load_snapshot_unlocked(struct playlist_info *playlist,
+                                  unsigned long serial,
+                                  struct playlist_snapshot *hdr,
+                                  void *buf, size_t buflen)
+{
+    unsigned long *entries = buf;
+    int fd, i, count;
+    int err = 0;
+
+    fd = open(PLAYLIST_SNAPSHOT_FILE, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    if (read(fd, hdr, sizeof(*hdr)) != sizeof(*hdr) ||
+        hdr->magic != PLAYLIST_SNAPSHOT_MAGIC ||
+        hdr->version != PLAYLIST_SNAPSHOT_VERSION ||
+        hdr->serial != serial ||
+        hdr->amount < 0 || hdr->amount > playlist->max_playlist_size ||
+        filesize(fd) != (off_t)(sizeof(*hdr) +
+                                hdr->amount * sizeof(*entries)) ||
+        filesize(playlist->control_fd) < (off_t)hdr->base_size)
+    {
+        err = -2;
+        goto out;
+    }
+
+    for (i = 0; i < hdr->amount; i += count)
+    {
+        count = MIN((size_t)(hdr->amount - i), buflen / sizeof(*entries));
+        if (read(fd, entries, count * sizeof(*entries)) !=
+            (ssize_t)(count * sizeof(*entries)))
+        {
+            err = -3;
+            goto out;
+        }
+
+        for (int j = 0; j < count; j++)
+        {
+            if (!pl_index_insert(&playlist->indices, i + j, entries[j]))
+            {
+                err = -4;
+                goto out;
+            }
+        }
+    }
+
+    playlist->amount = hdr->amount;
+    playlist->first_index = hdr->first_index;
+    playlist->last_insert_pos = hdr->last_insert_pos;
+    playlist->seed = hdr->seed;
+    playlist->flags = hdr->flags;
+    current_sorted = hdr->sorted;
+
+out:
+    if (err < 0)
+        pl_index_clear(&playlist->indices);
+    close(fd);
+    return err;
+}
+
 /******************************************************************************/
 /******************************************************************************/
 /* ************************************************************************** */
@@ -1938,7 +2520,6 @@ static struct buflib_callbacks ops = {
  */
 void playlist_init(void)
 {
-    int handle;
     struct playlist_info* playlist = &current_playlist;
     mutex_init(&current_playlist.mutex);
     mutex_init(&on_disk_playlist.mutex);
@@ -1955,15 +2536,26 @@ void playlist_init(void)
     on_disk_playlist.control_fd = -1;
     playlist->max_playlist_size = global_settings.max_files_in_playlist;
 
-    handle = core_alloc_ex(playlist->max_playlist_size * sizeof(*playlist->indices), &ops);
-    playlist->indices = core_get_data(handle);
+    /* Reserve room for the usual playlist sizes now, so that playback
+       isn't disturbed by the index growing. Larger playlists grow it on
+       demand. */
+    pl_index_alloc(&playlist->indices,
+                   MIN(playlist->max_playlist_size, PLAYLIST_RESERVED_SIZE),
+#ifdef HAVE_DIRCACHE
+                   true,
+#else
+                   false,
+#endif
+                   &ops);
+#ifdef HAVE_DIRCACHE
+    if (!global_settings.dircache) /* see keep_track_paths() */
+#endif
+        pl_paths_init(&track_paths, PLAYLIST_PATHS_RESERVED_SIZE);
 
     empty_playlist_unlocked(playlist, true);
 
 #ifdef HAVE_DIRCACHE
-    playlist->dcfrefs_handle = core_alloc(
-        playlist->max_playlist_size * sizeof(struct dircache_fileref));
-    dc_init_filerefs(playlist, 0, playlist->max_playlist_size);
+    dc_init_filerefs(playlist);
 
     unsigned int playlist_thread_id =
         create_thread(dc_thread_playlist, playlist_stack, sizeof(playlist_stack),
@@ -1988,12 +2580,28 @@ void playlist_shutdown(void)
     /*if (usb_detect() == USB_INSERTED)*/
     audio_stop();
     struct playlist_info* playlist = &current_playlist;
+    dc_thread_stop(playlist);
     playlist_write_lock(playlist);
+
+    /* make the next resume quick */
+    if (playlist->control_fd >= 0)
+    {
+        size_t buflen;
+        int handle = alloc_tempbuf(&buflen);
+        if (handle > 0)
+        {
+            compact_control_if_needed(playlist, core_get_data(handle), buflen,
+                                      PLAYLIST_COMPACT_MIN);
+            core_free(handle);
+        }
+    }
+
     logf("Closing Control %s", __func__);
     if (playlist->control_fd >= 0)
         pl_close_control(playlist);
 
     playlist_write_unlock(playlist);
+    dc_thread_start(playlist, false);
 }
 
 /* returns number of tracks in playlist (includes queued/inserted tracks) */
@@ -2018,8 +2626,8 @@ int playlist_amount(void)
  */
 size_t playlist_get_index_bufsz(size_t max_sz)
 {
-    size_t index_buffer_size = (global_settings.max_files_in_playlist *
-                                sizeof(*on_disk_playlist.indices));
+    size_t index_buffer_size =
+        pl_index_bufsz(global_settings.max_files_in_playlist, false);
 
     return index_buffer_size > max_sz ? max_sz : index_buffer_size;
 }
@@ -2030,7 +2638,8 @@ size_t playlist_get_index_bufsz(size_t max_sz)
  * if one has been left open.
  *
  * The index_buffer is used to store playlist indices. If no index buffer is
- * provided, the current playlist's index buffer is shared.
+ * provided, the current playlist's index block is taken over and grows as
+ * needed, until playlist_close() or playlist_set_current() give it back.
  * FIXME: When using the shared buffer, you must ensure that playback is
  *        stopped and that no other playlist will be started while this
  *        one is loaded. The current playlist's indices will be trashed!
@@ -2042,21 +2651,29 @@ struct playlist_info* playlist_load(const char* dir, const char* file,
                                     void* temp_buffer, int temp_buffer_size)
 {
     struct playlist_info* playlist = &on_disk_playlist;
-    if (index_buffer)
-    {
-        int num_indices = index_buffer_size / sizeof(*playlist->indices);
 
-        if (num_indices > global_settings.max_files_in_playlist)
-            num_indices = global_settings.max_files_in_playlist;
+    /* a previous load that wasn't closed */
+    return_borrowed_index(false);
 
-        playlist->max_playlist_size = num_indices;
-        playlist->indices = index_buffer;
+    if (index_buffer)
+    {
+        pl_index_init_buffer(&playlist->indices,
+                             index_buffer, index_buffer_size, false);
+        playlist->max_playlist_size =
+            MIN(pl_index_capacity(&playlist->indices),
+                global_settings.max_files_in_playlist);
     }
     else
     {
-        playlist->max_playlist_size = current_playlist.max_playlist_size;
-        playlist->indices = current_playlist.indices;
+        /* take over the block, so it can grow like the current playlist's
+           would; playlist_close() or playlist_set_current() give it back */
         current_playlist.started = false;
+        current_playlist.amount = 0;
+        playlist->indices = current_playlist.indices;
+        pl_index_clear(&playlist->indices);
+        pl_index_init_buffer(&current_playlist.indices, NULL, 0, false);
+        index_borrowed = playlist->indices.base != NULL;
+        playlist->max_playlist_size = global_settings.max_files_in_playlist;
     }
 
     new_playlist_unlocked(playlist, dir, file);
@@ -2139,6 +2756,9 @@ void playlist_close(struct playlist_info* playlist)
     pl_close_playlist(playlist);
     pl_close_control(playlist);
 
+    if (playlist == &on_disk_playlist)
+        return_borrowed_index(false);
+
     if (playlist->control_created)
     {
         remove(playlist->control_filename);
@@ -2381,15 +3001,15 @@ int playlist_get_track_info(struct playlist_info* playlist, int index,
 
     info->attr = 0;
 
-    if (playlist->indices[index] & PLAYLIST_INSERT_TYPE_MASK)
+    if (PL_INDEX(playlist, index) & PLAYLIST_INSERT_TYPE_MASK)
     {
-        if (playlist->indices[index] & PLAYLIST_QUEUED)
+        if (PL_INDEX(playlist, index) & PLAYLIST_QUEUED)
             info->attr |= PLAYLIST_ATTR_QUEUED;
         else
             info->attr |= PLAYLIST_ATTR_INSERTED;
     }
 
-    if (playlist->indices[index] & PLAYLIST_SKIPPED)
+    if (PL_INDEX(playlist, index) & PLAYLIST_SKIPPED)
         info->attr |= PLAYLIST_ATTR_SKIPPED;
 
     info->index = index;
@@ -2444,9 +3064,33 @@ int playlist_insert_context_create(struct playlist_info* playlist,
     else
         context->count_langid = LANG_PLAYLIST_INSERT_COUNT;
 
+    /* batch the control file lines, unless another context does */
+    if (!control_batch.playlist)
+    {
+        control_batch.playlist = playlist;
+        control_batch.used = 0;
+    }
+
     return 0;
 }
 
+/*
+ * make room for inserting count tracks with an insert context at once,
+ * rather than growing the index while they are added
+ */
+void playlist_insert_context_reserve(struct playlist_insert_context *context,
+                                     int count)
+{
+    struct playlist_info* playlist = context->playlist;
+
+    if (!context->initialized)
+        return;
+
+    count = MIN(count, playlist->max_playlist_size - playlist->amount);
+    if (count > 0)
+        pl_index_reserve(&playlist->indices, count);
+}
+
 /*
  * add tracks to playlist using opened insert context
  */
@@ -2491,7 +3135,16 @@ void playlist_insert_context_release(struct playlist_insert_context *context)
 
     struct playlist_info* playlist = context->playlist;
     if (context->initialized)
+    {
+        if (control_batch.playlist == playlist &&
+            flush_control_batch(playlist) < 0)
+            notify_control_access_error();
+
         sync_control_unlocked(playlist);
+    }
+
+    if (control_batch.playlist == playlist)
+        control_batch.playlist = NULL;
     if (context->progress)
         display_playlist_count(context->count, ID2P(context->count_langid), true);
 
@@ -2794,7 +3447,7 @@ int playlist_move(struct playlist_info* playlist, int index, int new_index)
         }
     }
 
-    queue = playlist->indices[index] & PLAYLIST_QUEUED;
+    queue = PL_INDEX(playlist, index) & PLAYLIST_QUEUED;
 
     if (get_track_filename(playlist, index, filename, sizeof(filename)) != 0)
         goto out;
@@ -2922,7 +3575,7 @@ int playlist_next(int steps)
             {
                 index = get_next_index(playlist, i, -1);
 
-                if (index >= 0 && playlist->indices[index] & PLAYLIST_QUEUED)
+                if (index >= 0 && PL_INDEX(playlist, index) & PLAYLIST_QUEUED)
                 {
                     remove_track_unlocked(playlist, index, true);
                     steps--; /* one less track */
@@ -3098,12 +3751,15 @@ int playlist_remove_all_tracks(struct playlist_info *playlist)
 }
 
 /* playlist_resume helper function
- * only allows comments (#) and PLAYLIST_COMMAND_PLAYLIST (P)
+ * only allows comments (#), PLAYLIST_COMMAND_SNAPSHOT (B)
+ * and PLAYLIST_COMMAND_PLAYLIST (P)
  */
 static enum playlist_command pl_cmds_start(char cmd)
 {
     if (cmd == 'P')
         return PLAYLIST_COMMAND_PLAYLIST;
+    if (cmd == 'B')
+        return PLAYLIST_COMMAND_SNAPSHOT;
     if (cmd == '#')
         return PLAYLIST_COMMAND_COMMENT;
 
@@ -3152,6 +3808,11 @@ int playlist_resume(void)
     int control_file_size = 0;
     bool sorted = true;
     int result = -1;
+    struct playlist_snapshot snapshot;
+    bool have_snapshot = false;
+    bool rebuilt = false;         /* without the snapshot it named */
+    bool rebuild_inserts = false; /* reading the compacted inserts */
+    int skip_to = 0;
     enum playlist_command (*pl_cmd)(char) = &pl_cmds_start;
 
     splash(0, ID2P(LANG_WAIT));
@@ -3181,6 +3842,7 @@ int playlist_resume(void)
     buflen = ALIGN_DOWN(buflen, 512); /* to avoid partial sector I/O */
 
     empty_playlist_unlocked(playlist, true);
+    control_base_size = 0;
 
     if (!file_exists(playlist->control_filename))
         goto out;
@@ -3221,6 +3883,7 @@ int playlist_resume(void)
         bool newline = true;
         bool exit_loop = false;
         char *p = buffer;
+        char *line = buffer;
         char *strp[3] = {NULL};
 
         unsigned long last_tick = current_tick;
@@ -3299,7 +3962,33 @@ int playlist_resume(void)
 
                         update_playlist_filename_unlocked(playlist, strp[1], strp[2]);
 
-                        if (strp[2][0] != '\0')
+                        /* the indices only fit the playlist file that they
+                           were taken from */
+                        if (have_snapshot && get_playlist_size(playlist) !=
+                                             snapshot.playlist_size)
+                        {
+                            logf("resume: playlist changed, rebuilding");
+                            pl_index_clear(&playlist->indices);
+                            playlist->amount = 0;
+                            playlist->first_index = 0;
+                            playlist->last_insert_pos = -1;
+                            playlist->seed = 0;
+                            have_snapshot = false;
+                            rebuilt = true;
+                            sorted = true;
+                        }
+
+                        /* without the snapshot, the inserted tracks on the
+                           comment lines that follow are added at the end */
+                        rebuild_inserts = rebuilt;
+
+                        if (have_snapshot)
+                        {
+                            /* the rest of the compacted part is in the
+                               snapshot already */
+                            skip_to = snapshot.base_size;
+                        }
+                        else if (strp[2][0] != '\0')
                         {
                             /* NOTE: add_indices_to_playlist() overwrites the
                                audiobuf so we need to reload control file
@@ -3317,6 +4006,38 @@ int playlist_resume(void)
                         pl_cmd = &pl_cmds_run;
                         break;
                     }
+                    case PLAYLIST_COMMAND_SNAPSHOT:
+                    {
+                        /* strp[0]=serial */
+                        if (!strp[0] || have_snapshot)
+                        {
+                            result = -19;
+                            exit_loop = true;
+                            break;
+                        }
+
+                        /* NOTE: the snapshot is loaded through the buffer so
+                           we need to reload control file data */
+                        if (load_snapshot_unlocked(playlist,
+                                strtoul(strp[0], NULL, 10), &snapshot,
+                                buffer, buflen) < 0)
+                        {
+                            /* rebuild what can be from the playlist file
+                               and the inserted tracks rather than losing
+                               the playlist */
+                            logf("resume: no snapshot, rebuilding");
+                            rebuilt = true;
+                        }
+                        else
+                        {
+                            have_snapshot = true;
+                            /* continue from the state the replay had
+                               reached when the snapshot was taken */
+                            sorted = snapshot.sorted;
+                        }
+                        exit_loop = true;
+                        break;
+                    }
                     case PLAYLIST_COMMAND_QUEUE:
                         queue = true;
                         /*Fall-through*/
@@ -3333,6 +4054,11 @@ int playlist_resume(void)
                         int position = atoi(strp[0]);
                         int last_position = atoi(strp[1]);
 
+                        /* positions were logged against the order the
+                           snapshot had */
+                        if (rebuilt && position > playlist->amount)
+                            position = playlist->amount;
+
                         /* seek position is based on strp[2]'s position in
                            buffer */
                         if (add_track_to_playlist_unlocked(playlist, strp[2],
@@ -3360,6 +4086,9 @@ int playlist_resume(void)
 
                         position = atoi(strp[0]);
 
+                        if (rebuilt && position >= playlist->amount)
+                            break;
+
                         if (remove_track_unlocked(playlist, position, false) < 0)
                         {
                             result = -7;
@@ -3370,7 +4099,7 @@ int playlist_resume(void)
                     }
                     case PLAYLIST_COMMAND_SHUFFLE:
                     {
-                        /* strp[0]=seed strp[1]=first_index */
+                        /* strp[0]=seed strp[1]=first_index strp[2]=method */
                         int seed;
 
                         if (!strp[0] || !strp[1])
@@ -3389,11 +4118,20 @@ int playlist_resume(void)
                         seed = atoi(strp[0]);
                         playlist->first_index = atoi(strp[1]);
 
-                        if (randomise_playlist_unlocked(playlist, seed, false,
-                                false) < 0)
+                        if (strp[2] && atoi(strp[2]) == PLAYLIST_SHUFFLE_METHOD)
                         {
-                            result = -9;
-                            goto out;
+                            if (randomise_playlist_unlocked(playlist, seed,
+                                    false, false) < 0)
+                            {
+                                result = -9;
+                                goto out;
+                            }
+                        }
+                        else
+                        {
+                            randomise_indices_compat(playlist, seed);
+                            playlist->last_insert_pos = -1;
+                            playlist->seed = seed;
                         }
                         sorted = false;
 
@@ -3440,6 +4178,18 @@ int playlist_resume(void)
                         break;
                     }
                     case PLAYLIST_COMMAND_COMMENT:
+                    {
+                        /* an inserted track of the compacted part */
+                        if (rebuild_inserts && line[0] == '#' && line[1] &&
+                            add_track_to_playlist_unlocked(playlist, line + 1,
+                                PLAYLIST_INSERT_LAST, false,
+                                total_read + (line + 1 - buffer)) < 0)
+                        {
+                            result = -5;
+                            goto out;
+                        }
+                        break;
+                    }
                     default:
                         break;
                 }
@@ -3454,7 +4204,10 @@ int playlist_resume(void)
             else if(newline)
             {
                 newline = false;
+                line = p;
                 current_command = (*pl_cmd)(*p);
+                if (current_command != PLAYLIST_COMMAND_COMMENT)
+                    rebuild_inserts = false;
                 str_count = -1;
                 strp[0] = NULL;
                 strp[1] = NULL;
@@ -3520,6 +4273,12 @@ int playlist_resume(void)
 
         total_read += count;
 
+        if (total_read < skip_to)
+        {
+            total_read = skip_to;
+            lseek(playlist->control_fd, total_read, SEEK_SET);
+        }
+
         nread = read(playlist->control_fd, buffer, readsize);
 
         /* Terminate on EOF */
@@ -3532,6 +4291,14 @@ int playlist_resume(void)
     if (global_status.resume_index != -1)
         playlist->index = global_status.resume_index;
 
+    if (have_snapshot)
+        control_base_size = snapshot.base_size;
+    current_sorted = sorted;
+
+    /* don't make the next resume replay all of that again */
+    compact_control_if_needed(playlist, buffer, buflen,
+                              PLAYLIST_COMPACT_RESUME);
+
 out:
     playlist_write_unlock(playlist);
     dc_thread_start(playlist, true);
@@ -3614,10 +4381,14 @@ int playlist_set_current(struct playlist_info* playlist)
     current_playlist.control_created = true;
     current_playlist.dirlen = playlist->dirlen;
 
-    if (playlist->indices && playlist->indices != current_playlist.indices)
-        memcpy((void*)current_playlist.indices, (void*)playlist->indices,
-               playlist->max_playlist_size*sizeof(*playlist->indices));
-    dc_init_filerefs(&current_playlist, 0, current_playlist.max_playlist_size);
+    if (playlist == &on_disk_playlist && index_borrowed)
+        return_borrowed_index(true);
+    else if (!pl_index_copy(&current_playlist.indices, &playlist->indices))
+    {
+        notify_buffer_full();
+        goto out;
+    }
+    dc_init_filerefs(&current_playlist);
 
     current_playlist.first_index = playlist->first_index;
     current_playlist.amount = playlist->amount;
@@ -3690,7 +4461,7 @@ void playlist_skip_entry(struct playlist_info *playlist, int steps)
     else if (index >= playlist->amount)
         index -= playlist->amount;
 
-    playlist->indices[index] |= PLAYLIST_SKIPPED;
+    PL_INDEX(playlist, index) |= PLAYLIST_SKIPPED;
     playlist_write_unlock(playlist);
 }
 
@@ -3788,17 +4559,6 @@ int playlist_update_resume_info(const struct mp3entry* id3)
     return 0;
 }
 
-static int pl_get_tempname(const char *filename, char *buf, size_t bufsz)
-{
-    if (strlcpy(buf, filename, bufsz) >= bufsz)
-        return -1;
-
-    if (strlcat(buf, "_temp", bufsz) >= bufsz)
-        return -1;
-
-    return 0;
-}
-
 /*
  * Save all non-queued tracks to an M3U playlist with the given filename.
  * On success, the playlist is updated to point to the new playlist file.
@@ -3849,7 +4609,7 @@ static int pl_save_playlist(struct playlist_info* playlist,
         }
 
         /* Do not save queued files to playlist. */
-        if (playlist->indices[index] & PLAYLIST_QUEUED)
+        if (PL_INDEX(playlist, index) & PLAYLIST_QUEUED)
             continue;
 
         if (get_track_filename(playlist, index, tmpbuf, tmpsize) != 0)
@@ -3859,9 +4619,9 @@ static int pl_save_playlist(struct playlist_info* playlist,
         }
 
         /* Update seek offset so it points into the new file. */
-        playlist->indices[index] &= ~PLAYLIST_INSERT_TYPE_MASK;
-        playlist->indices[index] &= ~PLAYLIST_SEEK_MASK;
-        playlist->indices[index] |= offset;
+        PL_INDEX(playlist, index) &= ~PLAYLIST_INSERT_TYPE_MASK;
+        PL_INDEX(playlist, index) &= ~PLAYLIST_SEEK_MASK;
+        PL_INDEX(playlist, index) |= offset;
 
         ret = fdprintf(fd, "%s\n", tmpbuf);
         if (ret < 0)
@@ -3891,6 +4651,10 @@ static int pl_save_playlist(struct playlist_info* playlist,
     file[-1] = '\0';
 
     update_playlist_filename_unlocked(playlist, dir, file);
+
+    /* all tracks moved to the new file */
+    if (playlist == &current_playlist)
+        pl_paths_clear(&track_paths);
     return 0;
 
 error:
@@ -3903,21 +4667,7 @@ error:
 static void pl_reverse(struct playlist_info *playlist, int start, int end)
 {
     for (; start < end; start++, end--)
-    {
-        unsigned long index_swap = playlist->indices[start];
-        playlist->indices[start] = playlist->indices[end];
-        playlist->indices[end]   = index_swap;
-
-#ifdef HAVE_DIRCACHE
-        if (playlist->dcfrefs_handle)
-        {
-            struct dircache_fileref *dcfrefs = core_get_data(playlist->dcfrefs_handle);
-            struct dircache_fileref dcf_swap = dcfrefs[start];
-            dcfrefs[start] = dcfrefs[end];
-            dcfrefs[end] = dcf_swap;
-        }
-#endif
-    }
+        pl_index_swap(&playlist->indices, start, end);
 }
 
 /*
@@ -3990,12 +4740,12 @@ static int pl_save_update_control(struct playlist_info* playlist,
     for (int index = 0; index < playlist->amount; ++index)
     {
         /* We only need to update queued files */
-        if (!(playlist->indices[index] & PLAYLIST_INSERT_TYPE_MASK &&
-              playlist->indices[index] & PLAYLIST_QUEUED))
+        if (!(PL_INDEX(playlist, index) & PLAYLIST_INSERT_TYPE_MASK &&
+              PL_INDEX(playlist, index) & PLAYLIST_QUEUED))
             continue;
 
         /* Read filename from old control file */
-        lseek(old_fd, playlist->indices[index] & PLAYLIST_SEEK_MASK, SEEK_SET);
+        lseek(old_fd, PL_INDEX(playlist, index) & PLAYLIST_SEEK_MASK, SEEK_SET);
         read_line(old_fd, tmpbuf, tmpsize);
 
         /* Write it out to the new control file */
@@ -4009,8 +4759,8 @@ static int pl_save_update_control(struct playlist_info* playlist,
             goto error;
         }
         /* Update seek offset for the new control file. */
-        playlist->indices[index] &= ~PLAYLIST_SEEK_MASK;
-        playlist->indices[index] |= seekpos;
+        PL_INDEX(playlist, index) &= ~PLAYLIST_SEEK_MASK;
+        PL_INDEX(playlist, index) |= seekpos;
         any_queued = true;
     }
 
@@ -4051,6 +4801,8 @@ static int pl_save_update_control(struct playlist_info* playlist,
 
     playlist->control_fd = open(playlist->control_filename, O_RDWR);
     playlist->control_created = (playlist->control_fd >= 0);
+    if (playlist == &current_playlist)
+        control_base_size = 0;
 
     return 0;
 
@@ -4088,7 +4840,7 @@ int playlist_save(struct playlist_info* playlist, char *filename)
     /* Ask if queued tracks should be removed, so that
     playlist can be bookmarked after it's been saved */
     for (int i = playlist->amount - 1; i >= 0; i--)
-        if (playlist->indices[i] & PLAYLIST_QUEUED)
+        if (PL_INDEX(playlist, i) & PLAYLIST_QUEUED)
         {
             if (reload_tracks || (reload_tracks =
                 (yesno_pop(ID2P(LANG_REMOVE_QUEUED_TRACKS)))))
@@ -29,6 +29,7 @@
 #include "metadata.h"
 #include "rbpaths.h"
 #include "chunk_alloc.h"
+#include "playlist_index.h"
 
 #define PLAYLIST_ATTR_QUEUED    0x01
 #define PLAYLIST_ATTR_INSERTED  0x02
@@ -52,6 +53,7 @@ enum playlist_command {
     PLAYLIST_COMMAND_UNSHUFFLE,
     PLAYLIST_COMMAND_RESET,
     PLAYLIST_COMMAND_FLAGS,
+    PLAYLIST_COMMAND_SNAPSHOT,
     PLAYLIST_COMMAND_COMMENT,
     PLAYLIST_COMMAND_ERROR = PLAYLIST_COMMAND_COMMENT + 1 /* Internal */
 };
@@ -76,7 +78,8 @@ struct playlist_info
     int  control_fd;     /* descriptor of the open control file     */
     int  max_playlist_size; /* Max number of files in playlist. Mirror of
                               global_settings.max_files_in_playlist */
-    unsigned long *indices; /* array of indices            */
+    struct pl_index indices; /* track indices, and their dircache
+                                references for the current playlist */
 
     int  index;          /* index of current playing track          */
     int  first_index;    /* index of first song in playlist         */
@@ -87,9 +90,6 @@ struct playlist_info
                                     shuffled command start */
     int  seed;           /* shuffle seed                            */
     struct mutex mutex; /* mutex for control file access    */
-#ifdef HAVE_DIRCACHE
-    int dcfrefs_handle;
-#endif
     int  dirlen;         /* Length of the path to the playlist file */
     char filename[MAX_PATH];  /* path name of m3u playlist on disk  */
     /* full path of control file (with extra room for extensions) */
@@ -154,6 +154,8 @@ int playlist_insert_context_create(struct playlist_info* playlist,
                                    int position, bool queue, bool progress);
 int playlist_insert_context_add(struct playlist_insert_context *context,
                                 const char *filename);
+void playlist_insert_context_reserve(struct playlist_insert_context *context,
+                                     int count);
 void playlist_insert_context_release(struct playlist_insert_context *context);
 int playlist_insert_directory(struct playlist_info* playlist,
                               const char *dirname, int position, bool queue,
@@ -0,0 +1,805 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/*
+ * Layout of the block:
+ *
+ *   struct chunk dir[max_chunks]       chunks in playlist order
+ *   unsigned short free[max_chunks]    stack of unused chunk slots
+ *   unsigned long entries[(max_chunks + 1) * CHUNK]
+ *   struct dircache_fileref refs[(max_chunks + 1) * CHUNK]   (optional)
+ *
+ * The entries and refs of slot s start at s * CHUNK. The extra slot at the
+ * end is scratch space for pl_index_flatten().
+ *
+ * A shuffle is not carried out right away. Instead every index is mapped
+ * through a permutation keyed by the seed, a small Feistel network over the
+ * smallest domain of an even number of bits that covers all entries, applied
+ * again until the result is an entry ("cycle walking"). Swapping entries
+ * works on the mapped positions, everything else that changes the order
+ * applies the permutation to the entries first.
+ */
+
+#include <string.h>
+#include "config.h"
+#include "system.h"
+#include "core_alloc.h"
+#include "playlist_index.h"
+
+/*#define LOGF_ENABLE*/
+#include "logf.h"
+
+#if MEMORYSIZE <= 2
+#define CHUNK   64
+#else
+#define CHUNK   256
+#endif
+
+/* chunks are merged when they drop below this together */
+#define MERGE_LIMIT (CHUNK / 2)
+
+#define PERM_ROUNDS 4
+
+/* slot numbers are unsigned short and this one marks a free slot */
+#define NO_SLOT     0xffff
+#define MAX_CHUNKS  (NO_SLOT - 1)
+
+struct chunk
+{
+    int start;              /* index of the first entry */
+    unsigned short slot;    /* where its entries are stored */
+    unsigned short count;   /* number of entries */
+};
+
+#ifdef HAVE_DIRCACHE
+#define REF_SIZE(refs)  ((refs) ? sizeof(struct dircache_fileref) : 0)
+#else
+#define REF_SIZE(refs)  ((void)(refs), 0)
+#endif
+#define ENTRY_SIZE(refs) (sizeof(unsigned long) + REF_SIZE(refs))
+
+static void apply_permutation(struct pl_index *pli);
+
+static inline size_t header_size(int max_chunks)
+{
+    return ALIGN_UP(max_chunks * (sizeof(struct chunk) +
+                                  sizeof(unsigned short)), sizeof(long));
+}
+
+static size_t block_size(int max_chunks, bool refs)
+{
+    return header_size(max_chunks) +
+           (size_t)(max_chunks + 1) * CHUNK * ENTRY_SIZE(refs);
+}
+
+static inline struct chunk *get_dir(const struct pl_index *pli)
+{
+    return pli->base;
+}
+
+static inline unsigned short *get_free(const struct pl_index *pli)
+{
+    return (unsigned short *)(get_dir(pli) + pli->max_chunks);
+}
+
+static inline unsigned long *get_entries(const struct pl_index *pli)
+{
+    return (unsigned long *)((char *)pli->base +
+                             header_size(pli->max_chunks));
+}
+
+#ifdef HAVE_DIRCACHE
+static inline struct dircache_fileref *get_refs(const struct pl_index *pli)
+{
+    return (struct dircache_fileref *)
+        (get_entries(pli) + (size_t)(pli->max_chunks + 1) * CHUNK);
+}
+#endif
+
+/* move n entries (and their refs) from one position in the slots to another,
+   positions counting from the start of slot 0 */
+static void move_entries(struct pl_index *pli, size_t to, size_t from, int n)
+{
+    if (n <= 0 || to == from)
+        return;
+
+    unsigned long *entries = get_entries(pli);
+    memmove(&entries[to], &entries[from], n * sizeof(*entries));
+#ifdef HAVE_DIRCACHE
+    if (pli->refs)
+    {
+        struct dircache_fileref *refs = get_refs(pli);
+        memmove(&refs[to], &refs[from], n * sizeof(*refs));
+    }
+#endif
+}
+
+/* put all slots on the free stack, lowest slots on top */
+static void reset_free(struct pl_index *pli, int first)
+{
+    unsigned short *free = get_free(pli);
+    for (int i = 0, s = pli->max_chunks - 1; s >= first; i++, s--)
+        free[i] = s;
+}
+
+void pl_index_clear(struct pl_index *pli)
+{
+    pli->amount = 0;
+    pli->num_chunks = 0;
+    pli->perm_count = 0;
+
+    if (pli->max_chunks > 0)
+    {
+        /* keep one chunk around, so that every index maps to a slot */
+        struct chunk *dir = get_dir(pli);
+        dir[0].start = 0;
+        dir[0].slot = 0;
+        dir[0].count = 0;
+        pli->num_chunks = 1;
+        reset_free(pli, 1);
+    }
+}
+
+static void setup(struct pl_index *pli, void *base, int max_chunks, bool refs)
+{
+    pli->base = base;
+    pli->max_chunks = max_chunks;
+    pli->refs = refs;
+    pl_index_clear(pli);
+}
+
+/* chunks for the given number of entries, with some room for chunks that
+   aren't full after inserts */
+static int chunks_for(int entries)
+{
+    int max_chunks = entries / CHUNK + entries / (CHUNK * 8) + 2;
+    return MIN(max_chunks, MAX_CHUNKS);
+}
+
+size_t pl_index_bufsz(int entries, bool refs)
+{
+    /* plus room for aligning the buffer */
+    return block_size(chunks_for(entries), refs) + sizeof(long);
+}
+
+bool pl_index_alloc(struct pl_index *pli, int entries, bool refs,
+                    struct buflib_callbacks *ops)
+{
+    int max_chunks = chunks_for(entries);
+
+    pli->ops = ops;
+    pli->handle = core_alloc_ex(block_size(max_chunks, refs), ops);
+    if (pli->handle <= 0)
+    {
+        pli->handle = 0;
+        setup(pli, NULL, 0, false);
+        return false;
+    }
+
+    setup(pli, core_get_data(pli->handle), max_chunks, refs);
+    return true;
+}
+
+void pl_index_init_buffer(struct pl_index *pli, void *buf, size_t size,
+                          bool refs)
+{
+    int max_chunks = 0;
+
+    /* block_size() is linear in max_chunks apart from the alignment of
+       the header, so start from the estimate and step down if needed */
+    size_t align = (size_t)ALIGN_UP((uintptr_t)buf, sizeof(long)) -
+                   (uintptr_t)buf;
+    if (size > align + block_size(0, refs))
+    {
+        size -= align;
+        max_chunks = (size - block_size(0, refs)) /
+                     (sizeof(struct chunk) + sizeof(unsigned short) +
+                      CHUNK * ENTRY_SIZE(refs));
+        if (max_chunks > MAX_CHUNKS)
+            max_chunks = MAX_CHUNKS;
+        while (max_chunks > 0 && block_size(max_chunks, refs) > size)
+            max_chunks--;
+    }
+
+    pli->handle = 0;
+    pli->ops = NULL;
+    setup(pli, max_chunks > 0 ? (char *)buf + align : NULL, max_chunks, refs);
+}
+
+int pl_index_capacity(const struct pl_index *pli)
+{
+    return pli->max_chunks * CHUNK;
+}
+
+/* Make room for new_max chunks by moving to a larger allocation */
+static bool grow_to(struct pl_index *pli, int new_max)
+{
+    int old_max = pli->max_chunks;
+    if (new_max > MAX_CHUNKS)
+        new_max = MAX_CHUNKS;
+
+    if (!pli->handle || new_max <= old_max)
+        return false;
+
+    int handle = core_alloc_ex(block_size(new_max, pli->refs), pli->ops);
+    if (handle <= 0)
+    {
+        logf("%s: no memory for %d chunks", __func__, new_max);
+        return false;
+    }
+
+    /* the allocation may have moved the old block, but buflib kept
+       pli->base up to date */
+    struct pl_index old = *pli;
+    pli->handle = handle;
+    pli->base = core_get_data(handle);
+    pli->max_chunks = new_max;
+
+    memcpy(get_dir(pli), get_dir(&old), old.num_chunks * sizeof(struct chunk));
+    memcpy(get_entries(pli), get_entries(&old),
+           (size_t)old_max * CHUNK * sizeof(unsigned long));
+#ifdef HAVE_DIRCACHE
+    if (pli->refs)
+        memcpy(get_refs(pli), get_refs(&old),
+               (size_t)old_max * CHUNK * sizeof(struct dircache_fileref));
+#endif
+
+    /* new slots go below the old free ones so they are used last */
+    unsigned short *free = get_free(pli);
+    int old_free = old_max - old.num_chunks;
+    reset_free(pli, old_max);
+    memcpy(&free[new_max - old_max], get_free(&old),
+           old_free * sizeof(unsigned short));
+
+    core_free(old.handle);
+
+    logf("%s: %d -> %d chunks", __func__, old_max, new_max);
+    return true;
+}
+
+static bool grow(struct pl_index *pli)
+{
+    return grow_to(pli, pli->max_chunks + MAX(pli->max_chunks / 2, 4));
+}
+
+bool pl_index_reserve(struct pl_index *pli, int entries)
+{
+    /* enough if they are inserted in one place, splitting one chunk */
+    int need = pli->num_chunks + (entries + CHUNK - 1) / CHUNK + 1;
+    if (need <= pli->max_chunks)
+        return true;
+
+    return grow_to(pli, MAX(need, pli->max_chunks + MAX(pli->max_chunks / 2, 4)));
+}
+
+/* Insert an empty chunk into the directory at position c */
+static bool new_chunk(struct pl_index *pli, int c)
+{
+    if (pli->num_chunks == pli->max_chunks && !grow(pli))
+        return false;
+
+    struct chunk *dir = get_dir(pli);
+    int free_top = pli->max_chunks - pli->num_chunks - 1;
+
+    memmove(&dir[c + 1], &dir[c], (pli->num_chunks - c) * sizeof(*dir));
+    dir[c].start = c < pli->num_chunks ? dir[c + 1].start : pli->amount;
+    dir[c].slot = get_free(pli)[free_top];
+    dir[c].count = 0;
+    pli->num_chunks++;
+    return true;
+}
+
+/* Remove the (empty or already merged) chunk at directory position c */
+static void free_chunk(struct pl_index *pli, int c)
+{
+    struct chunk *dir = get_dir(pli);
+    int free_top = pli->max_chunks - pli->num_chunks;
+
+    get_free(pli)[free_top] = dir[c].slot;
+    pli->num_chunks--;
+    memmove(&dir[c], &dir[c + 1], (pli->num_chunks - c) * sizeof(*dir));
+}
+
+/* The chunk found last, which is tried first since entries are mostly
+   looked up one after the other. It is checked before use, so it doesn't
+   matter which index it was for or what changed since. */
+static const struct pl_index *hint_pli;
+static int hint_chunk;
+
+static inline bool chunk_holds(const struct pl_index *pli, int c, int i)
+{
+    const struct chunk *dir = get_dir(pli);
+    return c < pli->num_chunks && dir[c].start <= i &&
+           (c + 1 == pli->num_chunks || dir[c + 1].start > i);
+}
+
+/* Find the chunk that holds entry i. For i == amount this is the last one. */
+static int find_chunk(const struct pl_index *pli, int i)
+{
+    const struct chunk *dir = get_dir(pli);
+    int lo = 0, hi = pli->num_chunks - 1;
+
+    if (hint_pli == pli)
+    {
+        int c = hint_chunk;
+        if (chunk_holds(pli, c, i))
+            return c;
+        if (chunk_holds(pli, c + 1, i))
+        {
+            hint_chunk = c + 1;
+            return c + 1;
+        }
+    }
+
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (dir[mid].start <= i)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    hint_pli = pli;
+    hint_chunk = lo;
+    return lo;
+}
+
+static inline size_t entry_pos(const struct chunk *ch, int i)
+{
+    return (size_t)ch->slot * CHUNK + (i - ch->start);
+}
+
+static inline uint32_t perm_hash(uint32_t x, uint32_t key)
+{
+    x ^= key;
+    x *= 0x9e3779b1;
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    return x;
+}
+
+/* one pass of the Feistel network over 2 * perm_bits bits, or its inverse */
+static unsigned int feistel(const struct pl_index *pli, unsigned int x,
+                            bool inverse)
+{
+    unsigned int bits = pli->perm_bits, mask = (1u << bits) - 1;
+    unsigned int l = x >> bits, r = x & mask, t;
+
+    for (int round = 0; round < PERM_ROUNDS; round++)
+    {
+        uint32_t key = pli->perm_seed + 0x6d2b79f5u *
+            (uint32_t)(inverse ? PERM_ROUNDS - 1 - round : round);
+        if (inverse)
+        {
+            t = r ^ (perm_hash(l, key) & mask);
+            r = l;
+            l = t;
+        }
+        else
+        {
+            t = l ^ (perm_hash(r, key) & mask);
+            l = r;
+            r = t;
+        }
+    }
+
+    return (l << bits) | r;
+}
+
+/* where the entry at index i is stored, or the inverse */
+static int permute(const struct pl_index *pli, int i, bool inverse)
+{
+    unsigned int x = i;
+    do
+        x = feistel(pli, x, inverse);
+    while (x >= (unsigned int)pli->perm_count);
+    return x;
+}
+
+static inline int map_index(const struct pl_index *pli, int i)
+{
+    return pli->perm_count ? permute(pli, i, false) : i;
+}
+
+unsigned long *pl_index_get(const struct pl_index *pli, int i)
+{
+    i = map_index(pli, i);
+    const struct chunk *ch = &get_dir(pli)[find_chunk(pli, i)];
+    return &get_entries(pli)[entry_pos(ch, i)];
+}
+
+#ifdef HAVE_DIRCACHE
+struct dircache_fileref *pl_index_ref(const struct pl_index *pli, int i)
+{
+    if (!pli->refs)
+        return NULL;
+
+    i = map_index(pli, i);
+    const struct chunk *ch = &get_dir(pli)[find_chunk(pli, i)];
+    return &get_refs(pli)[entry_pos(ch, i)];
+}
+
+void pl_index_init_refs(struct pl_index *pli)
+{
+    if (!pli->refs || !pli->base)
+        return;
+
+    struct dircache_fileref *refs = get_refs(pli);
+    for (size_t i = 0; i < (size_t)pli->max_chunks * CHUNK; i++)
+        dircache_fileref_init(&refs[i]);
+}
+#endif
+
+bool pl_index_insert(struct pl_index *pli, int i, unsigned long entry)
+{
+    struct chunk *dir;
+    int c, pos;
+
+    apply_permutation(pli);
+
+    if (pli->num_chunks == 0 && !new_chunk(pli, 0))
+        return false;
+
+    c = find_chunk(pli, i);
+    dir = get_dir(pli);
+    pos = i - dir[c].start;
+
+    /* at the start of a chunk, the end of the previous one will do too */
+    if (pos == 0 && c > 0 && dir[c - 1].count < CHUNK)
+        pos = dir[--c].count;
+
+    if (dir[c].count == CHUNK)
+    {
+        if (pos == CHUNK)
+        {
+            /* appending to a full chunk */
+            if (!new_chunk(pli, ++c))
+                return false;
+            pos = 0;
+        }
+        else if (pos == 0)
+        {
+            /* prepending to a full chunk */
+            if (!new_chunk(pli, c))
+                return false;
+        }
+        else
+        {
+            /* split it in halves */
+            if (!new_chunk(pli, c + 1))
+                return false;
+
+            dir = get_dir(pli);
+            move_entries(pli, (size_t)dir[c + 1].slot * CHUNK,
+                         (size_t)dir[c].slot * CHUNK + CHUNK / 2, CHUNK / 2);
+            dir[c].count = CHUNK / 2;
+            dir[c + 1].count = CHUNK / 2;
+            dir[c + 1].start = dir[c].start + CHUNK / 2;
+
+            if (pos > CHUNK / 2)
+            {
+                c++;
+                pos -= CHUNK / 2;
+            }
+        }
+
+        dir = get_dir(pli);
+    }
+
+    size_t p = (size_t)dir[c].slot * CHUNK + pos;
+    move_entries(pli, p + 1, p, dir[c].count - pos);
+    get_entries(pli)[p] = entry;
+#ifdef HAVE_DIRCACHE
+    if (pli->refs)
+        dircache_fileref_init(&get_refs(pli)[p]);
+#endif
+
+    dir[c].count++;
+    for (int k = c + 1; k < pli->num_chunks; k++)
+        dir[k].start++;
+
+    pli->amount++;
+    return true;
+}
+
+/* Append the entries of chunk c + 1 to chunk c */
+static void merge_chunks(struct pl_index *pli, int c)
+{
+    struct chunk *dir = get_dir(pli);
+
+    move_entries(pli, (size_t)dir[c].slot * CHUNK + dir[c].count,
+                 (size_t)dir[c + 1].slot * CHUNK, dir[c + 1].count);
+    dir[c].count += dir[c + 1].count;
+    free_chunk(pli, c + 1);
+}
+
+void pl_index_remove(struct pl_index *pli, int i)
+{
+    apply_permutation(pli);
+
+    int c = find_chunk(pli, i);
+    struct chunk *dir = get_dir(pli);
+    size_t p = entry_pos(&dir[c], i);
+
+    move_entries(pli, p, p + 1, dir[c].count - (i - dir[c].start) - 1);
+
+    dir[c].count--;
+    for (int k = c + 1; k < pli->num_chunks; k++)
+        dir[k].start--;
+
+    pli->amount--;
+
+    /* don't let the playlist spread over lots of nearly empty chunks */
+    if (dir[c].count == 0 && pli->num_chunks > 1)
+        free_chunk(pli, c);
+    else if (c > 0 && dir[c - 1].count + dir[c].count <= MERGE_LIMIT)
+        merge_chunks(pli, c - 1);
+    else if (c + 1 < pli->num_chunks &&
+             dir[c].count + dir[c + 1].count <= MERGE_LIMIT)
+        merge_chunks(pli, c);
+}
+
+void pl_index_swap(struct pl_index *pli, int i, int j)
+{
+    i = map_index(pli, i);
+    j = map_index(pli, j);
+
+    const struct chunk *dir = get_dir(pli);
+    size_t pi = entry_pos(&dir[find_chunk(pli, i)], i);
+    size_t pj = entry_pos(&dir[find_chunk(pli, j)], j);
+
+    unsigned long *entries = get_entries(pli);
+    unsigned long tmp = entries[pi];
+    entries[pi] = entries[pj];
+    entries[pj] = tmp;
+
+#ifdef HAVE_DIRCACHE
+    if (pli->refs)
+    {
+        struct dircache_fileref *refs = get_refs(pli);
+        struct dircache_fileref ref = refs[pi];
+        refs[pi] = refs[pj];
+        refs[pj] = ref;
+    }
+#endif
+}
+
+/* Exchange the contents of two slots, using the spare one at the end */
+static void swap_slots(struct pl_index *pli, int a, int b)
+{
+    size_t spare = (size_t)pli->max_chunks * CHUNK;
+
+    move_entries(pli, spare, (size_t)a * CHUNK, CHUNK);
+    move_entries(pli, (size_t)a * CHUNK, (size_t)b * CHUNK, CHUNK);
+    move_entries(pli, (size_t)b * CHUNK, spare, CHUNK);
+}
+
+/* Make the slots contiguous and in order, without looking at a shuffle */
+static unsigned long *flatten_slots(struct pl_index *pli)
+{
+    struct chunk *dir = get_dir(pli);
+    unsigned short *owner = get_free(pli); /* rebuilt at the end */
+    int c, s;
+
+    if (!pli->base)
+        return NULL;
+
+    /* put chunk c into slot c, using the free stack to map each slot
+       to the chunk that is stored in it */
+    for (s = 0; s < pli->max_chunks; s++)
+        owner[s] = NO_SLOT;
+    for (c = 0; c < pli->num_chunks; c++)
+        owner[dir[c].slot] = c;
+
+    for (c = 0; c < pli->num_chunks; c++)
+    {
+        s = dir[c].slot;
+        if (s == c)
+            continue;
+
+        int other = owner[c];
+        if (other != NO_SLOT)
+        {
+            swap_slots(pli, c, s);
+            dir[other].slot = s;
+            owner[s] = other;
+        }
+        else
+        {
+            move_entries(pli, (size_t)c * CHUNK, (size_t)s * CHUNK, CHUNK);
+            owner[s] = NO_SLOT;
+        }
+
+        dir[c].slot = c;
+        owner[c] = c;
+    }
+
+    /* close the gaps left by chunks that aren't full */
+    size_t to = 0;
+    for (c = 0; c < pli->num_chunks; c++)
+    {
+        move_entries(pli, to, (size_t)c * CHUNK, dir[c].count);
+        to += dir[c].count;
+    }
+
+    /* and describe the result */
+    pli->num_chunks = MAX((pli->amount + CHUNK - 1) / CHUNK, 1);
+    for (c = 0; c < pli->num_chunks; c++)
+    {
+        dir[c].start = c * CHUNK;
+        dir[c].slot = c;
+        dir[c].count = MIN(CHUNK, pli->amount - c * CHUNK);
+    }
+    reset_free(pli, pli->num_chunks);
+
+    return get_entries(pli);
+}
+
+static void swap_entries(struct pl_index *pli, int i, int j)
+{
+    unsigned long *entries = get_entries(pli);
+    unsigned long tmp = entries[i];
+    entries[i] = entries[j];
+    entries[j] = tmp;
+#ifdef HAVE_DIRCACHE
+    if (pli->refs)
+    {
+        struct dircache_fileref *refs = get_refs(pli);
+        struct dircache_fileref ref = refs[i];
+        refs[i] = refs[j];
+        refs[j] = ref;
+    }
+#endif
+}
+
+/* Put the entries in the order of the shuffle, if there is one */
+static void apply_permutation(struct pl_index *pli)
+{
+    int n = pli->perm_count;
+    if (n == 0)
+        return;
+
+    /* with a bit for every entry, each cycle is followed once */
+    size_t map_size = ((n + 31) / 32) * sizeof(uint32_t);
+    int handle = 0;
+    if (map_size <= core_allocatable())
+        handle = core_alloc(map_size);
+
+    flatten_slots(pli);
+
+    if (handle > 0)
+    {
+        uint32_t *done = core_get_data(handle);
+        memset(done, 0, map_size);
+
+        for (int i = 0; i < n; i++)
+        {
+            if (done[i / 32] & (1u << (i % 32)))
+                continue;
+
+            /* entry j gets what is stored at permute(j), around the cycle */
+            for (int j = i;;)
+            {
+                int k = permute(pli, j, false);
+                done[j / 32] |= 1u << (j % 32);
+                if (k == i)
+                    break;
+                swap_entries(pli, j, k);
+                j = k;
+            }
+        }
+
+        core_free(handle);
+    }
+    else
+    {
+        /* Without memory, find where the entry that belongs at i went: the
+           ones before i have already been exchanged with it */
+        for (int i = 0; i < n; i++)
+        {
+            int j = permute(pli, i, false);
+            while (j < i)
+                j = permute(pli, j, false);
+            if (j != i)
+                swap_entries(pli, i, j);
+        }
+    }
+
+    pli->perm_count = 0;
+    logf("%s: %d entries", __func__, n);
+}
+
+unsigned long *pl_index_flatten(struct pl_index *pli)
+{
+    if (!pli->base)
+        return NULL;
+
+    apply_permutation(pli);
+    return flatten_slots(pli);
+}
+
+void pl_index_shuffle(struct pl_index *pli, unsigned int seed)
+{
+    if (!pli->base)
+        return;
+
+    apply_permutation(pli);
+    if (pli->amount < 2)
+        return;
+
+    int bits = 1;
+    while ((1u << (2 * bits)) < (unsigned int)pli->amount)
+        bits++;
+
+    pli->perm_seed = seed;
+    pli->perm_bits = bits;
+    pli->perm_count = pli->amount;
+}
+
+void pl_index_drop_shuffle(struct pl_index *pli)
+{
+    pli->perm_count = 0;
+}
+
+int pl_index_find(const struct pl_index *pli, unsigned long entry)
+{
+    const struct chunk *dir = get_dir(pli);
+    const unsigned long *entries = get_entries(pli);
+
+    /* search in storage order and map back */
+    for (int c = 0; c < pli->num_chunks; c++)
+    {
+        const unsigned long *p = &entries[(size_t)dir[c].slot * CHUNK];
+        for (int k = 0; k < dir[c].count; k++)
+        {
+            if (p[k] == entry)
+            {
+                int i = dir[c].start + k;
+                return pli->perm_count ? permute(pli, i, true) : i;
+            }
+        }
+    }
+
+    return -1;
+}
+
+bool pl_index_copy(struct pl_index *dst, const struct pl_index *src)
+{
+    if (dst->base == src->base)
+    {
+        /* same block, so only the bookkeeping differs */
+        dst->amount = src->amount;
+        dst->num_chunks = src->num_chunks;
+        dst->perm_seed = src->perm_seed;
+        dst->perm_bits = src->perm_bits;
+        dst->perm_count = src->perm_count;
+        return true;
+    }
+
+    pl_index_clear(dst);
+    for (int i = 0; i < src->amount; i++)
+    {
+        if (!pl_index_insert(dst, i, *pl_index_get(src, i)))
+            return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,101 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef _PLAYLIST_INDEX_H_
+#define _PLAYLIST_INDEX_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+#include "buflib.h"
+#ifdef HAVE_DIRCACHE
+#include "dircache.h"
+#endif
+
+/* Storage for the track indices of a playlist.
+ *
+ * Entries are kept in fixed-size chunks which a small directory links
+ * together in playlist order, so inserting or removing a track only moves
+ * the rest of its chunk and not the rest of the playlist. All chunks live in
+ * one block which is either a buflib allocation that is grown on demand, or
+ * a buffer supplied by the caller which is not.
+ *
+ * Pointers returned by pl_index_get() and pl_index_ref() are only valid
+ * until the next insert or remove, or until the block is moved by buflib.
+ *
+ * pl_index_shuffle() only records the seed, entries are looked up through
+ * a permutation until something changes the order in another way.
+ */
+
+struct pl_index
+{
+    int handle;             /* buflib allocation, 0 for a caller's buffer */
+    struct buflib_callbacks *ops; /* callbacks used for the allocation */
+    void *base;             /* start of the block, NULL if there is none */
+    bool refs;              /* keep a dircache reference for each entry */
+    int amount;             /* number of entries */
+    int max_chunks;         /* chunks that fit in the block */
+    int num_chunks;         /* chunks in use */
+    unsigned int perm_seed; /* key of the shuffle that isn't applied yet */
+    int perm_bits;          /* half the width of its domain */
+    int perm_count;         /* entries it covers, 0 if there is none */
+};
+
+bool pl_index_alloc(struct pl_index *pli, int entries, bool refs,
+                    struct buflib_callbacks *ops);
+void pl_index_init_buffer(struct pl_index *pli, void *buf, size_t size,
+                          bool refs);
+
+/* Buffer size that holds at least the given number of entries */
+size_t pl_index_bufsz(int entries, bool refs);
+/* Number of entries that can be appended without growing the block */
+int pl_index_capacity(const struct pl_index *pli);
+/* Grow the block once so that the given number of entries can be inserted
+   without growing it again. Returns false if there is no memory for that, but
+   inserting may still work. */
+bool pl_index_reserve(struct pl_index *pli, int entries);
+
+void pl_index_clear(struct pl_index *pli);
+bool pl_index_insert(struct pl_index *pli, int i, unsigned long entry);
+void pl_index_remove(struct pl_index *pli, int i);
+void pl_index_swap(struct pl_index *pli, int i, int j);
+unsigned long *pl_index_get(const struct pl_index *pli, int i);
+
+/* Shuffle the entries, the same way every time for the same seed and order */
+void pl_index_shuffle(struct pl_index *pli, unsigned int seed);
+/* Forget a shuffle that wasn't applied yet, for when the order is about to be
+   replaced anyway */
+void pl_index_drop_shuffle(struct pl_index *pli);
+/* Index of an entry equal to entry, -1 if there is none */
+int pl_index_find(const struct pl_index *pli, unsigned long entry);
+
+/* Make entries contiguous and in order and return the first one, so that
+   the whole index can be processed as a flat array. The dircache references
+   are rearranged the same way. */
+unsigned long *pl_index_flatten(struct pl_index *pli);
+
+/* Copy all entries of src to dst, or take over the state of src if both
+   share the same block */
+bool pl_index_copy(struct pl_index *dst, const struct pl_index *src);
+
+#ifdef HAVE_DIRCACHE
+struct dircache_fileref *pl_index_ref(const struct pl_index *pli, int i);
+void pl_index_init_refs(struct pl_index *pli);
+#endif
+
+#endif /* _PLAYLIST_INDEX_H_ */
@@ -0,0 +1,371 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/*
+ * Layout of the block:
+ *
+ *   records[used]                      grow up from the start
+ *   ...free...
+ *   struct path_block index[blocks]    grow down from the end
+ *
+ * A record is the difference of its key to the one before, the length of
+ * the prefix it shares with the path before, the length of the rest and the
+ * rest itself. The numbers are stored 7 bits per byte. The first record of a
+ * block shares nothing and has the key of its index entry.
+ */
+
+#include <string.h>
+#include "config.h"
+#include "system.h"
+#include "core_alloc.h"
+#include "playlist_paths.h"
+
+/*#define LOGF_ENABLE*/
+#include "logf.h"
+
+#define BLOCK_PATHS     16
+#define PATHS_MIN_SIZE  (4 << 10)
+#if MEMORYSIZE <= 8
+#define PATHS_MAX_SIZE  (64 << 10)
+#elif MEMORYSIZE <= 32
+#define PATHS_MAX_SIZE  (256 << 10)
+#else
+#define PATHS_MAX_SIZE  (1 << 20)
+#endif
+
+/* the store that was reserved at startup, see shrink_callback() */
+static struct pl_paths *reserved;
+
+/* a record is at most this long: key delta, prefix, length and the rest */
+#define RECORD_MAX(len) (5 + 2 + 2 + (len))
+
+struct path_block
+{
+    uint32_t key;           /* of the first record */
+    uint32_t offset;        /* of the first record */
+};
+
+static inline struct path_block *get_block(unsigned char *base, size_t size,
+                                           int i)
+{
+    return (struct path_block *)(base + size) - (i + 1);
+}
+
+static unsigned char *put_number(unsigned char *p, unsigned long v)
+{
+    while (v >= 0x80)
+    {
+        *p++ = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    *p++ = v;
+    return p;
+}
+
+static const unsigned char *get_number(const unsigned char *p,
+                                       unsigned long *v)
+{
+    unsigned long r = 0;
+    int shift = 0;
+
+    do
+    {
+        r |= (unsigned long)(*p & 0x7f) << shift;
+        shift += 7;
+    }
+    while (*p++ & 0x80);
+
+    *v = r;
+    return p;
+}
+
+/* Decode the record at p into str, which holds the path of the record before
+   it, and add its delta to key. Returns the next record, or NULL if the path
+   doesn't fit in strsz. */
+static const unsigned char *read_record(const unsigned char *p,
+                                        unsigned long *key,
+                                        char *str, size_t strsz)
+{
+    unsigned long delta, prefix, len;
+
+    p = get_number(p, &delta);
+    p = get_number(p, &prefix);
+    p = get_number(p, &len);
+
+    if (prefix + len >= strsz)
+        return NULL;
+
+    memcpy(str + prefix, p, len);
+    str[prefix + len] = '\0';
+    *key += delta;
+    return p + len;
+}
+
+/* index of the last block whose first key is <= key, -1 if there is none */
+static int find_block(unsigned char *base, const struct pl_paths *pp,
+                      unsigned long key)
+{
+    int lo = 0, hi = pp->blocks - 1, found = -1;
+
+    while (lo <= hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (get_block(base, pp->size, mid)->key <= key)
+        {
+            found = mid;
+            lo = mid + 1;
+        }
+        else
+            hi = mid - 1;
+    }
+
+    return found;
+}
+
+/* The paths can be read from disk again, so the store gives up what it
+   doesn't use when buflib needs memory, and all of it if buflib needs it
+   really hard, rather than the audio buffer having to shrink */
+static int shrink_callback(int handle, unsigned hints, void *start,
+                           size_t old_size)
+{
+    struct pl_paths *pp = reserved;
+
+    if (!pp || handle != pp->handle)
+        return BUFLIB_CB_CANNOT_SHRINK;
+
+    size_t wanted = hints & BUFLIB_SHRINK_SIZE_MASK;
+    size_t index_size = pp->blocks * sizeof(struct path_block);
+
+    if ((hints & BUFLIB_SHRINK_POS_BACK) &&
+        pp->used + index_size + wanted <= old_size)
+    {
+        /* move the index down over the free room */
+        size_t size = ALIGN_DOWN(old_size - wanted, sizeof(struct path_block));
+        unsigned char *base = start;
+        memmove(base + size - index_size, base + old_size - index_size,
+                index_size);
+        core_shrink(handle, start, size);
+        pp->size = size;
+        logf("%s: %lu bytes left", __func__, (unsigned long)size);
+        return BUFLIB_CB_OK;
+    }
+
+    if ((hints & BUFLIB_SHRINK_POS_MASK) == BUFLIB_SHRINK_POS_MASK)
+    {
+        logf("%s: giving up %d paths", __func__, pp->count);
+        pp->handle = core_free(handle);
+        pp->size = pp->used = 0;
+        pp->count = pp->blocks = 0;
+        return BUFLIB_CB_OK;
+    }
+
+    return BUFLIB_CB_CANNOT_SHRINK;
+}
+
+static struct buflib_callbacks ops = {
+    .move_callback = NULL,
+    .shrink_callback = shrink_callback,
+};
+
+/* make room for need more bytes, moving to a larger block if necessary */
+static bool reserve(struct pl_paths *pp, size_t need)
+{
+    size_t index_size = pp->blocks * sizeof(struct path_block);
+    size_t size = pp->size ? pp->size : PATHS_MIN_SIZE;
+
+    if (pp->handle > 0 && pp->used + index_size + need <= pp->size)
+        return true;
+
+    while (pp->used + index_size + need > size)
+        size *= 2;
+
+    /* Only grow beyond the reserve into memory that is free, making the
+       audio buffer shrink for this would cost more than reading the
+       playlist */
+    if (size > PATHS_MAX_SIZE || size > core_allocatable())
+        return false;
+
+    int handle = core_alloc_ex(size, &ops);
+    if (handle <= 0)
+        return false;
+
+    if (pp->handle > 0)
+    {
+        unsigned char *src = core_get_data(pp->handle);
+        unsigned char *dst = core_get_data(handle);
+        memcpy(dst, src, pp->used);
+        memcpy(dst + size - index_size, src + pp->size - index_size,
+               index_size);
+        core_free(pp->handle);
+    }
+
+    logf("%s: %lu bytes", __func__, (unsigned long)size);
+    reserved = pp;
+    pp->handle = handle;
+    pp->size = size;
+    return true;
+}
+
+void pl_paths_init(struct pl_paths *pp, size_t size)
+{
+    memset(pp, 0, sizeof(*pp));
+    reserved = pp;
+
+    size = ALIGN_UP(MIN(size, PATHS_MAX_SIZE), sizeof(struct path_block));
+    pp->handle = core_alloc_ex(size, &ops);
+    if (pp->handle <= 0)
+    {
+        logf("%s: no memory", __func__);
+        pp->handle = 0;
+        return;
+    }
+    pp->size = size;
+}
+
+void pl_paths_clear(struct pl_paths *pp)
+{
+    pp->used = 0;
+    pp->count = pp->blocks = 0;
+}
+
+bool pl_paths_add(struct pl_paths *pp, unsigned long key, const char *path)
+{
+    size_t len = strlen(path), prefix = 0;
+    bool new_block = (pp->count % BLOCK_PATHS) == 0;
+
+    if ((pp->count > 0 && key <= pp->last_key) || len >= MAX_PATH)
+        return false;
+
+    if (!new_block)
+    {
+        while (prefix < len && path[prefix] == pp->last[prefix])
+            prefix++;
+    }
+
+    if (!reserve(pp, RECORD_MAX(len - prefix) +
+                     (new_block ? sizeof(struct path_block) : 0)))
+        return false;
+
+    unsigned char *base = core_get_data(pp->handle);
+    if (new_block)
+    {
+        struct path_block *b = get_block(base, pp->size, pp->blocks++);
+        b->key = key;
+        b->offset = pp->used;
+    }
+
+    unsigned char *p = base + pp->used;
+    p = put_number(p, new_block ? 0 : key - pp->last_key);
+    p = put_number(p, prefix);
+    p = put_number(p, len - prefix);
+    memcpy(p, path + prefix, len - prefix);
+    p += len - prefix;
+
+    pp->used = p - base;
+    pp->count++;
+    pp->last_key = key;
+    memcpy(pp->last + prefix, path + prefix, len - prefix + 1);
+    return true;
+}
+
+void pl_paths_truncate(struct pl_paths *pp, unsigned long key)
+{
+    if (pp->count == 0 || key > pp->last_key)
+        return;
+
+    unsigned char *base = core_get_data(pp->handle);
+    int b = find_block(base, pp, key);
+
+    /* a block that starts with key goes entirely */
+    if (b >= 0 && get_block(base, pp->size, b)->key == key)
+        b--;
+
+    if (b < 0)
+    {
+        pp->used = 0;
+        pp->count = pp->blocks = 0;
+        return;
+    }
+
+    /* keep the records of block b that come before key */
+    const unsigned char *p = base + get_block(base, pp->size, b)->offset;
+    const unsigned char *end = base + pp->used;
+    unsigned long k = get_block(base, pp->size, b)->key;
+    int count = b * BLOCK_PATHS;
+
+    if (b + 1 < pp->blocks)
+        end = base + get_block(base, pp->size, b + 1)->offset;
+
+    while (p < end)
+    {
+        unsigned long next = k;
+        const unsigned char *q = read_record(p, &next, pp->last,
+                                             sizeof(pp->last));
+        if (next >= key)
+            break;
+        p = q;
+        k = next;
+        count++;
+    }
+
+    pp->used = p - base;
+    pp->count = count;
+    pp->blocks = b + 1;
+    pp->last_key = k;
+
+    /* pp->last holds the record that was decoded last, which is the one
+       after the last one kept if the loop stopped early */
+    if (p < end)
+    {
+        p = base + get_block(base, pp->size, b)->offset;
+        k = get_block(base, pp->size, b)->key;
+        for (int i = b * BLOCK_PATHS; i < count; i++)
+            p = read_record(p, &k, pp->last, sizeof(pp->last));
+    }
+}
+
+int pl_paths_get(const struct pl_paths *pp, unsigned long key,
+                 char *buf, size_t bufsz)
+{
+    if (pp->count == 0 || key > pp->last_key)
+        return -1;
+
+    unsigned char *base = core_get_data(pp->handle);
+    int b = find_block(base, pp, key);
+    if (b < 0)
+        return -1;
+
+    const unsigned char *p = base + get_block(base, pp->size, b)->offset;
+    const unsigned char *end = base + pp->used;
+    unsigned long k = get_block(base, pp->size, b)->key;
+
+    if (b + 1 < pp->blocks)
+        end = base + get_block(base, pp->size, b + 1)->offset;
+
+    while (p && p < end)
+    {
+        p = read_record(p, &k, buf, bufsz);
+        if (!p || k > key)
+            break;
+        if (k == key)
+            return strlen(buf);
+    }
+
+    return -1;
+}
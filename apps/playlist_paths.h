@@ -0,0 +1,70 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef _PLAYLIST_PATHS_H_
+#define _PLAYLIST_PATHS_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include "config.h"
+#include "file.h"
+
+/* In-memory copy of the track paths of a playlist.
+ *
+ * Paths are added with increasing keys, normally the offset of the line they
+ * were read from, and stored front coded: each path only keeps what differs
+ * from the one before it, which for playlists is usually the file name. Every
+ * few paths one is stored in full and indexed, so a lookup is a binary search
+ * and decoding at most one such block.
+ *
+ * The store is optional. It is reserved at startup, grows beyond that only
+ * into memory that is free and gives memory back when buflib runs short.
+ * Paths that don't fit or were given up are simply not found, so the caller
+ * must be able to fall back to reading them from disk.
+ */
+
+struct pl_paths
+{
+    int handle;             /* buflib allocation, 0 if there is none */
+    size_t size;            /* of the allocation */
+    size_t used;            /* bytes of paths at the start */
+    int count;              /* paths stored */
+    int blocks;             /* entries of the block index at the end */
+    unsigned long last_key;
+    char last[MAX_PATH];    /* path that was added last */
+};
+
+/* Reserve size bytes for the paths */
+void pl_paths_init(struct pl_paths *pp, size_t size);
+
+/* Forget all paths, keeping the memory */
+void pl_paths_clear(struct pl_paths *pp);
+
+/* Add a path. Returns false if it was not stored, because there is no memory
+   or the key is not larger than all the ones before. */
+bool pl_paths_add(struct pl_paths *pp, unsigned long key, const char *path);
+
+/* Forget the paths with keys from key on */
+void pl_paths_truncate(struct pl_paths *pp, unsigned long key);
+
+/* Copy the path with the given key to buf. Returns its length, or -1 if it
+   isn't stored or doesn't fit. */
+int pl_paths_get(const struct pl_paths *pp, unsigned long key,
+                 char *buf, size_t bufsz);
+
+#endif /* _PLAYLIST_PATHS_H_ */
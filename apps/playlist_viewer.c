@@ -51,6 +51,7 @@
 #include "menus/exported_menus.h"
 #include "yesno.h"
 #include "playback.h"
+#include "metadata_cache.h"
 
 /* Maximum number of tracks we can have loaded at one time                   */
 #define MAX_PLAYLIST_ENTRIES 200
@@ -279,7 +280,7 @@ static bool retrieve_id3_tags(const int index, const char* name, struct mp3entry
     else
     {
     /* Read from disk, the database, doesn't store frequency, file size or codec (g4470) ChrisS*/
-        id3_retrieval_successful = get_metadata_ex(id3, -1, name, flags);
+        id3_retrieval_successful = get_metadata_cached(id3, -1, name, flags);
     }
     return id3_retrieval_successful;
 }
@@ -609,6 +610,39 @@ static void format_line(struct playlist_entry* track, char* str,
     }
 }
 
+/* Number of loaded entries whose tags are read per idle period */
+#define ID3_PREFETCH_ENTRIES 8
+
+/* While the user isn't doing anything, read the tags of the loaded entries
+ * closest to the selection, so that scrolling to them doesn't stall. What is
+ * read also ends up in the metadata cache, where it outlives the buffer.
+ */
+static void playlist_buffer_prefetch_id3(struct playlist_buffer *pb)
+{
+    char line[MAX_PATH];
+    int selected, done = 0;
+
+    if (global_settings.playlist_viewer_track_display !=
+            PLAYLIST_VIEWER_ENTRY_SHOW_ID3_TITLE_AND_ALBUM &&
+        global_settings.playlist_viewer_track_display !=
+            PLAYLIST_VIEWER_ENTRY_SHOW_ID3_TITLE)
+        return;
+
+    selected = playlist_buffer_get_index(pb, viewer.selected_track);
+    for (int dist = 1; dist < pb->num_loaded; dist++)
+    {
+        for (int i = selected - dist; i <= selected + dist; i += 2 * dist)
+        {
+            if (i < 0 || i >= pb->num_loaded ||
+                (pb->tracks[i].attr & PLAYLIST_ATTR_RETRIEVE_ID3_ATTEMPTED))
+                continue;
+            if (done++ >= ID3_PREFETCH_ENTRIES || button_queue_count())
+                return;
+            format_line(&pb->tracks[i], line, sizeof(line));
+        }
+    }
+}
+
 /* Fallback for displaying fullscreen tags, in case there is not
  * enough plugin buffer space left to call the view_text plugin
  * from the Track Info screen
@@ -1204,6 +1238,9 @@ enum playlist_viewer_result playlist_viewer_ex(const char* filename,
                 break;
             }
 #endif /* HAVE_HOTKEY */
+            case ACTION_NONE:
+                playlist_buffer_prefetch_id3(&viewer.buffer);
+                break;
             default:
                 if(default_event_handler(button) == SYS_USB_CONNECTED)
                 {
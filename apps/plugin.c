@@ -875,6 +875,10 @@ static const struct plugin_api rockbox_api = {
 
     /* new stuff at the end, sort into place next time
        the API gets incompatible */
+#ifdef HAVE_RECORDING
+    codec_get_enc_callback,
+#endif
+    pcm_analysis_get,
 };
 
 static int plugin_buffer_handle;
@@ -28,6 +28,7 @@
 static unsigned char output;
 static int output_y = 0;
 static int font_h;
+static int log_fd = -1;
 static unsigned char *plugin_buf;
 struct img_part part;
 
@@ -44,7 +45,8 @@ static void output_row_null(uint32_t row, void * row_in,
     (void) row;
     uint32_t *in = (uint32_t *)row_in;
 #ifdef HAVE_LCD_COLOR
-    uint32_t *lim = in + ctx->bm->width * 3;
+    uint32_t *lim = in + ctx->bm->width *
+                    (sizeof(struct uint32_argb) / sizeof(uint32_t));
 #else
     uint32_t *lim = in + ctx->bm->width;
 #endif
@@ -74,63 +76,139 @@ const struct custom_format format_null = {
     .get_size = get_size_null
 };
 
+/* Scaling cases. The area scaler is used whenever a dimension shrinks and the
+   linear one whenever it grows, so each gets its own set of cases. */
+static const struct {
+    const char *path;
+    short in_w, in_h;
+    short out_w, out_h;
+} cases[] = {
+    { "area",   1024, 1024,  64,  64 },
+    { "area",   1024, 1024, 256, 256 },
+    { "area",    640,  480, 320, 240 },
+    { "area",    500,  500, 176, 176 },
+    { "area",    256,  256, 255, 255 },
+    { "linear",   64,   64, 256, 256 },
+    { "linear",  100,  100, 320, 240 },
+};
+
+/* Output stages. "null" measures the scaler alone, the native ones add the
+   conversion to the LCD's pixel format that album art and backdrops use. */
+static const struct {
+    const char *name;
+    const struct custom_format *format;
+    int format_index;
+} outputs[] = {
+    { "null",   &format_null,   0 },
+#if LCD_DEPTH > 1
+    { "native", &format_native, 0 },
+#ifdef HAVE_LCD_COLOR
+    { "yuv",    &format_native, 1 },
+#endif
+#endif
+};
+
 #define lcd_printf(...) \
 do { \
     rb->lcd_putsxyf(0, output_y, __VA_ARGS__); \
     rb->lcd_update_rect(0, output_y, LCD_WIDTH, font_h); \
     output_y += font_h; \
+    if (output_y + font_h > LCD_HEIGHT) \
+        output_y = 0; \
+    if (log_fd >= 0) \
+        rb->fdprintf(log_fd, __VA_ARGS__), rb->fdprintf(log_fd, "\n"); \
 } while (0)
 
+/* Run one case for at least BENCH_TIME ticks and BENCH_MIN_RUNS runs, and
+   return the throughput in 1/100ths of a megapixel per second. The larger of
+   the source and destination is counted since that is what the scaler walks. */
+#define BENCH_TIME     (5 * HZ)
+#define BENCH_MIN_RUNS 10
+static long bench_one(struct bitmap *bm, struct dim *in_dim,
+                      struct rowset *rset, unsigned char *buf, size_t buf_len,
+                      const struct custom_format *format, int format_index)
+{
+    long t1, t2, t_end;
+    int count = 0;
+    (void)format_index;
+    t2 = *(rb->current_tick);
+    while (t2 == (t1 = *(rb->current_tick)))
+        rb->yield();
+    t_end = t1 + BENCH_TIME;
+    do {
+        if (!resize_on_load(bm, false, in_dim, rset, buf, buf_len, format,
+                            IF_PIX_FMT(format_index,) store_part_null, NULL))
+            return -1;
+        count++;
+        t2 = *(rb->current_tick);
+    } while (TIME_BEFORE(t2, t_end) || count < BENCH_MIN_RUNS);
+
+    uint64_t pixels = (uint64_t)MAX(in_dim->width * in_dim->height,
+                                    bm->width * bm->height) * count;
+    return (long)(pixels * HZ * 100 / ((uint64_t)(t2 - t1) * 1000000));
+}
+
 /* this is the plugin entry point */
 enum plugin_status plugin_start(const void* parameter)
 {
     size_t plugin_buf_len;
     plugin_buf = (unsigned char *)rb->plugin_get_buffer(&plugin_buf_len);
-    struct bitmap bm;
+    static char logfilename[MAX_PATH];
+    struct bitmap bm = { .data = NULL }; /* no alpha channel */
     struct dim in_dim;
     struct rowset rset = {
         .rowstep = 1,
         .rowstart = 0,
     };
+    unsigned i, j;
     (void)parameter;
 
     rb->lcd_set_drawmode(DRMODE_SOLID|DRMODE_INVERSEVID);
     rb->lcd_fillrect(0, 0, LCD_WIDTH, LCD_HEIGHT);
     rb->lcd_set_drawmode(DRMODE_SOLID);
     rb->lcd_getstringsize("A", NULL, &font_h);
-    bm.data = plugin_buf;
-    int in, out;
-    for (in = 64; in < 1025; in <<= 2)
+
+    rb->create_numbered_filename(logfilename, HOME_DIR, "bench_scaler_",
+                                 ".txt", 2 IF_CNFN_NUM_(, NULL));
+    log_fd = rb->open(logfilename, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+
+    /* keep the source pixels predictable so that runs can be compared */
+    for (i = 0; i < 256 * sizeof(*part.buf); i++)
+        plugin_buf[i] = i * 73;
+
+    for (i = 0; i < ARRAYLEN(cases); i++)
     {
-        for (out = 64; out < 257; out <<= 1)
+        in_dim.width = cases[i].in_w;
+        in_dim.height = cases[i].in_h;
+        bm.width = cases[i].out_w;
+        bm.height = rset.rowstop = cases[i].out_h;
+        lcd_printf("%s %dx%d->%dx%d", cases[i].path, in_dim.width,
+                   in_dim.height, bm.width, bm.height);
+        for (j = 0; j < ARRAYLEN(outputs); j++)
         {
-            if (in == out)
+            /* source pixels come first, then the output bitmap, then the
+               scaler's own row buffers */
+            unsigned char *buf = plugin_buf + 256 * sizeof(*part.buf);
+            size_t size = outputs[j].format->get_size(&bm);
+            bm.data = buf;
+            buf += ALIGN_UP(size, sizeof(uint32_t));
+            if (buf >= plugin_buf + plugin_buf_len)
                 continue;
-            lcd_printf("timing %dx%d->%dx>%d scale", in, in, out, out);
-            long t1, t2, t_end;
-            int count = 0;
-            t2 = *(rb->current_tick);
-            in_dim.width = in_dim.height = in;
-            bm.width = bm.height = rset.rowstop = out;
-            while (t2 != (t1 = *(rb->current_tick)));
-            t_end = t1 + 10 * HZ;
-            do {
-                resize_on_load(&bm, false, &in_dim, &rset, (unsigned char *)plugin_buf, plugin_buf_len, &format_null, IF_PIX_FMT(0,) store_part_null, NULL);
-                count++;
-                t2 = *(rb->current_tick);
-            } while (TIME_BEFORE(t2, t_end) || count < 10);
-            t2 -= t1;
-            t2 *= 10;
-            t2 += count >> 1;
-            t2 /= count;
-            t1 = t2 / 1000;
-            t2 -= t1 * 1000;
-            lcd_printf("%01d.%03d secs/scale", (int)t1, (int)t2);
-            if (!(bm.width && bm.height))
-                break;
+            long mpx = bench_one(&bm, &in_dim, &rset, buf,
+                                 plugin_buf + plugin_buf_len - buf,
+                                 outputs[j].format, outputs[j].format_index);
+            if (mpx < 0)
+                lcd_printf("  %-6s failed", outputs[j].name);
+            else
+                lcd_printf("  %-6s %3ld.%02ld Mpx/s", outputs[j].name,
+                           mpx / 100, mpx % 100);
         }
     }
 
+    lcd_printf("done, results in %s", logfilename);
+    if (log_fd >= 0)
+        rb->close(log_fd);
+
     while (rb->get_action(CONTEXT_STD,1) != ACTION_STD_OK) rb->yield();
     return PLUGIN_OK;
 }
@@ -22,6 +22,7 @@
 #include "lib/pluginlib_touchscreen.h"
 #include "lib/pluginlib_exit.h"
 #include "lib/pluginlib_actions.h"
+#include "fixedpoint.h"
 
 /* this set the context to use with PLA */
 static const struct button_mapping *plugin_contexts[] = { pla_main_ctx };
@@ -628,6 +629,224 @@ static void codec_thread(void)
     codec_playing = false;
 }
 
+#ifdef HAVE_RECORDING
+/* Encoder speed test: a synthetic signal is fed to the encoder from memory
+   and the output is only counted, so only the encoder is measured */
+#define ENC_TEST_SAMPR      44100
+#define ENC_TEST_SECONDS    30
+#define ENC_TEST_BITRATE    128
+
+static int16_t *enc_pcm;            /* stereo frames */
+static size_t enc_pcm_frames;       /* in enc_pcm, played in a loop */
+static size_t enc_pcm_pos;
+static unsigned long enc_frames_left;
+static unsigned long enc_bytes;
+static bool enc_aborted;
+static struct encoder_config enc_config;
+static union
+{
+    struct enc_chunk_data data;
+    uint8_t buf[sizeof (struct enc_chunk_data) + 4096];
+} enc_chunk;
+
+/* Some tones with a slow envelope and a little noise, so the quantizer has
+   something to do in every band */
+static void enc_make_signal(void)
+{
+    static const unsigned freqs[2][3] = { { 220, 1320, 5000 },
+                                          { 330, 1357, 7500 } };
+    const unsigned long full = 360ul << 16;
+    unsigned long phase[2][3] = { { 0 } };
+    unsigned long env_phase = 0;
+    uint32_t noise = 1;
+
+    enc_pcm = audiobuf;
+    enc_pcm_frames = MIN(audiosize / (2 * sizeof (int16_t)),
+                         (size_t)ENC_TEST_SAMPR * 10);
+
+    for (size_t i = 0; i < enc_pcm_frames; i++)
+    {
+        /* 0.25 Hz, between 1/8 and 1 */
+        long env = 9216 + (fp14_sin(env_phase >> 16) * 7168 >> 14);
+        env_phase = (env_phase + (full / 4) / ENC_TEST_SAMPR) % full;
+
+        for (int ch = 0; ch < 2; ch++)
+        {
+            long v = 0;
+
+            for (int k = 0; k < 3; k++)
+            {
+                v += fp14_sin(phase[ch][k] >> 16) >> k;
+                phase[ch][k] = (phase[ch][k] +
+                                freqs[ch][k] * (full / ENC_TEST_SAMPR)) % full;
+            }
+
+            noise = noise * 1664525 + 1013904223;
+            v = (v * env >> 15) + ((int32_t)noise >> 22);
+            enc_pcm[2*i + ch] = v;
+        }
+    }
+}
+
+static int enc_pcmbuf_read(void *buf, int count)
+{
+    if (enc_frames_left < (unsigned long)count)
+    {
+        codec_action = CODEC_ACTION_HALT;
+        return 0;
+    }
+
+    int16_t *dst = buf;
+    size_t pos = enc_pcm_pos;
+
+    for (int i = count; i > 0; )
+    {
+        size_t n = MIN((size_t)i, enc_pcm_frames - pos);
+        rb->memcpy(dst, enc_pcm + 2*pos, n * 2 * sizeof (int16_t));
+        dst += 2*n;
+        i -= n;
+        pos = (pos + n) % enc_pcm_frames;
+    }
+
+    return count;
+}
+
+static int enc_pcmbuf_advance(int count)
+{
+    enc_pcm_pos = (enc_pcm_pos + count) % enc_pcm_frames;
+    enc_frames_left -= count;
+    return count;
+}
+
+static struct enc_chunk_data * enc_encbuf_get_buffer(size_t need)
+{
+    if (need > sizeof (enc_chunk) - sizeof (struct enc_chunk_data))
+    {
+        codec_action = CODEC_ACTION_HALT;
+        return NULL;
+    }
+
+    return &enc_chunk.data;
+}
+
+static void enc_encbuf_finish_buffer(void)
+{
+    enc_bytes += enc_chunk.data.hdr.size;
+}
+
+static void encoder_thread(void)
+{
+    const char *codecname =
+        rb->get_codec_filename(AFMT_MPA_L3 | CODEC_TYPE_ENCODER);
+
+    if (rb->codec_load_file(codecname, &ci) >= 0)
+    {
+        enc_callback_t enc_cb = rb->codec_get_enc_callback();
+
+        if (enc_cb)
+        {
+            struct enc_inputs inputs =
+            {
+                .sample_rate  = ENC_TEST_SAMPR,
+                .num_channels = 2,
+                .config       = &enc_config,
+            };
+
+            enc_cb(ENC_CB_INPUTS, &inputs);
+            rb->codec_run_proc();
+        }
+    }
+
+    rb->codec_close();
+
+    endtick = *rb->current_tick;
+    codec_playing = false;
+}
+
+/* Returns false if the user stopped it */
+static bool test_encoder(bool fast)
+{
+    char str[64];
+    long starttick, ticks;
+    unsigned long speed, duration;
+
+    rb->snprintf(str, sizeof(str), "MP3 %d kbit/s%s", ENC_TEST_BITRATE,
+                 fast ? ", fast" : "");
+    log_text(str, true);
+
+    init_ci();
+    ci.enc_pcmbuf_read = enc_pcmbuf_read;
+    ci.enc_pcmbuf_advance = enc_pcmbuf_advance;
+    ci.enc_encbuf_get_buffer = enc_encbuf_get_buffer;
+    ci.enc_encbuf_finish_buffer = enc_encbuf_finish_buffer;
+    ci.round_value_to_list32 = rb->round_value_to_list32;
+
+    enc_config.afmt = AFMT_MPA_L3;
+    enc_config.mp3_enc.bitrate = ENC_TEST_BITRATE;
+    enc_config.mp3_enc.fast = fast;
+
+    enc_pcm_pos = 0;
+    enc_frames_left = (unsigned long)ENC_TEST_SAMPR * ENC_TEST_SECONDS;
+    enc_bytes = 0;
+    enc_aborted = false;
+
+    starttick = *rb->current_tick;
+    codec_playing = true;
+    codec_action = CODEC_ACTION_NULL;
+
+    rb->codec_thread_do_callback(encoder_thread, NULL);
+
+    while (codec_playing)
+    {
+        int button = pluginlib_getaction(HZ, plugin_contexts,
+                          ARRAYLEN(plugin_contexts));
+        if ((button == TESTCODEC_EXITBUTTON) || (button == TESTCODEC_EXITBUTTON2))
+        {
+            codec_action = CODEC_ACTION_HALT;
+            enc_aborted = true;
+            break;
+        }
+    }
+
+    rb->codec_thread_do_callback(NULL, NULL);
+
+    if (enc_aborted)
+        return false;
+
+    if (enc_bytes == 0)
+    {
+        log_text("Cannot run encoder", true);
+        return true;
+    }
+
+    ticks = endtick - starttick;
+    rb->snprintf(str, sizeof(str), "Encode time - %d.%02ds",
+                 (int)ticks/100, (int)ticks%100);
+    log_text(str, true);
+
+    duration = ENC_TEST_SECONDS * 100;
+    speed = ticks > 0 ? duration * 10000 / ticks : 0;
+    rb->snprintf(str, sizeof(str), "%d.%02d%% realtime",
+                 (int)speed/100, (int)speed%100);
+    log_text(str, true);
+
+    rb->snprintf(str, sizeof(str), "%lu kbit/s written",
+                 enc_bytes * 8 / (ENC_TEST_SECONDS * 1000));
+    log_text(str, true);
+
+    return true;
+}
+
+static void test_encoders(void)
+{
+    log_text("Generating test signal", true);
+    enc_make_signal();
+
+    if (test_encoder(false))
+        test_encoder(true);
+}
+#endif /* HAVE_RECORDING */
+
 static enum plugin_status test_track(const char* filename)
 {
     size_t n;
@@ -886,6 +1105,9 @@ enum plugin_status plugin_start(const void* parameter)
         WRITE_WAV_WITH_DSP,
         CHECKSUM,
         CHECKSUM_DIR,
+#ifdef HAVE_RECORDING
+        ENCODER_TEST,
+#endif
         QUIT,
 #ifdef HAVE_ADJUSTABLE_CPU_FREQ
         BOOST,
@@ -902,6 +1124,9 @@ enum plugin_status plugin_start(const void* parameter)
         "Write WAV with DSP",
         "Checksum",
         "Checksum folder",
+#ifdef HAVE_RECORDING
+        "MP3 encoder speed test",
+#endif
         "Quit",
 #ifdef HAVE_ADJUSTABLE_CPU_FREQ
         "Boosting",
@@ -933,6 +1158,25 @@ menu:
         goto exit;
     }
 
+#ifdef HAVE_RECORDING
+    if (result == ENCODER_TEST)
+    {
+        log_init(false);
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+        if (boost)
+            rb->cpu_boost(true);
+#endif
+        test_encoders();
+#ifdef HAVE_ADJUSTABLE_CPU_FREQ
+        if (boost)
+            rb->cpu_boost(false);
+#endif
+        plugin_quit();
+        rb->button_clear_queue();
+        goto show_menu;
+    }
+#endif /* HAVE_RECORDING */
+
     scandir = 0;
 
     /* Map test runs with checksum calcualtion to standard runs 
@@ -970,7 +970,7 @@ static void vu_meter_cleanup(void)
 
 enum plugin_status plugin_start(const void* parameter)
 {
-    static struct pcm_peaks peaks;
+    struct pcm_analysis analysis;
     int button;
 #if defined(VUMETER_HELP_PRE) || defined(VUMETER_MENU_PRE)
     int lastbutton = BUTTON_NONE;
@@ -1003,17 +1003,17 @@ enum plugin_status plugin_start(const void* parameter)
 
 #ifdef USB_ENABLE_AUDIO
         if (rb->usb_audio_get_playing())
-            rb->mixer_channel_calculate_peaks(PCM_MIXER_CHAN_USBAUDIO,
-                                              &peaks);
+            rb->pcm_analysis_get(PCM_MIXER_CHAN_USBAUDIO,
+                                 PCM_ANALYSIS_PEAK, &analysis);
         else
 #endif
-            rb->mixer_channel_calculate_peaks(PCM_MIXER_CHAN_PLAYBACK,
-                                              &peaks);
+            rb->pcm_analysis_get(PCM_MIXER_CHAN_PLAYBACK,
+                                 PCM_ANALYSIS_PEAK, &analysis);
 
         if(vumeter_settings.meter_type == ANALOG)
-            draw_analog_meter(peaks.left, peaks.right);
+            draw_analog_meter(analysis.peak[0], analysis.peak[1]);
         else
-            draw_digital_meter(peaks.left, peaks.right);
+            draw_digital_meter(analysis.peak[0], analysis.peak[1]);
 
         rb->lcd_update();
 
@@ -30,6 +30,9 @@
 #include "pathfuncs.h"
 #include "settings.h"
 #include "wps.h"
+#include "crc32.h"
+#include "file.h"
+#include "dir.h"
 
 /* Define LOGF_ENABLE to enable logf output in this file */
 /*#define LOGF_ENABLE*/
@@ -118,8 +121,12 @@ static bool try_exts(char *path, int len)
  * then the colon is skipped ("100x100" will be used) and the track
  * specific image (./<trackname><size>.bmp) is tried last instead of first.
  */
-bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
-                           char *buf, int buflen)
+#define AA_SEARCH_TRACK     0x1 /* ./<trackname><size> */
+#define AA_SEARCH_SHARED    0x2 /* everything not specific to the track */
+#define AA_SEARCH_ALL       (AA_SEARCH_TRACK | AA_SEARCH_SHARED)
+
+static bool search_files(const struct mp3entry *id3, const char *size_string,
+                         char *buf, int buflen, int flags)
 {
     char path[MAX_PATH + 11]; /* need room for filename and null termination */
     char dir[MAX_PATH + 1];
@@ -143,7 +150,8 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
     if (*size_string == ':')
     {
         size_string++;
-        track_first = 0;
+        if (flags == AA_SEARCH_ALL)
+            track_first = 0;
     }
 
     strip_filename(dir, sizeof(dir), trackname);
@@ -152,7 +160,7 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
 
     for(pass = 0; pass < 2 - track_first; pass++)
     {
-        if (track_first || pass)
+        if ((track_first || pass) && (flags & AA_SEARCH_TRACK))
         {
             /* the first file we look for is one specific to the
                current track */
@@ -165,7 +173,7 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
 #endif
             found = try_exts(path, pathlen);
         }
-        if (pass)
+        if (pass || !(flags & AA_SEARCH_SHARED))
             break;
         if (!found && albumlen > 0)
         {
@@ -251,7 +259,79 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
     return true;
 }
 
+bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
+                           char *buf, int buflen)
+{
+    return search_files(id3, size_string, buf, buflen, AA_SEARCH_ALL);
+}
+
 #ifndef PLUGIN
+/* Results of the directory search, shared by all the tracks of an album.
+ * Only the locations that don't depend on the track name are remembered,
+ * the track specific names are always probed first. */
+#define AA_LOOKUP_ENTRIES   4
+
+enum aa_lookup_result
+{
+    AA_LOOKUP_NONE = 0,     /* nothing found */
+    AA_LOOKUP_SIZED,        /* found a bitmap of the requested size */
+    AA_LOOKUP_GENERIC,      /* found a bitmap without size in its name */
+};
+
+static struct aa_lookup_entry
+{
+    uint32_t key;           /* hash of dir, album, artist and dimensions */
+    int result;             /* enum aa_lookup_result */
+    char path[MAX_PATH];    /* bitmap found if result != AA_LOOKUP_NONE */
+} aa_lookup[AA_LOOKUP_ENTRIES];
+static unsigned int aa_lookup_next;
+
+static uint32_t aa_lookup_key(const struct mp3entry *id3, const struct dim *dim)
+{
+    const char *artist = id3->albumartist ?: id3->artist;
+    const char *sep = strrchr(id3->path, '/');
+    uint32_t key = crc_32(dim, sizeof (*dim), 0xffffffff);
+
+    if (sep)
+        key = crc_32(id3->path, sep - id3->path, key);
+    if (id3->album)
+        key = crc_32(id3->album, strlen(id3->album) + 1, key);
+    if (artist)
+        key = crc_32(artist, strlen(artist) + 1, key);
+
+    return key;
+}
+
+static struct aa_lookup_entry * aa_lookup_find(uint32_t key)
+{
+    for (int i = 0; i < AA_LOOKUP_ENTRIES; i++)
+    {
+        struct aa_lookup_entry *e = &aa_lookup[i];
+        if (e->key == key && e->key != 0)
+            return e;
+    }
+
+    return NULL;
+}
+
+static void aa_lookup_store(uint32_t key, int result, const char *path)
+{
+    struct aa_lookup_entry *e = &aa_lookup[aa_lookup_next];
+    aa_lookup_next = (aa_lookup_next + 1) % AA_LOOKUP_ENTRIES;
+
+    e->key = key;
+    e->result = result;
+    strmemccpy(e->path, result != AA_LOOKUP_NONE ? path : "", sizeof (e->path));
+}
+
+/* Forget all the remembered search results, for example because bitmaps
+ * may have been added or removed. */
+void albumart_lookup_flush(void)
+{
+    memset(aa_lookup, 0, sizeof (aa_lookup));
+    aa_lookup_next = 0;
+}
+
 /* Look for albumart bitmap in the same dir as the track and in its parent dir.
  * Stores the found filename in the buf parameter.
  * Returns true if a bitmap was found, false otherwise */
@@ -268,13 +348,241 @@ bool find_albumart(const struct mp3entry *id3, char *buf, int buflen,
     snprintf(size_string, sizeof(size_string), ".%dx%d",
               dim->width, dim->height);
 
-    /* First we look for a bitmap of the right size */
-    if (search_albumart_files(id3, size_string, buf, buflen))
+    /* The search order is kept the same as without the lookup cache:
+     * sized track bitmap, sized shared bitmaps, generic track bitmap and
+     * finally generic shared bitmaps. */
+    if (search_files(id3, size_string, buf, buflen, AA_SEARCH_TRACK))
+        return true;
+
+    uint32_t key = aa_lookup_key(id3, dim);
+    struct aa_lookup_entry *e = aa_lookup_find(key);
+    int result;
+
+    if (e)
+    {
+        result = e->result;
+        logf("Album art lookup hit: %d", result);
+    }
+    else if (search_files(id3, size_string, buf, buflen, AA_SEARCH_SHARED))
+    {
+        aa_lookup_store(key, AA_LOOKUP_SIZED, buf);
+        return true;
+    }
+    else
+        result = -1; /* shared generic bitmaps not searched yet */
+
+    if (result != AA_LOOKUP_SIZED &&
+        search_files(id3, "", buf, buflen, AA_SEARCH_TRACK))
         return true;
 
-    /* Then we look for generic bitmaps */
-    *size_string = 0;
-    return search_albumart_files(id3, size_string, buf, buflen);
+    if (result < 0)
+    {
+        result = search_files(id3, "", buf, buflen, AA_SEARCH_SHARED) ?
+                    AA_LOOKUP_GENERIC : AA_LOOKUP_NONE;
+        aa_lookup_store(key, result, buf);
+        return result != AA_LOOKUP_NONE;
+    }
+
+    if (result == AA_LOOKUP_NONE)
+        return false;
+
+    strmemccpy(buf, e->path, buflen);
+    return true;
 }
 
+/* Persistent cache of album art that has already been decoded and scaled
+ * to native format. Entries are named after a hash of the path of the file
+ * holding the image, its size and samples from the start and the end of the
+ * image data, so tracks sharing the same cover file also share the cached
+ * bitmap and a replaced cover gets a new entry. When the cache grows beyond
+ * AA_CACHE_MAX_SIZE, entries are removed in the order they were written
+ * (first in, first out); a hit doesn't renew an entry, which would cost a
+ * directory write every time a cover is shown. */
+#define AA_CACHE_MAGIC      0x52424141 /* RBAA */
+#define AA_CACHE_VERSION    ((LCD_DEPTH << 24) | (LCD_PIXELFORMAT << 8) | 2)
+#define AA_CACHE_HASH_BYTES 512
+#define AA_CACHE_MAX_SIZE   (4*1024*1024)
+#define AA_CACHE_MAX_EVICT  8
+
+struct aa_cache_header
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t key;           /* hash of the source image */
+    uint32_t srcsize;       /* size of the source image */
+    int32_t  dim_width;     /* requested dimensions */
+    int32_t  dim_height;
+    int32_t  width;         /* dimensions of the cached bitmap */
+    int32_t  height;
+    int32_t  format;
+    int32_t  alpha_offset;
+    int32_t  size;          /* size of the bitmap data that follows */
+};
+
+static void aa_cache_filename(char *buf, size_t bufsize, uint32_t key,
+                              const struct dim *dim)
+{
+    snprintf(buf, bufsize, ALBUMART_CACHE_DIR "/%08lx_%dx%d.rbaa",
+             (unsigned long)key, dim->width, dim->height);
+}
+
+/* Remove the entries written first until size more bytes fit */
+static void aa_cache_evict(int size)
+{
+    char path[MAX_PATH];
+
+    for (int i = 0; i < AA_CACHE_MAX_EVICT; i++)
+    {
+        DIR *dir = opendir(ALBUMART_CACHE_DIR);
+        if (!dir)
+            return;
+
+        struct dirent *entry;
+        off_t total = size;
+        time_t oldest_time = 0;
+        bool found = false;
+
+        while ((entry = readdir(dir)))
+        {
+            struct dirinfo info = dir_get_info(dir, entry);
+            if (info.attribute & ATTR_DIRECTORY)
+                continue;
+
+            total += info.size;
+            if (!found || info.mtime < oldest_time)
+            {
+                found = true;
+                oldest_time = info.mtime;
+                snprintf(path, sizeof (path), ALBUMART_CACHE_DIR "/%s",
+                         entry->d_name);
+            }
+        }
+
+        closedir(dir);
+
+        if (!found || total <= AA_CACHE_MAX_SIZE)
+            return;
+
+        logf("Album art cache full, removing %s", path);
+        remove(path);
+    }
+}
+
+/* Identify the image at the current position of fd (the embedded picture if
+ * aa is given) in the file at srcpath and try to load a cached scaled copy
+ * of it into bmp. The file position is restored in any case. Returns the
+ * size of the bitmap data or <= 0 if there is no matching cache entry, *key
+ * receives the cache key to use with albumart_cache_store(). */
+int albumart_cache_load(int fd, const char *srcpath,
+                        const struct mp3_albumart *aa,
+                        const struct dim *dim, struct bitmap *bmp,
+                        int maxsize, struct albumart_cache_key *key)
+{
+    unsigned char sample[AA_CACHE_HASH_BYTES];
+    off_t start = aa ? aa->pos : 0;
+    uint32_t srcsize = aa ? (uint32_t)aa->size : (uint32_t)filesize(fd);
+    struct aa_cache_header hdr;
+    char path[MAX_PATH];
+    int rc = 0;
+
+    key->hash = 0;
+    key->srcsize = srcsize;
+
+    uint32_t hash = crc_32(srcpath, strlen(srcpath), 0xffffffff);
+    hash = crc_32(&srcsize, sizeof (srcsize), hash);
+
+    /* the start and the end of the image data */
+    size_t samplesize = MIN(srcsize, sizeof (sample));
+    lseek(fd, start, SEEK_SET);
+    ssize_t len = read(fd, sample, samplesize);
+    if (len > 0)
+    {
+        hash = crc_32(sample, len, hash);
+        lseek(fd, start + srcsize - samplesize, SEEK_SET);
+        len = read(fd, sample, samplesize);
+        hash = crc_32(sample, MAX(len, 0), hash);
+    }
+
+    lseek(fd, start, SEEK_SET);
+    if (len <= 0)
+        return 0;
+
+    key->hash = hash;
+
+    aa_cache_filename(path, sizeof (path), key->hash, dim);
+    int cfd = open(path, O_RDONLY);
+    if (cfd < 0)
+        return 0;
+
+    if (read(cfd, &hdr, sizeof (hdr)) == sizeof (hdr) &&
+        hdr.magic == AA_CACHE_MAGIC && hdr.version == AA_CACHE_VERSION &&
+        hdr.key == key->hash && hdr.srcsize == srcsize &&
+        hdr.dim_width == dim->width && hdr.dim_height == dim->height &&
+        hdr.size > 0 && hdr.size <= maxsize &&
+        read(cfd, bmp->data, hdr.size) == hdr.size)
+    {
+        bmp->width = hdr.width;
+        bmp->height = hdr.height;
+#if (LCD_DEPTH > 1) || defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1)
+        bmp->format = hdr.format;
+#endif
+#ifdef HAVE_LCD_COLOR
+        bmp->alpha_offset = hdr.alpha_offset;
+#endif
+        rc = hdr.size;
+        logf("Album art from cache: %s", path);
+    }
+
+    close(cfd);
+    return rc;
+}
+
+/* Save a freshly decoded bitmap under the key obtained by a previous call
+ * to albumart_cache_load() */
+void albumart_cache_store(const struct albumart_cache_key *key,
+                          const struct dim *dim,
+                          const struct bitmap *bmp, int size)
+{
+    struct aa_cache_header hdr =
+    {
+        .magic        = AA_CACHE_MAGIC,
+        .version      = AA_CACHE_VERSION,
+        .key          = key->hash,
+        .srcsize      = key->srcsize,
+        .dim_width    = dim->width,
+        .dim_height   = dim->height,
+        .width        = bmp->width,
+        .height       = bmp->height,
+        .size         = size,
+    };
+    char path[MAX_PATH];
+
+    if (key->hash == 0 || size <= 0)
+        return;
+
+#if (LCD_DEPTH > 1) || defined(HAVE_REMOTE_LCD) && (LCD_REMOTE_DEPTH > 1)
+    hdr.format = bmp->format;
+#endif
+#ifdef HAVE_LCD_COLOR
+    hdr.alpha_offset = bmp->alpha_offset;
+#endif
+
+    if (!dir_exists(ALBUMART_CACHE_DIR) && mkdir(ALBUMART_CACHE_DIR) < 0)
+        return;
+
+    aa_cache_evict(sizeof (hdr) + size);
+
+    aa_cache_filename(path, sizeof (path), key->hash, dim);
+    int fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+
+    /* a truncated file is rejected by the size check when loading */
+    bool ok = write(fd, &hdr, sizeof (hdr)) == sizeof (hdr) &&
+              write(fd, bmp->data, size) == size;
+
+    close(fd);
+    if (!ok)
+        remove(path);
+}
 #endif /* PLUGIN */
@@ -40,6 +40,26 @@ bool search_albumart_files(const struct mp3entry *id3, const char *size_string,
 
 void get_albumart_size(struct bitmap *bmp);
 
+#ifndef PLUGIN
+void albumart_lookup_flush(void);
+
+/* Identifies a source image in the scaled album art cache */
+struct albumart_cache_key
+{
+    uint32_t hash;      /* hash of the path, size and image data samples */
+    uint32_t srcsize;   /* size of the image data */
+};
+
+int albumart_cache_load(int fd, const char *srcpath,
+                        const struct mp3_albumart *aa,
+                        const struct dim *dim, struct bitmap *bmp,
+                        int maxsize, struct albumart_cache_key *key);
+
+void albumart_cache_store(const struct albumart_cache_key *key,
+                          const struct dim *dim,
+                          const struct bitmap *bmp, int size);
+#endif /* PLUGIN */
+
 #endif /* HAVE_ALBUMART */
 
 #endif /* _ALBUMART_H_ */
@@ -143,5 +143,6 @@ struct bitstream
 #define DHT       0x0020 /* with Definition of huffman tables */
 #define SOS       0x0040 /* with Start-of-Scan segment */
 #define DQT       0x0080 /* with definition of quantization table */
+#define EOI       0x0100 /* with End-of-Image marker (progressive only) */
 
 #endif /* _JPEG_COMMON_H */
@@ -136,6 +136,18 @@ struct jpeg
     int subsample_x[3]; /* info per component */
     int subsample_y[3];
     bool resize;
+    bool progressive; /* SOF2: coefficients are spread over several scans */
+    int components; /* number of components in the frame */
+    int scan_comps; /* number of components in the current scan */
+    int scan_ss, scan_se; /* spectral selection of the current scan */
+    int scan_ah, scan_al; /* successive approximation of the current scan */
+    int eobrun; /* blocks left in the current end-of-band run */
+    int mcu_y; /* MCU row being output from the coefficient buffer */
+    int dc_pred[3]; /* per component DC predictor for progressive scans */
+    int coef_num[3]; /* per component number of coefficients kept per block */
+    int coef_bw[3]; /* per component number of blocks per row */
+    int16_t *coef_buf[3]; /* per component kept coefficients */
+    uint64_t *coef_nz[3]; /* per component masks of nonzero coefficients */
     unsigned char buf[JPEG_READ_BUF_SIZE];
     struct img_part part;
 };
@@ -995,14 +1007,22 @@ static int process_markers(struct jpeg* p_jpeg)
 
     while (!done)
     {
-        c = e_getc(p_jpeg, -1);
-        if (c != 0xFF) /* no marker? */
-        {
-            JDEBUGF("Non-marker data\n");
-            continue; /* discard */
+        if (p_jpeg->marker)
+        {   /* marker was met while reading the previous scan */
+            c = p_jpeg->marker;
+            p_jpeg->marker = 0;
         }
+        else
+        {
+            c = e_getc(p_jpeg, -1);
+            if (c != 0xFF) /* no marker? */
+            {
+                JDEBUGF("Non-marker data\n");
+                continue; /* discard */
+            }
 
-        c = e_getc(p_jpeg, -1);
+            c = e_getc(p_jpeg, -1);
+        }
         JDEBUGF("marker value %X\n",c);
         switch (c)
         {
@@ -1012,6 +1032,9 @@ static int process_markers(struct jpeg* p_jpeg)
         case 0x00: /* Zero stuffed byte */
             break; /* discard */
 
+        case 0xC2: /* SOF Huff  - Progressive DCT*/
+            p_jpeg->progressive = true;
+            /* fallthrough */
         case 0xC0: /* SOF Huff  - Baseline DCT */
             {
                 JDEBUGF("SOF marker ");
@@ -1050,11 +1073,11 @@ static int process_markers(struct jpeg* p_jpeg)
                     return -3; /* Unsupported SOF0 subsampling */
                 }
                 p_jpeg->blocks = n;
+                p_jpeg->components = n;
             }
             break;
 
         case 0xC1: /* SOF Huff  - Extended sequential DCT*/
-        case 0xC2: /* SOF Huff  - Progressive DCT*/
         case 0xC3: /* SOF Huff  - Spatial (sequential) lossless*/
         case 0xC5: /* SOF Huff  - Differential sequential DCT*/
         case 0xC6: /* SOF Huff  - Differential progressive DCT*/
@@ -1067,7 +1090,7 @@ static int process_markers(struct jpeg* p_jpeg)
         case 0xCE: /* SOF Arith - Differential progressive DCT*/
         case 0xCF: /* SOF Arith - Differential spatial*/
             {
-                return (-4); /* other DCT model than baseline not implemented */
+                return (-4); /* other DCT models not implemented */
             }
 
         case 0xC4: /* Define Huffman Table(s) */
@@ -1139,6 +1162,11 @@ static int process_markers(struct jpeg* p_jpeg)
             break;
         case 0xD9: /* End of Image */
             JDEBUGF("EOI\n");
+            if (p_jpeg->progressive)
+            {   /* all scans have been read */
+                ret |= EOI;
+                done = true;
+            }
             break;
         case 0x01: /* for temp private use arith code */
             JDEBUGF("private\n");
@@ -1153,7 +1181,8 @@ static int process_markers(struct jpeg* p_jpeg)
                 marker_size -= 2;
 
                 n = (marker_size-1-3)/2;
-                if (e_getc(p_jpeg, -1) != n || (n != 1 && n != 3))
+                if (e_getc(p_jpeg, -1) != n || (n != 1 && n != 3 &&
+                    !(p_jpeg->progressive && n == 2)))
                 {
                     return (-7); /* Unsupported SOS component specification */
                 }
@@ -1166,7 +1195,15 @@ static int process_markers(struct jpeg* p_jpeg)
                     p_jpeg->scanheader[i].AC_select = c & 0x0F;
                     marker_size -= 2;
                 }
-                /* skip spectral information */
+                p_jpeg->scan_comps = n;
+                /* spectral selection and successive approximation, only
+                 * used by progressive images */
+                p_jpeg->scan_ss = e_getc(p_jpeg, -1);
+                p_jpeg->scan_se = e_getc(p_jpeg, -1);
+                c = e_getc(p_jpeg, -1);
+                p_jpeg->scan_ah = c >> 4;
+                p_jpeg->scan_al = c & 0x0F;
+                marker_size -= 3;
                 e_skip_bytes(p_jpeg, marker_size);
                 done = true;
             }
@@ -1611,12 +1648,12 @@ INLINE void fix_quant_tables(struct jpeg *p_jpeg)
 * is evaluated multiple times.
 */
 
-static void fill_bit_buffer(struct jpeg* p_jpeg)
+INLINE unsigned char get_scan_byte(struct jpeg* p_jpeg, int marker_ind)
 {
     unsigned char byte, marker;
 
-    if (p_jpeg->marker_val)
-        p_jpeg->marker_ind += 16;
+    if (UNLIKELY(p_jpeg->marker)) /* end of scan reached, pad with zeros */
+        return 0;
     byte = d_getc(p_jpeg, 0);
     if (UNLIKELY(byte == 0xFF)) /* legal marker can be byte stuffing or RSTm */
     {   /* simplification: just skip the (one-byte) marker code */
@@ -1624,22 +1661,23 @@ static void fill_bit_buffer(struct jpeg* p_jpeg)
         if ((marker & ~7) == 0xD0)
         {
             p_jpeg->marker_val = marker;
-            p_jpeg->marker_ind = 8;
+            p_jpeg->marker_ind = marker_ind;
         }
-    }
-    p_jpeg->bitbuf = (p_jpeg->bitbuf << 8) | byte;
-
-    byte = d_getc(p_jpeg, 0);
-    if (UNLIKELY(byte == 0xFF)) /* legal marker can be byte stuffing or RSTm */
-    {   /* simplification: just skip the (one-byte) marker code */
-        marker = d_getc(p_jpeg, 0);
-        if ((marker & ~7) == 0xD0)
-        {
-            p_jpeg->marker_val = marker;
-            p_jpeg->marker_ind = 0;
+        else if (marker && p_jpeg->progressive)
+        {   /* keep it for process_markers(), more scans may follow */
+            p_jpeg->marker = marker;
+            byte = 0;
         }
     }
-    p_jpeg->bitbuf = (p_jpeg->bitbuf << 8) | byte;
+    return byte;
+}
+
+static void fill_bit_buffer(struct jpeg* p_jpeg)
+{
+    if (p_jpeg->marker_val)
+        p_jpeg->marker_ind += 16;
+    p_jpeg->bitbuf = (p_jpeg->bitbuf << 8) | get_scan_byte(p_jpeg, 8);
+    p_jpeg->bitbuf = (p_jpeg->bitbuf << 8) | get_scan_byte(p_jpeg, 0);
     p_jpeg->bitbuf_bits += 16;
 #ifdef JPEG_BS_DEBUG
     DEBUGF("read in: %04X\n", p_jpeg->bitbuf & 0xFFFF);
@@ -1802,6 +1840,351 @@ static void search_restart(struct jpeg *p_jpeg)
     } /* end slow decode */ \
 }
 
+/* Progressive JPEG (ITU T.81 Annex G) support. All scans are read before the
+ * first row is output, so the coefficients have to be kept for the whole
+ * image. Only those used by the scaled IDCT are stored, plus a mask of the
+ * nonzero coefficients of each block for components where AC refinement
+ * scans need to be followed. Components needing no AC coefficients at all
+ * have their AC scans skipped without being decoded.
+ */
+static size_t prog_coef_setup(struct jpeg *p_jpeg, char *buf, bool dc_only)
+{
+    size_t size = 0;
+    int nblocks[3];
+    int ci;
+
+    for (ci = 0; ci < p_jpeg->components; ci++)
+    {
+        struct frame_component *fc = &p_jpeg->frameheader[ci];
+        int n;
+        p_jpeg->coef_bw[ci] = p_jpeg->x_mbl * fc->horizontal_sampling;
+        nblocks[ci] = p_jpeg->coef_bw[ci] *
+                      p_jpeg->y_mbl * fc->vertical_sampling;
+#ifndef HAVE_LCD_COLOR
+        if (ci)
+            n = 0; /* chroma isn't needed for greyscale output */
+        else
+#endif
+        if (dc_only)
+            n = 1;
+        else
+            n = MAX(p_jpeg->k_need[!!ci], 1);
+        p_jpeg->coef_num[ci] = n;
+        p_jpeg->coef_nz[ci] = NULL;
+        if (n > 1)
+        {
+            if (buf)
+                p_jpeg->coef_nz[ci] = (uint64_t *)(buf + size);
+            size += nblocks[ci] * sizeof(uint64_t);
+        }
+    }
+    for (ci = 0; ci < p_jpeg->components; ci++)
+    {
+        p_jpeg->coef_buf[ci] = buf ? (int16_t *)(buf + size) : NULL;
+        size += nblocks[ci] * p_jpeg->coef_num[ci] * sizeof(int16_t);
+    }
+    size = ALIGN_UP(size, sizeof(uint64_t));
+    if (buf)
+        memset(buf, 0, size);
+    return size;
+}
+
+/* Refine one AC coefficient if it is already nonzero, returns false if it is
+ * still zero and no correction bit was read */
+INLINE bool prog_refine_ac(struct jpeg *p_jpeg, int16_t *coef, int n,
+                           uint64_t nz, int k, int p1)
+{
+    if (!(nz & ((uint64_t)1 << k)))
+        return false;
+    check_bit_buffer(p_jpeg, 1);
+    if (get_bits(p_jpeg, 1) && k < n && !(coef[k] & p1))
+        coef[k] += coef[k] >= 0 ? p1 : -p1;
+    return true;
+}
+
+static void prog_decode_block(struct jpeg *p_jpeg, int ci, int bx, int by,
+                              struct derived_tbl *dctbl,
+                              struct derived_tbl *actbl)
+{
+    int n = p_jpeg->coef_num[ci];
+    int blk = by * p_jpeg->coef_bw[ci] + bx;
+    int16_t *coef = n ? p_jpeg->coef_buf[ci] + blk * n : NULL;
+    uint64_t *nz = p_jpeg->coef_nz[ci] ? p_jpeg->coef_nz[ci] + blk : NULL;
+    int al = p_jpeg->scan_al;
+    int k, s, r;
+
+    if (p_jpeg->scan_ss == 0)
+    {
+        if (p_jpeg->scan_ah == 0)
+        {   /* Section G.1.2.1: first DC scan */
+            huff_decode_dc(p_jpeg, dctbl, s, r);
+            p_jpeg->dc_pred[ci] += HUFF_EXTEND(r, s);
+            if (coef)
+                coef[0] = p_jpeg->dc_pred[ci] * (1 << al);
+        }
+        else
+        {   /* DC refinement: one more bit of precision */
+            check_bit_buffer(p_jpeg, 1);
+            if (get_bits(p_jpeg, 1) && coef)
+                coef[0] |= 1 << al;
+        }
+        return;
+    }
+
+    /* only components with kept AC coefficients get here */
+    if (p_jpeg->scan_ah == 0)
+    {   /* Section G.1.2.2: first AC scan for this band */
+        if (p_jpeg->eobrun)
+        {
+            p_jpeg->eobrun--;
+            return;
+        }
+        for (k = p_jpeg->scan_ss; k <= p_jpeg->scan_se; k++)
+        {
+            huff_decode_ac(p_jpeg, actbl, s);
+            r = s >> 4;
+            s &= 15;
+            if (s)
+            {
+                k += r;
+                check_bit_buffer(p_jpeg, s);
+                r = get_bits(p_jpeg, s);
+                r = HUFF_EXTEND(r, s);
+                if (k < n)
+                    coef[k] = r * (1 << al);
+                if (k < 64)
+                    *nz |= (uint64_t)1 << k;
+            }
+            else if (r == 15)
+                k += 15;
+            else
+            {   /* end of band, possibly for the following blocks too */
+                p_jpeg->eobrun = BIT_N(r) - 1;
+                if (r)
+                {
+                    check_bit_buffer(p_jpeg, r);
+                    p_jpeg->eobrun += get_bits(p_jpeg, r);
+                }
+                break;
+            }
+        }
+        return;
+    }
+
+    /* Section G.1.2.3: AC refinement, newly nonzero coefficients are
+     * interleaved with correction bits for the already nonzero ones */
+    int p1 = 1 << al;
+    int se = MIN(p_jpeg->scan_se, 63);
+    k = p_jpeg->scan_ss;
+    if (p_jpeg->eobrun == 0)
+    {
+        for (; k <= se; k++)
+        {
+            huff_decode_ac(p_jpeg, actbl, s);
+            r = s >> 4;
+            s &= 15;
+            if (s)
+            {
+                check_bit_buffer(p_jpeg, 1);
+                s = get_bits(p_jpeg, 1) ? p1 : -p1;
+            }
+            else if (r != 15)
+            {
+                p_jpeg->eobrun = BIT_N(r);
+                if (r)
+                {
+                    check_bit_buffer(p_jpeg, r);
+                    p_jpeg->eobrun += get_bits(p_jpeg, r);
+                }
+                break;
+            }
+            /* skip r still zero coefficients */
+            for (; k <= se; k++)
+            {
+                if (prog_refine_ac(p_jpeg, coef, n, *nz, k, p1))
+                    continue;
+                if (--r < 0)
+                    break;
+            }
+            if (s && k <= se)
+            {
+                if (k < n)
+                    coef[k] = s;
+                *nz |= (uint64_t)1 << k;
+            }
+        }
+    }
+    if (p_jpeg->eobrun > 0)
+    {
+        for (; k <= se; k++)
+            prog_refine_ac(p_jpeg, coef, n, *nz, k, p1);
+        p_jpeg->eobrun--;
+    }
+}
+
+/* Skip the entropy coded data of a scan nothing is needed from */
+static int prog_skip_scan(struct jpeg *p_jpeg)
+{
+    unsigned char *c;
+
+    while ((c = jpeg_getc(p_jpeg)))
+    {
+        while (*c == 0xFF)
+        {
+            if (!(c = jpeg_getc(p_jpeg)))
+                return -1;
+            if (*c && *c != 0xFF && (*c & ~7) != 0xD0)
+            {
+                p_jpeg->marker = *c;
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+/* Check for a restart marker before decoding the next MCU. Unlike with
+ * baseline images, this must not look past the last MCU of the scan as the
+ * next marker segment follows. Returns true if the decoder was reset. */
+static bool prog_restart_due(struct jpeg *p_jpeg)
+{
+    if (!p_jpeg->restart_interval)
+        return false;
+    if (p_jpeg->restart-- > 0)
+        return false;
+    p_jpeg->restart = p_jpeg->restart_interval - 1;
+    search_restart(p_jpeg);
+    p_jpeg->eobrun = 0;
+    return true;
+}
+
+static int prog_decode_scan(struct jpeg *p_jpeg)
+{
+    int comp[3];
+    int i, j, ci;
+
+    for (i = 0; i < p_jpeg->scan_comps; i++)
+    {
+        for (ci = 0; ci < p_jpeg->components; ci++)
+            if (p_jpeg->frameheader[ci].ID == p_jpeg->scanheader[i].ID)
+                break;
+        if (ci == p_jpeg->components)
+            return -12; /* scan refers to an unknown component */
+        comp[i] = ci;
+    }
+
+    if (p_jpeg->scan_se > 63 || p_jpeg->scan_ss > p_jpeg->scan_se ||
+        (p_jpeg->scan_ss == 0 && p_jpeg->scan_se != 0) ||
+        (p_jpeg->scan_ss != 0 && p_jpeg->scan_comps != 1) ||
+        p_jpeg->scan_al > 13)
+        return -13; /* invalid progression parameters */
+
+    if (p_jpeg->scan_comps == 1 && (p_jpeg->scan_ss ? !p_jpeg->coef_nz[comp[0]]
+                                                    : !p_jpeg->coef_num[comp[0]]))
+        return prog_skip_scan(p_jpeg);
+
+    p_jpeg->bitbuf_bits = 0;
+    p_jpeg->marker_val = 0;
+    p_jpeg->marker_ind = 0;
+    p_jpeg->eobrun = 0;
+    p_jpeg->dc_pred[0] = p_jpeg->dc_pred[1] = p_jpeg->dc_pred[2] = 0;
+    p_jpeg->restart = p_jpeg->restart_interval;
+
+    if (p_jpeg->scan_comps == 1)
+    {   /* non-interleaved: each MCU is a single block of the component */
+        ci = comp[0];
+        struct frame_component *fc = &p_jpeg->frameheader[ci];
+        int hmax = 8 * p_jpeg->frameheader[0].horizontal_sampling;
+        int vmax = 8 * p_jpeg->frameheader[0].vertical_sampling;
+        int nbx = (p_jpeg->x_size * fc->horizontal_sampling + hmax - 1) / hmax;
+        int nby = (p_jpeg->y_size * fc->vertical_sampling + vmax - 1) / vmax;
+        struct derived_tbl *dctbl =
+            &p_jpeg->dc_derived_tbls[p_jpeg->scanheader[0].DC_select & 1];
+        struct derived_tbl *actbl =
+            &p_jpeg->ac_derived_tbls[p_jpeg->scanheader[0].AC_select & 1];
+
+        for (int by = 0; by < nby; by++)
+        {
+            for (int bx = 0; bx < nbx; bx++)
+            {
+                if (prog_restart_due(p_jpeg))
+                    p_jpeg->dc_pred[ci] = 0;
+                prog_decode_block(p_jpeg, ci, bx, by, dctbl, actbl);
+            }
+            /* don't starve other threads while a scan decodes */
+            yield();
+        }
+        return 0;
+    }
+
+    /* interleaved: only DC scans can have several components */
+    for (int my = 0; my < p_jpeg->y_mbl; my++)
+    {
+        for (int mx = 0; mx < p_jpeg->x_mbl; mx++)
+        {
+            if (prog_restart_due(p_jpeg))
+                p_jpeg->dc_pred[0] = p_jpeg->dc_pred[1] =
+                                     p_jpeg->dc_pred[2] = 0;
+            for (i = 0; i < p_jpeg->scan_comps; i++)
+            {
+                struct frame_component *fc = &p_jpeg->frameheader[comp[i]];
+                struct derived_tbl *dctbl =
+                    &p_jpeg->dc_derived_tbls[p_jpeg->scanheader[i].DC_select & 1];
+                int h = fc->horizontal_sampling;
+                int v = fc->vertical_sampling;
+                for (j = 0; j < h * v; j++)
+                    prog_decode_block(p_jpeg, comp[i], mx * h + j % h,
+                                      my * v + j / h, dctbl, NULL);
+            }
+        }
+        yield();
+    }
+    return 0;
+}
+
+/* Read all the scans of a progressive image into the coefficient buffer, the
+ * first SOS marker has already been processed */
+static int prog_decode(struct jpeg *p_jpeg)
+{
+    int status;
+    do
+    {
+        status = prog_decode_scan(p_jpeg);
+        if (status < 0)
+            return status;
+        status = process_markers(p_jpeg);
+        if (status < 0)
+            return status;
+        /* tables are usually redefined between scans */
+        fix_huff_tables(p_jpeg);
+    } while (!(status & EOI));
+    return 0;
+}
+
+/* Fill a block from the coefficient buffer, the way store_row_jpeg() does
+ * while decoding a baseline image */
+static void prog_load_block(struct jpeg *p_jpeg, int16_t *block, int ci,
+                            int bx, int by, bool transpose)
+{
+    int n = p_jpeg->coef_num[ci];
+    const int16_t *coef = p_jpeg->coef_buf[ci] +
+                          (by * p_jpeg->coef_bw[ci] + bx) * n;
+    const int16_t *qt = p_jpeg->quanttable[!!ci];
+    int k;
+
+    block[0] = MULTIPLY16(coef[0], qt[0]);
+    MEMSET(block+1, 0, p_jpeg->zero_need[!!ci] * sizeof(int));
+    for (k = 1; k < n; k++)
+    {
+#ifdef JPEG_IDCT_TRANSPOSE
+        block[zag[transpose ? k : k + 64]] = MULTIPLY16(coef[k], qt[k]);
+#else
+        block[zag[k]] = MULTIPLY16(coef[k], qt[k]);
+#endif
+    }
+    (void)transpose;
+}
+
 static struct img_part *store_row_jpeg(void *jpeg_args)
 {
     struct jpeg *p_jpeg = (struct jpeg*) jpeg_args;
@@ -1848,6 +2231,27 @@ static struct img_part *store_row_jpeg(void *jpeg_args)
                 struct derived_tbl* dctbl = &p_jpeg->dc_derived_tbls[ti];
                 struct derived_tbl* actbl = &p_jpeg->ac_derived_tbls[ti];
 
+                if (p_jpeg->progressive)
+                {
+#ifndef HAVE_LCD_COLOR
+                    if (!ci)
+#endif
+                    {
+                        int h = p_jpeg->frameheader[ci].horizontal_sampling;
+                        int j = ci ? 0 : blkn;
+                        prog_load_block(p_jpeg, block, ci, x * h + j % h,
+                            p_jpeg->mcu_y *
+                                p_jpeg->frameheader[ci].vertical_sampling +
+                                j / h,
+#ifdef JPEG_IDCT_TRANSPOSE
+                            transpose);
+#else
+                            false);
+#endif
+                    }
+                    goto block_end;
+                }
+
                 /* Section F.2.2.1: decode the DC coefficient difference */
                 huff_decode_dc(p_jpeg, dctbl, s, r);
 
@@ -1962,7 +2366,8 @@ block_end:
             }
 #endif
             out += mcu_offset;
-            if (p_jpeg->restart_interval && --p_jpeg->restart == 0)
+            if (p_jpeg->restart_interval && !p_jpeg->progressive &&
+                --p_jpeg->restart == 0)
             {   /* if a restart marker is due: */
                 p_jpeg->restart = p_jpeg->restart_interval; /* count again */
                 search_restart(p_jpeg); /* align the bitstream */
@@ -1974,6 +2379,7 @@ block_end:
 #endif
             }
         }
+        p_jpeg->mcu_y++;
     } /* if !p_jpeg->mcu_row */
     p_jpeg->mcu_row = (p_jpeg->mcu_row + 1) & (height - 1);
     p_jpeg->part.len = width;
@@ -2242,26 +2648,50 @@ int clip_jpeg_fd(int fd, int flags,
 #endif
     decode_buf_size *= JPEG_PIX_SZ;
     JDEBUGF("decode buffer size: %d\n", decode_buf_size);
-    if (return_size)
-    {
-        return (buf_start - (char *) bm->data) + decode_buf_size
-               + (resize
-                      ?
-                      /* buffer for 1 line + 2 spare lines */
+    int resize_buf_size = resize ?
+        /* buffer for 1 line + 2 spare lines */
 #ifdef HAVE_LCD_COLOR
-                      sizeof(struct uint32_argb)
+        sizeof(struct uint32_argb)
 #else
-                      sizeof(uint32_t)
+        sizeof(uint32_t)
 #endif
-                      * 3 * bm->width
-                      : 0);
+        * 3 * bm->width : 0;
+    size_t coef_size = 0;
+    bool dc_only = false;
+    if (p_jpeg->progressive)
+    {   /* keep the coefficients the IDCT uses if there's enough memory,
+         * otherwise fall back to DC only */
+        coef_size = prog_coef_setup(p_jpeg, NULL, false);
+        if (!return_size &&
+            buf_end - buf_start < (long)coef_size + decode_buf_size +
+                                  resize_buf_size)
+        {
+            JDEBUGF("progressive: DC only\n");
+            dc_only = true;
+            coef_size = prog_coef_setup(p_jpeg, NULL, true);
+        }
+        JDEBUGF("coefficient buffer size: %d\n", (int)coef_size);
+    }
+    if (return_size)
+    {
+        return (buf_start - (char *) bm->data) + coef_size + decode_buf_size
+               + resize_buf_size;
     }
 
-    if (buf_end - buf_start < decode_buf_size)
+    if (buf_end - buf_start < (long)coef_size + decode_buf_size)
         return -1;
 
     fix_huff_tables(p_jpeg);
 
+    if (p_jpeg->progressive)
+    {
+        prog_coef_setup(p_jpeg, buf_start, dc_only);
+        buf_start += coef_size;
+        status = prog_decode(p_jpeg);
+        if (status < 0)
+            return status;
+    }
+
     p_jpeg->img_buf = (jpeg_pix_t *)buf_start;
     buf_start += decode_buf_size;
     maxsize = buf_end - buf_start;
@@ -21,6 +21,7 @@
  * KIND, either express or implied.
  *
  ****************************************************************************/
+#include <stdio.h>
 #include "config.h"
 #include "system.h"
 #include "kernel.h"
@@ -74,7 +75,10 @@
  * PANIC_SECONDS:     Flood watermark time until full
  * FLUSH_SECONDS:     Flush watermark time until full
  * STREAM_BUF_SIZE:   Size of stream write buffer
+ * STREAM_WRITE_ALIGN: File offset that stream writes end on if they can
+ * PREALLOC_SECONDS:  Recording time file space is reserved for at once
  * PRIO_SECONDS:      Max flush time before prio boost
+ * ARC_WRITE_SIZE:    PCM gathered before it is written to the archive
  *
  * Total PCM buffer size should be mem aligned
  *
@@ -113,9 +117,18 @@
 #ifndef STREAM_BUF_SIZE
 #define STREAM_BUF_SIZE     65536
 #endif
+#ifndef STREAM_WRITE_ALIGN
+#define STREAM_WRITE_ALIGN   4096
+#endif
+#ifndef PREALLOC_SECONDS
+#define PREALLOC_SECONDS       60
+#endif
 #ifndef PRIO_SECONDS
 #define PRIO_SECONDS           10
 #endif
+#ifndef ARC_WRITE_SIZE
+#define ARC_WRITE_SIZE      (PCM_BUF_SIZE*1/4)
+#endif
 
 /* FAT limit for filesize. Recording will accept no further data from the
  * codec if this limit is reached in order to preserve its own data
@@ -200,6 +213,16 @@ static unsigned int  pre_record_seconds; /* Pre-record time in seconds     */
    3.audio:   while encoded data available, repeat 2.
    4.audio:   flush_stream_end();         stream flush destination is closing
 
+  Archive copy:
+  With rec_archive set, the PCM the encoder has consumed is also written
+  unchanged as a WAV file next to the encoded one. It stays in pcm_buffer
+  between pcm_ridx and pcm_arc_ridx until the audio thread writes it in
+  large pieces from flush_chunk(), so the encoder never waits for it. DMA
+  doesn't wait for it either: when it would have to, the archive is given
+  up (arc_overrun) and the recording continues without it. It starts with
+  the recording, without the prerecorded part, and is split along with the
+  encoded stream.
+
 ****************************************************************************/
 
 /** Buffer parameters where incoming PCM data is placed **/
@@ -238,6 +261,11 @@ static size_t         enc_buflen;       /* Length of buffer in slots       */
 
 static unsigned char *stream_buffer;    /* Stream-to-disk write buffer     */
 static ssize_t        stream_buf_used;  /* Stream write buffer occupancy   */
+static off_t          rec_fpos;         /* Position of rec_fd              */
+#if (CONFIG_PLATFORM & PLATFORM_NATIVE)
+static off_t          rec_fresv;        /* File space reserved up to here,
+                                           -1 = don't try again            */
+#endif
 
 static struct enc_chunk_file *fname_buf;/* Buffer with next file to create */
 
@@ -247,6 +275,13 @@ static bool           pcm_buffer_empty; /* All PCM chunks processed?       */
 static typeof (memcpy) *pcm_copyfn;     /* PCM memcpy or copy_buffer_mono  */
 static enc_callback_t enc_cb;           /* Encoder's recording callback    */
 
+/** Archive copy **/
+static bool           arc_enabled;      /* Archive wanted for recordings   */
+static volatile int   arc_fd = -1;      /* Archive file, if one is open    */
+static volatile size_t pcm_arc_ridx;    /* Archive PCM read position       */
+static volatile bool  arc_overrun;      /* DMA overwrote unarchived PCM    */
+static size_t         arc_data_bytes;   /* PCM bytes in archive file       */
+
 /** File flushing **/
 static unsigned long  encbuf_datarate;  /* Rate of data per second         */
 #if (CONFIG_STORAGE & STORAGE_ATA)
@@ -301,6 +336,30 @@ size_t pcmbuf_used(void)
     return p2 - p1;
 }
 
+/* Size of data in PCM buffer, including what the archive still needs */
+static size_t pcmbuf_held(void)
+{
+    size_t p1 = arc_fd >= 0 && !arc_overrun ? pcm_arc_ridx : pcm_ridx;
+    size_t p2 = pcm_widx;
+
+    if (p1 > p2)
+        p2 += PCM_BUF_SIZE;
+
+    return p2 - p1;
+}
+
+/* Size of data the encoder is done with but isn't in the archive yet */
+static size_t pcmbuf_arc_pending(void)
+{
+    size_t p1 = pcm_arc_ridx;
+    size_t p2 = pcm_ridx;
+
+    if (p1 > p2)
+        p2 += PCM_BUF_SIZE;
+
+    return p2 - p1;
+}
+
 /* Buffer pointer (p) to memory address of header */
 static inline union enc_chunk_hdr * encbuf_ptr(size_t p)
 {
@@ -491,7 +550,13 @@ static void pcm_rec_have_more(void **start, size_t *size)
     if (!pcm_pause)
     {
         /* One empty chunk must remain after widx is advanced */
-        if (pcmbuf_used() <= PCM_BUF_SIZE - 2*PCM_CHUNK_SIZE)
+        const size_t limit = PCM_BUF_SIZE - 2*PCM_CHUNK_SIZE;
+
+        /* The archive fell behind; drop it rather than the recording */
+        if (pcmbuf_held() > limit && pcmbuf_used() <= limit)
+            arc_overrun = true;
+
+        if (pcmbuf_held() <= limit)
             next_idx = pcmbuf_add(next_idx, PCM_CHUNK_SIZE);
         else
             set_warning_bits(PCMREC_W_PCM_BUFFER_OVF);
@@ -570,6 +635,7 @@ static void reset_fifos(bool hard)
         pcm_widx = 0; /* Don't just empty but reset it */
 
     pcm_ridx = pcm_widx;
+    pcm_arc_ridx = pcm_ridx;
 
     /* Encoder FIFO */
     encbuf_widx_advance(0, 0);
@@ -585,7 +651,7 @@ static void reset_rec_stats(void)
     num_rec_bytes = 0;
     num_rec_samples = 0;
     encbuf_rec_count = 0;
-    clear_warning_status(PCMREC_W_FILE_SIZE);
+    clear_warning_status(PCMREC_W_FILE_SIZE | PCMREC_W_ARCHIVE);
 }
 
 /* Boost or unboost recording threads' priorities */
@@ -808,28 +874,73 @@ static inline void stream_discard_buf(void)
     stream_buf_used = 0;
 }
 
-/* Flush stream buffer to disk */
-static bool stream_flush_buf(void)
+/* Reserve file space ahead of writing count more bytes, enough for what is
+   waiting in the encoder buffer and PREALLOC_SECONDS more. The FAT is then
+   searched once, for one run if there is one, instead of for every cluster
+   in the middle of a flush. What isn't used is freed when the file is
+   closed. */
+static void reserve_rec_file(size_t count)
 {
-    if (stream_buf_used == 0)
-        return true;
+#if (CONFIG_PLATFORM & PLATFORM_NATIVE)
+    off_t end = rec_fpos + stream_buf_used + count;
+
+    if (rec_fresv < 0 || end <= rec_fresv)
+        return;
+
+    off_t start = MAX(rec_fresv, rec_fpos);
+    off_t size = MAX((off_t)encbuf_used(),
+                     (off_t)(encbuf_datarate*PREALLOC_SECONDS)) * ENC_HDR_SIZE;
+    size = MAX(size, end - start);
+    size = MIN(size, (off_t)MAX_NUM_REC_BYTES - start);
 
-    ssize_t rc = write(rec_fd, stream_buffer, stream_buf_used);
+    off_t got = size > 0 ? freserve(rec_fd, size) : 0;
 
-    if (LIKELY(rc == stream_buf_used))
+    if (got <= 0)
     {
-        stream_discard_buf();
-        return true;
+        /* Writes will allocate as they go */
+        logf("reserve failed: %ld", (long)got);
+        rec_fresv = -1;
+        return;
+    }
+
+    rec_fresv = start + got;
+    logf("reserved: %ld", (long)got);
+#else
+    (void)count;
+#endif /* PLATFORM_NATIVE */
+}
+
+/* Flush stream buffer to disk. Unless all of it is wanted, a tail that
+   would end the write in the middle of a sector is kept for the next. */
+static bool stream_flush_buf(bool all)
+{
+    ssize_t count = stream_buf_used;
+
+    if (!all)
+    {
+        off_t end = rec_fpos + count;
+        end -= end % STREAM_WRITE_ALIGN;
+
+        if (end > rec_fpos)
+            count = end - rec_fpos;
     }
 
+    if (count == 0)
+        return true;
+
+    reserve_rec_file(count);
+
+    ssize_t rc = write(rec_fd, stream_buffer, count);
+
     if (rc > 0)
     {
-        /* Some was written; keep in sync */
+        /* Keep in sync with what was written */
+        rec_fpos += rc;
         stream_buf_used -= rc;
         memmove(stream_buffer, stream_buffer + rc, stream_buf_used);
     }
 
-    return false;
+    return rc == count;
 }
 
 /* Close the output file */
@@ -838,7 +949,7 @@ static void close_rec_file(void)
     if (rec_fd < 0)
         return;
 
-    bool ok = stream_flush_buf();
+    bool ok = stream_flush_buf(true);
 
     if (close(rec_fd) != 0 || !ok)
         raise_error_status(PCMREC_E_IO);
@@ -866,9 +977,164 @@ static bool open_rec_file(bool create)
         return false;
     }
 
+    rec_fpos = 0;
+#if (CONFIG_PLATFORM & PLATFORM_NATIVE)
+    rec_fresv = 0;
+#endif
+
     return true;
 }
 
+/* WAV header of the archive copy; the sizes are filled in when it's closed */
+struct arc_riff_header
+{
+    uint8_t  riff_id[4];
+    uint32_t riff_size;
+    uint8_t  format[4];
+    uint8_t  format_id[4];
+    uint32_t format_size;
+    uint16_t audio_format;
+    uint16_t num_channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    uint8_t  data_id[4];
+    uint32_t data_size;
+} __attribute__((packed));
+
+static bool arc_write_header(void)
+{
+    struct arc_riff_header riff =
+    {
+        { 'R', 'I', 'F', 'F' },
+        htole32(sizeof (riff) - 8 + arc_data_bytes),
+        { 'W', 'A', 'V', 'E' },
+        { 'f', 'm', 't', ' ' },
+        htole32(16),
+        htole16(1),
+        htole16(2),
+        htole32(sample_rate),
+        htole32(sample_rate*PCM_SAMP_SIZE),
+        htole16(PCM_SAMP_SIZE),
+        htole16(PCM_DEPTH_BYTES*8),
+        { 'd', 'a', 't', 'a' },
+        htole32(arc_data_bytes),
+    };
+
+    return write(arc_fd, &riff, sizeof (riff)) == sizeof (riff);
+}
+
+/* Close the archive; the caller has written out what belongs to it */
+static void arc_close(void)
+{
+    if (arc_fd < 0)
+        return;
+
+    /* Fill in the sizes; a file cut short still has a usable header */
+    bool ok = lseek(arc_fd, 0, SEEK_SET) == 0 && arc_write_header();
+
+    if (close(arc_fd) != 0 || !ok)
+        raise_warning_status(PCMREC_W_ARCHIVE);
+
+    arc_fd = -1;
+}
+
+/* Drop the archive after a failure, the encoded file continues alone */
+static void arc_abandon(void)
+{
+    logf("archive: %s", arc_overrun ? "fell behind" : "write failed");
+    raise_warning_status(PCMREC_W_ARCHIVE);
+    arc_close();
+}
+
+/* Create the archive for the encoded file at path, starting with the PCM the
+   encoder reads next */
+static void arc_open(const char *path)
+{
+    if (!arc_enabled || arc_fd >= 0)
+        return;
+
+    /* Same name with .wav; a WAV recording is its own archive */
+    char arcpath[MAX_PATH];
+    const char *name = strrchr(path, '/');
+    const char *ext = strrchr(name ? name : path, '.');
+    int len = ext ? ext - path : (int)strlen(path);
+
+    if (snprintf(arcpath, sizeof (arcpath), "%.*s.wav", len, path)
+            >= (int)sizeof (arcpath))
+    {
+        raise_warning_status(PCMREC_W_ARCHIVE);
+        return;
+    }
+
+    int fd = open(arcpath, O_RDWR|O_CREAT|O_TRUNC, 0666);
+
+    if (fd < 0)
+    {
+        raise_warning_status(PCMREC_W_ARCHIVE);
+        return;
+    }
+
+    arc_data_bytes = 0;
+    pcm_arc_ridx = pcm_ridx;
+    arc_overrun = false;
+    arc_fd = fd; /* DMA must now keep the archive's part too */
+
+    if (!arc_write_header())
+        arc_abandon();
+}
+
+/* Write what the encoder is done with to the archive. Unless 'all' is set,
+ * wait until there is enough for a large write. */
+static void arc_write_pcm(bool all)
+{
+    if (arc_fd < 0)
+        return;
+
+    if (arc_overrun)
+    {
+        arc_abandon();
+        return;
+    }
+
+    size_t pending = pcmbuf_arc_pending();
+
+    if (!all && pending < ARC_WRITE_SIZE)
+        return;
+
+    while (pending)
+    {
+        size_t ridx = pcm_arc_ridx;
+        size_t size = MIN(pending, PCM_BUF_SIZE - ridx);
+        void *p = pcmbuf_ptr(ridx);
+
+        if (arc_data_bytes + size > MAX_NUM_REC_BYTES)
+        {
+            arc_abandon();
+            return;
+        }
+
+#ifdef ROCKBOX_BIG_ENDIAN
+        /* The encoder is done with it and DMA doesn't get past
+           pcm_arc_ridx, so it can be swapped where it is */
+        for (uint32_t *s = p, *end = p + size; s < end; s++)
+            *s = swap_odd_even32(*s);
+#endif
+
+        if (write(arc_fd, p, size) != (ssize_t)size || arc_overrun)
+        {
+            /* after an overrun, what was written may be newer PCM */
+            arc_abandon();
+            return;
+        }
+
+        arc_data_bytes += size;
+        pcm_arc_ridx = pcmbuf_add(ridx, size);
+        pending -= size;
+    }
+}
+
 /* Copy with mono conversion - output 1/2 size of input */
 static void * ICODE_ATTR
 copy_buffer_mono_lr(void *dst, const void *src, size_t src_size)
@@ -1171,6 +1437,9 @@ static enum record_state flush_chunk(enum record_state state, size_t margin)
 
     size_t used = encbuf_used();
 
+    /* The archive only has the PCM buffer to wait in, so it goes first */
+    arc_write_pcm(false);
+
     switch (state)
     {
     case REC_STATE_MONITOR:
@@ -1423,6 +1692,7 @@ static void on_close_recording(void)
     codec_unload();
     pcm_close_recording();
     close_rec_file();
+    arc_close();
     init_state();
 
     rec_errors = 0;
@@ -1487,6 +1757,8 @@ static void on_recording_options(struct audio_recording_options *options)
     pre_record_seconds = options->rec_prerecord_time;
     enc_config         = options->enc_config;
     enc_config.afmt    = afmt;
+    arc_enabled        = options->rec_archive &&
+                         get_audio_base_codec_type(afmt) != AFMT_PCM_WAV;
 
     queue_reply(&audio_queue, 0);  /* Let caller go */
 
@@ -1606,6 +1878,9 @@ static void on_record(const char *filename)
         logf("inserting split");
         mark_action = MARK_STREAM_SPLIT;
         finish_stream(false);
+        /* The encoded stream ends where the encoder stopped reading */
+        arc_write_pcm(true);
+        arc_close();
         reset_rec_stats();
     }
 
@@ -1618,6 +1893,7 @@ static void on_record(const char *filename)
     }
 
     mark_stream(path, mark_action);
+    arc_open(path);
 
     codec_go();
     pcm_pause = record_status != RECORD_RECORDING;
@@ -1634,6 +1910,7 @@ static void on_record_stop(void)
     /* Drain encoder and PCM buffers */
     pcm_pause = true;
     finish_stream(true);
+    arc_write_pcm(true);
 
     /* End stream at last data and flush end marker */
     mark_stream(NULL, MARK_STREAM_END);
@@ -1650,6 +1927,7 @@ static void on_record_stop(void)
     }
 
     close_rec_file();
+    arc_close();
     rec_errors = 0;
 
     record_state = REC_STATE_IDLE;
@@ -1969,19 +2247,29 @@ static void enc_encbuf_finish_buffer(void)
 /* Read from the output stream */
 static ssize_t enc_stream_read(void *buf, size_t count)
 {
-    if (!stream_flush_buf())
+    if (!stream_flush_buf(true))
         return -1;
 
-    return read(rec_fd, buf, count);
+    ssize_t rc = read(rec_fd, buf, count);
+
+    if (rc > 0)
+        rec_fpos += rc;
+
+    return rc;
 }
 
 /* Seek the output steam */
 static off_t enc_stream_lseek(off_t offset, int whence)
 {
-    if (!stream_flush_buf())
+    if (!stream_flush_buf(true))
         return -1;
 
-    return lseek(rec_fd, offset, whence);
+    off_t pos = lseek(rec_fd, offset, whence);
+
+    if (pos >= 0)
+        rec_fpos = pos;
+
+    return pos;
 }
 
 /* Write to the output stream */
@@ -1990,8 +2278,17 @@ static ssize_t enc_stream_write(const void *buf, size_t count)
     if (UNLIKELY(count >= STREAM_BUF_SIZE))
     {
         /* Too big to buffer */
-        if (stream_flush_buf())
-            return write(rec_fd, buf, count);
+        if (stream_flush_buf(true))
+        {
+            reserve_rec_file(count);
+
+            ssize_t rc = write(rec_fd, buf, count);
+
+            if (rc > 0)
+                rec_fpos += rc;
+
+            return rc;
+        }
     }
 
     if (!count)
@@ -1999,7 +2296,14 @@ static ssize_t enc_stream_write(const void *buf, size_t count)
 
     if (stream_buf_used + count > STREAM_BUF_SIZE)
     {
-        if (!stream_flush_buf() && stream_buf_used + count > STREAM_BUF_SIZE)
+        /* Write up to a sector boundary, or all if that doesn't make
+           enough room */
+        stream_flush_buf(false);
+
+        if (stream_buf_used + count > STREAM_BUF_SIZE)
+            stream_flush_buf(true);
+
+        if (stream_buf_used + count > STREAM_BUF_SIZE)
             count = STREAM_BUF_SIZE - stream_buf_used;
     }
 
@@ -41,9 +41,13 @@
 /* internal file size limit was reached; encoded data was dropped */
 /* persists until: stop, new file, clear */
 #define PCMREC_W_FILE_SIZE              0x00000010
+/* archive copy could not be written or reached the size limit; it was
+   closed and the encoded file continues alone */
+/* persists until: stop, new file, clear */
+#define PCMREC_W_ARCHIVE                0x00000020
 
 /* all warning flags */
-#define PCMREC_W_ALL                    0x0000001f
+#define PCMREC_W_ALL                    0x0000003f
 
 /** Errors (recording should be reset)
  **
@@ -41,6 +41,7 @@
 
 #include "pcm.h"
 #include "pcm_mixer.h"
+#include "pcm_analysis.h"
 
 #ifdef HAVE_RECORDING
 #include "pcm_record.h"
@@ -564,11 +565,11 @@ void peak_meter_peek(void)
    /* read current values */
     if (pm_playback)
     {
-        static struct pcm_peaks chan_peaks; /* *MUST* be static */
-        mixer_channel_calculate_peaks(PCM_MIXER_CHAN_PLAYBACK,
-                                      &chan_peaks);
-        pm_cur_left = chan_peaks.left;
-        pm_cur_right = chan_peaks.right;
+        struct pcm_analysis analysis;
+        pcm_analysis_get(PCM_MIXER_CHAN_PLAYBACK, PCM_ANALYSIS_PEAK,
+                         &analysis);
+        pm_cur_left = analysis.peak[0];
+        pm_cur_right = analysis.peak[1];
     }
 #ifdef HAVE_RECORDING
     else
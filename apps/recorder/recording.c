@@ -607,6 +607,7 @@ void rec_init_recording_options(struct audio_recording_options *options)
     options->rec_prerecord_time    = global_settings.rec_prerecord_time;
     options->rec_mono_mode         = global_settings.rec_mono_mode;
     options->rec_source_flags      = 0;
+    options->rec_archive           = global_settings.rec_archive;
     options->enc_config.rec_format = global_settings.rec_format;
     global_to_encoder_config(&options->enc_config);
 }
@@ -169,141 +169,147 @@ static bool scale_h_area(void *out_line_ptr,
     mul = 0;
     /* give other tasks a chance to run */
     yield();
-    for (ix = 0; ix < (unsigned int)ctx->src->width; ix++)
+    for (ix = 0; ix < (unsigned int)ctx->src->width; )
     {
-        oxe += h_o_val;
-        /* end of current area has been reached */
-        /* fill buffer if needed */
+        /* fill buffer if needed, then work through as much of it as belongs
+           to this row without rechecking its length for every pixel */
         FILL_BUF(part,ctx->store_part,ctx->args);
-#ifdef HAVE_LCD_COLOR
-        if (oxe >= h_i_val)
+        unsigned int run = MIN((unsigned int)part->len,
+                               (unsigned int)ctx->src->width - ix);
+        ix += run;
+        part->len -= run;
+        for (; run; run--, part->buf++)
         {
-            /* "reset" error, which now represents partial coverage of next
-               pixel by the next area
-            */
-            oxe -= h_i_val;
+            oxe += h_o_val;
+            /* end of current area has been reached */
+#ifdef HAVE_LCD_COLOR
+            if (oxe >= h_i_val)
+            {
+                /* "reset" error, which now represents partial coverage of next
+                   pixel by the next area
+                */
+                oxe -= h_i_val;
 
 #if defined(CPU_COLDFIRE)
 /* Coldfire EMAC math */
-            /* add saved partial pixel from start of area */
-            MAC(rgbvalacc.r, h_o_val, 0);
-            MAC(rgbvalacc.g, h_o_val, 1);
-            MAC(rgbvalacc.b, h_o_val, 2);
-            MAC(rgbvalacc.a, h_o_val, 3);
-            MAC(rgbvaltmp.r, mul, 0);
-            MAC(rgbvaltmp.g, mul, 1);
-            MAC(rgbvaltmp.b, mul, 2);
-            MAC(rgbvaltmp.a, mul, 3);
-            /* get new pixel , then add its partial coverage to this area */
-            mul = h_o_val - oxe;
-            rgbvaltmp.r = part->buf->red;
-            rgbvaltmp.g = part->buf->green;
-            rgbvaltmp.b = part->buf->blue;
-            rgbvaltmp.a = part->buf->alpha;
-            MAC(rgbvaltmp.r, mul, 0);
-            MAC(rgbvaltmp.g, mul, 1);
-            MAC(rgbvaltmp.b, mul, 2);
-            MAC(rgbvaltmp.a, mul, 3);
-            MAC_OUT(rgbvalacc.r, 0);
-            MAC_OUT(rgbvalacc.g, 1);
-            MAC_OUT(rgbvalacc.b, 2);
-            MAC_OUT(rgbvalacc.a, 3);
+                /* add saved partial pixel from start of area */
+                MAC(rgbvalacc.r, h_o_val, 0);
+                MAC(rgbvalacc.g, h_o_val, 1);
+                MAC(rgbvalacc.b, h_o_val, 2);
+                MAC(rgbvalacc.a, h_o_val, 3);
+                MAC(rgbvaltmp.r, mul, 0);
+                MAC(rgbvaltmp.g, mul, 1);
+                MAC(rgbvaltmp.b, mul, 2);
+                MAC(rgbvaltmp.a, mul, 3);
+                /* get new pixel , then add its partial coverage to this area */
+                mul = h_o_val - oxe;
+                rgbvaltmp.r = part->buf->red;
+                rgbvaltmp.g = part->buf->green;
+                rgbvaltmp.b = part->buf->blue;
+                rgbvaltmp.a = part->buf->alpha;
+                MAC(rgbvaltmp.r, mul, 0);
+                MAC(rgbvaltmp.g, mul, 1);
+                MAC(rgbvaltmp.b, mul, 2);
+                MAC(rgbvaltmp.a, mul, 3);
+                MAC_OUT(rgbvalacc.r, 0);
+                MAC_OUT(rgbvalacc.g, 1);
+                MAC_OUT(rgbvalacc.b, 2);
+                MAC_OUT(rgbvalacc.a, 3);
 #else
 /* generic C math */
-            /* add saved partial pixel from start of area */
-            rgbvalacc.r = rgbvalacc.r * h_o_val + rgbvaltmp.r * mul;
-            rgbvalacc.g = rgbvalacc.g * h_o_val + rgbvaltmp.g * mul;
-            rgbvalacc.b = rgbvalacc.b * h_o_val + rgbvaltmp.b * mul;
-            rgbvalacc.a = rgbvalacc.a * h_o_val + rgbvaltmp.a * mul;
+                /* add saved partial pixel from start of area */
+                rgbvalacc.r = rgbvalacc.r * h_o_val + rgbvaltmp.r * mul;
+                rgbvalacc.g = rgbvalacc.g * h_o_val + rgbvaltmp.g * mul;
+                rgbvalacc.b = rgbvalacc.b * h_o_val + rgbvaltmp.b * mul;
+                rgbvalacc.a = rgbvalacc.a * h_o_val + rgbvaltmp.a * mul;
 
-            /* get new pixel , then add its partial coverage to this area */
-            rgbvaltmp.r = part->buf->red;
-            rgbvaltmp.g = part->buf->green;
-            rgbvaltmp.b = part->buf->blue;
-            rgbvaltmp.a = part->buf->alpha;
-            mul = h_o_val - oxe;
-            rgbvalacc.r += rgbvaltmp.r * mul;
-            rgbvalacc.g += rgbvaltmp.g * mul;
-            rgbvalacc.b += rgbvaltmp.b * mul;
-            rgbvalacc.a += rgbvaltmp.a * mul;
+                /* get new pixel , then add its partial coverage to this area */
+                rgbvaltmp.r = part->buf->red;
+                rgbvaltmp.g = part->buf->green;
+                rgbvaltmp.b = part->buf->blue;
+                rgbvaltmp.a = part->buf->alpha;
+                mul = h_o_val - oxe;
+                rgbvalacc.r += rgbvaltmp.r * mul;
+                rgbvalacc.g += rgbvaltmp.g * mul;
+                rgbvalacc.b += rgbvaltmp.b * mul;
+                rgbvalacc.a += rgbvaltmp.a * mul;
 #endif /* CPU */
-            rgbvalacc.r = (rgbvalacc.r + (1 << 21)) >> 22;
-            rgbvalacc.g = (rgbvalacc.g + (1 << 21)) >> 22;
-            rgbvalacc.b = (rgbvalacc.b + (1 << 21)) >> 22;
-            rgbvalacc.a = (rgbvalacc.a + (1 << 21)) >> 22;
-            /* store or accumulate to output row */
-            if (accum)
-            {
-                rgbvalacc.r += out_line[ox].r;
-                rgbvalacc.g += out_line[ox].g;
-                rgbvalacc.b += out_line[ox].b;
-                rgbvalacc.a += out_line[ox].a;
+                rgbvalacc.r = (rgbvalacc.r + (1 << 21)) >> 22;
+                rgbvalacc.g = (rgbvalacc.g + (1 << 21)) >> 22;
+                rgbvalacc.b = (rgbvalacc.b + (1 << 21)) >> 22;
+                rgbvalacc.a = (rgbvalacc.a + (1 << 21)) >> 22;
+                /* store or accumulate to output row */
+                if (accum)
+                {
+                    rgbvalacc.r += out_line[ox].r;
+                    rgbvalacc.g += out_line[ox].g;
+                    rgbvalacc.b += out_line[ox].b;
+                    rgbvalacc.a += out_line[ox].a;
+                }
+                out_line[ox].r = rgbvalacc.r;
+                out_line[ox].g = rgbvalacc.g;
+                out_line[ox].b = rgbvalacc.b;
+                out_line[ox].a = rgbvalacc.a;
+                /* reset accumulator */
+                rgbvalacc.r = 0;
+                rgbvalacc.g = 0;
+                rgbvalacc.b = 0;
+                rgbvalacc.a = 0;
+                mul = oxe;
+                ox += 1;
+            /* inside an area */
+            } else {
+                /* add pixel value to accumulator */
+                rgbvalacc.r += part->buf->red;
+                rgbvalacc.g += part->buf->green;
+                rgbvalacc.b += part->buf->blue;
+                rgbvalacc.a += part->buf->alpha;
             }
-            out_line[ox].r = rgbvalacc.r;
-            out_line[ox].g = rgbvalacc.g;
-            out_line[ox].b = rgbvalacc.b;
-            out_line[ox].a = rgbvalacc.a;
-            /* reset accumulator */
-            rgbvalacc.r = 0;
-            rgbvalacc.g = 0;
-            rgbvalacc.b = 0;
-            rgbvalacc.a = 0;
-            mul = oxe;
-            ox += 1;
-        /* inside an area */
-        } else {
-            /* add pixel value to accumulator */
-            rgbvalacc.r += part->buf->red;
-            rgbvalacc.g += part->buf->green;
-            rgbvalacc.b += part->buf->blue;
-            rgbvalacc.a += part->buf->alpha;
-        }
 #else
-        if (oxe >= h_i_val)
-        {
-            /* "reset" error, which now represents partial coverage of next
-               pixel by the next area
-            */
-            oxe -= h_i_val;
+            if (oxe >= h_i_val)
+            {
+                /* "reset" error, which now represents partial coverage of next
+                   pixel by the next area
+                */
+                oxe -= h_i_val;
 #if defined(CPU_COLDFIRE)
 /* Coldfire EMAC math */
-            /* add saved partial pixel from start of area */
-            MAC(acc, h_o_val, 0);
-            MAC(tmp, mul, 0);
-            /* get new pixel , then add its partial coverage to this area */
-            tmp = *(part->buf);
-            mul = h_o_val - oxe;
-            MAC(tmp, mul, 0);
-            MAC_OUT(acc, 0);
+                /* add saved partial pixel from start of area */
+                MAC(acc, h_o_val, 0);
+                MAC(tmp, mul, 0);
+                /* get new pixel , then add its partial coverage to this area */
+                tmp = *(part->buf);
+                mul = h_o_val - oxe;
+                MAC(tmp, mul, 0);
+                MAC_OUT(acc, 0);
 #else
 /* generic C math */
-            /* add saved partial pixel from start of area */
-            acc = (acc * h_o_val) + (tmp * mul);
+                /* add saved partial pixel from start of area */
+                acc = (acc * h_o_val) + (tmp * mul);
 
-            /* get new pixel , then add its partial coverage to this area */
-            tmp = *(part->buf);
-            mul = h_o_val - oxe;
-            acc += tmp * mul;
+                /* get new pixel , then add its partial coverage to this area */
+                tmp = *(part->buf);
+                mul = h_o_val - oxe;
+                acc += tmp * mul;
 #endif /* CPU */
-            /* round, divide, and either store or accumulate to output row */
-            acc = (acc + (1 << 21)) >> 22;
-            if (accum)
-            {
-                acc += out_line[ox];
+                /* round, divide, and either store or accumulate to output row */
+                acc = (acc + (1 << 21)) >> 22;
+                if (accum)
+                {
+                    acc += out_line[ox];
+                }
+                out_line[ox] = acc;
+                /* reset accumulator */
+                acc = 0;
+                mul = oxe;
+                ox += 1;
+            /* inside an area */
+            } else {
+                /* add pixel value to accumulator */
+                acc += *(part->buf);
             }
-            out_line[ox] = acc;
-            /* reset accumulator */
-            acc = 0;
-            mul = oxe;
-            ox += 1;
-        /* inside an area */
-        } else {
-            /* add pixel value to accumulator */
-            acc += *(part->buf);
-        }
 #endif
-        part->buf++;
-        part->len--;
+        }
     }
     return true;
 }
@@ -314,17 +320,22 @@ static inline bool scale_v_area(struct rowset *rset, struct scaler_context *ctx)
     uint32_t mul, oy, iy, oye;
     const uint32_t v_i_val = ctx->v_i_val,
                    v_o_val = ctx->v_o_val;
+    /* number of 32-bit values in one scaled row */
+    const unsigned int row_len = ctx->bm->width * CHANNEL_BYTES;
+    /* set when the accumulator holds nothing, so that the next row can be
+       stored into it rather than added to a freshly cleared row */
+    bool acc_empty = true;
 
     /* Set up rounding and scale factors */
     mul = 0;
     oy = rset->rowstart;
     oye = 0;
     uint32_t *rowacc = (uint32_t *) ctx->buf,
-             *rowtmp = rowacc + ctx->bm->width * CHANNEL_BYTES,
+             *rowtmp = rowacc + row_len,
              *rowacc_px, *rowtmp_px;
-    memset((void *)ctx->buf, 0, ctx->bm->width * 2 * sizeof(uint32_t)*CHANNEL_BYTES);
+    /* zero the temp row, the accumulator is written before it is read */
+    memset((void *)rowtmp, 0, row_len * sizeof(uint32_t));
     SDEBUGF("scale_v_area\n");
-    /* zero the accumulator and temp rows */
     for (iy = 0; iy < (unsigned int)ctx->src->height; iy++)
     {
         oye += v_o_val;
@@ -336,9 +347,14 @@ static inline bool scale_v_area(struct rowset *rset, struct scaler_context *ctx)
             */
             oye -= v_i_val;
             /* add stored partial row to accumulator */
-            for(rowacc_px = rowacc, rowtmp_px = rowtmp; rowacc_px != rowtmp;
-                rowacc_px++, rowtmp_px++)
-                *rowacc_px = *rowacc_px * v_o_val + *rowtmp_px * mul;
+            if (acc_empty)
+                for(rowacc_px = rowacc, rowtmp_px = rowtmp; rowacc_px != rowtmp;
+                    rowacc_px++, rowtmp_px++)
+                    *rowacc_px = *rowtmp_px * mul;
+            else
+                for(rowacc_px = rowacc, rowtmp_px = rowtmp; rowacc_px != rowtmp;
+                    rowacc_px++, rowtmp_px++)
+                    *rowacc_px = *rowacc_px * v_o_val + *rowtmp_px * mul;
             /* store new scaled row in temp row */
             if(!ctx->h_scaler(rowtmp, ctx, false))
                 return false;
@@ -350,15 +366,16 @@ static inline bool scale_v_area(struct rowset *rset, struct scaler_context *ctx)
                 rowacc_px++, rowtmp_px++)
                 *rowacc_px += mul * *rowtmp_px;
             ctx->output_row(oy, (void*)rowacc, ctx);
-            /* clear accumulator row, store partial coverage for next row */
-            memset((void *)rowacc, 0, ctx->bm->width * sizeof(uint32_t) * CHANNEL_BYTES);
+            /* accumulator is consumed, store partial coverage for next row */
+            acc_empty = true;
             mul = oye;
             oy += rset->rowstep;
         /* inside an area */
         } else {
             /* accumulate new scaled row to rowacc */
-            if (!ctx->h_scaler(rowacc, ctx, true))
+            if (!ctx->h_scaler(rowacc, ctx, !acc_empty))
                 return false;
+            acc_empty = false;
         }
     }
     return true;
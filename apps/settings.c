@@ -190,6 +190,157 @@ static bool settings_crc_changed(void)
     return false;
 }
 
+/** Binary copy of the settings read from CONFIGFILE **/
+/*
+ * Parsing the config looks up every line by name, so the result is kept
+ * in SETTINGSCACHEFILE with the crc of the text it came from and is read
+ * back in one go while neither the config nor the firmware changed.
+ * Custom settings can set more than their global_settings member and may
+ * hold pointers, so they are reset after the read and the changed ones
+ * are loaded again from text stored after the struct.
+ */
+#define SETTINGS_CACHE_MAGIC 0x52425343 /* 'RBSC' */
+
+struct settings_cache_header
+{
+    uint32_t magic;
+    uint32_t version_crc;   /* crc of rbversion */
+    uint32_t settings_size; /* sizeof (global_settings) */
+    uint32_t cfg_crc;       /* crc of CONFIGFILE, 0 if there is none */
+    uint32_t data_crc;      /* crc of all that follows the header */
+};
+
+static uint32_t settings_file_crc(const char *file) INIT_ATTR;
+static uint32_t settings_file_crc(const char *file)
+{
+    char buf[256];
+    uint32_t crc = 0xFFFFFFFF;
+    ssize_t n;
+
+    int fd = open(file, O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    while ((n = read(fd, buf, sizeof buf)) > 0)
+        crc = crc_32(buf, n, crc);
+
+    close(fd);
+    return crc;
+}
+
+/* crc of the changed custom settings as config lines, also written to fd
+   if it is >= 0. settings_cache_load() resets all of them first. */
+static uint32_t settings_cache_custom(int fd, uint32_t crc) INIT_ATTR;
+static uint32_t settings_cache_custom(int fd, uint32_t crc)
+{
+    char line[MAX_PATH];
+
+    for(int i=0; i<nb_settings; i++)
+    {
+        const struct settings_list *setting = &settings[i];
+        if (!(setting->flags & F_CUSTOM_SETTING) || !setting->cfg_name ||
+            !setting->custom_setting->is_changed(setting->setting,
+                                                 setting->default_val.custom))
+            continue;
+
+        int len = snprintf(line, sizeof line, "%s: ", setting->cfg_name);
+        cfg_to_string(setting, line + len, sizeof line - len);
+        len = strlen(line);
+
+        crc = crc_32(line, len, crc);
+        if (fd >= 0)
+            fdprintf(fd, "%s\n", line);
+    }
+
+    return crc;
+}
+
+static bool settings_cache_load(uint32_t cfg_crc) INIT_ATTR;
+static bool settings_cache_load(uint32_t cfg_crc)
+{
+    struct settings_cache_header hdr;
+    char line[MAX_PATH];
+    bool theme_changed;
+    bool loaded = false;
+
+    int fd = open(SETTINGSCACHEFILE, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    if (read(fd, &hdr, sizeof hdr) != sizeof hdr ||
+        hdr.magic != SETTINGS_CACHE_MAGIC ||
+        hdr.version_crc != crc_32(rbversion, strlen(rbversion), 0xFFFFFFFF) ||
+        hdr.settings_size != sizeof (global_settings) ||
+        hdr.cfg_crc != cfg_crc)
+    {
+        close(fd);
+        return false;
+    }
+
+    if (read(fd, &global_settings, sizeof (global_settings)) ==
+            sizeof (global_settings))
+    {
+        uint32_t crc = crc_32(&global_settings, sizeof (global_settings),
+                              0xFFFFFFFF);
+
+        /* what the read put in their place isn't valid in this run */
+        for (int i = 0; i < nb_settings; i++)
+        {
+            if (settings[i].flags & F_CUSTOM_SETTING)
+                reset_setting(&settings[i], settings[i].setting);
+        }
+
+        while (read_line(fd, line, sizeof line) > 0)
+        {
+            char *name, *value;
+            crc = crc_32(line, strlen(line), crc);
+            if (settings_parseline(line, &name, &value))
+                string_to_cfg(name, value, &theme_changed);
+        }
+
+        loaded = crc == hdr.data_crc;
+    }
+
+    close(fd);
+
+    if (!loaded)
+    {
+        logf("settings cache bad");
+        settings_reset();
+    }
+
+    return loaded;
+}
+
+static void settings_cache_save(uint32_t cfg_crc) INIT_ATTR;
+static void settings_cache_save(uint32_t cfg_crc)
+{
+    struct settings_cache_header hdr =
+    {
+        .magic = SETTINGS_CACHE_MAGIC,
+        .version_crc = crc_32(rbversion, strlen(rbversion), 0xFFFFFFFF),
+        .settings_size = sizeof (global_settings),
+        .cfg_crc = cfg_crc,
+        .data_crc = settings_cache_custom(-1,
+                        crc_32(&global_settings, sizeof (global_settings),
+                               0xFFFFFFFF)),
+    };
+
+    int fd = open(SETTINGSCACHEFILE, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+
+    /* a partial write fails the crc next time */
+    if (write(fd, &hdr, sizeof hdr) == sizeof hdr &&
+        write(fd, &global_settings, sizeof (global_settings)) ==
+            sizeof (global_settings))
+    {
+        settings_cache_custom(fd, 0);
+    }
+
+    close(fd);
+}
+
 /** Reading from a config file **/
 /*
  * load settings from disk
@@ -203,7 +354,19 @@ void settings_load(void)
     rename_temp_file(RESUMEFILE_TEMP, RESUMEFILE, RESUMEFILE".old");
     rename_temp_file(CONFIGFILE_TEMP, CONFIGFILE, CONFIGFILE".old");
 
-    settings_load_config(CONFIGFILE, false); /* load user_settings items */
+    /* load user_settings items */
+    uint32_t cfg_crc = settings_file_crc(CONFIGFILE);
+    CHART(">settings_cache_load");
+    bool cached = settings_cache_load(cfg_crc);
+    CHART("<settings_cache_load");
+    if (!cached)
+    {
+        /* don't keep a copy if the config also set system_status items */
+        struct system_status status = global_status;
+        settings_load_config(CONFIGFILE, false);
+        if (!memcmp(&status, &global_status, sizeof (status)))
+            settings_cache_save(cfg_crc);
+    }
     settings_load_config(RESUMEFILE, false); /* load system_status items */
 
     /* fixed settings file has final say on user_settings AND system_status items */
@@ -989,9 +1152,12 @@ void settings_apply(bool read_disk)
         if ( global_settings.lang_file[0]) {
             snprintf(buf, sizeof buf, LANG_DIR "/%s.lng",
                      global_settings.lang_file);
-            CHART(">lang_core_load");
-            lang_core_load(buf);
-            CHART("<lang_core_load");
+            if (!lang_core_is_loaded(buf))
+            {
+                CHART(">lang_core_load");
+                lang_core_load(buf);
+                CHART("<lang_core_load");
+            }
         }
         CHART(">talk_init");
         talk_init(); /* use voice of same language */
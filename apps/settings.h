@@ -457,6 +457,7 @@ struct user_settings
     int rec_split_method; /* time/filesize */
 
     int rec_prerecord_time; /* In seconds, 0-30, 0 means OFF */
+    bool rec_archive; /* also keep the input as WAV */
     char rec_directory[MAX_PATHNAME+1];
     int cliplight; /* 0 = off
                       1 = main lcd
@@ -825,6 +826,7 @@ struct user_settings
 
 #ifdef USB_ENABLE_AUDIO
     int usb_audio;
+    bool usb_audio_resample;
 #endif
 
 #if defined(USB_ENABLE_STORAGE) && defined(HAVE_MULTIDRIVE)
@@ -1245,8 +1245,14 @@ const struct settings_list settings[] = {
 #else
                   400,
 #endif
-                  "max files in playlist", UNIT_INT, 1000, 32000, 1000,
-                  NULL, NULL, NULL),
+                  "max files in playlist", UNIT_INT, 1000,
+#if MEMORYSIZE >= 32
+                  /* the playlist index only takes memory as it fills up */
+                  1000000,
+#else
+                  32000,
+#endif
+                  1000, NULL, NULL, NULL),
     INT_SETTING(F_BANFROMQS, max_files_in_dir, LANG_MAX_FILES_IN_DIR,
                 MAX_FILES_IN_DIR_DEFAULT, "max files in dir", UNIT_INT,
                 MAX_FILES_IN_DIR_STEP /* min */, MAX_FILES_IN_DIR_MAX,
@@ -1640,6 +1646,8 @@ const struct settings_list settings[] = {
                 LANG_RECORD_PRERECORD_TIME, 0,
                 "prerecording time", UNIT_SEC, 0, 30, 1,
                 formatter_time_unit_0_is_off, getlang_time_unit_0_is_off, NULL),
+    OFFON_SETTING(F_RECSETTING, rec_archive, LANG_RECORDING_ARCHIVE, false,
+                  "rec archive", NULL),
 
     TEXT_SETTING(F_RECSETTING, rec_directory, "rec path",
                      REC_BASE_DIR, NULL, NULL),
@@ -1682,6 +1690,8 @@ const struct settings_list settings[] = {
     {F_T_INT|F_RECSETTING|F_HAS_CFGVALS, &global_settings.mp3_enc_config.bitrate,-1,
         INT(MP3_ENC_BITRATE_CFG_DEFAULT),
         "mp3_enc bitrate",{.cfg_vals=MP3_ENC_BITRATE_CFG_VALUE_LIST}},
+    OFFON_SETTING(F_RECSETTING, mp3_enc_config.fast, LANG_MP3_ENC_FAST, false,
+                  "mp3_enc fast", NULL),
     /* wav_enc */
     /* (no settings yet) */
     /* wavpack_enc */
@@ -2325,6 +2335,7 @@ const struct settings_list settings[] = {
 #ifdef USB_ENABLE_AUDIO
     CHOICE_SETTING(0, usb_audio, LANG_USB_DAC, 0, "usb-dac", "never,always,while_charge_only,while_mass_storage", usb_set_audio, 4,
         ID2P(LANG_NEVER), ID2P(LANG_ALWAYS), ID2P(LANG_WHILE_USB_CHARGE_ONLY), ID2P(LANG_WHILE_MASS_STORAGE_USB_ONLY)),
+    OFFON_SETTING(0, usb_audio_resample, LANG_USB_DAC_RESAMPLE, false, "usb-dac resampling", NULL),
 #endif
 
 #if defined(USB_ENABLE_STORAGE) && defined(HAVE_MULTIDRIVE)
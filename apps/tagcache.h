@@ -70,6 +70,16 @@ enum tag_type { tag_artist = 0, tag_album, tag_genre, tag_title,
 
 #define TAGCACHE_IS_NUMERIC(tag) (BIT_N(tag) & TAGCACHE_NUMERIC_TAGS)
 
+/* Tags we want to get sorted (loaded to the tempbuf). Their tag files are
+   kept in the order of the database, so searches that don't filter return
+   them sorted and the seeks of the entries sort the same way. */
+#define TAGCACHE_SORTED_TAGS ((1LU << tag_artist) | (1LU << tag_album) | \
+    (1LU << tag_genre) | (1LU << tag_composer) | (1LU << tag_comment) | \
+    (1LU << tag_albumartist) | (1LU << tag_grouping) | (1LU << tag_title) | \
+    (1LU << tag_virt_canonicalartist))
+
+#define TAGCACHE_IS_SORTED(tag) (BIT_N(tag) & TAGCACHE_SORTED_TAGS)
+
 enum clause { clause_none, clause_is, clause_is_not, clause_gt, clause_gteq,
     clause_lt, clause_lteq, clause_contains, clause_not_contains, 
     clause_begins_with, clause_not_begins_with, clause_ends_with,
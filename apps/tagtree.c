@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include "string-extra.h"
 #include "config.h"
 #include "system.h"
@@ -55,6 +56,7 @@
 #include "dir.h"
 #include "playback.h"
 #include "strnatcmp.h"
+#include "collation.h"
 #include "panic.h"
 #include "onplay.h"
 #include "plugin.h"
@@ -84,6 +86,7 @@ struct tagentry {
 };
 
 static struct tagentry* tagtree_get_entry(struct tree_context *c, int id);
+static void stop_loading(void);
 
 #define SEARCHSTR_SIZE 256
 
@@ -216,6 +219,26 @@ static int rootmenu;
 static int current_offset;
 static int current_entry_count;
 
+/* Lists that need no sorting are shown once this many entries past the
+   selected one are loaded, the rest is loaded in slices while the list is
+   idle */
+#define LOAD_FIRST_ENTRIES 64
+#define LOAD_SLICE_TICKS   (HZ/20)
+
+/* The search of the current list */
+static struct
+{
+    struct tagcache_search tcs;
+    char buf[TAGCACHE_BUFSZ];
+    bool active;            /* still open, the list isn't complete */
+    bool complete;          /* dirlength is the final count */
+    bool filling;           /* entries still fit into the cache */
+    bool is_basename;
+    int level;
+    int total_count;        /* entries found so far */
+    int namebufused;
+} load;
+
 static struct tree_context *tc;
 
 static int max_history_level; /* depth of menu levels with applicable history */
@@ -243,6 +266,18 @@ static int move_callback(int handle, void* current, void* new)
     if (csi)
         UPDATE(csi, diff);
 
+    /* the search of a list that is still loading keeps clauses from here */
+    if (load.active)
+    {
+        for (int i = 0; i < load.tcs.clause_count; i++)
+        {
+            char *clause = (char *) load.tcs.clause[i];
+            if (clause >= (char *) current &&
+                clause < (char *) current + tagtree_buf_used)
+                UPDATE(load.tcs.clause[i], diff);
+        }
+    }
+
     /* loop over menus */
     for(int i = 0; i < menu_count; i++)
     {
@@ -915,6 +950,14 @@ static int compare(const void *p1, const void *p2)
     return qsort_fn(e1->name, e2->name, MAX_PATH);
 }
 
+/* Sorted tags are in the order of their seeks, see TAGCACHE_SORTED_TAGS */
+static int compare_seek(const void *p1, const void *p2)
+{
+    const struct tagentry *e1 = p1;
+    const struct tagentry *e2 = p2;
+    return (e1->extraseek > e2->extraseek) - (e1->extraseek < e2->extraseek);
+}
+
 static int compare_with_albums(const void *p1, const void *p2)
 {
     struct tagentry *e1 = (struct tagentry *)p1;
@@ -930,6 +973,37 @@ static int compare_with_albums(const void *p1, const void *p2)
     return qsort_fn(e1->name, e2->name, MAX_PATH);
 }
 
+/* Sort entries by collation keys, which gives the same order as qsort()
+   with the functions above but compares a lot quicker. Returns false if
+   there isn't enough memory for the keys. */
+static bool sort_by_keys(struct tagentry *entries, int count,
+                         bool with_albums, unsigned int flags)
+{
+    struct collation co;
+    size_t size = 0;
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        if (with_albums)
+            size += collation_string_size(entries[i].album_name ?: "", flags);
+        size += collation_string_size(entries[i].name, flags);
+    }
+
+    if (!collation_init(&co, count, size, sizeof(struct tagentry)))
+        return false;
+
+    for (i = 0; i < count; i++)
+    {
+        if (with_albums)
+            collation_add_string(&co, entries[i].album_name ?: "", flags);
+        collation_add_string(&co, entries[i].name, flags);
+        collation_next(&co);
+    }
+
+    return collation_sort(&co, entries, sizeof(struct tagentry));
+}
+
 static void tagtree_buffer_event(unsigned short id, void *ev_data)
 {
     (void)id;
@@ -1381,6 +1455,8 @@ static bool parse_menu(const char *filename)
 
 static void tagtree_unload(struct tree_context *c)
 {
+    stop_loading();
+
     /* may be spurious... */
     core_pin(tagtree_handle);
 
@@ -1582,25 +1658,268 @@ static void tcs_get_basename(struct tagcache_search *tcs, bool is_basename)
     }
 }
 
-static int retrieve_entries(struct tree_context *c, int offset, bool init)
+/* Add the current result of the search to the cache at dptr. Returns 1 if
+   there is no room left for it, or < 0 if it couldn't be formatted. */
+static int add_entry(struct tree_context *c, struct tagentry *dptr,
+                     int level, bool is_basename)
 {
-    logf( "%s", __func__);
-    char tcs_buf[TAGCACHE_BUFSZ];
-    const long tcs_bufsz = sizeof(tcs_buf);
-    struct tagcache_search tcs;
+    struct tagcache_search *tcs = &load.tcs;
     struct display_format *fmt;
+    int tag = tcs->type;
+    int i;
+
+    dptr->newtable = TABLE_NAVIBROWSE;
+    if (tag == tag_title || tag == tag_filename)
+    {
+        dptr->newtable = TABLE_PLAYTRACK;
+        dptr->extraseek = tcs->idx_id;
+    }
+    else
+        dptr->extraseek = tcs->result_seek;
+    dptr->customaction = ONPLAY_NO_CUSTOMACTION;
+
+    fmt = NULL;
+    /* Check the format */
+    for (i = 0; i < format_count; i++)
+    {
+        if (c->currtable == TABLE_ALLSUBENTRIES_SORTED_BY_ALBUMS)
+        {
+            /* If it is sorted by albums, we need to use the proper view
+            that includes the disc number etc so sorting will be correct for each albums.
+            Otherwise, tracks will be sorted by title names */
+            if (formats[i]->group_id != csi->format_id[level + 1])
+                continue;
+        }
+        else if (formats[i]->group_id != csi->format_id[level])
+            continue;
+
+        if (tagcache_check_clauses(tcs, formats[i]->clause,
+                                   formats[i]->clause_count))
+        {
+            fmt = formats[i];
+            break;
+        }
+    }
+
+    if (strcmp(tcs->result, UNTAGGED) == 0)
+    {
+        if (tag == tag_title && tcs->filter_count <= 1)
+        { /* Fallback to basename */
+            char *lastname = dptr->name;
+            dptr->name = core_get_data(c->cache.name_buffer_handle)+load.namebufused;
+            if ((c->cache.name_buffer_size - load.namebufused) > 0 &&
+                tagcache_retrieve(tcs, tcs->idx_id, tag_virt_basename, dptr->name,
+                                  c->cache.name_buffer_size - load.namebufused))
+            {
+                load.namebufused += strlen(dptr->name)+1;
+                dptr->album_name = core_get_data(c->cache.name_buffer_handle)+load.namebufused;
+                if ((c->cache.name_buffer_size - load.namebufused) > 0 &&
+                    tagcache_retrieve(tcs, tcs->idx_id, tag_album, dptr->album_name,
+                                c->cache.name_buffer_size - load.namebufused))
+                    load.namebufused += strlen(dptr->album_name)+1;
+                else
+                    dptr->album_name = NULL;
+                return 0;
+            }
+            dptr->name = lastname; /* restore last entry if filename failed */
+            dptr->album_name = NULL;
+        }
+
+        tcs->result = str(LANG_TAGNAVI_UNTAGGED);
+        tcs->result_len = strlen(tcs->result);
+        tcs->ramresult = true;
+    }
+
+    if (!tcs->ramresult || fmt)
+    {
+
+        dptr->name = core_get_data(c->cache.name_buffer_handle)+load.namebufused;
+
+        if (fmt)
+        {
+            int ret = format_str(tcs, fmt, dptr->name,
+                                 c->cache.name_buffer_size - load.namebufused);
+            bool error_on_str_format = ret < 0;
+            if (!error_on_str_format)
+            {
+                load.namebufused += strlen(dptr->name)+1; /* include NULL */
+                dptr->album_name = core_get_data(c->cache.name_buffer_handle)+load.namebufused;
+                if ((c->cache.name_buffer_size - load.namebufused) > 0 &&
+                        tagcache_retrieve(tcs, tcs->idx_id, tag_album, dptr->album_name,
+                                  c->cache.name_buffer_size - load.namebufused))
+                    load.namebufused += strlen(dptr->album_name)+1;
+                else
+                    dptr->album_name = NULL;
+            }
+            else
+            {
+                if (ret == -4)          /* buffer full */
+                {
+                    logf("chunk mode #2: %d", current_entry_count);
+                    return 1;
+                }
+
+                return ret;
+            }
+        }
+        else
+        {
+            tcs_get_basename(tcs, is_basename);
+            load.namebufused += tcs->result_len;
+            bool buffer_full = (load.namebufused >= c->cache.name_buffer_size);
+            if (!buffer_full)
+            {
+                dptr->album_name = core_get_data(c->cache.name_buffer_handle)+load.namebufused;
+                if (tagcache_retrieve(tcs, tcs->idx_id, tag_album, dptr->album_name,
+                                  c->cache.name_buffer_size - load.namebufused))
+                    load.namebufused += strlen(dptr->album_name)+1;
+                else
+                    dptr->album_name = NULL;
+                strcpy(dptr->name, tcs->result);
+            }
+            else
+            {
+                logf("chunk mode #2a: %d", current_entry_count);
+                return 1;
+            }
+        }
+    }
+    else
+    {
+        tcs_get_basename(tcs, is_basename);
+        dptr->name = tcs->result;
+        dptr->album_name = NULL;
+    }
+
+    return 0;
+}
+
+/* Close the search of a list that is still being loaded */
+static void stop_loading(void)
+{
+    if (!load.active)
+        return;
+
+    tagcache_search_finish(&load.tcs);
+    load.active = false;
+    /* the count is incomplete, don't reuse it */
+    loaded_entries_crc = 0;
+}
+
+/* Continue loading a list that was shown before it was complete, until it
+   has min_count entries and the deadline has passed. Entries are added to
+   the cache while there is room, after that they are only counted. Returns
+   true if there is more to load. */
+static bool load_entries(struct tree_context *c, int min_count, long deadline,
+                         bool show_progress)
+{
+    bool more = true;
+
+    if (!load.active)
+        return false;
+
+    tree_lock_cache(c);
+    /* the search uses clauses from the tagtree buffer, keep it in place only
+       while loading so buflib can move it in between */
+    core_pin(tagtree_handle);
+
+    while (load.total_count < min_count || TIME_BEFORE(current_tick, deadline))
+    {
+        if (!tagcache_get_next(&load.tcs, load.buf, sizeof(load.buf)))
+        {
+            more = false;
+            break;
+        }
+
+        load.total_count++;
+
+        if (load.filling)
+        {
+            struct tagentry *dptr = get_entries(c) + current_entry_count;
+
+            if (add_entry(c, dptr, load.level, load.is_basename) != 0 ||
+                ++current_entry_count >= c->cache.max_entries)
+            {
+                logf("chunk mode #4: %d", current_entry_count);
+                c->dirfull = true;
+                load.filling = false;
+            }
+        }
+
+        if (show_progress &&
+            !show_search_progress(false, load.total_count, 0, 0))
+        {   /* user aborted, keep what there is */
+            more = false;
+            break;
+        }
+    }
+
+    core_unpin(tagtree_handle);
+    tree_unlock_cache(c);
+
+    if (more)
+        c->dirlength = MAX(c->dirlength, load.total_count);
+    else
+    {
+        c->dirlength = load.total_count;
+        tagcache_search_finish(&load.tcs);
+        load.active = false;
+        load.complete = true;
+    }
+
+    c->filesindir = c->dirlength;
+    return more;
+}
+
+static void strip_entries(struct tree_context *c, int strip)
+{
+    struct tagentry *dptr = get_entries(c);
     int i;
-    int namebufused = 0;
+
+    for (i = c->special_entry_count; i < current_entry_count; i++, dptr++)
+    {
+        int len = strlen(dptr->name);
+
+        if (len < strip)
+            continue;
+
+        dptr->name = &dptr->name[strip];
+    }
+}
+
+/* Load the entries of the current table from offset on into the cache.
+ *
+ * With init set, all entries are counted and the total is returned, else
+ * only the number of entries in the cache. With stream set, lists that come
+ * in their final order are returned once the first screen of them is there
+ * and the rest is left to load_entries(), and so is the count of a list
+ * whose count wasn't finished yet.
+ */
+static int retrieve_entries(struct tree_context *c, int offset, bool init,
+                            bool stream)
+{
+    logf( "%s", __func__);
+    struct tagcache_search *tcs = &load.tcs;
+    struct display_format *fmt;
+    int i, rc;
     int total_count = 0;
     c->special_entry_count = 0;
     int level = c->currextra;
     int tag;
+    int first_count = INT_MAX;
     bool sort = false;
+    bool tag_order = false;
+    bool more = false;
     bool sort_inverse;
     bool is_basename = false;
     int sort_limit;
     int strip;
 
+    /* There is only one search, finish with the previous list */
+    stop_loading();
+    if (init)
+        load.complete = true;
+
     /* Show search progress straight away if the disk needs to spin up,
        otherwise show it after the normal 1/2 second delay */
     show_search_progress(
@@ -1631,11 +1950,11 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
         tag = tag_filename;
     }
 
-    if (!tagcache_search(&tcs, tag))
+    if (!tagcache_search(tcs, tag))
         return -1;
 
     /* Prevent duplicate entries in the search list. */
-    tagcache_search_set_uniqbuf(&tcs, uniqbuf, UNIQBUF_SIZE);
+    tagcache_search_set_uniqbuf(tcs, uniqbuf, UNIQBUF_SIZE);
 
     if (level || is_basename|| csi->clause_count[0] || TAGCACHE_IS_NUMERIC(tag))
         sort = true;
@@ -1651,28 +1970,30 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
             cc.type = clause_is;
             cc.numeric = true;
             cc.numeric_data = csi->result_seek[i];
-            tagcache_search_add_clause(&tcs, &cc);
+            tagcache_search_add_clause(tcs, &cc);
         }
         else
         {
-            tagcache_search_add_filter(&tcs, csi->tagorder[i],
+            tagcache_search_add_filter(tcs, csi->tagorder[i],
                                        csi->result_seek[i]);
         }
     }
 
     /* because tagcache saves the clauses, we need to lock the buffer
-     * for the entire duration of the search */
+     * while searching here, a search left open for load_entries() has its
+     * clauses updated by move_callback() */
     core_pin(tagtree_handle);
     for (i = 0; i <= level; i++)
     {
         int j;
 
         for (j = 0; j < csi->clause_count[i]; j++)
-            tagcache_search_add_clause(&tcs, csi->clause[i][j]);
+            tagcache_search_add_clause(tcs, csi->clause[i][j]);
     }
 
     current_offset = offset;
     current_entry_count = 0;
+    load.namebufused = 0;
     c->dirfull = false;
 
     fmt = NULL;
@@ -1705,6 +2026,19 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
         strip = 0;
     }
 
+    /* Searches without filters or clauses return a sorted tag in the order
+       of its tag file, which is what it would be sorted into here unless the
+       names are formatted or numbers are compared as such. Filtered ones can
+       simply be put back into that order by their seeks. */
+    if (!fmt && !is_basename && !global_settings.interpret_numbers &&
+        TAGCACHE_IS_SORTED(tag) && tag != tag_title)
+        tag_order = true;
+
+    /* A list that needs no sorting can be shown before all of it is there,
+       as long as the selected entry is */
+    if (init && stream && !sort)
+        first_count = MAX(c->selected_item, 0) + LOAD_FIRST_ENTRIES;
+
     /* lock buflib out due to possible yields */
     tree_lock_cache(c);
     struct tagentry *dptr = core_get_data(c->cache.entries_handle);
@@ -1749,142 +2083,28 @@ static int retrieve_entries(struct tree_context *c, int offset, bool init)
             total_count++;
     }
 
-    while (tagcache_get_next(&tcs, tcs_buf, tcs_bufsz))
+    while (tagcache_get_next(tcs, load.buf, sizeof(load.buf)))
     {
         if (total_count++ < offset)
             continue;
 
-        dptr->newtable = TABLE_NAVIBROWSE;
-        if (tag == tag_title || tag == tag_filename)
+        rc = add_entry(c, dptr, level, is_basename);
+        if (rc < 0)
         {
-            dptr->newtable = TABLE_PLAYTRACK;
-            dptr->extraseek = tcs.idx_id;
+            logf("format_str() failed");
+            tagcache_search_finish(tcs);
+            tree_unlock_cache(c);
+            core_unpin(tagtree_handle);
+            return 0;
         }
-        else
-            dptr->extraseek = tcs.result_seek;
-        dptr->customaction = ONPLAY_NO_CUSTOMACTION;
-
-        fmt = NULL;
-        /* Check the format */
-        for (i = 0; i < format_count; i++)
+        else if (rc > 0)
         {
-            if (c->currtable == TABLE_ALLSUBENTRIES_SORTED_BY_ALBUMS)
-            {
-                /* If it is sorted by albums, we need to use the proper view
-                that includes the disc number etc so sorting will be correct for each albums.
-                Otherwise, tracks will be sorted by title names */
-                if (formats[i]->group_id != csi->format_id[level + 1])
-                    continue;
-            }
-            else if (formats[i]->group_id != csi->format_id[level])
-                continue;
-
-            if (tagcache_check_clauses(&tcs, formats[i]->clause,
-                                       formats[i]->clause_count))
-            {
-                fmt = formats[i];
-                break;
-            }
-        }
-
-        if (strcmp(tcs.result, UNTAGGED) == 0)
-        {
-            if (tag == tag_title && tcs.type == tag_title && tcs.filter_count <= 1)
-            { /* Fallback to basename */
-                char *lastname = dptr->name;
-                dptr->name = core_get_data(c->cache.name_buffer_handle)+namebufused;
-                if ((c->cache.name_buffer_size - namebufused) > 0 && 
-                    tagcache_retrieve(&tcs, tcs.idx_id, tag_virt_basename, dptr->name,
-                                      c->cache.name_buffer_size - namebufused))
-                {
-                    namebufused += strlen(dptr->name)+1;
-                    dptr->album_name = core_get_data(c->cache.name_buffer_handle)+namebufused;
-                    if ((c->cache.name_buffer_size - namebufused) > 0 &&
-                        tagcache_retrieve(&tcs, tcs.idx_id, tag_album, dptr->album_name,
-                                    c->cache.name_buffer_size - namebufused))
-                        namebufused += strlen(dptr->album_name)+1;
-                    else
-                        dptr->album_name = NULL;
-                    goto entry_skip_formatter;
-                }
-                dptr->name = lastname; /* restore last entry if filename failed */
-                dptr->album_name = NULL;
-            }
-
-            tcs.result = str(LANG_TAGNAVI_UNTAGGED);
-            tcs.result_len = strlen(tcs.result);
-            tcs.ramresult = true;
+            c->dirfull = true;
+            sort = false;
+            more = true;
+            break ;
         }
 
-        if (!tcs.ramresult || fmt)
-        {
-
-            dptr->name = core_get_data(c->cache.name_buffer_handle)+namebufused;
-
-            if (fmt)
-            {
-                int ret = format_str(&tcs, fmt, dptr->name,
-                                     c->cache.name_buffer_size - namebufused);
-                bool error_on_str_format = ret < 0;
-                if (!error_on_str_format)
-                {
-                    namebufused += strlen(dptr->name)+1; /* include NULL */
-                    dptr->album_name = core_get_data(c->cache.name_buffer_handle)+namebufused;
-                    if ((c->cache.name_buffer_size - namebufused) > 0 &&
-                            tagcache_retrieve(&tcs, tcs.idx_id, tag_album, dptr->album_name,
-                                      c->cache.name_buffer_size - namebufused))
-                        namebufused += strlen(dptr->album_name)+1;
-                    else
-                        dptr->album_name = NULL;
-                }
-                else
-                {
-                    if (ret == -4)          /* buffer full */
-                    {
-                        logf("chunk mode #2: %d", current_entry_count);
-                        c->dirfull = true;
-                        sort = false;
-                        break;
-                    }
-
-                    logf("format_str() failed");
-                    tagcache_search_finish(&tcs);
-                    tree_unlock_cache(c);
-                    core_unpin(tagtree_handle);
-                    return 0;
-                }
-            }
-            else
-            {
-                tcs_get_basename(&tcs, is_basename);
-                namebufused += tcs.result_len;
-                bool buffer_full = (namebufused >= c->cache.name_buffer_size);
-                if (!buffer_full)
-                {
-                    dptr->album_name = core_get_data(c->cache.name_buffer_handle)+namebufused;
-                    if (tagcache_retrieve(&tcs, tcs.idx_id, tag_album, dptr->album_name,
-                                      c->cache.name_buffer_size - namebufused))
-                        namebufused += strlen(dptr->album_name)+1;
-                    else
-                        dptr->album_name = NULL;
-                    strcpy(dptr->name, tcs.result);
-                }
-                else
-                {
-                    logf("chunk mode #2a: %d", current_entry_count);
-                    c->dirfull = true;
-                    sort = false;
-                    break ;
-                }
-            }
-        }
-        else
-        {
-            tcs_get_basename(&tcs, is_basename);
-            dptr->name = tcs.result;
-            dptr->album_name = NULL;
-        }
-entry_skip_formatter:
         dptr++;
         current_entry_count++;
 
@@ -1893,6 +2113,14 @@ entry_skip_formatter:
             logf("chunk mode #3: %d", current_entry_count);
             c->dirfull = true;
             sort = false;
+            more = true;
+            break ;
+        }
+
+        if (current_entry_count >= first_count)
+        {
+            logf("first entries: %d", current_entry_count);
+            more = true;
             break ;
         }
 
@@ -1900,7 +2128,7 @@ entry_skip_formatter:
         {
             if (!show_search_progress(false, total_count, 0, 0))
             {   /* user aborted */
-                tagcache_search_finish(&tcs);
+                tagcache_search_finish(tcs);
                 tree_unlock_cache(c);
                 core_unpin(tagtree_handle);
                 return current_entry_count;
@@ -1908,7 +2136,15 @@ entry_skip_formatter:
         }
     }
 
-    if (sort)
+    if (sort && tag_order)
+    {
+        struct tagentry *entries = get_entries(c);
+
+        qsort(&entries[c->special_entry_count],
+              current_entry_count - c->special_entry_count,
+              sizeof(struct tagentry), compare_seek);
+    }
+    else if (sort)
     {
         if (global_settings.interpret_numbers)
             qsort_fn = sort_inverse ? strnatcasecmp_n_inv : strnatcasecmp_n;
@@ -1916,31 +2152,73 @@ entry_skip_formatter:
             qsort_fn = sort_inverse ? strncasecmp_inv : strncasecmp;
 
         struct tagentry *entries = get_entries(c);
-        qsort(&entries[c->special_entry_count],
-              current_entry_count - c->special_entry_count,
-              sizeof(struct tagentry),
-              c->currtable == TABLE_ALLSUBENTRIES_SORTED_BY_ALBUMS ? compare_with_albums : compare
-        );
+        bool with_albums =
+            c->currtable == TABLE_ALLSUBENTRIES_SORTED_BY_ALBUMS;
+        unsigned int flags =
+            (global_settings.interpret_numbers ? COLLATE_NATURAL : 0) |
+            (sort_inverse ? COLLATE_REVERSE : 0);
+
+        if (!sort_by_keys(&entries[c->special_entry_count],
+                          current_entry_count - c->special_entry_count,
+                          with_albums, flags))
+        {
+            qsort(&entries[c->special_entry_count],
+                  current_entry_count - c->special_entry_count,
+                  sizeof(struct tagentry),
+                  with_albums ? compare_with_albums : compare);
+        }
     }
 
-    if (!init)
+    if (stream && more && !sort_inverse && !sort_limit)
     {
-        tagcache_search_finish(&tcs);
+        /* keep the search open and load the rest while the list is shown */
+        load.active = true;
+        load.complete = false;
+        load.filling = init && !c->dirfull;
+        load.is_basename = is_basename;
+        load.level = level;
+        load.total_count = total_count;
+        tree_unlock_cache(c);
+        core_unpin(tagtree_handle);
+
+        if (!init)
+            return current_entry_count;
+
+        if (strip)
+            strip_entries(c, strip);
+
+        /* count on to the selected entry if it wasn't loaded */
+        c->dirlength = 0;
+        load_entries(c, c->selected_item + 1, current_tick, true);
+        return c->dirlength;
+    }
+
+    if (!init && !stream)
+    {
+        tagcache_search_finish(tcs);
         tree_unlock_cache(c);
         core_unpin(tagtree_handle);
         return current_entry_count;
     }
 
-    while (tagcache_get_next(&tcs, tcs_buf, tcs_bufsz))
+    while (tagcache_get_next(tcs, load.buf, sizeof(load.buf)))
     {
         if (!show_search_progress(false, total_count, 0, 0))
             break;
         total_count++;
     }
 
-    tagcache_search_finish(&tcs);
+    tagcache_search_finish(tcs);
     tree_unlock_cache(c);
     core_unpin(tagtree_handle);
+    load.complete = true;
+
+    if (!init)
+    {
+        /* the count that was left unfinished */
+        c->dirlength = c->filesindir = total_count;
+        return current_entry_count;
+    }
 
     if (!sort && (sort_inverse || sort_limit))
     {
@@ -1959,18 +2237,7 @@ entry_skip_formatter:
         total_count = MIN(total_count, sort_limit);
 
     if (strip)
-    {
-        dptr = get_entries(c);
-        for (i = c->special_entry_count; i < current_entry_count; i++, dptr++)
-        {
-            int len = strlen(dptr->name);
-
-            if (len < strip)
-                continue;
-
-            dptr->name = &dptr->name[strip];
-        }
-    }
+        strip_entries(c, strip);
 
     return total_count;
 
@@ -2037,7 +2304,7 @@ static int load_root(struct tree_context *c)
     return i;
 }
 
-int tagtree_load(struct tree_context* c)
+static int load_table(struct tree_context* c, bool stream)
 {
     logf( "%s", __func__);
 
@@ -2045,6 +2312,7 @@ int tagtree_load(struct tree_context* c)
     int table = c->currtable;
 
     c->dirsindir = 0;
+    stop_loading();
 
     if (!table)
     {
@@ -2077,7 +2345,7 @@ int tagtree_load(struct tree_context* c)
             }
 
             cpu_boost(true);
-            count = retrieve_entries(c, 0, true);
+            count = retrieve_entries(c, 0, true, stream);
             cpu_boost(false);
             break;
 
@@ -2109,6 +2377,39 @@ int tagtree_load(struct tree_context* c)
     return count;
 }
 
+int tagtree_load(struct tree_context* c)
+{
+    return load_table(c, false);
+}
+
+int tagtree_load_first(struct tree_context* c)
+{
+    return load_table(c, true);
+}
+
+bool tagtree_load_more(struct tree_context* c)
+{
+    return load_entries(c, 0, current_tick + LOAD_SLICE_TICKS, false);
+}
+
+void tagtree_stop_loading(void)
+{
+    stop_loading();
+}
+
+/* Load the rest of the current list right away, for those that need all
+   of it */
+static void finish_loading(struct tree_context* c)
+{
+    if (!load.active)
+        return;
+
+    cpu_boost(true);
+    show_search_progress(true, 0, 0, 0);
+    load_entries(c, INT_MAX, current_tick, true);
+    cpu_boost(false);
+}
+
 /* Enters menu or table for selected item in the database.
  *
  * Call this with the is_visible parameter set to false to
@@ -2138,6 +2439,7 @@ int tagtree_enter(struct tree_context* c, bool is_visible)
     if (seek == -1) /* <Random> menu item was selected */
     {
         is_random_item = true;
+        finish_loading(c);
         if(c->filesindir<=c->special_entry_count) /* Menu contains only special entries */
             return 0;
         srand(current_tick);
@@ -2329,6 +2631,7 @@ int tagtree_enter(struct tree_context* c, bool is_visible)
 void tagtree_exit(struct tree_context* c, bool is_visible)
 {
     logf( "%s", __func__);
+    stop_loading();
     if (is_visible) /* update selection history only for user-selected items */
     {
         if (c->selected_item != selected_item_history[c->dirlevel])
@@ -2425,6 +2728,7 @@ static bool insert_all_playlist(struct tree_context *c,
     char buf[MAX_PATH];
     struct playlist_insert_context context;
 
+    finish_loading(c);
     cpu_boost(true);
 
     if (!tagcache_search(&tcs, tag_filename))
@@ -2468,11 +2772,13 @@ static bool insert_all_playlist(struct tree_context *c,
         if (slots_remaining <= 0)
         {
             logf("Playlist has no space remaining");
+            playlist_insert_context_release(&context);
             tagcache_search_finish(&tcs);
             cpu_boost(false);
             return false;
         }
 
+        playlist_insert_context_reserve(&context, n);
         fill_randomly = n > slots_remaining;
 
         if (fill_randomly)
@@ -2779,7 +3085,7 @@ static struct tagentry* tagtree_get_entry(struct tree_context *c, int id)
     {
         cpu_boost(true);
         if (retrieve_entries(c, MAX(0, id - (current_entry_count / 2)),
-                             false) < 0)
+                             false, !load.complete) < 0)
         {
             logf("retrieve failed");
             cpu_boost(false);
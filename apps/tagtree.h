@@ -37,6 +37,12 @@ void tagtree_init(void) INIT_ATTR;
 int tagtree_enter(struct tree_context* c, bool is_visible);
 void tagtree_exit(struct tree_context* c, bool is_visible);
 int tagtree_load(struct tree_context* c);
+/* Like tagtree_load(), but returns a list that needs no sorting as soon as
+   its first screen is loaded. The rest is loaded by calling
+   tagtree_load_more() while the list is idle, until it returns false. */
+int tagtree_load_first(struct tree_context* c);
+bool tagtree_load_more(struct tree_context* c);
+void tagtree_stop_loading(void);
 char* tagtree_get_entry_name(struct tree_context *c, int id,
                                     char* buf, size_t bufsize);
 bool tagtree_current_playlist_insert(int position, bool queue);
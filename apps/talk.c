@@ -123,6 +123,10 @@ static unsigned char last_lang[MAX_FILENAME+1]; /* name of last used lang file (
 static bool talk_initialized; /* true if talk_init has been called */
 static bool give_buffer_away; /* true if we should give the buffers away in shrink_callback if requested */
 static int talk_temp_disable_count; /* if positive, temporarily disable voice UI (not saved) */
+static bool prefetching; /* load clips but don't queue them, see talk_prefetch() */
+static size_t prefetch_budget; /* bytes that may still be loaded while prefetching */
+static unsigned int voice_generation; /* counts talk_init() loading a voice */
+static int prefetch_fd = -1; /* voicefile kept open while prefetching */
 
  /* size of the voice data in the voice file and the actually allocated buffer
   * for it. voicebuf_size is always smaller or equal to voicefile_size */
@@ -306,17 +310,40 @@ static int index2id(int index)
 }
 #endif
 
+/* whether the clip is still waiting in the queue or being played */
+static bool clip_is_queued(int handle)
+{
+    bool queued = false;
+
+    talk_queue_lock();
+    for (int i = queue_read; i != queue_write; i = (i + 1) & QUEUE_MASK)
+    {
+        if (queue[i].handle == handle)
+        {
+            queued = true;
+            break;
+        }
+    }
+    talk_queue_unlock();
+
+    return queued;
+}
+
+/* Free the least recently used clip, returns its slot in the cache table.
+   While prefetching, clips in the queue are kept and -1 is returned if
+   there is nothing else to free. */
 static int free_oldest_clip(void)
 {
     unsigned i;
-    int oldest = 0;
+    int oldest = prefetching ? -1 : 0;
     bool thumb = false;
     long age, now, next_age;
     struct clip_entry* clipbuf;
     struct clip_cache_metadata *cc = buflib_get_data(&clip_ctx, metadata_table_handle);
     for(age = i = 0, now = current_tick; i < max_clips; i++)
     {
-        if (cc[i].handle)
+        if (cc[i].handle &&
+            !(prefetching && clip_is_queued(cc[i].handle)))
         {
             next_age = (now - cc[i].tick);
             if (thumb && cc[i].voice_id == VOICEONLY_DELIMITER && next_age > age)
@@ -342,6 +369,8 @@ static int free_oldest_clip(void)
             }
         }
     }
+    if (oldest < 0)
+        return -1;
     /* free the last one if no oldest one could be determined */
     cc = &cc[oldest];
     cc->handle = buflib_free(&clip_ctx, cc->handle);
@@ -354,8 +383,9 @@ static int free_oldest_clip(void)
     return oldest;
 }
 
-/* common code for load_initial_clips() and get_clip() */
-static void add_cache_entry(int clip_handle, int table_index, int id)
+/* common code for load_initial_clips() and get_clip(), returns false if
+   no slot could be freed for the clip */
+static bool add_cache_entry(int clip_handle, int table_index, int id)
 {
     unsigned i;
     struct clip_cache_metadata *cc = buflib_get_data(&clip_ctx, metadata_table_handle);
@@ -370,12 +400,18 @@ static void add_cache_entry(int clip_handle, int table_index, int id)
     {   /* find an empty slot */
         for(i = 0; cc[i].handle && i < max_clips; i++) ;
         if (i == max_clips) /* no free slot in the cache table? */
-            i = free_oldest_clip();
+        {
+            int oldest = free_oldest_clip();
+            if (oldest < 0)
+                return false;
+            i = oldest;
+        }
         cc = &cc[i];
     }
     cc->handle = clip_handle;
     cc->tick = current_tick;
     cc->voice_id = id;
+    return true;
 }
 
 static ssize_t read_clip_data(int fd, int index, int clip_handle)
@@ -460,24 +496,51 @@ static int get_clip(long id, struct queue_entry *q)
     {   /* clip needs loading */
         int fd, handle, oldest = -1;
         ssize_t ret;
-        cache_misses++;
+        if (prefetching)
+        {
+            /* don't push out more of the cache than talk_prefetch() allows */
+            if (prefetch_budget < clipsize)
+                return -1;
+            prefetch_budget -= clipsize;
+        }
+        else
+            cache_misses++;
         /* free clips from cache until this one succeeds to allocate */
         while ((handle = buflib_alloc(&clip_ctx, clipsize)) < 0)
+        {
             oldest = free_oldest_clip();
+            if (oldest < 0)
+                return -1; /* only queued clips left, prefetch gives up */
+        }
         /* handle should now hold a valid alloc. Load from disk
          * and insert into cache */
-        fd = open_voicefile();
+        if (prefetching)
+        {
+            if (prefetch_fd < 0)
+                prefetch_fd = open_voicefile();
+            fd = prefetch_fd;
+        }
+        else
+            fd = open_voicefile();
         ret = read_clip_data(fd, index, handle);
-        close(fd);
+        if (!prefetching)
+            close(fd);
         if (ret < 0)
             return ret;
         /* finally insert into metadata table */
-        add_cache_entry(handle, oldest, id);
+        if (!add_cache_entry(handle, oldest, id))
+        {
+            buflib_free(&clip_ctx, handle);
+            clipbuf = core_get_data(index_handle);
+            clipbuf[index].size &= ~LOADED_MASK;
+            return -1;
+        }
         retval = handle;
     }
     else
     {   /* clip is in memory already; find where it was loaded */
-        cache_hits++;
+        if (!prefetching)
+            cache_hits++;
         struct clip_cache_metadata *cc;
         static int i;
         cc = buflib_get_data(&clip_ctx, metadata_table_handle);
@@ -759,6 +822,9 @@ static int _talk_spell(const char* spell, size_t len, bool enqueue)
     ucschar_t c; /* currently processed char */
     int button = BUTTON_NONE;
 
+    if (prefetching)
+        return 0; /* the letters are only worth loading when needed */
+
     if (talk_is_disabled())
         return -1;
 
@@ -858,7 +924,7 @@ void talk_force_shutup(void)
 /* Shutup the voice, except if force_enqueue_next is set. */
 void talk_shutup(void)
 {
-    if (need_shutup && !force_enqueue_next)
+    if (need_shutup && !force_enqueue_next && !prefetching)
         talk_force_shutup();
 }
 
@@ -868,6 +934,9 @@ static void queue_clip(struct queue_entry *clip, bool enqueue)
     struct queue_entry *qe;
     int queue_level;
 
+    if (prefetching)
+        return; /* the clip is in the cache now, that's all that was wanted */
+
     do_enqueue(enqueue);  /* cut off all the pending stuff */
 
     /* Something is being enqueued, force_enqueue_next override is no
@@ -924,6 +993,7 @@ void talk_init(void)
     talk_force_shutup();  /* In case we have something speaking! */
 
     talk_initialized = true;
+    voice_generation++;
     strmemccpy((char *)last_lang, (char *)global_settings.lang_file,
                MAX_FILENAME);
 
@@ -1080,10 +1150,49 @@ int talk_idarray(const long *ids, bool enqueue)
     return 0;
 }
 
+/* Changes whenever another voice file is loaded and the clip cache emptied,
+   so callers can tell their prefetched clips are gone. */
+unsigned int talk_get_generation(void)
+{
+    return voice_generation;
+}
+
 /* Make sure the current utterance is not interrupted by the next one. */
 void talk_force_enqueue_next(void)
 {
-    force_enqueue_next = true;
+    if (!prefetching)
+        force_enqueue_next = true;
+}
+
+/* Load the clips that talk_id() and friends would speak into the clip cache
+ * without speaking them, so a later announcement doesn't wait for the disk.
+ * Wrap the talk calls in talk_prefetch(true) and talk_prefetch(false); the
+ * former returns false when there is nothing to gain, in which case the calls
+ * should be skipped. Thumbnails and spelling are not prefetched, at most a
+ * quarter of the cache (in bytes) is replaced per prefetch and clips still
+ * queued for playback are never evicted for it. */
+bool talk_prefetch(bool prefetch)
+{
+    if (!prefetch)
+    {
+        if (prefetch_fd >= 0)
+            close(prefetch_fd);
+        prefetch_fd = -1;
+        prefetching = false;
+        return false;
+    }
+
+    if (!has_voicefile || talk_is_disabled() ||
+        talk_handle <= 0 || index_handle <= 0)
+        return false;
+#ifndef TALK_PROGRESSIVE_LOAD
+    if (voicebuf_size >= voicefile_size)
+        return false; /* every clip was loaded up front */
+#endif
+
+    prefetch_budget = voicebuf_size / 4;
+    prefetching = true;
+    return true;
 }
 
 /* play a thumbnail from file */
@@ -1100,6 +1209,8 @@ static int _talk_file(const char* filename,
     /* reload needed? */
     if (talk_is_disabled())
         return -1;
+    if (prefetching)
+        return 0; /* thumbnails are loaded when they are spoken */
 
     if (talk_handle <= 0 || index_handle <= 0)
     {
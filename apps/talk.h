@@ -159,6 +159,13 @@ int talk_time_intervals(long time, int unit_idx, bool enqueue);
    interrupt the current utterance. */
 void talk_force_enqueue_next(void);
 
+/* Load clips into the cache instead of speaking them while enabled. Returns
+   false when enabling it would not gain anything. */
+bool talk_prefetch(bool prefetch);
+
+/* Changes whenever the voice is reloaded, which empties the clip cache */
+unsigned int talk_get_generation(void);
+
 /* speaks one or more IDs (from an array)). */
 int talk_idarray(const long *idarray, bool enqueue);
 /* This makes an initializer for the array of IDs and takes care to
@@ -0,0 +1,158 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/* Checks that sorting by collation keys gives the order of the comparison
+ * functions the keys stand in for, on random names that are heavy in
+ * digits, dots and case differences. Build and run with "make" here. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "core_alloc.h"
+#include "strnatcmp.h"
+#include "collation.h"
+
+#define NAMES   2000
+#define ROUNDS  50
+
+struct buflib_callbacks buflib_ops_locked;
+static void *blocks[16];
+
+int core_alloc_ex(size_t size, struct buflib_callbacks *ops)
+{
+    (void)ops;
+    for (int i = 1; i < 16; i++)
+    {
+        if (!blocks[i])
+        {
+            blocks[i] = malloc(size);
+            return blocks[i] ? i : -1;
+        }
+    }
+    return -1;
+}
+
+void core_free(int handle)
+{
+    free(blocks[handle]);
+    blocks[handle] = NULL;
+}
+
+void *core_get_data(int handle)
+{
+    return blocks[handle];
+}
+
+size_t core_allocatable(void)
+{
+    return 16 << 20;
+}
+
+static const struct
+{
+    const char *name;
+    int (*cmp)(const char *, const char *);
+    unsigned int flags;
+} orders[] =
+{
+    { "strnatcasecmp", strnatcasecmp, COLLATE_NATURAL },
+    { "strnatcmp",     strnatcmp,     COLLATE_NATURAL | COLLATE_CASE },
+    { "strcasecmp",    strcasecmp,    0 },
+    { "strcmp",        strcmp,        COLLATE_CASE },
+};
+
+static void random_name(char *buf, int size)
+{
+    static const char chars[] = "aAbBzZ0012789 .-_";
+    int len = rand() % (size - 1);
+    for (int i = 0; i < len; i++)
+        buf[i] = chars[rand() % (sizeof(chars) - 1)];
+    buf[len] = '\0';
+}
+
+/* sort names by their keys and check every neighbour with cmp */
+static int check(char **names, int count, int o, bool reverse)
+{
+    struct collation co;
+    unsigned int flags = orders[o].flags | (reverse ? COLLATE_REVERSE : 0);
+    size_t size = 0;
+
+    for (int i = 0; i < count; i++)
+        size += collation_string_size(names[i], flags);
+
+    if (!collation_init(&co, count, size, sizeof(char *)))
+    {
+        printf("collation_init failed\n");
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        collation_add_string(&co, names[i], flags);
+        collation_next(&co);
+    }
+
+    if (!collation_sort(&co, names, sizeof(char *)))
+    {
+        printf("collation_sort failed\n");
+        return 1;
+    }
+
+    for (int i = 1; i < count; i++)
+    {
+        int c = orders[o].cmp(names[i - 1], names[i]);
+        if (reverse ? c < 0 : c > 0)
+        {
+            printf("%s%s: \"%s\" before \"%s\"\n", orders[o].name,
+                   reverse ? " reversed" : "", names[i - 1], names[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    static char buf[NAMES][16];
+    char *names[NAMES];
+    int failed = 0;
+
+    srand(1);
+    collation_init_reserve();
+
+    for (int round = 0; round < ROUNDS; round++)
+    {
+        for (int i = 0; i < NAMES; i++)
+        {
+            random_name(buf[i], sizeof(buf[i]));
+            names[i] = buf[i];
+        }
+
+        for (size_t o = 0; o < sizeof(orders) / sizeof(orders[0]); o++)
+        {
+            failed |= check(names, NAMES, o, false);
+            failed |= check(names, NAMES, o, true);
+        }
+    }
+
+    printf("%s\n", failed ? "FAILED" : "ok");
+    return failed;
+}
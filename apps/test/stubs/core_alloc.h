@@ -0,0 +1,29 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+/* host stand-in for core_alloc.h: handles index a table of malloc()ed
+   blocks that never move */
+#include <stddef.h>
+
+struct buflib_callbacks { int dummy; };
+extern struct buflib_callbacks buflib_ops_locked;
+
+int core_alloc_ex(size_t size, struct buflib_callbacks *ops);
+void core_free(int handle);
+void *core_get_data(int handle);
+size_t core_allocatable(void);
@@ -84,6 +84,7 @@ static struct gui_synclist tree_lists;
 static struct tree_context tc;
 
 char lastfile[MAX_PATH];
+static bool lastfile_pending; /* select lastfile once it is loaded */
 static char lastdir[MAX_PATH];
 #ifdef HAVE_TAGCACHE
 static int lasttable, lastextra;
@@ -420,7 +421,7 @@ static int update_dir(void)
             tc.currextra != lastextra ||
             reload_dir)
         {
-            if (tagtree_load(&tc) < 0)
+            if (tagtree_load_first(&tc) < 0)
                 return -1;
 
             lasttable = tc.currtable;
@@ -435,7 +436,9 @@ static int update_dir(void)
         /* if the tc.currdir has been changed, reload it ...*/
         if (reload_dir || strncmp(tc.currdir, lastdir, sizeof(lastdir)))
         {
-            if (ft_load(&tc, NULL) < 0)
+            if (reload_dir) /* kept listings may be out of date */
+                ft_stop_loading();
+            if (ft_load_first(&tc) < 0)
                 return -1;
             strmemccpy(lastdir, tc.currdir, MAX_PATH);
             changed = true;
@@ -445,8 +448,12 @@ static int update_dir(void)
     if (tc.selected_item == -1)
     {
         if (!id3db)
+        {
             /* use lastfile to determine the selected item */
             tc.selected_item = tree_get_file_position(lastfile);
+            /* it may not have been read yet */
+            lastfile_pending = tc.selected_item < 0;
+        }
 
         /* If the file doesn't exists, select the first one (default) */
         if(tc.selected_item < 0)
@@ -525,6 +532,8 @@ static int update_dir(void)
 #ifdef HAVE_LCD_COLOR
     gui_synclist_set_color_callback(list, &tree_get_filecolor);
 #endif
+    /* entries only change with a reload, which draws the list again */
+    gui_synclist_set_cache_rows(list, true);
     if( tc.selected_item >= tc.filesindir)
         tc.selected_item=tc.filesindir-1;
 
@@ -709,12 +718,70 @@ void set_current_file(const char *path)
 }
 
 
+/* Give up loading the rest of the list, closing what it keeps open */
+static void stop_loading(void)
+{
+#ifdef HAVE_TAGCACHE
+    tagtree_stop_loading();
+#endif
+    ft_stop_loading();
+}
+
 static int exit_to_new_screen(int screen)
 {
+    stop_loading();
     gui_synclist_scroll_stop(&tree_lists);
     return screen;
 }
 
+/* Load more of a list that was shown before it was complete, or prefetch
+   the directories around it, while nothing else is going on */
+static void load_more(bool *loading)
+{
+    struct gui_synclist * const list = &tree_lists;
+    int count = tc.filesindir;
+    bool dirfull = tc.dirfull;
+
+#ifdef HAVE_TAGCACHE
+    if (*tc.dirfilter == SHOW_ID3DB)
+    {
+        *loading = tagtree_load_more(&tc);
+        if (tc.filesindir != count)
+        {
+            gui_synclist_grow_nb_items(list, tc.filesindir);
+            gui_synclist_draw(list);
+        }
+        return;
+    }
+#endif
+
+    /* the entries are sorted again, keep the same one selected */
+    if (*loading && !lastfile_pending)
+    {
+        struct entry *entry = tree_get_entry_at(&tc, tc.selected_item);
+        if (entry && tc.selected_item < tc.filesindir)
+            strmemccpy(lastfile, entry->name, MAX_PATH);
+    }
+
+    *loading = ft_load_more(&tc);
+    if (tc.filesindir == count)
+        return;
+
+    int pos = tree_get_file_position(lastfile);
+    if (pos >= 0)
+    {
+        tc.selected_item = pos;
+        lastfile_pending = false;
+    }
+
+    gui_synclist_grow_nb_items(list, tc.filesindir);
+    gui_synclist_select_item(list, tc.selected_item);
+    gui_synclist_draw(list);
+
+    if (tc.dirfull && !dirfull)
+        splash(HZ, ID2P(LANG_SHOWDIR_BUFFER_FULL));
+}
+
 /* main loop, handles key events */
 static int dirbrowse(void)
 {
@@ -726,6 +793,7 @@ static int dirbrowse(void)
     int lastfilter = *tc.dirfilter;
     bool lastsortcase = global_settings.sort_case;
     bool exit_func = false;
+    bool loading = false; /* there is more to load while idle */
 
     char* currdir = tc.currdir; /* just a shortcut */
 #ifdef HAVE_TAGCACHE
@@ -746,6 +814,7 @@ static int dirbrowse(void)
     start_wps = false;
     numentries = update_dir();
     reload_dir = false;
+    loading = true;
     if (numentries == -1)
         return exit_to_new_screen(GO_TO_PREVIOUS);  /* currdir is not a directory */
 
@@ -763,7 +832,15 @@ static int dirbrowse(void)
 
         keyclick_set_callback(gui_synclist_keyclick_callback, &tree_lists);
         button = get_action(CONTEXT_TREE|ALLOW_SOFTLOCK,
+                            loading ? HZ/50 :
                             list_do_action_timeout(&tree_lists, HZ/2));
+        if (button == ACTION_NONE)
+        {
+            load_more(&loading);
+            numentries = tc.filesindir;
+        }
+        else if (!IS_SYSEVENT(button))
+            lastfile_pending = false;
         oldbutton = button;
         gui_synclist_do_button(&tree_lists, &button);
         tc.selected_item = gui_synclist_get_sel_pos(&tree_lists);
@@ -959,6 +1036,11 @@ static int dirbrowse(void)
                     else
 #endif
                     {
+                        /* the actions may work on all of the directory */
+                        ft_finish_loading(&tc);
+                        gui_synclist_set_nb_items(&tree_lists, tc.filesindir);
+                        gui_synclist_select_item(&tree_lists, tc.selected_item);
+
                         struct entry *entry =
                                get_valid_entry(__func__, &tc, tc.selected_item);
 
@@ -1006,6 +1088,12 @@ static int dirbrowse(void)
 #endif
 
             default:
+                if (button == SYS_USB_CONNECTED)
+                {
+                    /* the database or directory must not stay open */
+                    stop_loading();
+                    loading = false;
+                }
                 if (default_event_handler(button) == SYS_USB_CONNECTED)
                 {
                     if(*tc.dirfilter > NUM_FILTER_MODES)
@@ -1065,6 +1153,7 @@ static int dirbrowse(void)
             /* restore display */
             numentries = update_dir();
             reload_dir = false;
+            loading = true;
             if (currdir[1] && (numentries < 0))
             {   /* not in root and reload failed */
                 reload_root = true; /* try root */
@@ -1211,12 +1300,48 @@ void tree_mem_init(void)
     cache->max_entries = global_settings.max_files_in_dir;
     cache->entries_handle =
             core_alloc_ex(cache->max_entries*(sizeof(struct entry)), &ops);
+
+    ft_mem_init();
+}
+
+/* Find the bookmarked file, which is at index unless the playlist or its
+   shuffle order has changed since. Returns its index, or -1 if it isn't in
+   the playlist. */
+static int find_bookmarked_track(int index, const char *filename)
+{
+    char filename_buf[MAX_PATH + 1];
+    const char* peek_filename;
+    int amt = playlist_amount();
+
+    for (int i = 0; i < amt; i++)
+    {
+        int modidx = (i + index) % amt;
+        peek_filename = playlist_peek(modidx, filename_buf,
+            sizeof(filename_buf));
+
+        if (peek_filename == NULL)
+        {
+            if (index == 0) /* searched every entry didn't find a match */
+                return -1;
+            /* playlist has shrunk, search from the top */
+            i = 0;
+            amt = index;
+            index = 0;
+        }
+        else
+        {
+            const char *name = strrchr(peek_filename, '/');
+            if (!strcmp(name ? name + 1 : peek_filename, filename))
+                return modidx;
+        }
+    }
+
+    return -1;
 }
 
 bool bookmark_play(char *resume_file, int index, unsigned long elapsed,
                    unsigned long offset, int seed, char *filename)
 {
-    int i;
     char* suffix = strrchr(resume_file, '.');
     bool started = false;
 
@@ -1242,7 +1367,11 @@ bool bookmark_play(char *resume_file, int index, unsigned long elapsed,
             {
                 if (global_settings.playlist_shuffle)
                     playlist_shuffle(seed, -1);
-                started = true;
+
+                /* bookmarks of shuffled playlists from older versions have
+                   their index in another order */
+                index = find_bookmarked_track(index, filename);
+                started = (index >= 0);
             }
             *slash='/';
         }
@@ -1253,37 +1382,14 @@ bool bookmark_play(char *resume_file, int index, unsigned long elapsed,
         lastdir[0]='\0';
         if (playlist_create(resume_file, NULL) != -1)
         {
-            char filename_buf[MAX_PATH + 1];
-            const char* peek_filename;
             resume_directory(resume_file);
             if (global_settings.playlist_shuffle)
                 playlist_shuffle(seed, -1);
 
             /* Check if the file is at the same spot in the directory,
                else search for it */
-            int amt = playlist_amount();
-            for ( i=0; i < amt; i++ )
-            {
-                int modidx = (i + index) % amt;
-                peek_filename = playlist_peek(modidx, filename_buf,
-                    sizeof(filename_buf));
-
-                if (peek_filename == NULL)
-                {
-                    if (index == 0) /* searched every entry didn't find a match */
-                        return false;
-                    /* playlist has shrunk, search from the top */
-                    i = 0;
-                    amt = index;
-                    index = 0;
-                }
-                else if (!strcmp(strrchr(peek_filename, '/') + 1, filename))
-                {
-                    started = true;
-                    index = modidx;
-                    break;
-                }
-            }
+            index = find_bookmarked_track(index, filename);
+            started = (index >= 0);
         }
     }
 
@@ -0,0 +1,137 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#include <string.h>
+#include "string-extra.h"
+#include "config.h"
+#include "system.h"
+#include "kernel.h"
+#include "file.h"
+#include "rbpaths.h"
+#include "bootchart.h"
+
+/* The marks are kept until bootchart_save() writes them out as the time
+ * each stage started and took, a stage being what is between ">name" and
+ * "<name". Marks after the table is full are only logged. */
+
+#define BOOTCHART_MARKS     128
+#define BOOTCHART_NAME_LEN  40
+
+static struct bootchart_mark
+{
+    uint32_t time;                  /* microseconds */
+    int line;
+    char name[BOOTCHART_NAME_LEN];
+} marks[BOOTCHART_MARKS];
+
+static int num_marks = 0;
+
+static inline uint32_t bootchart_time(void)
+{
+#ifdef USEC_TIMER
+    return USEC_TIMER;
+#else
+    return current_tick * (1000000 / HZ);
+#endif
+}
+
+void bootchart_mark(const char *name, const char *arg, int line)
+{
+    int oldlevel = disable_irq_save();
+    int i = num_marks < BOOTCHART_MARKS ? num_marks++ : -1;
+    restore_irq(oldlevel);
+
+    if (i < 0)
+        return;
+
+    marks[i].time = bootchart_time();
+    marks[i].line = line;
+    strmemccpy(marks[i].name, name, sizeof (marks[i].name));
+    strlcat(marks[i].name, arg, sizeof (marks[i].name));
+}
+
+void bootchart_save(void)
+{
+    int fd = open(ROCKBOX_DIR "/bootchart.txt", O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+
+    int count = num_marks;
+    int depth = 0;
+    uint32_t base = count ? marks[0].time : 0;
+
+    fdprintf(fd, "#%9s %10s %5s  %s\n", "start ms", "took ms", "line", "stage");
+
+    for (int i = 0; i < count; i++)
+    {
+        const struct bootchart_mark *m = &marks[i];
+        uint32_t start = m->time - base;
+
+        if (m->name[0] == '<')
+        {
+            if (depth > 0)
+                depth--;
+            continue;
+        }
+
+        if (m->name[0] != '>')
+        {
+            /* a single point in time */
+            fdprintf(fd, "%6lu.%03lu %10s %5d  %*s%s\n",
+                     (unsigned long)start / 1000, (unsigned long)start % 1000,
+                     "", m->line, depth * 2, "", m->name);
+            continue;
+        }
+
+        /* the end is the first unmatched "<name" after this */
+        int end = -1;
+        for (int j = i + 1, nested = 0; j < count; j++)
+        {
+            if (strcmp(marks[j].name + 1, m->name + 1))
+                continue;
+            if (marks[j].name[0] == '>')
+                nested++;
+            else if (marks[j].name[0] == '<' && nested-- == 0)
+            {
+                end = j;
+                break;
+            }
+        }
+
+        if (end >= 0)
+        {
+            uint32_t time = marks[end].time - m->time;
+            fdprintf(fd, "%6lu.%03lu %6lu.%03lu %5d  %*s%s\n",
+                     (unsigned long)start / 1000, (unsigned long)start % 1000,
+                     (unsigned long)time / 1000, (unsigned long)time % 1000,
+                     m->line, depth * 2, "", m->name + 1);
+            depth++;
+        }
+        else
+        {
+            fdprintf(fd, "%6lu.%03lu %10s %5d  %*s%s (no end)\n",
+                     (unsigned long)start / 1000, (unsigned long)start % 1000,
+                     "", m->line, depth * 2, "", m->name + 1);
+        }
+    }
+
+    if (count == BOOTCHART_MARKS)
+        fdprintf(fd, "# table full, later marks are missing\n");
+
+    close(fd);
+}
@@ -2393,9 +2393,10 @@ int fat_closewrite(struct fat_filestr *filestr, uint32_t size,
 
     if (!size && file->firstcluster)
     {
-        /* empty file */
-        rc = update_fat_entry(fat_bpb, file->firstcluster, 0);
-        if (rc < 0)
+        /* empty file; the chain may be longer than one cluster if space
+           was reserved for it */
+        rc = free_cluster_chain(fat_bpb, file->firstcluster);
+        if (rc <= 0)
             FAT_ERROR(rc * 10 - 2);
 
         file->firstcluster = 0;
@@ -2790,6 +2791,105 @@ fat_error:
     return rc;
 }
 
+/* runs of free clusters looked at before settling for the longest one */
+#define FAT_PREALLOC_MAX_RUNS   64
+
+/* append free clusters for sectorcount sectors to the end of the file's
+   chain, preferring a single run; later writes into them just follow the
+   chain. returns the number of sectors added, which may be fewer. */
+long fat_preallocate(const struct fat_filestr *filestr,
+                     unsigned long sectorcount)
+{
+    struct fat_file * const file = filestr->fatfilep;
+    struct bpb * const fat_bpb = FAT_BPB(file->volume);
+    if (!fat_bpb)
+        return -1;
+
+#ifdef HAVE_FAT16SUPPORT
+    if (file->firstcluster < 0)
+        return 0; /* the FAT16 root dir can't grow */
+#endif
+
+    unsigned long want = (sectorcount + fat_bpb->bpb_secperclus - 1) /
+                            fat_bpb->bpb_secperclus;
+    long rc = 0;
+
+    if (!want)
+        return 0;
+
+    dc_lock_cache();
+
+    /* find the end of the chain, normally right at the current position */
+    long last = filestr->lastcluster ? filestr->lastcluster :
+                                       file->firstcluster;
+    while (last)
+    {
+        long next = get_next_cluster(fat_bpb, last);
+        if (next < 0)
+            FAT_ERROR(next * 10 - 2);
+        if (!next)
+            break;
+        last = next;
+    }
+
+    /* look for a run long enough, the free cluster after a run is where the
+       next one starts */
+    long first = find_free_cluster(fat_bpb, last ?
+                                   last + 1 : (long)fat_bpb->fsinfo.nextfree);
+    long run = first, best = 0;
+    unsigned long bestlen = 0;
+
+    for (int i = 0; run && i < FAT_PREALLOC_MAX_RUNS; i++)
+    {
+        unsigned long len = 1;
+        long c = 0;
+
+        while (len < want && (c = find_free_cluster(fat_bpb, run + len)) ==
+                                    run + (long)len)
+            len++;
+
+        if (len > bestlen)
+        {
+            best = run;
+            bestlen = len;
+        }
+
+        if (len >= want || c == first)
+            break;
+
+        run = c;
+    }
+
+    if (!bestlen)
+        goto fat_error; /* disk full */
+
+    for (unsigned long i = 0; i < bestlen; i++)
+    {
+        int rc2 = update_fat_entry(fat_bpb, best + i,
+                                   i + 1 < bestlen ? best + i + 1 :
+                                                     FAT_EOF_MARK);
+        if (rc2 < 0)
+            FAT_ERROR(rc2 * 10 - 3);
+    }
+
+    if (last)
+    {
+        int rc2 = update_fat_entry(fat_bpb, last, best);
+        if (rc2 < 0)
+            FAT_ERROR(rc2 * 10 - 4);
+    }
+    else
+    {
+        file->firstcluster = best;
+    }
+
+    fat_bpb->fsinfo.nextfree = best + bestlen;
+    rc = bestlen * fat_bpb->bpb_secperclus;
+fat_error:
+    dc_unlock_cache();
+    return rc;
+}
+
 
 /** Directory stream functions **/
 
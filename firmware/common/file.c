@@ -889,6 +889,51 @@ file_error:
     return rc;
 }
 
+/* allocate space for the file to grow into by length bytes, in as few
+   pieces as possible; the space isn't part of the file until written and
+   what is left of it is freed when the file is closed. returns the number
+   of bytes allocated, which may be fewer. */
+off_t freserve(int fildes, off_t length)
+{
+    DEBUGF("freserve(fd=%d,len=%ld)\n", fildes, (long)length);
+
+    struct filestr_desc * const file = GET_FILESTR(READER, fildes);
+    if (!file)
+        FILE_ERROR_RETURN(ERRNO, -1);
+
+    off_t rc;
+
+    if (!(file->stream.flags & FD_WRITE))
+    {
+        DEBUGF("Descriptor is read-only mode\n");
+        FILE_ERROR(EBADF, -2);
+    }
+
+    if (length < 0)
+    {
+        DEBUGF("Length %ld is invalid\n", (long)length);
+        FILE_ERROR(EINVAL, -3);
+    }
+
+    uint16_t sector_size = fat_file_sector_size(IF_MV(file->stream.fatstr.fatfilep));
+
+    long rc2 = fat_preallocate(&file->stream.fatstr,
+                               filesize_sectors(sector_size, length));
+    if (rc2 < 0)
+        FILE_ERROR(EIO, rc2 * 10 - 4);
+
+    if (rc2 == 0 && length > 0)
+        FILE_ERROR(ENOSPC, -5);
+
+    /* the part that isn't used is cut off again on close */
+    fileobj_change_flags(&file->stream, FO_TRUNC, FO_TRUNC);
+
+    rc = (off_t)rc2 * sector_size;
+file_error:
+    RELEASE_FILESTR(READER, file);
+    return rc;
+}
+
 /* synchronize changes to a file */
 int fsync(int fildes)
 {
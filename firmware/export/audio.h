@@ -145,6 +145,7 @@ struct audio_recording_options
     int  rec_prerecord_time;
     int  rec_mono_mode;
     int  rec_source_flags;  /* for rec_set_source */
+    bool rec_archive;       /* also keep the input as WAV */
     struct encoder_config enc_config;
 };
 
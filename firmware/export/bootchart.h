@@ -27,14 +27,25 @@
 
 #ifdef DO_BOOTCHART
 
+/* Marks starting with '>' and '<' begin and end a stage. They are kept so
+   bootchart_save() can write ROCKBOX_DIR/bootchart.txt with the time each
+   stage took. */
+void bootchart_mark(const char *name, const char *arg, int line);
+void bootchart_save(void);
+
 /* we call _logf directly to avoid needing LOGF_ENABLE per-file */
-#define CHART2(x,y) _logf("BC:%s%s,%d,%ld", (x), (y), __LINE__, current_tick)
+#define CHART2(x,y) \
+    do { \
+        _logf("BC:%s%s,%d,%ld", (x), (y), __LINE__, current_tick); \
+        bootchart_mark((x), (y), __LINE__); \
+    } while (0)
 #define CHART(x) CHART2(x,"")
 
 #else /* !DO_BOOTCHART */
 
 #define CHART2(x,y)
 #define CHART(x)
+#define bootchart_save()
 
 #endif /* DO_BOOTCHART */
 
@@ -24,6 +24,7 @@
 #ifndef ENC_BASE_H
 #define ENC_BASE_H
 
+#include <stdbool.h>
 #include <sys/types.h>
 
 /** Encoder config structures **/
@@ -111,6 +112,7 @@ extern const unsigned long mp3_enc_bitr[MP3_ENC_NUM_BITR];
 struct mp3_enc_config
 {
     unsigned long bitrate;
+    bool fast; /* estimate the quantizer instead of searching for it */
 };
 
 #define MP3_ENC_BITRATE_CFG_DEFAULT     11 /* 128 */
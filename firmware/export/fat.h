@@ -165,6 +165,8 @@ int fat_seek(struct fat_filestr *filestr, unsigned long sector);
 void fat_seek_to_stream(struct fat_filestr *filestr,
                         const struct fat_filestr *filestr_seek_to);
 int fat_truncate(const struct fat_filestr *filestr);
+long fat_preallocate(const struct fat_filestr *filestr,
+                     unsigned long sectorcount);
 
 /** Directory stream functions **/
 struct filestr_cache;
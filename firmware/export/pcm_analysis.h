@@ -0,0 +1,61 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef PCM_ANALYSIS_H
+#define PCM_ANALYSIS_H
+
+#include <stdint.h>
+#include "pcm.h"
+#include "pcm_mixer.h"
+
+/* Levels and spectrum of what a mixer channel is playing, for the peak
+ * meter, the WPS, the recording screen and plugins. The analysis is done
+ * at most once per tick for all callers together, and only of the parts
+ * that were asked for recently, so several displays don't each pay for
+ * it. */
+
+/* Number of bands, spaced evenly on a log scale up to half the samplerate */
+#define PCM_ANALYSIS_BANDS      16
+
+/* Lowest level reported, in tenths of dB */
+#define PCM_ANALYSIS_FLOOR      (-960)
+
+enum pcm_analysis_features
+{
+    PCM_ANALYSIS_PEAK     = 0x1, /* peak, of every 4th frame */
+    PCM_ANALYSIS_RMS      = 0x2, /* rms, and the peak of every frame */
+    PCM_ANALYSIS_LOUDNESS = 0x4, /* momentary loudness */
+    PCM_ANALYSIS_SPECTRUM = 0x8, /* band levels */
+};
+
+struct pcm_analysis
+{
+    long tick;                  /* when this was computed */
+    unsigned int features;      /* which of the following are valid */
+    uint32_t peak[2];           /* left, right; 0-32768 like pcm_peaks */
+    uint32_t rms[2];            /* left, right; same scale */
+    int loudness;               /* momentary (400 ms) in tenths of LUFS */
+    int bands[PCM_ANALYSIS_BANDS]; /* tenths of dB below full scale */
+};
+
+/* Fill in the analysis of the last part played on channel, with at least
+   the parts in features. Can be called from any thread on the main core. */
+void pcm_analysis_get(enum pcm_mixer_channel channel, unsigned int features,
+                      struct pcm_analysis *result);
+
+#endif /* PCM_ANALYSIS_H */
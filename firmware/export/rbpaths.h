@@ -117,6 +117,7 @@
 #define FMPRESET_PATH       ROCKBOX_DIR "/fmpresets"
 
 #define DIRCACHE_FILE       ROCKBOX_DIR "/dircache.dat"
+#define ALBUMART_CACHE_DIR  ROCKBOX_DIR "/.albumart_cache"
 #define CODEPAGE_DIR        ROCKBOX_DIR "/codepages"
 
 #define VIEWERS_CONFIG      ROCKBOX_DIR "/viewers.config"
@@ -124,8 +125,10 @@
 #define RESUMEFILE          ROCKBOX_DIR "/.resume.cfg"
 #define CONFIGFILE          ROCKBOX_DIR "/config.cfg"
 #define FIXEDSETTINGSFILE   ROCKBOX_DIR "/fixed.cfg"
+#define SETTINGSCACHEFILE   ROCKBOX_DIR "/.config.bin"
 
 #define PLAYLIST_CONTROL_FILE   ROCKBOX_DIR "/.playlist_control"
+#define PLAYLIST_SNAPSHOT_FILE  ROCKBOX_DIR "/.playlist_snapshot"
 #define GLYPH_CACHE_FILE        ROCKBOX_DIR "/.glyphcache"
 
 #endif /* __PATHS_H__ */
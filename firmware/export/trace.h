@@ -0,0 +1,79 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#ifndef TRACE_H
+#define TRACE_H
+#include <config.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Timed events from the hot paths, recorded as small binary records in a
+ * ring per core. Recording an event takes a timestamp and a few stores, so
+ * it can be left in places where a logf() would disturb what is measured.
+ * The ring is saved with trace_dump() (debug menu) and converted with
+ * tools/trace2json.py for chrome://tracing or Perfetto.
+ *
+ * Only built with the "trace ring" developer option, otherwise the
+ * TRACE_* macros are empty. */
+
+/* All events and the names they are shown with. The names are saved with
+   the trace, so events can be added anywhere in the list. */
+#define TRACE_EVENT_LIST(X) \
+    X(THREAD_SWITCH,    "thread switch")    \
+    X(PCMBUF_COMMIT,    "pcmbuf commit")    \
+    X(PCMBUF_UNDERRUN,  "pcmbuf underrun")  \
+    X(CODEC_RUN,        "codec run")        \
+    X(BUFFER_READ,      "buffer read")      \
+    X(STORAGE_READ,     "storage read")
+
+enum trace_event_id
+{
+#define X(id, name) TRACE_##id,
+    TRACE_EVENT_LIST(X)
+#undef X
+    TRACE_NUM_EVENTS
+};
+
+enum trace_phase
+{
+    TRACE_PH_INSTANT = 0,
+    TRACE_PH_BEGIN,
+    TRACE_PH_END,
+};
+
+#ifdef ROCKBOX_HAS_TRACE
+
+void trace_init(void);
+void trace_event(enum trace_event_id id, enum trace_phase phase,
+                 uint32_t arg);
+/* Save the rings to path. Returns the number of events, -1 on error. */
+int trace_dump(const char *path);
+
+#define TRACE_EVENT(id, arg) trace_event(TRACE_##id, TRACE_PH_INSTANT, (arg))
+#define TRACE_BEGIN(id, arg) trace_event(TRACE_##id, TRACE_PH_BEGIN, (arg))
+#define TRACE_END(id, arg)   trace_event(TRACE_##id, TRACE_PH_END, (arg))
+
+#else /* !ROCKBOX_HAS_TRACE */
+
+#define TRACE_EVENT(id, arg) do { } while (0)
+#define TRACE_BEGIN(id, arg) do { } while (0)
+#define TRACE_END(id, arg)   do { } while (0)
+
+#endif /* ROCKBOX_HAS_TRACE */
+
+#endif /* TRACE_H */
@@ -49,6 +49,7 @@ int     open(const char *name, int oflag);
 int     creat(const char *name);
 int     close(int fildes);
 int     ftruncate(int fildes, off_t length);
+off_t   freserve(int fildes, off_t length);
 int     fsync(int fildes);
 off_t   lseek(int fildes, off_t offset, int whence);
 ssize_t read(int fildes, void *buf, size_t nbyte);
@@ -35,6 +35,7 @@
 #ifdef RB_PROFILE
 #include <profile.h>
 #endif
+#include "trace.h"
 #include "core_alloc.h"
 
 #if (CONFIG_PLATFORM & PLATFORM_HOSTED)
@@ -1102,6 +1103,7 @@ void switch_thread(void)
 #ifdef RB_PROFILE
     profile_thread_started(THREAD_ID_SLOT(thread->id));
 #endif
+    TRACE_EVENT(THREAD_SWITCH, THREAD_ID_SLOT(thread->id));
 
     /* And finally, give control to the next thread. */
     thread_load_context(thread);
@@ -0,0 +1,496 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "system.h"
+#include "kernel.h"
+#include "pcm.h"
+#include "pcm_mixer.h"
+#include "pcm_analysis.h"
+#include "fixedpoint.h"
+
+/*
+ * The data analysed is what is left of the buffer a channel is playing,
+ * limited to what plays between two analyses, like the peak calculation in
+ * pcm.c.
+ *
+ * Peaks alone only look at every 4th frame, like the peak meter always
+ * did; with rms every frame is looked at.
+ *
+ * The spectrum comes from one 256 point FFT of a Hann-windowed block, with
+ * left and right packed as the real and imaginary parts. The loudness runs
+ * every frame through the two BS.1770 K-weighting filters, whose state is
+ * kept from one analysis to the next, and averages the last 400 ms. As the
+ * parts analysed only roughly join up, it is a meter, not a compliant
+ * measurement.
+ *
+ * Results are written to a local copy and published under a sequence
+ * count, so readers never see a half-written result and never block.
+ */
+
+#define FFT_BITS        8
+#define FFT_SIZE        (1 << FFT_BITS)
+#define FFT_BINS        (FFT_SIZE / 2)
+
+/* features not asked for within this long are no longer computed */
+#define FEATURE_TIMEOUT HZ
+#define FEATURE_COUNT   4
+
+/* momentary loudness is the mean over 16 slots of 25 ms */
+#define LOUD_SLOTS      16
+#define LOUD_SLOT_HZ    40
+
+/* highest FFT bin of each band */
+static const uint8_t band_edges[PCM_ANALYSIS_BANDS] =
+{
+    1, 2, 3, 4, 5, 6, 8, 11, 15, 20, 27, 37, 50, 68, 93, 127
+};
+
+static struct analysis_state
+{
+    struct pcm_analysis result;     /* the published result */
+    volatile unsigned int seq;      /* odd while result is written */
+    long requested[FEATURE_COUNT];  /* last tick each feature was wanted */
+    long last_tick;                 /* of the last analysis */
+    struct
+    {
+        unsigned int slot;
+        unsigned int count;         /* frames */
+        uint64_t energy;
+    } loud[LOUD_SLOTS];
+    int32_t k_state[2][6];          /* K-weighting filters, left and right */
+} states[PCM_MIXER_NUM_CHANNELS];
+
+/* FFT tables, made once */
+static int16_t fft_cos[FFT_BINS + 1];
+static int16_t fft_sin[FFT_BINS + 1];
+
+/* K-weighting for the current samplerate, 4.28: b0, b1, b2, a1, a2 of the
+   shelf and a1, a2 of the high pass */
+static int32_t k_coefs[7];
+static unsigned int k_weight_sampr = 0;
+
+static int32_t fft_re[FFT_SIZE];
+static int32_t fft_im[FFT_SIZE];
+
+/* 10*log10(x) in tenths of dB, x > 0 */
+static int db_tenths(uint64_t x)
+{
+    int e = 63 - __builtin_clzll(x);
+    uint32_t m = e >= 16 ? (uint32_t)(x >> (e - 16)) & 0xffff :
+                           (uint32_t)(x << (16 - e)) & 0xffff;
+
+    /* log2(1 + m) ~ m + 0.346*m*(1 - m), within 0.01 */
+    m += ((m * (65536 - m)) >> 16) * 22676 >> 16;
+
+    /* 100*log10(2) = 30.103 */
+    return (((e << 16) + m) >> 8) * 7706 >> 16;
+}
+
+static int32_t isqrt(uint32_t x)
+{
+    uint32_t r = 0, bit = 1ul << 30;
+
+    while (bit > x)
+        bit >>= 2;
+
+    while (bit)
+    {
+        if (x >= r + bit)
+        {
+            x -= r + bit;
+            r = (r >> 1) + bit;
+        }
+        else
+        {
+            r >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return r;
+}
+
+static void init_fft_tables(void)
+{
+    for (int i = 0; i <= FFT_BINS; i++)
+    {
+        long c;
+        long s = fp_sincos((unsigned long)i << (32 - FFT_BITS), &c);
+        fft_cos[i] = MIN(c >> 16, 32767);
+        fft_sin[i] = MIN(s >> 16, 32767);
+    }
+}
+
+/* tan(pi * f / sampr) in 4.28, f in mHz */
+static int64_t tan_q28(uint64_t f, unsigned int sampr)
+{
+    long c;
+    long s = fp_sincos(f * (1ull << 31) / (sampr * 1000ull), &c);
+    return ((int64_t)s << 28) / c;
+}
+
+/* BS.1770 pre-filter (+4 dB shelf at 1682 Hz) and RLB high pass (38 Hz),
+   by the bilinear transform of their analog prototypes */
+static void init_k_weight(unsigned int sampr)
+{
+    const int64_t one = 1 << 28;
+    const int64_t vh = 425433879;       /* 10^(4/20) */
+    const int64_t vb = 337885327;       /* vh^0.4997 */
+    const int64_t shelf_iq = 379588314; /* 1/Q */
+    const int64_t hp_iq = 536519988;
+
+    int64_t k = tan_q28(1681974, sampr);
+    int64_t k2 = k * k >> 28;
+    int64_t kq = k * shelf_iq >> 28;
+    int64_t a0 = one + kq + k2;
+
+    k_coefs[0] = ((vh + (vb * kq >> 28) + k2) << 28) / a0;
+    k_coefs[1] = ((2 * (k2 - vh)) << 28) / a0;
+    k_coefs[2] = ((vh - (vb * kq >> 28) + k2) << 28) / a0;
+    k_coefs[3] = ((2 * (k2 - one)) << 28) / a0;
+    k_coefs[4] = ((one - kq + k2) << 28) / a0;
+
+    k = tan_q28(38135, sampr);
+    k2 = k * k >> 28;
+    kq = k * hp_iq >> 28;
+    a0 = one + kq + k2;
+
+    k_coefs[5] = ((2 * (k2 - one)) << 28) / a0;
+    k_coefs[6] = ((one - kq + k2) << 28) / a0;
+
+    k_weight_sampr = sampr;
+}
+
+/* K-weights one channel of interleaved stereo, returns the sum of squares
+   of the result in 28.4 */
+static uint64_t k_weight_kernel(const int16_t *p, int count, int32_t z[6])
+{
+    const int32_t *c = k_coefs;
+    int32_t x1 = z[0], x2 = z[1], y1 = z[2], y2 = z[3], w1 = z[4], w2 = z[5];
+    uint64_t sum = 0;
+
+    for (; count > 0; count--, p += 2)
+    {
+        /* 8 fractional bits */
+        int32_t x = *p << 8;
+        int32_t y = ((int64_t)c[0] * x + (int64_t)c[1] * x1 +
+                     (int64_t)c[2] * x2 - (int64_t)c[3] * y1 -
+                     (int64_t)c[4] * y2) >> 28;
+        int32_t w = (((int64_t)(y - 2 * y1 + y2) << 28) -
+                     (int64_t)c[5] * w1 - (int64_t)c[6] * w2) >> 28;
+
+        x2 = x1; x1 = x;
+        y2 = y1; y1 = y;
+        w2 = w1; w1 = w;
+
+        w >>= 4;
+        sum += (int64_t)w * w;
+    }
+
+    z[0] = x1; z[1] = x2; z[2] = y1; z[3] = y2; z[4] = w1; z[5] = w2;
+    return sum;
+}
+
+/* peak of every 4th frame of interleaved stereo */
+static void peak_kernel(const int16_t *p, int count, uint32_t peak[2])
+{
+    uint32_t pl = 0, pr = 0;
+
+    for (; count > 0; count -= 4, p += 4 * 2)
+    {
+        uint32_t l = abs(p[0]), r = abs(p[1]);
+        if (l > pl)
+            pl = l;
+        if (r > pr)
+            pr = r;
+    }
+
+    peak[0] = pl;
+    peak[1] = pr;
+}
+
+/* peak and sum of squares of interleaved stereo */
+static void levels_kernel(const int16_t *p, int count,
+                          uint32_t peak[2], uint64_t sum[2])
+{
+    uint32_t pl = 0, pr = 0;
+    uint64_t sl = 0, sr = 0;
+
+    /* two frames at a time, with 32 bit partial sums that can't overflow
+       for two products */
+    for (; count >= 2; count -= 2, p += 4)
+    {
+        int32_t l0 = p[0], r0 = p[1], l1 = p[2], r1 = p[3];
+
+        sl += (uint32_t)(l0 * l0) + (uint32_t)(l1 * l1);
+        sr += (uint32_t)(r0 * r0) + (uint32_t)(r1 * r1);
+
+        l0 = MAX(abs(l0), abs(l1));
+        r0 = MAX(abs(r0), abs(r1));
+        if ((uint32_t)l0 > pl)
+            pl = l0;
+        if ((uint32_t)r0 > pr)
+            pr = r0;
+    }
+
+    if (count)
+    {
+        int32_t l = p[0], r = p[1];
+        sl += (uint32_t)(l * l);
+        sr += (uint32_t)(r * r);
+        pl = MAX(pl, (uint32_t)abs(l));
+        pr = MAX(pr, (uint32_t)abs(r));
+    }
+
+    peak[0] = pl;
+    peak[1] = pr;
+    sum[0] = sl;
+    sum[1] = sr;
+}
+
+/* in-place radix 2 FFT of fft_re/fft_im, scaled by 1/FFT_SIZE */
+static void fft_kernel(void)
+{
+    for (int i = 1, j = 0; i < FFT_SIZE; i++)
+    {
+        int bit = FFT_SIZE >> 1;
+        for (; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if (i < j)
+        {
+            int32_t t = fft_re[i]; fft_re[i] = fft_re[j]; fft_re[j] = t;
+            t = fft_im[i]; fft_im[i] = fft_im[j]; fft_im[j] = t;
+        }
+    }
+
+    for (int half = 1, step = FFT_BINS; half < FFT_SIZE; half <<= 1, step >>= 1)
+    {
+        for (int k = 0; k < half; k++)
+        {
+            int32_t wr = fft_cos[k * step];
+            int32_t wi = -fft_sin[k * step];
+
+            for (int a = k; a < FFT_SIZE; a += half << 1)
+            {
+                int b = a + half;
+                int32_t tr = ((int64_t)fft_re[b] * wr - (int64_t)fft_im[b] * wi) >> 15;
+                int32_t ti = ((int64_t)fft_re[b] * wi + (int64_t)fft_im[b] * wr) >> 15;
+
+                fft_re[b] = (fft_re[a] - tr) >> 1;
+                fft_im[b] = (fft_im[a] - ti) >> 1;
+                fft_re[a] = (fft_re[a] + tr) >> 1;
+                fft_im[a] = (fft_im[a] + ti) >> 1;
+            }
+        }
+    }
+}
+
+/* fills in the band levels of the block */
+static void spectrum(const int16_t *p, int count, int *bands)
+{
+    static const int band_ref = 1265; /* a full scale sine in one bin */
+    count = MIN(count, FFT_SIZE);
+
+    for (int i = 0; i < FFT_SIZE; i++)
+    {
+        /* Hann window, from the cosine table by symmetry */
+        int32_t c = fft_cos[i <= FFT_BINS ? i : FFT_SIZE - i];
+        int32_t w = (32767 - c) >> 1;
+
+        /* 8 bits of headroom for the scaling in each pass */
+        if (i < count)
+        {
+            fft_re[i] = p[2*i] * w >> 7;
+            fft_im[i] = p[2*i + 1] * w >> 7;
+        }
+        else
+        {
+            fft_re[i] = fft_im[i] = 0;
+        }
+    }
+
+    fft_kernel();
+
+    uint64_t band = 0;
+    int b = 0;
+
+    for (int k = 1; k < FFT_BINS; k++)
+    {
+        /* separate left and right from the packed transform */
+        int32_t sr = fft_re[k] + fft_re[FFT_SIZE - k];
+        int32_t di = fft_im[k] - fft_im[FFT_SIZE - k];
+        int32_t si = fft_im[k] + fft_im[FFT_SIZE - k];
+        int32_t dr = fft_re[k] - fft_re[FFT_SIZE - k];
+        uint64_t power = ((int64_t)sr * sr + (int64_t)di * di +
+                          (int64_t)si * si + (int64_t)dr * dr) >> 2;
+
+        band += power;
+
+        if (k == band_edges[b])
+        {
+            bands[b] = band ? MAX(db_tenths(band) - band_ref,
+                                  PCM_ANALYSIS_FLOOR) :
+                              PCM_ANALYSIS_FLOOR;
+            band = 0;
+            b++;
+        }
+    }
+}
+
+static int momentary_loudness(struct analysis_state *s, const int16_t *p,
+                              int frames)
+{
+    unsigned int slot = current_tick * LOUD_SLOT_HZ / HZ;
+    unsigned int count = 0;
+    uint64_t sum = 0;
+
+    if (s->loud[slot % LOUD_SLOTS].slot != slot)
+    {
+        s->loud[slot % LOUD_SLOTS].slot = slot;
+        s->loud[slot % LOUD_SLOTS].count = 0;
+        s->loud[slot % LOUD_SLOTS].energy = 0;
+    }
+
+    s->loud[slot % LOUD_SLOTS].count += frames;
+    s->loud[slot % LOUD_SLOTS].energy += k_weight_kernel(p, frames, s->k_state[0]) +
+                                         k_weight_kernel(p + 1, frames, s->k_state[1]);
+
+    for (int i = 0; i < LOUD_SLOTS; i++)
+    {
+        if (slot - s->loud[i].slot < LOUD_SLOTS)
+        {
+            count += s->loud[i].count;
+            sum += s->loud[i].energy;
+        }
+    }
+
+    if (!count || !sum)
+        return PCM_ANALYSIS_FLOOR;
+
+    /* The sum of left and right is relative to full scale squared in 28.4,
+       2^38 or 114.4 dB; BS.1770 adds -0.691 dB */
+    return MAX(db_tenths(sum / count) - 1144 - 7, PCM_ANALYSIS_FLOOR);
+}
+
+static void analyse(enum pcm_mixer_channel channel, struct analysis_state *s,
+                    unsigned int features, struct pcm_analysis *res)
+{
+    int count;
+    const int16_t *addr = mixer_channel_get_buffer(channel, &count);
+    bool playing = mixer_channel_status(channel) == CHANNEL_PLAYING;
+
+    res->tick = current_tick;
+
+    /* between two buffers; keep what was published last (res starts out
+       as that) rather than dropping to silence */
+    if (playing && (!addr || count <= 0))
+        return;
+
+    res->features = features;
+
+    if (!playing)
+    {
+        memset(res->peak, 0, sizeof (res->peak));
+        memset(res->rms, 0, sizeof (res->rms));
+        res->loudness = PCM_ANALYSIS_FLOOR;
+        for (int i = 0; i < PCM_ANALYSIS_BANDS; i++)
+            res->bands[i] = PCM_ANALYSIS_FLOOR;
+        memset(s->loud, 0, sizeof (s->loud));
+        memset(s->k_state, 0, sizeof (s->k_state));
+        return;
+    }
+
+    /* no farther ahead than what plays until the next analysis */
+    long period = MIN(MAX(current_tick - s->last_tick, 1), HZ/5);
+    s->last_tick = current_tick;
+    int frames = MAX(period * (long)mixer_get_frequency() / HZ, FFT_SIZE);
+    count = MIN(count, frames);
+
+    if (features & PCM_ANALYSIS_RMS)
+    {
+        /* the exact peak comes along */
+        uint64_t sum[2];
+        levels_kernel(addr, count, res->peak, sum);
+        res->rms[0] = isqrt(sum[0] / count);
+        res->rms[1] = isqrt(sum[1] / count);
+        res->features |= PCM_ANALYSIS_PEAK;
+    }
+    else if (features & PCM_ANALYSIS_PEAK)
+    {
+        peak_kernel(addr, count, res->peak);
+    }
+
+    if (features & PCM_ANALYSIS_LOUDNESS)
+    {
+        if (k_weight_sampr != mixer_get_frequency())
+            init_k_weight(mixer_get_frequency());
+
+        res->loudness = momentary_loudness(s, addr, count);
+    }
+
+    if (features & PCM_ANALYSIS_SPECTRUM)
+    {
+        if (!fft_cos[0])
+            init_fft_tables();
+
+        spectrum(addr, count, res->bands);
+    }
+}
+
+void pcm_analysis_get(enum pcm_mixer_channel channel, unsigned int features,
+                      struct pcm_analysis *result)
+{
+    struct analysis_state *s = &states[channel];
+    long tick = current_tick;
+    unsigned int seq;
+
+    for (int i = 0; i < FEATURE_COUNT; i++)
+    {
+        if (features & (1u << i))
+            s->requested[i] = tick;
+    }
+
+    /* someone already did this tick's analysis? */
+    do
+    {
+        seq = s->seq;
+        *result = s->result;
+    }
+    while ((seq & 1) || seq != s->seq);
+
+    if (result->tick == tick && (result->features & features) == features)
+        return;
+
+    /* also do what others asked for lately so they can share it */
+    for (int i = 0; i < FEATURE_COUNT; i++)
+    {
+        if (TIME_BEFORE(tick, s->requested[i] + FEATURE_TIMEOUT))
+            features |= 1u << i;
+    }
+
+    analyse(channel, s, features, result);
+
+    s->seq++;
+    s->result = *result;
+    s->seq++;
+}
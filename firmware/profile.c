@@ -69,16 +69,22 @@
 #define INDEX_MASK 0x7FF /* lower INDEX_BITS 1 */
 
 /*
- * In the current setup (pfd has 4 longs and 2 shorts) this uses 20k of RAM
+ * In the current setup (pfd has 6 longs and 1 short) this uses 14k of RAM
  * for profiling, and allows for profiling sections of code with up-to
- * 1024 function caller->callee pairs
+ * 512 function caller->callee pairs
  */
 #define NUMPFDS 512
 
+/* How far up the call chain a tick is counted as inclusive time. The chain
+ * can loop when a call site is re-entered through indirect recursion. */
+#define MAX_INCLUSIVE_DEPTH 32
+
 struct pfd_struct {
     void *self_pc;
+    void *caller_pc;        /* function the call site is in, 0 if unknown */
     unsigned long count;
-    unsigned long time;
+    unsigned long time;     /* ticks spent in the function itself */
+    unsigned long inclusive;/* ticks spent in it and what it called */
     unsigned short link;
     struct pfd_struct *caller;
 };
@@ -148,7 +154,12 @@ static void profile_timer_tick(void) {
     if (!profiling) {
         register struct pfd_struct *my_last_pfd = last_pfd;
         if (my_last_pfd) {
+            int depth = MAX_INCLUSIVE_DEPTH;
             ADDQI_L(my_last_pfd->time,1);
+            do {
+                ADDQI_L(my_last_pfd->inclusive,1);
+                my_last_pfd = my_last_pfd->caller;
+            } while (my_last_pfd && --depth);
         }
     }
 }
@@ -181,6 +192,34 @@ static void write_function_recursive(int fd, struct pfd_struct *pfd, int depth){
     }
 }
 
+/* The same data as a call graph in the format of callgrind, which is read by
+ * callgrind_annotate and KCachegrind. Functions are given by address,
+ * profile_reader.pl replaces them with names. */
+static void write_callgrind(void) {
+    int i;
+    int used = MIN(pfds[0].link, NUMPFDS - 1);
+    int fd = open("/profile.callgrind", O_WRONLY|O_CREAT|O_TRUNC, 0666);
+    if (fd < 0)
+        return;
+    fdprintf(fd,"version: 1\n");
+    fdprintf(fd,"creator: rockbox profile\n");
+    fdprintf(fd,"positions: line\n");
+    fdprintf(fd,"events: Ticks\n\n");
+    for (i = 1; i <= used; i++) {
+        struct pfd_struct *pfd = &pfds[i];
+        if (pfd->self_pc == 0)
+            continue;
+        /* exclusive time, summed over all the pfds of a function */
+        fdprintf(fd,"fn=0x%08lX\n0 %lu\n", (size_t)pfd->self_pc, pfd->time);
+        if (pfd->caller_pc != 0) {
+            fdprintf(fd,"fn=0x%08lX\ncfn=0x%08lX\ncalls=%lu 0\n0 %lu\n",
+                    (size_t)pfd->caller_pc, (size_t)pfd->self_pc,
+                    pfd->count, pfd->inclusive);
+        }
+    }
+    close(fd);
+}
+
 void profstop() {
     int profiling_exit = profiling;
     int fd = 0;
@@ -220,6 +259,7 @@ void profstop() {
         fdprintf(fd,"%08lX=%04d\n",(size_t)&indices[i],indices[i]);
     }
     close(fd);
+    write_callgrind();
 }
 
 void __cyg_profile_func_exit(void *self_pc, void *call_site) {
@@ -251,7 +291,9 @@ void __cyg_profile_func_exit(void *self_pc, void *call_site) {
     temp = ++pfds[0].link;\
     if (temp >= NUMPFDS) goto overflow; \
     pfd = &pfds[temp];\
-    pfd->self_pc = self_pc; pfd->count = 1; pfd->time = 0
+    pfd->self_pc = self_pc; pfd->count = 1; pfd->time = 0; \
+    pfd->inclusive = 0; \
+    pfd->caller_pc = last_pfd ? last_pfd->self_pc : 0
 
 void __cyg_profile_func_enter(void *self_pc, void *from_pc) {
     struct pfd_struct *pfd;
@@ -24,6 +24,7 @@
 #include "usb.h"
 #include "disk.h"
 #include "pathfuncs.h"
+#include "trace.h"
 
 #ifdef CONFIG_STORAGE_MULTI
 
@@ -343,8 +344,8 @@ int storage_init(void)
     return rc;
 }
 
-int storage_read_sectors(IF_MD(int drive,) sector_t start, int count,
-                         void* buf)
+static inline int read_sectors(IF_MD(int drive,) sector_t start, int count,
+                               void* buf)
 {
 #ifdef CONFIG_STORAGE_MULTI
     int driver=(storage_drivers[drive] & DRIVER_MASK)>>DRIVER_OFFSET;
@@ -385,6 +386,15 @@ int storage_read_sectors(IF_MD(int drive,) sector_t start, int count,
 
 }
 
+int storage_read_sectors(IF_MD(int drive,) sector_t start, int count,
+                         void* buf)
+{
+    TRACE_BEGIN(STORAGE_READ, count);
+    int rc = read_sectors(IF_MD(drive,) start, count, buf);
+    TRACE_END(STORAGE_READ, rc);
+    return rc;
+}
+
 int storage_write_sectors(IF_MD(int drive,) sector_t start, int count,
                           const void* buf)
 {
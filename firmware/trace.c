@@ -0,0 +1,179 @@
+/***************************************************************************
+ *             __________               __   ___.
+ *   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+ *   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+ *   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+ *   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+ *                     \/            \/     \/    \/            \/
+ * $Id$
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+ * KIND, either express or implied.
+ *
+ ****************************************************************************/
+
+/*
+ * Each core has its own ring, so recording never has to synchronize with
+ * another core; interrupts are only masked while a record is filled in,
+ * since events are also recorded from interrupt handlers and the scheduler.
+ *
+ * Layout of a dump, in the byte order of the target:
+ *
+ *   "RBTR", version, number of events, number of threads, number of records
+ *   the names of the events, each terminated by 0
+ *   the names of the thread slots, "" for an unused one
+ *   the records, oldest first, one core after the other
+ *
+ * Timestamps are in microseconds and wrap around; targets without a
+ * microsecond timer use the tick.
+ */
+
+#include <string.h>
+#include "config.h"
+#include "system.h"
+#include "kernel.h"
+#include "thread.h"
+#include "../thread-internal.h"
+#include "file.h"
+#include "trace.h"
+
+#define TRACE_VERSION 1
+
+#if MEMORYSIZE <= 8
+#define TRACE_RECORDS 1024
+#else
+#define TRACE_RECORDS 4096
+#endif
+
+struct trace_record
+{
+    uint32_t time;
+    uint32_t arg;
+    uint8_t id;
+    uint8_t phase;
+    uint8_t thread;         /* slot */
+    uint8_t core;
+};
+
+static struct trace_ring
+{
+    struct trace_record records[TRACE_RECORDS];
+    unsigned int head;      /* records written, ever */
+} rings[NUM_CORES];
+
+static bool trace_enabled = false;
+
+static const char * const event_names[TRACE_NUM_EVENTS] =
+{
+#define X(id, name) [TRACE_##id] = name,
+    TRACE_EVENT_LIST(X)
+#undef X
+};
+
+static inline uint32_t trace_time(void)
+{
+#ifdef USEC_TIMER
+    return USEC_TIMER;
+#else
+    return current_tick * (1000000 / HZ);
+#endif
+}
+
+void trace_init(void)
+{
+    trace_enabled = true;
+}
+
+void trace_event(enum trace_event_id id, enum trace_phase phase,
+                 uint32_t arg)
+{
+    if (!trace_enabled)
+        return;
+
+    int oldlevel = disable_irq_save();
+
+#if NUM_CORES > 1
+    const unsigned int core = CURRENT_CORE;
+#else
+    const unsigned int core = 0;
+#endif
+    struct trace_ring *ring = &rings[core];
+    struct trace_record *r = &ring->records[ring->head++ % TRACE_RECORDS];
+
+    r->time = trace_time();
+    r->arg = arg;
+    r->id = id;
+    r->phase = phase;
+    r->thread = THREAD_ID_SLOT(thread_self());
+    r->core = core;
+
+    restore_irq(oldlevel);
+}
+
+static bool write_string(int fd, const char *s)
+{
+    size_t len = strlen(s) + 1;
+    return write(fd, s, len) == (ssize_t)len;
+}
+
+int trace_dump(const char *path)
+{
+    struct thread_debug_info info;
+    uint32_t header[5];
+    unsigned int i;
+    int count = 0;
+
+    int fd = open(path, O_CREAT|O_WRONLY|O_TRUNC, 0666);
+    if (fd < 0)
+        return -1;
+
+    /* don't let the rings move while they are written out */
+    trace_enabled = false;
+
+    for (i = 0; i < NUM_CORES; i++)
+        count += MIN(rings[i].head, TRACE_RECORDS);
+
+    memcpy(&header[0], "RBTR", 4);
+    header[1] = TRACE_VERSION;
+    header[2] = TRACE_NUM_EVENTS;
+    header[3] = MAXTHREADS;
+    header[4] = count;
+    bool ok = write(fd, header, sizeof(header)) == sizeof(header);
+
+    for (i = 0; ok && i < TRACE_NUM_EVENTS; i++)
+        ok = write_string(fd, event_names[i]);
+
+    for (i = 0; ok && i < MAXTHREADS; i++)
+    {
+        if (thread_get_debug_info(i, &info) <= 0)
+            info.name[0] = '\0';
+        ok = write_string(fd, info.name);
+    }
+
+    for (i = 0; ok && i < NUM_CORES; i++)
+    {
+        struct trace_ring *ring = &rings[i];
+        unsigned int n = MIN(ring->head, TRACE_RECORDS);
+        unsigned int start = (ring->head - n) % TRACE_RECORDS;
+        unsigned int first = MIN(n, TRACE_RECORDS - start);
+
+        /* the older part from start to the end of the ring, then the rest
+           from its beginning */
+        ok = write(fd, &ring->records[start], first * sizeof(struct trace_record))
+                == (ssize_t)(first * sizeof(struct trace_record));
+        if (ok && n > first)
+            ok = write(fd, ring->records, (n - first) * sizeof(struct trace_record))
+                    == (ssize_t)((n - first) * sizeof(struct trace_record));
+    }
+
+    trace_enabled = true;
+
+    if (close(fd) < 0 || !ok)
+        return -1;
+    return count;
+}
@@ -385,6 +385,25 @@ static bool sent_fb_this_frame = false;
 int fb_startframe = 0;
 bool send_fb = false;
 
+/* adaptive resampling variables
+ *
+ * Instead of asking the host to follow our clock through the feedback
+ * endpoint, the mixer runs at HW_SAMPR_DEFAULT and the DSP resamples from the
+ * host rate. The input rate given to the DSP is trimmed by a PI controller on
+ * the buffer fill, so drift between the two clocks is absorbed here. The
+ * integral settles on the drift, which is what is reported.
+ *
+ * The gains are for one update every FEEDBACK_UPDATE_RATE_FRAMES frames:
+ * with them a 500 ppm drift settles within about two minutes while the fill
+ * stays within two buffers of the target. */
+#define RESAMPLE_KP             200   /* ppm per buffer of fill error */
+#define RESAMPLE_KI_SHIFT       1     /* 1/2 ppm per buffer per update */
+#define RESAMPLE_MAX_PPM        2000
+static bool resample_active = false;
+static int32_t resample_integral;     /* ppm, 16.16 */
+static int32_t resample_ppm;          /* correction currently applied */
+static unsigned long resample_in_freq;
+
 /* debug screen sample count display variables */
 static unsigned long samples_received;
 static unsigned long samples_received_last;
@@ -398,6 +417,10 @@ int buffers_filled_max_last;
 static int last_frame = 0;
 static int frames_dropped = 0;
 
+/* buffer health counters */
+static unsigned int underflow_count = 0;
+static unsigned int overflow_count = 0;
+
 /* for blocking normal playback */
 static bool usbaudio_active = false;
 
@@ -470,6 +493,62 @@ static void encodeFBfixedpt(uint8_t arr[4], int32_t value, bool portspeed)
 
 }
 
+/* host rate trimmed by the current correction, rounded to the nearest Hz */
+static unsigned long resample_input_frequency(void)
+{
+    long f = hw_freq_sampr[as_playback_freq_idx];
+    long trim = f * resample_ppm;
+
+    trim = (trim + (trim < 0 ? -500000 : 500000)) / 1000000;
+    return f + trim;
+}
+
+static void usb_audio_apply_frequency(void)
+{
+    /* the DSP may be running from the completion interrupt */
+    int oldlevel = disable_irq_save();
+
+    if(resample_active)
+    {
+        resample_in_freq = resample_input_frequency();
+        dsp_configure(dsp, DSP_SET_OUT_FREQUENCY, HW_SAMPR_DEFAULT);
+        dsp_configure(dsp, DSP_SET_FREQUENCY, resample_in_freq);
+    }
+    else
+    {
+        /* same as the output rate: no resampling */
+        dsp_configure(dsp, DSP_SET_FREQUENCY, 0);
+    }
+
+    restore_irq(oldlevel);
+
+    mixer_set_frequency(resample_active ?
+                        HW_SAMPR_DEFAULT : hw_freq_sampr[as_playback_freq_idx]);
+    pcm_apply_settings();
+}
+
+/* PI step, fill_error is the average fill above the target in buffers,
+ * 16.16. A fuller buffer means the host runs fast, so raise the input rate
+ * to consume faster */
+static void usb_audio_update_resampling(int32_t fill_error)
+{
+    const int32_t max_integral = TO_16DOT16_FIXEDPT(RESAMPLE_MAX_PPM);
+
+    resample_integral += fill_error >> RESAMPLE_KI_SHIFT;
+    resample_integral = MIN(MAX(resample_integral, -max_integral), max_integral);
+
+    int32_t ppm = (fill_error * RESAMPLE_KP + resample_integral) / (1<<16);
+    resample_ppm = MIN(MAX(ppm, -RESAMPLE_MAX_PPM), RESAMPLE_MAX_PPM);
+
+    unsigned long in_freq = resample_input_frequency();
+    if(in_freq != resample_in_freq)
+    {
+        /* runs in the same context as dsp_process() */
+        resample_in_freq = in_freq;
+        dsp_configure(dsp, DSP_SET_FREQUENCY, in_freq);
+    }
+}
+
 static void set_playback_sampling_frequency(unsigned long f)
 {
     // only values 44.1k and higher (array is in descending order)
@@ -485,8 +564,7 @@ static void set_playback_sampling_frequency(unsigned long f)
     logf("usbaudio: set playback sampling frequency to %lu Hz for a requested %lu Hz",
         hw_freq_sampr[as_playback_freq_idx], f);
 
-    mixer_set_frequency(hw_freq_sampr[as_playback_freq_idx]);
-    pcm_apply_settings();
+    usb_audio_apply_frequency();
 }
 
 unsigned long usb_audio_get_playback_sampling_frequency(void)
@@ -672,6 +750,7 @@ static void playback_audio_get_more(const void **start, size_t *size)
     {
         logf("usbaudio: playback underflow");
         playback_audio_underflow = true;
+        underflow_count++;
         *start = NULL;
         *size = 0;
         return;
@@ -709,8 +788,15 @@ static void usb_audio_start_playback(void)
     samples_fb = 0;
     samples_received_report = 0;
 
+    // adaptive resampling, or feedback only
+    resample_active = global_settings.usb_audio_resample;
+    resample_integral = 0;
+    resample_ppm = 0;
+
     // debug screen info - frame drop counter
     frames_dropped = 0;
+    underflow_count = 0;
+    overflow_count = 0;
     last_frame = -1;
     buffers_filled_min = -1;
     buffers_filled_min_last = -1;
@@ -726,9 +812,9 @@ static void usb_audio_start_playback(void)
     audio_set_input_source(AUDIO_SRC_PLAYBACK, SRCF_PLAYBACK);
     audio_set_output_source(AUDIO_SRC_PLAYBACK);
 #endif
-    logf("usbaudio: start playback at %lu Hz", hw_freq_sampr[as_playback_freq_idx]);
-    mixer_set_frequency(hw_freq_sampr[as_playback_freq_idx]);
-    pcm_apply_settings();
+    logf("usbaudio: start playback at %lu Hz%s", hw_freq_sampr[as_playback_freq_idx],
+         resample_active ? " (resampled)" : "");
+    usb_audio_apply_frequency();
     mixer_channel_set_amplitude(PCM_MIXER_CHAN_USBAUDIO, MIX_AMP_UNITY);
 
     usb_drv_recv_nonblocking(out_iso_ep_adr, rx_buffer, BUFFER_SIZE);
@@ -1274,6 +1360,38 @@ int usb_audio_get_frames_dropped(void)
     return frames_dropped;
 }
 
+bool usb_audio_get_resampling(void)
+{
+    return usb_audio_playing && resample_active;
+}
+
+int32_t usb_audio_get_drift_ppm(void)
+{
+    if (resample_active)
+        return resample_integral / (1<<16);
+
+    // asking for more than nominal means the host clock is slow
+    int32_t samples_base = TO_16DOT16_FIXEDPT(hw_freq_sampr[as_playback_freq_idx]/10)/100;
+    if (samples_fb == 0)
+        return 0;
+    return (int32_t)((int64_t)(samples_base - samples_fb) * 1000000 / samples_base);
+}
+
+int32_t usb_audio_get_correction_ppm(void)
+{
+    return resample_active ? resample_ppm : 0;
+}
+
+unsigned int usb_audio_get_underflow_count(void)
+{
+    return underflow_count;
+}
+
+unsigned int usb_audio_get_overflow_count(void)
+{
+    return overflow_count;
+}
+
 void usb_audio_transfer_complete(int ep, int dir, int status, int length)
 {
     /* normal handler is too slow to handle the completion rate, because
@@ -1346,6 +1464,7 @@ bool usb_audio_fast_transfer_complete(int ep, int dir, int status, int length)
         {
             logf("usbaudio: rx overflow");
             usb_rx_overflow = true;
+            overflow_count++;
         }
         /* if audio underflowed and prebuffering is done, restart audio */
         if(playback_audio_underflow && prebuffering_done())
@@ -1387,16 +1506,25 @@ bool usb_audio_fast_transfer_complete(int ep, int dir, int status, int length)
             buffers_filled_accumulator_old = buffers_filled_accumulator;
             buffers_filled_avgcount_old = buffers_filled_avgcount;
 
-            // someone who has implemented actual PID before might be able to do this correctly,
-            // but this seems to work good enough?
-            // Coefficients were 1, 0.25, 0.025 in float math --> 1, /4, /40 in fixed-point math
-            samples_fb = samples_base - (buffers_filled/4) + ((buffers_filled_old - buffers_filled)/40);
+            if (resample_active)
+            {
+                // drift is taken care of here, so let the host run at its own clock
+                usb_audio_update_resampling(buffers_filled);
+                samples_fb = samples_base;
+            }
+            else
+            {
+                // someone who has implemented actual PID before might be able to do this correctly,
+                // but this seems to work good enough?
+                // Coefficients were 1, 0.25, 0.025 in float math --> 1, /4, /40 in fixed-point math
+                samples_fb = samples_base - (buffers_filled/4) + ((buffers_filled_old - buffers_filled)/40);
+
+                // must limit to +/- 1 sample from nominal
+                samples_fb = samples_fb > (samples_base + TO_16DOT16_FIXEDPT(1)) ? samples_base + TO_16DOT16_FIXEDPT(1) : samples_fb;
+                samples_fb = samples_fb < (samples_base - TO_16DOT16_FIXEDPT(1)) ? samples_base - TO_16DOT16_FIXEDPT(1) : samples_fb;
+            }
             buffers_filled_old = buffers_filled;
 
-            // must limit to +/- 1 sample from nominal
-            samples_fb = samples_fb > (samples_base + TO_16DOT16_FIXEDPT(1)) ? samples_base + TO_16DOT16_FIXEDPT(1) : samples_fb;
-            samples_fb = samples_fb < (samples_base - TO_16DOT16_FIXEDPT(1)) ? samples_base - TO_16DOT16_FIXEDPT(1) : samples_fb;
-
             encodeFBfixedpt(sendFf, samples_fb, usb_drv_port_speed());
             logf("usbaudio: frame %d fbval 0x%02X%02X%02X%02X", usb_drv_get_frame_number(), sendFf[3], sendFf[2], sendFf[1], sendFf[0]);
             usb_drv_send_nonblocking(in_iso_feedback_ep_adr, sendFf, usb_drv_port_speed()?4:3);
@@ -270,6 +270,40 @@ bool usb_audio_get_overflow(void);
  */
 int usb_audio_get_frames_dropped(void);
 
+/*
+ * usb_audio_get_resampling():
+ *
+ * Return whether playback is resampled to HW_SAMPR_DEFAULT with the rate
+ * adapted to the host's clock, instead of relying on the feedback endpoint
+ */
+bool usb_audio_get_resampling(void);
+
+/*
+ * usb_audio_get_drift_ppm():
+ *
+ * Return how much faster the host's clock runs than ours, in ppm. When
+ * resampling this is the controller's estimate, otherwise it is what the
+ * feedback endpoint currently asks the host to correct.
+ */
+int32_t usb_audio_get_drift_ppm(void);
+
+/*
+ * usb_audio_get_correction_ppm():
+ *
+ * Return the rate correction applied by the resampler right now, in ppm
+ */
+int32_t usb_audio_get_correction_ppm(void);
+
+/*
+ * usb_audio_get_underflow_count():
+ * usb_audio_get_overflow_count():
+ *
+ * Return how many times playback ran out of data, and how many times usb
+ * had to stop receiving because all buffers were full, since playback started
+ */
+unsigned int usb_audio_get_underflow_count(void);
+unsigned int usb_audio_get_overflow_count(void);
+
 /*
  * usb_audio_get_cur_volume():
  *
@@ -90,6 +90,15 @@
 
 #define ALLOCATE_BUFFER_SIZE (2*MAX(READ_BUFFER_SIZE,WRITE_BUFFER_SIZE))
 
+/* If there isn't enough memory for the buffers above, smaller ones are
+ * tried down to this size; transfers are then just split into more pieces */
+#define MIN_BUFFER_SIZE (1024*16)
+
+/* Reads that fit in one buffer are still split in two pieces of at least
+ * this size. Otherwise the whole command is read from storage before any of
+ * it is sent, and nothing overlaps for the common 64k-128k host requests */
+#define READ_SPLIT_SIZE (1024*16)
+
 /* bulk-only class specific requests */
 #define USB_BULK_RESET_REQUEST   0xff
 #define USB_BULK_GET_MAX_LUN     0xfe
@@ -286,6 +295,8 @@ static union {
 } tb;
 
 static char *cbw_buffer;
+static unsigned int read_buffer_size;
+static unsigned int write_buffer_size;
 
 static struct {
     sector_t sector;
@@ -294,6 +305,7 @@ static struct {
     unsigned int block_size;
     unsigned int tag;
     unsigned int lun;
+    unsigned int chunk; /* sectors per transfer */
     unsigned char *data[2];
     unsigned char data_select;
     unsigned int last_result;
@@ -461,18 +473,43 @@ void usb_storage_init_connection(void)
     static unsigned char _transfer_buffer[ALLOCATE_BUFFER_SIZE]
         USB_DEVBSS_ATTR __attribute__((aligned(32)));
     tb.transfer_buffer = (void *)_transfer_buffer;
+    read_buffer_size = READ_BUFFER_SIZE;
+    write_buffer_size = WRITE_BUFFER_SIZE;
 #ifdef USB_USE_RAMDISK
     static unsigned char _ramdisk_buffer[RAMDISK_SIZE*SECTOR_SIZE];
     ramdisk_buffer = _ramdisk_buffer;
 #endif
 #else
     unsigned char * buffer;
+    size_t alloc_size;
+
+    read_buffer_size = READ_BUFFER_SIZE;
+    write_buffer_size = WRITE_BUFFER_SIZE;
+
+    while (1)
+    {
+        alloc_size = 2*MAX(read_buffer_size, write_buffer_size);
+
+        // Add 31 to handle worst-case misalignment
+        usb_handle = core_alloc_ex(alloc_size + MAX_CBW_SIZE + 31,
+                                   &buflib_ops_locked);
+        if (usb_handle >= 0)
+            break;
+
+        if (MAX(read_buffer_size, write_buffer_size) <= MIN_BUFFER_SIZE)
+            panicf("%s(): OOM", __func__);
+
+        /* halve the larger one, keeping the sizes multiples of 4k so any
+           sector size fits and the second buffer stays aligned */
+        if (read_buffer_size >= write_buffer_size)
+            read_buffer_size = MAX(ALIGN_DOWN(read_buffer_size / 2, 4096),
+                                   MIN_BUFFER_SIZE);
+        else
+            write_buffer_size = MAX(ALIGN_DOWN(write_buffer_size / 2, 4096),
+                                    MIN_BUFFER_SIZE);
+    }
 
-    // Add 31 to handle worst-case misalignment
-    usb_handle = core_alloc_ex(ALLOCATE_BUFFER_SIZE + MAX_CBW_SIZE + 31,
-                               &buflib_ops_locked);
-    if (usb_handle < 0)
-        panicf("%s(): OOM", __func__);
+    logf("ums: buffers r:%u w:%u", read_buffer_size, write_buffer_size);
 
     buffer = core_get_data(usb_handle);
 #if defined(UNCACHED_ADDR) && CONFIG_CPU != AS3525
@@ -483,7 +520,7 @@ void usb_storage_init_connection(void)
     tb.transfer_buffer = cbw_buffer + MAX_CBW_SIZE;
     commit_discard_dcache();
 #ifdef USB_USE_RAMDISK
-    ramdisk_buffer = tb.transfer_buffer + ALLOCATE_BUFFER_SIZE;
+    ramdisk_buffer = tb.transfer_buffer + alloc_size;
 #endif
 #endif
     usb_drv_recv_nonblocking(ep_out, cbw_buffer, MAX_CBW_SIZE);
@@ -522,21 +559,20 @@ void usb_storage_transfer_complete(int ep,int dir,int status,int length)
             logf("scsi write %llu %d", cur_cmd.sector, cur_cmd.count);
             if(status==0) {
                 if((unsigned int)length!=(cur_cmd.block_size* cur_cmd.count)
-                  && (unsigned int)length!=WRITE_BUFFER_SIZE) {
+                  && (unsigned int)length!=cur_cmd.block_size*cur_cmd.chunk) {
                     logf("unexpected length :%d",length);
                     break;
                 }
 
-                sector_t next_sector = cur_cmd.sector +
-                             (WRITE_BUFFER_SIZE/cur_cmd.block_size);
+                sector_t next_sector = cur_cmd.sector + cur_cmd.chunk;
                 unsigned int next_count = cur_cmd.count -
-                             MIN(cur_cmd.count,WRITE_BUFFER_SIZE/cur_cmd.block_size);
+                             MIN(cur_cmd.count,cur_cmd.chunk);
                 int next_select = !cur_cmd.data_select;
 
                 if(next_count!=0) {
                     /* Ask the host to send more, to the other buffer */
                     receive_block_data(cur_cmd.data[next_select],
-                                       MIN(WRITE_BUFFER_SIZE,next_count*cur_cmd.block_size));
+                                       MIN(cur_cmd.chunk,next_count)*cur_cmd.block_size);
                 }
 
                 /* Now write the data that just came in, while the host is
@@ -544,14 +580,14 @@ void usb_storage_transfer_complete(int ep,int dir,int status,int length)
 #ifdef USB_USE_RAMDISK
                 memcpy(ramdisk_buffer + cur_cmd.sector*cur_cmd.block_size,
                         cur_cmd.data[cur_cmd.data_select],
-                        MIN(WRITE_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count)*cur_cmd.block_size);
+                        MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
 #else
                 int result = USBSTOR_WRITE_SECTORS_FILTER();
 
                 if (result == 0) {
                     result = storage_write_sectors(IF_MD(cur_cmd.lun,)
                         cur_cmd.sector,
-                        MIN(WRITE_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count),
+                        MIN(cur_cmd.chunk, cur_cmd.count),
                         cur_cmd.data[cur_cmd.data_select]);
                 }
 
@@ -742,6 +778,24 @@ bool usb_storage_control_request(struct usb_ctrlrequest* req, void* reqdata, uns
     return handled;
 }
 
+/* point the two buffers at the transfer buffer and choose how many sectors
+   go in each transfer; call once sector, count and block_size are set */
+static void setup_block_buffers(unsigned int buffer_size, bool split)
+{
+    unsigned int chunk = buffer_size / cur_cmd.block_size;
+
+    if(split) {
+        unsigned int half = MAX((cur_cmd.count + 1) / 2,
+                                READ_SPLIT_SIZE / cur_cmd.block_size);
+        chunk = MIN(chunk, half);
+    }
+
+    cur_cmd.chunk = chunk;
+    cur_cmd.data[0] = tb.transfer_buffer;
+    cur_cmd.data[1] = &tb.transfer_buffer[buffer_size];
+    cur_cmd.data_select=0;
+}
+
 static void send_and_read_next(void)
 {
     int result = USBSTOR_READ_SECTORS_FILTER();
@@ -750,13 +804,13 @@ static void send_and_read_next(void)
         cur_cmd.last_result = result;
 
     send_block_data(cur_cmd.data[cur_cmd.data_select],
-                    MIN(READ_BUFFER_SIZE,cur_cmd.count*cur_cmd.block_size));
+                    MIN(cur_cmd.chunk,cur_cmd.count)*cur_cmd.block_size);
 
     /* Switch buffers for the next one */
     cur_cmd.data_select=!cur_cmd.data_select;
 
-    cur_cmd.sector+=(READ_BUFFER_SIZE/cur_cmd.block_size);
-    cur_cmd.count-=MIN(cur_cmd.count,READ_BUFFER_SIZE/cur_cmd.block_size);
+    cur_cmd.sector+=cur_cmd.chunk;
+    cur_cmd.count-=MIN(cur_cmd.count,cur_cmd.chunk);
 
     if(cur_cmd.count!=0) {
         /* already read the next bit, so we can send it out immediately when the
@@ -764,11 +818,11 @@ static void send_and_read_next(void)
 #ifdef USB_USE_RAMDISK
         memcpy(cur_cmd.data[cur_cmd.data_select],
                 ramdisk_buffer + cur_cmd.sector*cur_cmd.block_size,
-                MIN(READ_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count)*cur_cmd.block_size);
+                MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
 #else
         result = storage_read_sectors(IF_MD(cur_cmd.lun,)
                 cur_cmd.sector,
-                MIN(READ_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count),
+                MIN(cur_cmd.chunk, cur_cmd.count),
                 cur_cmd.data[cur_cmd.data_select]);
         if(cur_cmd.last_result == 0)
             cur_cmd.last_result = result;
@@ -1169,9 +1223,6 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 cur_sense_data.ascq=0;
                 break;
             }
-            cur_cmd.data[0] = tb.transfer_buffer;
-            cur_cmd.data[1] = &tb.transfer_buffer[READ_BUFFER_SIZE];
-            cur_cmd.data_select=0;
             cur_cmd.sector = block_size_mult *
                 (cbw->command_block[2] << 24 |
                  cbw->command_block[3] << 16 |
@@ -1181,6 +1232,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 (cbw->command_block[7] << 8 |
                  cbw->command_block[8]);
             cur_cmd.block_size = block_size;
+            setup_block_buffers(read_buffer_size, true);
 
             logf("scsi read %llu %d", cur_cmd.sector, cur_cmd.count);
 
@@ -1194,11 +1246,11 @@ static void handle_scsi(struct command_block_wrapper* cbw)
 #ifdef USB_USE_RAMDISK
                 memcpy(cur_cmd.data[cur_cmd.data_select],
                         ramdisk_buffer + cur_cmd.sector*cur_cmd.block_size,
-                        MIN(READ_BUFFER_SIZE/cur_cmd.block_size,cur_cmd.count)*cur_cmd.block_size);
+                        MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
 #else
                 cur_cmd.last_result = storage_read_sectors(IF_MD(cur_cmd.lun,)
                         cur_cmd.sector,
-                        MIN(READ_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count),
+                        MIN(cur_cmd.chunk, cur_cmd.count),
                         cur_cmd.data[cur_cmd.data_select]);
 #endif
                 send_and_read_next();
@@ -1214,9 +1266,6 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 cur_sense_data.ascq=0;
                 break;
             }
-            cur_cmd.data[0] = tb.transfer_buffer;
-            cur_cmd.data[1] = &tb.transfer_buffer[READ_BUFFER_SIZE];
-            cur_cmd.data_select=0;
             cur_cmd.sector = block_size_mult *
                  ((uint64_t)cbw->command_block[2] << 56 |
                  (uint64_t)cbw->command_block[3] << 48 |
@@ -1232,6 +1281,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                  cbw->command_block[12] << 8 |
                  cbw->command_block[13]);
             cur_cmd.block_size = block_size;
+            setup_block_buffers(read_buffer_size, true);
 
             logf("scsi read %llu %d", cur_cmd.sector, cur_cmd.count);
 
@@ -1245,11 +1295,11 @@ static void handle_scsi(struct command_block_wrapper* cbw)
 #ifdef USB_USE_RAMDISK
                 memcpy(cur_cmd.data[cur_cmd.data_select],
                         ramdisk_buffer + cur_cmd.sector*cur_cmd.block_size,
-                        MIN(READ_BUFFER_SIZE/cur_cmd.block_size,cur_cmd.count)*cur_cmd.block_size);
+                        MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
 #else
                 cur_cmd.last_result = storage_read_sectors(IF_MD(cur_cmd.lun,)
                         cur_cmd.sector,
-                        MIN(READ_BUFFER_SIZE/cur_cmd.block_size, cur_cmd.count),
+                        MIN(cur_cmd.chunk, cur_cmd.count),
                         cur_cmd.data[cur_cmd.data_select]);
 #endif
                 send_and_read_next();
@@ -1265,9 +1315,6 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 cur_sense_data.ascq=0;
                 break;
             }
-            cur_cmd.data[0] = tb.transfer_buffer;
-            cur_cmd.data[1] = &tb.transfer_buffer[WRITE_BUFFER_SIZE];
-            cur_cmd.data_select=0;
             cur_cmd.sector = block_size_mult *
                 (cbw->command_block[2] << 24 |
                  cbw->command_block[3] << 16 |
@@ -1277,6 +1324,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 (cbw->command_block[7] << 8 |
                  cbw->command_block[8]);
             cur_cmd.block_size = block_size;
+            setup_block_buffers(write_buffer_size, false);
 
             /* expect data */
             if((cur_cmd.sector + cur_cmd.count) > block_count) {
@@ -1287,7 +1335,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
             }
             else {
                 receive_block_data(cur_cmd.data[0],
-                        MIN(WRITE_BUFFER_SIZE, cur_cmd.count*cur_cmd.block_size));
+                        MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
             }
             break;
 #ifdef STORAGE_64BIT_SECTOR
@@ -1300,9 +1348,6 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                 cur_sense_data.ascq=0;
                 break;
             }
-            cur_cmd.data[0] = tb.transfer_buffer;
-            cur_cmd.data[1] = &tb.transfer_buffer[WRITE_BUFFER_SIZE];
-            cur_cmd.data_select=0;
             cur_cmd.sector = block_size_mult *
                 ((uint64_t)cbw->command_block[2] << 56 |
                  (uint64_t)cbw->command_block[3] << 48 |
@@ -1318,6 +1363,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
                  cbw->command_block[12] << 8 |
                  cbw->command_block[13]);
             cur_cmd.block_size = block_size;
+            setup_block_buffers(write_buffer_size, false);
 
             /* expect data */
             if((cur_cmd.sector + cur_cmd.count) > block_count) {
@@ -1328,7 +1374,7 @@ static void handle_scsi(struct command_block_wrapper* cbw)
             }
             else {
                 receive_block_data(cur_cmd.data[0],
-                        MIN(WRITE_BUFFER_SIZE, cur_cmd.count*cur_cmd.block_size));
+                        MIN(cur_cmd.chunk, cur_cmd.count)*cur_cmd.block_size);
             }
             break;
 #endif
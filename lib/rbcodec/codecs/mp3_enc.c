@@ -91,6 +91,7 @@ typedef struct
     int      flush_frames;
     int      delay;
     int      padding;
+    bool     fast;
 } config_t;
 
 typedef struct
@@ -1594,6 +1595,57 @@ static int inner_loop(int *xr, int max_bits, side_info_t *si)
     return bits;
 }
 
+/************************************************************************/
+/* Fast mode: keep the quantStep of the last granule if it fits well    */
+/* enough, else jump to an estimate and correct that once. Near the     */
+/* target each step of quantStep costs about 7/16 bit per value that    */
+/* isn't 0. The estimates are kept where quantize_int() can shift by    */
+/* quantStep/4 and global_gain still fits its 8 bits.                   */
+/************************************************************************/
+static int inner_loop_fast(int *xr, int max_bits, side_info_t *si)
+{
+    int target = max_bits - 96;
+    long max_step = MIN(4*32 - 1, 255 - 142 + si->additStep);
+    int bits;
+
+    /* the step of the last granule may not fit a smaller additStep */
+    si->quantStep = MIN(si->quantStep, max_step);
+    bits = quantize_and_count_bits(xr, enc_data, si);
+
+    if (bits < 10000 && (bits > max_bits || bits < max_bits - 192))
+    {
+        int nz = 0;
+
+        for (int i = si->address3 + 4*si->count1; i--; )
+            nz += enc_data[i] != 0;
+
+        long step0 = si->quantStep;
+        int  bits0 = bits;
+
+        long step  = step0 + (bits - target) * 16 / (7 * MAX(nz, 16));
+        si->quantStep = MIN(MAX(step, 0), max_step);
+        bits = quantize_and_count_bits(xr, enc_data, si);
+
+        /* one correction along the line through both counts */
+        if (bits < 10000 && bits != bits0 &&
+            (bits > max_bits || bits < max_bits - 192))
+        {
+            step = si->quantStep + (bits - target) *
+                   (si->quantStep - step0) / (bits0 - bits);
+            si->quantStep = MIN(MAX(step, 0), max_step);
+            bits = quantize_and_count_bits(xr, enc_data, si);
+        }
+    }
+
+    while (bits > max_bits && si->quantStep < max_step)
+    {
+        si->quantStep++;
+        bits = quantize_and_count_bits(xr, enc_data, si);
+    }
+
+    return bits;
+}
+
 static void iteration_loop(int *xr, side_info_t *si, int gr_cnt)
 {
     int max_bits = cfg.mean_bits;
@@ -1604,7 +1656,8 @@ static void iteration_loop(int *xr, side_info_t *si, int gr_cnt)
     if (tar_bits > max_bits + max_bits / 2)
         tar_bits = max_bits + max_bits / 2;
 
-    si->part2_3_length = inner_loop(xr, tar_bits, si);
+    si->part2_3_length = cfg.fast ? inner_loop_fast(xr, tar_bits, si) :
+                                    inner_loop(xr, tar_bits, si);
     si->global_gain    = si->quantStep + 142 - si->additStep;
 
     /* unused bits of the reservoir can be used for remaining granules */
@@ -2431,6 +2484,7 @@ static void ICODE_ATTR compress_frame(void)
             /* Perform imdct of 18 previous + 18 current subband samples */
             /* for integer precision do this loop again (if neccessary)  */
             int shift = 14 - (cfg.cod_info[gr][ch].additStep >> 2);
+            int next_addit = -1;
 
             for (int ii = 0; ii < 3; ii++)
             {
@@ -2508,6 +2562,14 @@ static void ICODE_ATTR compress_frame(void)
                 while ((max >> i) >= 0x10000u) i++, shift++;
                 if (i == 0) break;
                 if (shift < 0) shift = 0;
+
+                /* fast mode only redoes it on overflow, the better shift
+                   is used from the next granule on */
+                if (cfg.fast && max < 0x10000u)
+                {
+                    next_addit = 4 * (14 - shift);
+                    break;
+                }
             }
 
             cfg.cod_info[gr][ch].quantStep +=
@@ -2524,6 +2586,9 @@ static void ICODE_ATTR compress_frame(void)
             cfg.cod_info[gr][ch].quantStep -=
                                 cfg.cod_info[gr][ch].additStep;
 
+            if (next_addit >= 0)
+                cfg.cod_info[gr][ch].additStep = next_addit;
+
             if (cfg.granules == 1)
             {
                 ci->memcpy(sb_data[ch][0], sb_data[ch][1],
@@ -3051,6 +3116,7 @@ int enc_callback(enum enc_callback_reason reason, void *params)
 
         mp3_encoder_init(inputs->sample_rate, inputs->num_channels,
                          inputs->config->mp3_enc.bitrate);
+        cfg.fast = inputs->config->mp3_enc.fast;
 
         /* Return the actual configuration */
         inputs->enc_sample_rate = cfg.samplerate;
@@ -129,6 +129,26 @@ sub create_list {
     return values(%pfds);
 }
 
+# string (filename.callgrind), hash(number:string)
+# prints the call graph with the addresses replaced by symbols
+sub print_callgrind {
+    open(PROFILE_FILE,$_[0]) ||
+        error("Could not open profile file: $_[0]");
+    my $offsets = $_[1];
+    my %names;
+    while (<PROFILE_FILE>) {
+        if (m/^(c?fn)=(0x[[:xdigit:]]+)$/) {
+            if (!exists $names{$2}) {
+                $names{$2} = get_name($2,$offsets);
+            }
+            print("$1=$names{$2}\n");
+        } else {
+            print;
+        }
+    }
+    close(PROFILE_FILE);
+}
+
 # array(array(number,number,string)), number (sort element)
 sub print_sorted {
     my $pfds = $_[0];
@@ -183,8 +203,15 @@ sub usage {
     }
     print STDERR ("USAGE:\n");
     print STDERR ("$0 profile.out objdump_tool map obj[...] [map obj[...]...] sort[...]\n");
+    print STDERR ("$0 profile.callgrind objdump_tool map obj[...] [map obj[...]...]\n");
     print STDERR 
         ("\tprofile.out  output from the profiler, extension is .out\n");
+    print STDERR
+        ("\tprofile.callgrind\n");
+    print STDERR
+        ("\t             call graph from the profiler, printed with symbols\n");
+    print STDERR
+        ("\t             for callgrind_annotate or KCachegrind\n");
     print STDERR
         ("\tobjdump_tool name of objdump executable for this platform\n");
     print STDERR
@@ -210,8 +237,8 @@ if ($ARGV[0] =~ m/-(h|help|-help)/) {
 if (@ARGV < 3) {
     usage("Requires at least 3 arguments");
 }
-if ($ARGV[0] !~ m/\.out$/) {
-    usage("Profile file must end in .out");
+if ($ARGV[0] !~ m/\.(out|callgrind)$/) {
+    usage("Profile file must end in .out or .callgrind");
 }
 my $i = 2;
 my %symbols;
@@ -236,6 +263,10 @@ my %symbols;
 if (!%symbols) {
     warning("No symbols found");
 }
+if ($ARGV[0] =~ m/\.callgrind$/) {
+    print_callgrind($ARGV[0],\%symbols);
+    exit(0);
+}
 if ($i >= @ARGV) {
     error("You forgot to specify any sort ordering on output (e.g. 0, 1_p, 2)");
 }    
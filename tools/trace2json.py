@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+#             __________               __   ___.
+#   Open      \______   \ ____   ____ |  | _\_ |__   _______  ___
+#   Source     |       _//  _ \_/ ___\|  |/ /| __ \ /  _ \  \/  /
+#   Jukebox    |    |   (  <_> )  \___|    < | \_\ (  <_> > <  <
+#   Firmware   |____|_  /\____/ \___  >__|_ \|___  /\____/__/\_ \
+#                     \/            \/     \/    \/            \/
+# $Id$
+#
+#  All files in this archive are subject to the GNU General Public License.
+#  See the file COPYING in the source tree root for full license agreement.
+#
+#  This software is distributed on an "AS IS" basis, WITHOUT WARRANTY OF ANY
+#  KIND, either express or implied.
+#
+# Convert a trace saved with "Dump Trace" from the debug menu (see
+# firmware/trace.c) to the Trace Event format read by chrome://tracing and
+# Perfetto.
+#
+# Usage: trace2json.py trace.rbt [trace.json]
+
+import sys, struct, json
+
+PHASES = { 0: 'i', 1: 'B', 2: 'E' }
+RECORD_SIZE = 12
+
+
+def read_string(data, pos):
+    end = data.index(b'\0', pos)
+    return data[pos:end].decode('utf-8', 'replace'), end + 1
+
+
+def convert(data):
+    if data[0:4] != b'RBTR':
+        raise ValueError('not a trace')
+
+    # the dump is in the byte order of the target, the version tells which
+    endian = '<'
+    if struct.unpack_from('<I', data, 4)[0] > 0xffff:
+        endian = '>'
+    version, nevents, nthreads, nrecords = \
+        struct.unpack_from(endian + '4I', data, 4)
+    if version != 1:
+        raise ValueError('unknown trace version %d' % version)
+
+    pos = 20
+    events = []
+    for i in range(nevents):
+        name, pos = read_string(data, pos)
+        events.append(name)
+    threads = []
+    for i in range(nthreads):
+        name, pos = read_string(data, pos)
+        threads.append(name)
+
+    out = []
+    for slot, name in enumerate(threads):
+        if name:
+            out.append({ 'name': 'thread_name', 'ph': 'M', 'pid': 0,
+                         'tid': slot, 'args': { 'name': name } })
+
+    # timestamps are 32 bit microseconds, unwrap them per core
+    last = {}
+    base = {}
+    for i in range(nrecords):
+        time, arg, ev, phase, thread, core = \
+            struct.unpack_from(endian + 'IIBBBB', data, pos + i * RECORD_SIZE)
+        if core in last and time < last[core]:
+            base[core] = base.get(core, 0) + (1 << 32)
+        last[core] = time
+        ts = time + base.get(core, 0)
+
+        e = { 'name': events[ev] if ev < len(events) else 'event %d' % ev,
+              'ph': PHASES.get(phase, 'i'), 'ts': ts,
+              'pid': 0, 'tid': thread, 'args': { 'arg': arg, 'core': core } }
+        if e['ph'] == 'i':
+            e['s'] = 't'
+        out.append(e)
+
+    # the cores were saved one after the other
+    out.sort(key=lambda e: e.get('ts', -1))
+    return { 'traceEvents': out, 'displayTimeUnit': 'ms' }
+
+
+def main():
+    if len(sys.argv) < 2:
+        print('Usage: %s trace.rbt [trace.json]' % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+    result = convert(data)
+
+    if len(sys.argv) > 2:
+        with open(sys.argv[2], 'w') as f:
+            json.dump(result, f)
+    else:
+        json.dump(result, sys.stdout)
+
+
+if __name__ == '__main__':
+    main()
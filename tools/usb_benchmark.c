@@ -23,11 +23,22 @@
 	It talks with the 'custom' device application on the LPC214x through
 	libusb.
 
+	With -m it instead times READ(10)/WRITE(10) commands of different
+	sizes against a mass storage device, talking bulk-only transport
+	directly so the host's file system and cache aren't measured:
+
+	    usb_benchmark -m vid:pid [-l lun] [-s start] [-w]
+
+	-w also writes, putting back the data it read just before, so the
+	contents of the disk don't change. Don't use it on a mounted disk.
+
         2007-11-01: Some minor modifications by <bjorn@haxx.se>
 
 */
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/timeb.h>
 
@@ -92,7 +103,180 @@ static int stoptimer(void)
 }
 
 
-int main(void)
+// bulk-only mass storage
+#define MS_TIMEOUT	5000
+#define MS_MAX_XFER	(256 * 1024)
+#define MS_TOTAL	(32 * 1024 * 1024)
+
+static int ep_in, ep_out;
+static unsigned int ms_tag;
+static unsigned char msData[MS_MAX_XFER];
+
+static void put_be32(unsigned char *p, U32 v)
+{
+	p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+static U32 get_be32(const unsigned char *p)
+{
+	return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+// find the bulk endpoints of the mass storage interface
+static int find_ms_interface(struct usb_device *dev)
+{
+	struct usb_interface_descriptor *intf;
+	int i, j;
+
+	if (!dev->config)
+		return -1;
+	for (i = 0; i < dev->config[0].bNumInterfaces; i++) {
+		intf = &dev->config[0].interface[i].altsetting[0];
+		if (intf->bInterfaceClass != 8 || intf->bInterfaceProtocol != 0x50)
+			continue;
+		ep_in = ep_out = 0;
+		for (j = 0; j < intf->bNumEndpoints; j++) {
+			int ep = intf->endpoint[j].bEndpointAddress;
+			if ((intf->endpoint[j].bmAttributes & 3) != 2)
+				continue;
+			if (ep & 0x80)
+				ep_in = ep;
+			else
+				ep_out = ep;
+		}
+		if (ep_in && ep_out)
+			return intf->bInterfaceNumber;
+	}
+	return -1;
+}
+
+// one command: CBW, optional data stage, CSW. returns the CSW status
+static int ms_command(struct usb_dev_handle *hdl, int lun,
+                      const unsigned char *cb, int cblen,
+                      unsigned char *data, int len, int in)
+{
+	unsigned char cbw[31], csw[13];
+	int i, done;
+
+	memset(cbw, 0, sizeof cbw);
+	cbw[0] = 'U'; cbw[1] = 'S'; cbw[2] = 'B'; cbw[3] = 'C';
+	ms_tag++;
+	cbw[4] = ms_tag; cbw[5] = ms_tag >> 8; cbw[6] = ms_tag >> 16; cbw[7] = ms_tag >> 24;
+	cbw[8] = len; cbw[9] = len >> 8; cbw[10] = len >> 16; cbw[11] = len >> 24;
+	cbw[12] = in ? 0x80 : 0;
+	cbw[13] = lun;
+	cbw[14] = cblen;
+	memcpy(&cbw[15], cb, cblen);
+
+	if (usb_bulk_write(hdl, ep_out, (char *)cbw, sizeof cbw, MS_TIMEOUT)
+	        != sizeof cbw)
+		return -1;
+
+	for (done = 0; done < len; done += i) {
+		if (in)
+			i = usb_bulk_read(hdl, ep_in, (char *)data + done,
+			                  len - done, MS_TIMEOUT);
+		else
+			i = usb_bulk_write(hdl, ep_out, (char *)data + done,
+			                   len - done, MS_TIMEOUT);
+		if (i <= 0)
+			return -1;
+	}
+
+	if (usb_bulk_read(hdl, ep_in, (char *)csw, sizeof csw, MS_TIMEOUT)
+	        != sizeof csw || memcmp(csw, "USBS", 4))
+		return -1;
+	return csw[12];
+}
+
+static int ms_rw(struct usb_dev_handle *hdl, int lun, int write,
+                 U32 lba, int count, int blocksize)
+{
+	unsigned char cb[10];
+
+	memset(cb, 0, sizeof cb);
+	cb[0] = write ? 0x2a : 0x28;
+	put_be32(&cb[2], lba);
+	cb[7] = count >> 8;
+	cb[8] = count;
+	return ms_command(hdl, lun, cb, sizeof cb, msData, count * blocksize,
+	                  !write);
+}
+
+static int ms_benchmark(struct usb_device *dev, int lun, U32 start, int write)
+{
+	const int xfersize[] = { 4096, 16384, 32768, 65536, 131072, 262144 };
+	struct usb_dev_handle *hdl;
+	unsigned char cb[10];
+	U32 blocks, lba;
+	int blocksize, intf, i, count, iTimer;
+	long long bytes;
+
+	intf = find_ms_interface(dev);
+	if (intf < 0) {
+		fprintf(stderr, "no mass storage interface\n");
+		return -1;
+	}
+
+	hdl = usb_open(dev);
+#ifdef LIBUSB_HAS_DETACH_KERNEL_DRIVER_NP
+	usb_detach_kernel_driver_np(hdl, intf);
+#endif
+	if (usb_claim_interface(hdl, intf) < 0) {
+		fprintf(stderr, "usb_claim_interface failed\n");
+		usb_close(hdl);
+		return -1;
+	}
+
+	// READ CAPACITY(10)
+	memset(cb, 0, sizeof cb);
+	cb[0] = 0x25;
+	if (ms_command(hdl, lun, cb, sizeof cb, msData, 8, 1) != 0) {
+		fprintf(stderr, "read capacity failed\n");
+		goto out;
+	}
+	blocks = get_be32(msData) + 1;
+	blocksize = get_be32(&msData[4]);
+	fprintf(stderr, "%u blocks of %d bytes\n", blocks, blocksize);
+	if (blocksize <= 0 || blocksize > 4096) {
+		fprintf(stderr, "unsupported block size\n");
+		goto out;
+	}
+
+	for (i = 0; i < (int)(sizeof xfersize / sizeof xfersize[0]); i++) {
+		count = xfersize[i] / blocksize;
+		if (!count)
+			continue;
+
+		fprintf(stderr, "* %6d %s:", xfersize[i], write ? "write" : "read ");
+		bytes = 0;
+		lba = start;
+		starttimer();
+		while (bytes < MS_TOTAL && stoptimer() < MAX_TIME &&
+		       lba + count <= blocks) {
+			if (ms_rw(hdl, lun, 0, lba, count, blocksize) != 0 ||
+			    (write && ms_rw(hdl, lun, 1, lba, count, blocksize) != 0)) {
+				fprintf(stderr, " command failed at %u\n", lba);
+				goto out;
+			}
+			lba += count;
+			bytes += xfersize[i];
+		}
+		iTimer = stoptimer();
+		if (iTimer)
+			fprintf(stderr, " %9lld bytes in %d ms = %lld kB/s\n",
+			        bytes, iTimer, bytes / iTimer);
+		// stdout
+		printf("%d,%lld,%d\n", xfersize[i], bytes, iTimer);
+	}
+
+out:
+	usb_release_interface(hdl, intf);
+	usb_close(hdl);
+	return 0;
+}
+
+int main(int argc, char *argv[])
 {
     const int blocksize[] = { 128, 512 };
 	struct usb_device *dev;	
@@ -105,6 +289,33 @@ int main(void)
 	usb_init();
 	usb_find_busses();
 	usb_find_devices();
+
+	if (argc > 2 && !strcmp(argv[1], "-m")) {
+		unsigned int vid, pid;
+		int lun = 0, write = 0;
+		U32 start = 0;
+
+		if (sscanf(argv[2], "%x:%x", &vid, &pid) != 2) {
+			fprintf(stderr, "usage: %s -m vid:pid [-l lun] [-s start] [-w]\n",
+			        argv[0]);
+			return -1;
+		}
+		for (i = 3; i < argc; i++) {
+			if (!strcmp(argv[i], "-w"))
+				write = 1;
+			else if (!strcmp(argv[i], "-l") && i + 1 < argc)
+				lun = atoi(argv[++i]);
+			else if (!strcmp(argv[i], "-s") && i + 1 < argc)
+				start = strtoul(argv[++i], NULL, 0);
+		}
+
+		dev = find_device(vid, pid);
+		if (dev == NULL) {
+			fprintf(stderr, "device not found\n");
+			return -1;
+		}
+		return ms_benchmark(dev, lun, start, write);
+	}
 	
         for (i=0; i<sizeof abData/4; i++)
             ((unsigned int*)abData)[i] = i;